@@ -0,0 +1,22 @@
+#ifndef ALLOC_COUNTER_H_
+#define ALLOC_COUNTER_H_
+
+#include <cstdint>
+
+// ---------------------------------------------------------------------------
+// AllocCounter — heap allocation count for the benchmarks.
+//
+// Linking alloc_counter.cpp into a benchmark replaces the global operator
+// new with one that counts every heap allocation on every thread, so a
+// benchmark can check that its steady state allocates nothing (or no more
+// than a given number per sample) and fail loudly when that regresses.
+// ---------------------------------------------------------------------------
+
+namespace AllocCounter {
+
+// Heap allocations since the program started.
+std::uint64_t count() noexcept;
+
+} // namespace AllocCounter
+
+#endif /* ALLOC_COUNTER_H_ */
@@ -0,0 +1,140 @@
+// ---------------------------------------------------------------------------
+// dispatch_bench — steady-state allocation check of the sample hand-off.
+//
+// Replays what a poll does once the registers are read: the master
+// serialises its values into its payload buffer and fires the value
+// callback, which the Dispatcher copies into a pooled Sample for every sink.
+// The sinks here only touch the sample, like a consumer that copies it into
+// a queue of its own (the MQTT, PostgreSQL and slave queues are pooled or
+// fixed-size too, but need a broker, a database and a port).
+//
+// Allocations are counted by AllocCounter, which replaces the global
+// operator new and counts every heap allocation on every thread. After a
+// warm-up long enough for each pooled sample to have held a payload, the
+// timed run must allocate nothing; the benchmark fails if it does, so a
+// regression of the hand-off fails loudly rather than looking merely slower.
+// With `aggregate` the closed buckets are dispatched too.
+//
+// Build with -DBUILD_BENCHMARKS=ON and run
+// `dispatch_bench [iterations [devices [aggregate]]]`.
+// ---------------------------------------------------------------------------
+
+#include "alloc_counter.h"
+#include "config_yaml.h"
+#include "dispatcher.h"
+#include "meter_types.h"
+#include "payloads.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace {
+
+// Reads what a consumer would copy out, so the sample is not optimised away.
+class TouchSink : public Sink {
+public:
+  void consume(const Sample &sample) override {
+    bytes_.fetch_add(sample.payload.size(), std::memory_order_relaxed);
+    if (const auto *v = std::get_if<MeterTypes::Values>(&sample.data))
+      last_.store(v->time, std::memory_order_relaxed);
+    consumed_.fetch_add(1, std::memory_order_relaxed);
+  }
+  std::uint64_t consumed() const { return consumed_.load(); }
+
+private:
+  std::atomic<std::uint64_t> bytes_{0};
+  std::atomic<std::uint64_t> last_{0};
+  std::atomic<std::uint64_t> consumed_{0};
+};
+
+MeterTypes::Values makeValues(std::uint64_t time) {
+  MeterTypes::Values v;
+  v.time = time;
+  v.activeEnergyImport = 12345678.0 + static_cast<double>(time % 1000);
+  v.activeEnergyExport = 2345678.0;
+  v.activePower = static_cast<double>(time % 4000) - 2000.0;
+  v.phVoltage = 230.1;
+  v.ppVoltage = 398.5;
+  v.frequency = 50.01;
+  for (auto *p : {&v.phase1, &v.phase2, &v.phase3}) {
+    p->activePower = v.activePower / 3.0;
+    p->phVoltage = 230.1;
+    p->current = p->activePower / 230.0;
+  }
+  v.round();
+  return v;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const long iterations = argc > 1 ? std::atol(argv[1]) : 200000;
+  const long devices = argc > 2 ? std::atol(argv[2]) : 4;
+  const bool aggregate = argc > 3 && std::atol(argv[3]) != 0;
+  if (iterations <= 0 || devices <= 0 || devices > 64) {
+    std::cerr << "usage: dispatch_bench [iterations [devices [aggregate]]]\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<DeviceRegistryEntry> registry;
+  for (long i = 0; i < devices; ++i)
+    registry.push_back({std::format("meter{}", i), "meter", {}, false});
+  std::optional<AggregateConfig> aggregateCfg;
+  if (aggregate)
+    aggregateCfg = AggregateConfig{};
+
+  constexpr std::size_t queueSize = 256;
+  TouchSink mqtt, postgres, slave;
+  std::vector<std::string> payloads(static_cast<std::size_t>(devices));
+  std::uint64_t time = 1760000000000;
+  std::uint64_t allocated = 0;
+  double nsPerSample = 0.0;
+  {
+    Dispatcher dispatcher(registry, aggregateCfg, queueSize);
+    dispatcher.subscribe("mqtt", mqtt);
+    dispatcher.subscribe("postgres", postgres);
+    dispatcher.subscribe("slave", slave);
+
+    // One poll of every device, `time` a second later each round.
+    auto poll = [&] {
+      time += 1000;
+      for (long i = 0; i < devices; ++i) {
+        const auto values = makeValues(time);
+        auto &payload = payloads[static_cast<std::size_t>(i)];
+        Payload::froniusMeterValues(payload, values, 3);
+        dispatcher.dispatch(static_cast<DeviceId>(i), payload, values);
+      }
+    };
+
+    // Warm-up: every pooled sample and payload buffer reaches its size.
+    for (std::size_t i = 0; i < 4 * queueSize; ++i)
+      poll();
+
+    const std::uint64_t before = AllocCounter::count();
+    const auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i)
+      poll();
+    const std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    allocated = AllocCounter::count() - before;
+    nsPerSample = elapsed.count() / static_cast<double>(iterations * devices);
+  } // joins the sink threads once they have drained
+
+  std::cout << std::format("{} polls of {} devices{}\n", iterations, devices,
+                           aggregate ? " (aggregated)" : "")
+            << std::format("  dispatch {:10.1f} ns/sample\n", nsPerSample)
+            << std::format("  consumed {} / {} / {} samples\n",
+                           mqtt.consumed(), postgres.consumed(),
+                           slave.consumed())
+            << std::format("  heap allocations in steady state: {}\n",
+                           allocated);
+  return allocated == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
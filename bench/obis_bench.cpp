@@ -0,0 +1,212 @@
+// ---------------------------------------------------------------------------
+// obis_bench — EBZ telegram parser micro-benchmark.
+//
+// Compares the Obis::scan path EasyMeter uses against the std::regex path it
+// replaced, on telegrams recorded from a DD3-BZ06-ETA-ODZ1. The regex path is
+// reproduced here exactly as it ran in updateValuesAndJson(): copy into an
+// istringstream, build the regex, getline, strip '\r', regex_search, stod.
+// Both paths extract the same eight fields. The benchmark checks that they
+// agree before timing them, so a parser regression fails loudly rather than
+// looking fast.
+//
+// Build with -DBUILD_BENCHMARKS=ON and run `obis_bench [iterations]`.
+// ---------------------------------------------------------------------------
+
+#include "obis_parser.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// Recorded telegrams, CR LF line endings as they arrive on the wire.
+constexpr std::array<std::string_view, 3> telegrams = {
+    "/EBZ5DD3BZ06ETA_107\r\n"
+    "\r\n"
+    "1-0:0.0.0*255(1EBZ0100507409)\r\n"
+    "1-0:96.1.0*255(1EBZ0100507409)\r\n"
+    "1-0:1.8.0*255(000125.25688570*kWh)\r\n"
+    "1-0:16.7.0*255(000259.20*W)\r\n"
+    "1-0:36.7.0*255(000075.18*W)\r\n"
+    "1-0:56.7.0*255(000092.34*W)\r\n"
+    "1-0:76.7.0*255(000091.68*W)\r\n"
+    "1-0:32.7.0*255(232.4*V)\r\n"
+    "1-0:52.7.0*255(231.7*V)\r\n"
+    "1-0:72.7.0*255(233.1*V)\r\n"
+    "1-0:96.5.0*255(001C0104)\r\n"
+    "0-0:96.8.0*255(00AF7D44)\r\n"
+    "!\r\n",
+
+    "/EBZ5DD3BZ06ETA_107\r\n"
+    "\r\n"
+    "1-0:0.0.0*255(1EBZ0100507409)\r\n"
+    "1-0:96.1.0*255(1EBZ0100507409)\r\n"
+    "1-0:1.8.0*255(000125.25711022*kWh)\r\n"
+    "1-0:16.7.0*255(000812.47*W)\r\n"
+    "1-0:36.7.0*255(000402.11*W)\r\n"
+    "1-0:56.7.0*255(000318.90*W)\r\n"
+    "1-0:76.7.0*255(000091.46*W)\r\n"
+    "1-0:32.7.0*255(231.9*V)\r\n"
+    "1-0:52.7.0*255(231.2*V)\r\n"
+    "1-0:72.7.0*255(232.8*V)\r\n"
+    "1-0:96.5.0*255(001C0104)\r\n"
+    "0-0:96.8.0*255(00AF7D46)\r\n"
+    "!\r\n",
+
+    "/EBZ5DD3BZ06ETA_107\r\n"
+    "\r\n"
+    "1-0:0.0.0*255(1EBZ0100507409)\r\n"
+    "1-0:96.1.0*255(1EBZ0100507409)\r\n"
+    "1-0:1.8.0*255(000125.25719877*kWh)\r\n"
+    "1-0:16.7.0*255(-000143.05*W)\r\n"
+    "1-0:36.7.0*255(-000060.72*W)\r\n"
+    "1-0:56.7.0*255(-000041.19*W)\r\n"
+    "1-0:76.7.0*255(-000041.14*W)\r\n"
+    "1-0:32.7.0*255(233.6*V)\r\n"
+    "1-0:52.7.0*255(232.9*V)\r\n"
+    "1-0:72.7.0*255(234.0*V)\r\n"
+    "1-0:96.5.0*255(001C0104)\r\n"
+    "0-0:96.8.0*255(00AF7D48)\r\n"
+    "!\r\n",
+};
+
+struct Fields {
+  double energy{0.0};
+  double power{0.0};
+  std::array<double, 3> phasePower{};
+  std::array<double, 3> phaseVoltage{};
+
+  bool operator==(const Fields &) const = default;
+};
+
+// The pre-scanner parse, kept verbatim apart from the target struct.
+bool parseRegex(std::string_view telegram, Fields &out) {
+  std::istringstream iss;
+  iss.str(std::string(telegram));
+
+  std::regex obexRegex(R"(^([0-9]-0:[0-9]+.[0-9]+.[0-9]+\*255)\(([^)]+)\))");
+  std::string line;
+
+  while (std::getline(iss, line)) {
+    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+
+    if (line.empty() || (line.size() && (line[0] == '/' || line[0] == '!')))
+      continue;
+
+    try {
+      std::smatch match;
+      if (!std::regex_search(line, match, obexRegex))
+        return false;
+
+      std::string obis = match[1];
+      std::string value_unit = match[2];
+      const auto value = [&value_unit] {
+        return std::stod(value_unit.substr(0, value_unit.find("*")));
+      };
+
+      if (obis == "1-0:1.8.0*255")
+        out.energy = value();
+      else if (obis == "1-0:16.7.0*255")
+        out.power = value();
+      else if (obis == "1-0:36.7.0*255")
+        out.phasePower[0] = value();
+      else if (obis == "1-0:56.7.0*255")
+        out.phasePower[1] = value();
+      else if (obis == "1-0:76.7.0*255")
+        out.phasePower[2] = value();
+      else if (obis == "1-0:32.7.0*255")
+        out.phaseVoltage[0] = value();
+      else if (obis == "1-0:52.7.0*255")
+        out.phaseVoltage[1] = value();
+      else if (obis == "1-0:72.7.0*255")
+        out.phaseVoltage[2] = value();
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The EasyMeter::updateValuesAndJson() parse.
+bool parseScanner(std::string_view telegram, Fields &out) {
+  struct Field {
+    std::string_view code;
+    double *target;
+  };
+  const Field fields[] = {
+      {"1-0:1.8.0*255", &out.energy},
+      {"1-0:16.7.0*255", &out.power},
+      {"1-0:36.7.0*255", &out.phasePower[0]},
+      {"1-0:56.7.0*255", &out.phasePower[1]},
+      {"1-0:76.7.0*255", &out.phasePower[2]},
+      {"1-0:32.7.0*255", &out.phaseVoltage[0]},
+      {"1-0:52.7.0*255", &out.phaseVoltage[1]},
+      {"1-0:72.7.0*255", &out.phaseVoltage[2]},
+  };
+
+  auto scanned = Obis::scan(
+      telegram, [](std::string_view) -> const char * { return nullptr; },
+      [&fields](const Obis::DataSet &ds) -> const char * {
+        for (const Field &f : fields) {
+          if (ds.code != f.code)
+            continue;
+          auto number = Obis::parseNumber(ds.value);
+          if (!number)
+            return "Malformed OBIS value";
+          *f.target = *number;
+          break;
+        }
+        return nullptr;
+      });
+  return scanned.has_value();
+}
+
+// Written by the timing loops so the parses are not optimised away.
+volatile double sink = 0.0;
+
+template <typename Parse> double nsPerTelegram(Parse parse, long iterations) {
+  const auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    Fields f;
+    parse(telegrams[static_cast<std::size_t>(i) % telegrams.size()], f);
+    sink = f.power;
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const long iterations = argc > 1 ? std::atol(argv[1]) : 200000;
+  if (iterations <= 0) {
+    std::cerr << "usage: obis_bench [iterations]\n";
+    return EXIT_FAILURE;
+  }
+
+  for (std::string_view t : telegrams) {
+    Fields viaRegex, viaScanner;
+    if (!parseRegex(t, viaRegex) || !parseScanner(t, viaScanner) ||
+        viaRegex != viaScanner) {
+      std::cerr << "parsers disagree on telegram:\n" << t;
+      return EXIT_FAILURE;
+    }
+  }
+
+  const double regexNs = nsPerTelegram(parseRegex, iterations);
+  const double scannerNs = nsPerTelegram(parseScanner, iterations);
+
+  std::cout << std::format("{} telegrams per parser\n", iterations)
+            << std::format("  regex   {:10.1f} ns/telegram\n", regexNs)
+            << std::format("  scanner {:10.1f} ns/telegram\n", scannerNs)
+            << std::format("  speedup {:10.1f}x\n", regexNs / scannerNs);
+  return EXIT_SUCCESS;
+}
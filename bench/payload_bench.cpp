@@ -0,0 +1,190 @@
+// ---------------------------------------------------------------------------
+// payload_bench — MQTT payload serialiser micro-benchmark.
+//
+// Compares Payload::froniusMeterValues against the nlohmann::ordered_json
+// build it replaced, reproduced here as it ran in
+// FroniusMeter::updateValuesAndJson(): one tree per poll, then dump(). The
+// meter values are generated from a fixed seed and rounded as the master
+// rounds them. The benchmark checks that both paths produce the same bytes
+// before timing them, so a serialiser regression fails loudly rather than
+// looking fast. The CBOR and MessagePack encodings of the same descriptors
+// are timed alongside for comparison.
+//
+// Build with -DBUILD_BENCHMARKS=ON and run `payload_bench [iterations]`.
+// ---------------------------------------------------------------------------
+
+#include "meter_types.h"
+#include "payloads.h"
+#include "utils.h"
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using json = nlohmann::ordered_json;
+
+constexpr int phases = 3;
+
+std::vector<MeterTypes::Values> makeSamples(std::size_t count) {
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> power(-4000.0, 4000.0);
+  std::uniform_real_distribution<double> voltage(220.0, 245.0);
+  std::uniform_real_distribution<double> factor(-1.0, 1.0);
+  std::uniform_real_distribution<double> energy(0.0, 5e7);
+
+  std::vector<MeterTypes::Values> samples(count);
+  std::uint64_t time = 1760000000000;
+  for (auto &v : samples) {
+    v.time = time += 1000;
+    v.activeEnergyImport = energy(rng);
+    v.activeEnergyExport = energy(rng);
+    v.apparentEnergyImport = energy(rng);
+    v.apparentEnergyExport = energy(rng);
+    v.reactiveEnergyImport = energy(rng);
+    v.reactiveEnergyExport = energy(rng);
+    v.activePower = power(rng);
+    v.apparentPower = power(rng);
+    v.reactivePower = power(rng);
+    v.powerFactor = factor(rng);
+    v.frequency = 49.9 + factor(rng) / 10.0;
+    v.phVoltage = voltage(rng);
+    v.ppVoltage = voltage(rng) * 1.732;
+    v.current = power(rng) / 230.0;
+    for (auto *p : {&v.phase1, &v.phase2, &v.phase3}) {
+      p->activePower = power(rng);
+      p->apparentPower = power(rng);
+      p->reactivePower = power(rng);
+      p->powerFactor = factor(rng);
+      p->phVoltage = voltage(rng);
+      p->ppVoltage = voltage(rng) * 1.732;
+      p->current = power(rng) / 230.0;
+    }
+    v.round();
+  }
+  return samples;
+}
+
+json phaseJson(int id, const MeterTypes::Phase &p) {
+  return {
+      {"id", id},
+      {"power_active", p.activePower},
+      {"power_apparent", p.apparentPower},
+      {"power_reactive", p.reactivePower},
+      {"power_factor", p.powerFactor},
+      {"voltage_ph", p.phVoltage},
+      {"voltage_pp", p.ppVoltage},
+      {"current", p.current},
+  };
+}
+
+// The pre-writer build, kept verbatim apart from the phase helper.
+void serialiseNlohmann(const MeterTypes::Values &values, std::string &out) {
+  json newJson;
+  json phasesJson = json::array();
+
+  phasesJson.push_back(phaseJson(1, values.phase1));
+  if (phases > 1)
+    phasesJson.push_back(phaseJson(2, values.phase2));
+  if (phases > 2)
+    phasesJson.push_back(phaseJson(3, values.phase3));
+
+  newJson["time"] = values.time;
+  newJson["energy_active_import"] =
+      Utils::scaleToKilo(values.activeEnergyImport);
+  newJson["energy_active_export"] =
+      Utils::scaleToKilo(values.activeEnergyExport);
+  newJson["energy_apparent_import"] =
+      Utils::scaleToKilo(values.apparentEnergyImport);
+  newJson["energy_apparent_export"] =
+      Utils::scaleToKilo(values.apparentEnergyExport);
+  newJson["energy_reactive_import"] =
+      Utils::scaleToKilo(values.reactiveEnergyImport);
+  newJson["energy_reactive_export"] =
+      Utils::scaleToKilo(values.reactiveEnergyExport);
+  newJson["power_active"] = values.activePower;
+  newJson["power_apparent"] = values.apparentPower;
+  newJson["power_reactive"] = values.reactivePower;
+  newJson["power_factor"] = values.powerFactor;
+  newJson["frequency"] = values.frequency;
+  newJson["voltage_ph"] = values.phVoltage;
+  newJson["voltage_pp"] = values.ppVoltage;
+  newJson["current"] = values.current;
+  newJson["phases"] = phasesJson;
+
+  out = newJson.dump();
+}
+
+// The FroniusMeter::updateValuesAndJson() path.
+void serialiseWriter(const MeterTypes::Values &values, std::string &out) {
+  Payload::froniusMeterValues(out, values, phases);
+}
+
+void serialiseCbor(const MeterTypes::Values &values, std::string &out) {
+  Payload::froniusMeterValues(out, values, phases, MqttEncoding::Cbor);
+}
+
+void serialiseMsgPack(const MeterTypes::Values &values, std::string &out) {
+  Payload::froniusMeterValues(out, values, phases, MqttEncoding::MsgPack);
+}
+
+// Written by the timing loops so the serialisers are not optimised away.
+volatile std::size_t sink = 0;
+
+template <typename Serialise>
+double nsPerPayload(Serialise serialise,
+                    const std::vector<MeterTypes::Values> &samples,
+                    long iterations) {
+  std::string out;
+  const auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i) {
+    serialise(samples[static_cast<std::size_t>(i) % samples.size()], out);
+    sink = out.size();
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const long iterations = argc > 1 ? std::atol(argv[1]) : 200000;
+  if (iterations <= 0) {
+    std::cerr << "usage: payload_bench [iterations]\n";
+    return EXIT_FAILURE;
+  }
+
+  const auto samples = makeSamples(1024);
+  for (const auto &v : samples) {
+    std::string viaNlohmann, viaWriter;
+    serialiseNlohmann(v, viaNlohmann);
+    serialiseWriter(v, viaWriter);
+    if (viaNlohmann != viaWriter) {
+      std::cerr << "serialisers disagree:\n"
+                << "  nlohmann " << viaNlohmann << "\n"
+                << "  writer   " << viaWriter << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  const double nlohmannNs =
+      nsPerPayload(serialiseNlohmann, samples, iterations);
+  const double writerNs = nsPerPayload(serialiseWriter, samples, iterations);
+  const double cborNs = nsPerPayload(serialiseCbor, samples, iterations);
+  const double msgPackNs = nsPerPayload(serialiseMsgPack, samples, iterations);
+
+  std::cout << std::format("{} payloads per serialiser\n", iterations)
+            << std::format("  nlohmann {:10.1f} ns/payload\n", nlohmannNs)
+            << std::format("  writer   {:10.1f} ns/payload\n", writerNs)
+            << std::format("  speedup  {:10.1f}x\n", nlohmannNs / writerNs)
+            << std::format("  cbor     {:10.1f} ns/payload\n", cborNs)
+            << std::format("  msgpack  {:10.1f} ns/payload\n", msgPackNs);
+  return EXIT_SUCCESS;
+}
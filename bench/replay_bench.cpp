@@ -0,0 +1,524 @@
+// ---------------------------------------------------------------------------
+// fronius-bridge-bench — end-to-end replay of a capture.
+//
+// Replays a file recorded with `fronius-bridge --capture <file>` (see
+// capture.h) through the pipeline the masters feed, without the hardware:
+//
+//   decode    an EBZ telegram through EasyMeter::decodeTelegram(), or a
+//             Modbus device's captured values; then round() and serialise
+//             into the device's payload buffer, as the master does;
+//   dispatch  Dispatcher::dispatch(), which copies the sample into the pool
+//             and queues it for every sink (and aggregates, with
+//             --aggregate);
+//   queue     from dispatch until the sink's thread picks the sample up,
+//             per sink;
+//   consume   the sink's work on it, per sink.
+//
+// The sinks are the nearest this can get to the real ones without a broker
+// or a database: the MQTT stand-in copies each payload into a pooled buffer
+// and queues it, as MqttClient::publish() does, for a network loop that
+// takes it straight off; the PostgreSQL stand-in queues the values, as the
+// consumer's worker queue does; the slave is a real MeterSlave per meter,
+// listening on an ephemeral loopback port, whose register store each sample
+// updates.
+//
+// Each replayed sample is stamped one second after the previous one, so
+// the sinks find its dispatch time by its timestamp and a 30 s aggregate
+// bucket closes every 30 samples. With --speed N the records are paced at N
+// times the rate they were captured at; by default they are replayed as
+// fast as the pipeline takes them, and a sink that falls behind drops its
+// oldest samples, as in the bridge (consumed < dispatched in the report).
+//
+// The log sites run at warn by default, so they cost their level check.
+// With --log-level the bridge's loggers log at that level to stderr, where
+// the slave's per-update debug block is the heavy one, written out by the
+// consuming thread or, with --async-log, queued for spdlog's writer thread
+// as with `logger.async`; compare the consume latencies of the two runs with
+// stderr redirected, e.g. to /dev/null or a file.
+//
+// Allocations are counted by AllocCounter after a warm-up. With
+// --max-allocs-per-sample the benchmark fails when the timed run allocates
+// more than that per sample, so a CI job can catch a regression of the hot
+// path rather than just a slower one.
+//
+// Build with -DBUILD_BENCHMARKS=ON and run `fronius-bridge-bench --help`.
+// ---------------------------------------------------------------------------
+
+#include "alloc_counter.h"
+#include "capture.h"
+#include "config_yaml.h"
+#include "dispatcher.h"
+#include "easy_meter.h"
+#include "inverter_types.h"
+#include "logger.h"
+#include "meter_slave.h"
+#include "meter_types.h"
+#include "mpsc_ring.h"
+#include "object_pool.h"
+#include "payloads.h"
+#include "signal_handler.h"
+#include <CLI/CLI.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A capture record, loaded into memory before the replay starts.
+struct Input {
+  CaptureRecord::Type type;
+  DeviceId device;
+  std::chrono::nanoseconds at;
+  std::string data;
+};
+
+// The first sample's timestamp; sample `seq` is stamped a second later per
+// sample.
+constexpr std::uint64_t epoch = 1760000000000;
+
+std::uint64_t stamp(std::uint64_t seq) { return epoch + seq * 1000; }
+
+template <typename Values> std::uint64_t seqOf(const Values &values) {
+  return (values.time - epoch) / 1000;
+}
+
+// One stage's latencies in ns. Sized up front, so recording allocates
+// nothing; a stage records from one thread only.
+class Latencies {
+public:
+  explicit Latencies(std::size_t capacity) { ns_.reserve(capacity); }
+
+  void record(Clock::duration d) {
+    if (ns_.size() < ns_.capacity())
+      ns_.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+  }
+
+  std::size_t count() const { return ns_.size(); }
+
+  // After the run only.
+  double percentileUs(double p) {
+    if (ns_.empty())
+      return 0.0;
+    const auto n = static_cast<std::size_t>(
+        p * static_cast<double>(ns_.size() - 1) + 0.5);
+    std::nth_element(ns_.begin(), ns_.begin() + n, ns_.end());
+    return static_cast<double>(ns_[n]) / 1000.0;
+  }
+
+private:
+  std::vector<std::int64_t> ns_;
+};
+
+// Dispatch time of every sample, indexed by its sequence number. Written by
+// the replay thread before the sample is dispatched, read by the sinks after
+// they popped it off their ring, which orders the two.
+struct Timeline {
+  Clock::time_point start;
+  std::uint64_t firstTimed{0}; // samples before this are the warm-up
+  std::vector<Clock::time_point> dispatchedAt;
+};
+
+// Times a sink's values samples: how long each waited for the sink's thread
+// and how long the sink took with it.
+class TimedSink : public Sink {
+public:
+  TimedSink(std::string name, Sink &inner, const Timeline &timeline,
+            std::size_t samples)
+      : name_(std::move(name)), inner_(inner), timeline_(timeline),
+        queue_(samples), consume_(samples) {}
+
+  void consume(const Sample &sample) override {
+    std::optional<std::uint64_t> seq;
+    if (const auto *v = std::get_if<InverterTypes::Values>(&sample.data))
+      seq = seqOf(*v);
+    else if (const auto *v = std::get_if<MeterTypes::Values>(&sample.data))
+      seq = seqOf(*v);
+    if (!seq || *seq < timeline_.firstTimed) {
+      inner_.consume(sample);
+      return;
+    }
+    const auto start = Clock::now();
+    queue_.record(start - timeline_.dispatchedAt[*seq]);
+    inner_.consume(sample);
+    consume_.record(Clock::now() - start);
+  }
+
+  const std::string &name() const { return name_; }
+  Latencies &queue() { return queue_; }
+  Latencies &consumeLatency() { return consume_; }
+
+private:
+  std::string name_;
+  Sink &inner_;
+  const Timeline &timeline_;
+  Latencies queue_;
+  Latencies consume_;
+};
+
+// MqttSink and MqttClient::publish() without the broker: the payload is
+// copied into a pooled buffer and queued, and the network loop's side of the
+// queue takes it off at once.
+class MqttStandIn : public Sink {
+public:
+  explicit MqttStandIn(std::size_t queueSize)
+      : payloads_(queueSize + 2), queue_(queueSize) {}
+
+  void consume(const Sample &sample) override {
+    if (sample.payload.empty())
+      return;
+    auto payload = payloads_.acquire();
+    if (payload->capacity() < sample.payload.size())
+      payload->reserve(sample.payload.size() + sample.payload.size() / 4);
+    payload->assign(sample.payload);
+    queue_.push(std::move(payload));
+    while (auto sent = queue_.tryPop())
+      bytes_ += (**sent).size();
+  }
+
+  std::uint64_t bytes() const { return bytes_; }
+  std::uint64_t poolMisses() const { return payloads_.misses(); }
+
+private:
+  ObjectPool<std::string> payloads_;
+  MpscRing<ObjectPool<std::string>::Ref> queue_;
+  std::uint64_t bytes_{0};
+};
+
+// PostgresSink without the database: the values are queued for a writer,
+// which takes them off at once.
+class PostgresStandIn : public Sink {
+public:
+  explicit PostgresStandIn(std::size_t queueSize)
+      : inverterRows_(queueSize), meterRows_(queueSize) {}
+
+  void consume(const Sample &sample) override {
+    if (const auto *v = std::get_if<InverterTypes::Values>(&sample.data)) {
+      inverterRows_.push(*v);
+      while (inverterRows_.tryPop())
+        ++rows_;
+    } else if (const auto *v = std::get_if<MeterTypes::Values>(&sample.data)) {
+      meterRows_.push(*v);
+      while (meterRows_.tryPop())
+        ++rows_;
+    }
+  }
+
+  std::uint64_t rows() const { return rows_; }
+
+private:
+  MpscRing<InverterTypes::Values> inverterRows_;
+  MpscRing<MeterTypes::Values> meterRows_;
+  std::uint64_t rows_{0};
+};
+
+// SlaveSink's job, feeding each meter's MeterSlave.
+class SlaveLoopback : public Sink {
+public:
+  explicit SlaveLoopback(std::vector<MeterSlave *> slaves)
+      : slaves_(std::move(slaves)) {}
+
+  void consume(const Sample &sample) override {
+    MeterSlave *slave = slaves_[sample.device];
+    if (!slave)
+      return;
+    if (const auto *v = std::get_if<MeterTypes::Values>(&sample.data))
+      slave->updateValues(*v);
+  }
+
+private:
+  std::vector<MeterSlave *> slaves_; // indexed by DeviceId
+};
+
+std::vector<Input> load(const std::string &path,
+                        std::vector<CaptureDevice> &devices) {
+  CaptureReader reader(path);
+  devices = reader.devices();
+  std::vector<Input> inputs;
+  while (auto record = reader.next())
+    inputs.push_back({record->type, record->device, record->at,
+                      std::string(record->data)});
+  return inputs;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  CLI::App app{"fronius-bridge-bench - replay a capture through the "
+               "sample pipeline"};
+
+  std::string capturePath;
+  double speed = 0.0;
+  int loops = 1;
+  std::size_t warmup = 2048;
+  double maxAllocs = -1.0;
+  bool aggregate = false;
+  bool noSlave = false;
+  std::string logLevel = "warn";
+  bool asyncLog = false;
+  app.add_option("capture", capturePath,
+                 "Capture file written by fronius-bridge --capture")
+      ->required()
+      ->check(CLI::ExistingFile);
+  app.add_option("-s,--speed", speed,
+                 "Replay at this multiple of real time (0: as fast as "
+                 "possible)")
+      ->check(CLI::NonNegativeNumber);
+  app.add_option("-n,--loops", loops, "Replay the capture this many times")
+      ->check(CLI::PositiveNumber);
+  app.add_option("-w,--warmup", warmup,
+                 "Untimed samples replayed before the timed run");
+  app.add_option("--max-allocs-per-sample", maxAllocs,
+                 "Fail if the timed run allocates more than this per sample");
+  app.add_flag("--aggregate", aggregate,
+               "Aggregate into 30 s buckets on the dispatch path");
+  app.add_flag("--no-slave", noSlave, "Do not feed a loopback meter slave");
+  app.add_option("--log-level", logLevel,
+                 "Log at this level to stderr (off, error, warn, info, "
+                 "debug, trace)");
+  app.add_flag("--async-log", asyncLog,
+               "Queue the log messages for a writer thread");
+  CLI11_PARSE(app, argc, argv);
+
+  // Every module at the one level; the slaves resolve theirs on
+  // construction, below.
+  LoggerConfig logCfg;
+  logCfg.globalLevel = spdlog::level::from_str(logLevel);
+  for (const char *module : {"main", "meter", "meter.slave", "mqtt"})
+    logCfg.moduleLevels[module] = logCfg.globalLevel;
+  if (asyncLog)
+    logCfg.async = LoggerAsyncConfig{};
+  setupLogging(logCfg, std::make_shared<spdlog::sinks::stderr_color_sink_mt>());
+
+  std::vector<CaptureDevice> devices;
+  std::vector<Input> inputs;
+  try {
+    inputs = load(capturePath, devices);
+  } catch (const std::exception &ex) {
+    std::cerr << ex.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  const auto isSample = [](const Input &in) {
+    return in.type != CaptureRecord::Type::Shape;
+  };
+  const auto perLoop = static_cast<std::size_t>(
+      std::count_if(inputs.begin(), inputs.end(), isSample));
+  if (perLoop == 0) {
+    std::cerr << "Capture '" << capturePath << "' holds no samples\n";
+    return EXIT_FAILURE;
+  }
+  const std::chrono::nanoseconds duration =
+      inputs.back().at - inputs.front().at;
+
+  // --- Pipeline ---
+  std::vector<DeviceRegistryEntry> registry;
+  for (const auto &d : devices)
+    registry.push_back(
+        {d.name,
+         d.kind == CaptureDevice::Kind::Inverter ? "inverter" : "meter",
+         {},
+         false});
+  std::optional<AggregateConfig> aggregateCfg;
+  if (aggregate)
+    aggregateCfg = AggregateConfig{};
+
+  // The slave threads run until the handler stops them, after the
+  // dispatcher has drained.
+  SignalHandler handler;
+  std::vector<std::unique_ptr<MeterSlave>> slaves;
+  std::vector<MeterSlave *> slaveOf(devices.size(), nullptr);
+  if (!noSlave) {
+    MeterSlaveConfig slaveCfg;
+    slaveCfg.tcp = ModbusTcpServerConfig{"127.0.0.1", 0, 1};
+    try {
+      for (std::size_t id = 0; id < devices.size(); ++id) {
+        if (devices[id].kind == CaptureDevice::Kind::Inverter)
+          continue;
+        slaves.push_back(
+            std::make_unique<MeterSlave>(slaveCfg, devices[id].name, handler));
+        slaveOf[id] = slaves.back().get();
+      }
+    } catch (const std::exception &ex) {
+      std::cerr << "Loopback slave: " << ex.what() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  const std::size_t timed = perLoop * static_cast<std::size_t>(loops);
+  Timeline timeline;
+  timeline.firstTimed = warmup;
+  timeline.dispatchedAt.resize(warmup + timed);
+
+  constexpr std::size_t queueSize = 256;
+  MqttStandIn mqtt(queueSize);
+  PostgresStandIn postgres(queueSize);
+  SlaveLoopback slave(slaveOf);
+  std::vector<std::unique_ptr<TimedSink>> sinks;
+  sinks.push_back(std::make_unique<TimedSink>("mqtt", mqtt, timeline, timed));
+  sinks.push_back(
+      std::make_unique<TimedSink>("postgres", postgres, timeline, timed));
+  if (!slaves.empty())
+    sinks.push_back(
+        std::make_unique<TimedSink>("slave", slave, timeline, timed));
+
+  auto dispatcher =
+      std::make_unique<Dispatcher>(registry, aggregateCfg, queueSize);
+  for (auto &sink : sinks)
+    dispatcher->subscribe(sink->name(), *sink);
+
+  // --- Replay ---
+  std::vector<CaptureShape> shapes(devices.size());
+  std::vector<std::string> payloads(devices.size());
+  Latencies decodeLatency(timed);
+  Latencies dispatchLatency(timed);
+  std::uint64_t seq = 0;
+  std::uint64_t decodeErrors = 0;
+
+  // Decode, serialise and dispatch one record; false when it held no sample.
+  auto replay = [&](const Input &in) {
+    const DeviceId id = in.device;
+    const CaptureShape &shape = shapes[id];
+    const bool timedSample = seq >= warmup;
+    const auto start = Clock::now();
+    auto dispatched = [&](const auto &values) {
+      const auto at = Clock::now();
+      timeline.dispatchedAt[seq] = at;
+      dispatcher->dispatch(id, payloads[id], values);
+      if (timedSample) {
+        decodeLatency.record(at - start);
+        dispatchLatency.record(Clock::now() - at);
+      }
+      ++seq;
+    };
+
+    switch (in.type) {
+    case CaptureRecord::Type::Shape:
+      std::memcpy(&shapes[id], in.data.data(),
+                  std::min(in.data.size(), sizeof(CaptureShape)));
+      return false;
+    case CaptureRecord::Type::InverterValues: {
+      InverterTypes::Values v;
+      std::memcpy(&v, in.data.data(), std::min(in.data.size(), sizeof(v)));
+      v.time = stamp(seq);
+      v.round();
+      Payload::inverterValues(payloads[id], v, shape.phases, shape.inputs,
+                              shape.hybrid != 0);
+      dispatched(v);
+      return true;
+    }
+    case CaptureRecord::Type::MeterValues: {
+      MeterTypes::Values v;
+      std::memcpy(&v, in.data.data(), std::min(in.data.size(), sizeof(v)));
+      v.time = stamp(seq);
+      v.round();
+      Payload::froniusMeterValues(payloads[id], v, shape.phases);
+      dispatched(v);
+      return true;
+    }
+    case CaptureRecord::Type::Telegram: {
+      MeterTypes::Values v{};
+      if (!EasyMeter::decodeTelegram(in.data, devices[id].grid, v)) {
+        ++decodeErrors;
+        return false;
+      }
+      v.time = stamp(seq);
+      v.round();
+      Payload::easyMeterValues(payloads[id], v);
+      dispatched(v);
+      return true;
+    }
+    }
+    return false;
+  };
+
+  // Warm-up: every pool and buffer reaches its size. Shapes come first in
+  // the capture, so wrapping around keeps them current. A pass that yields
+  // no sample (every telegram corrupt) ends it.
+  for (std::size_t i = 0, idle = 0; seq < warmup && idle < inputs.size();
+       i = (i + 1) % inputs.size())
+    idle = replay(inputs[i]) ? 0 : idle + 1;
+  std::uint64_t replayed = 0;
+
+  const std::uint64_t allocsBefore = AllocCounter::count();
+  timeline.start = Clock::now();
+  for (int loop = 0; loop < loops; ++loop) {
+    for (const auto &in : inputs) {
+      if (speed > 0.0) {
+        const auto offset = in.at - inputs.front().at + loop * duration;
+        std::this_thread::sleep_until(
+            timeline.start +
+            std::chrono::duration_cast<Clock::duration>(offset / speed));
+      }
+      if (replay(in))
+        ++replayed;
+    }
+  }
+  dispatcher.reset(); // lets every sink drain, then joins their threads
+  const std::chrono::duration<double> elapsed = Clock::now() - timeline.start;
+  const std::uint64_t allocated = AllocCounter::count() - allocsBefore;
+  handler.shutdown();
+
+  // --- Report ---
+  const double perSample =
+      replayed ? static_cast<double>(allocated) / static_cast<double>(replayed)
+               : 0.0;
+  std::cout << std::format("'{}': {} devices, {} samples x {} loop(s){}{}{}\n",
+                           capturePath, devices.size(), perLoop, loops,
+                           speed > 0.0 ? std::format(" at {}x", speed) : "",
+                           aggregate ? ", aggregated" : "",
+                           logLevel == "warn"
+                               ? ""
+                               : std::format(", {} logging at {}",
+                                             asyncLog ? "async" : "sync",
+                                             logLevel))
+            << std::format("  throughput {:12.0f} samples/s\n",
+                           static_cast<double>(replayed) / elapsed.count())
+            << std::format("  {:<18}{:>10}{:>10}  (us)\n", "stage", "p50",
+                           "p99");
+  auto line = [](const std::string &stage, Latencies &l) {
+    std::cout << std::format("  {:<18}{:10.2f}{:10.2f}\n", stage,
+                             l.percentileUs(0.50), l.percentileUs(0.99));
+  };
+  line("decode", decodeLatency);
+  line("dispatch", dispatchLatency);
+  for (auto &sink : sinks) {
+    line("queue " + sink->name(), sink->queue());
+    line("consume " + sink->name(), sink->consumeLatency());
+  }
+  for (auto &sink : sinks)
+    std::cout << std::format("  {} consumed {} / {} samples\n", sink->name(),
+                             sink->consumeLatency().count(), replayed);
+  std::cout << std::format("  mqtt stand-in sent {} bytes ({} pool misses), "
+                           "postgres stand-in queued {} rows\n",
+                           mqtt.bytes(), mqtt.poolMisses(), postgres.rows());
+  if (decodeErrors)
+    std::cout << std::format("  telegrams that failed to decode: {}\n",
+                             decodeErrors);
+  std::cout << std::format("  heap allocations: {} ({:.3f} per sample)\n",
+                           allocated, perSample);
+
+  if (maxAllocs >= 0.0 && perSample > maxAllocs) {
+    std::cerr << std::format("FAIL: {:.3f} allocations per sample, at most "
+                             "{} allowed\n",
+                             perSample, maxAllocs);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
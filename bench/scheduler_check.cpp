@@ -0,0 +1,84 @@
+// ---------------------------------------------------------------------------
+// scheduler_check — BusScheduler's rescheduling across wall-clock steps.
+//
+// The scheduler aligns every poll to a wall-clock boundary, so a step of the
+// system clock moves the timeline its pending deadlines were computed on.
+// Stepping the real clock needs root and disturbs the host, so this drives
+// BusScheduler::nextBoundary(), the rule runLoop() applies after each poll,
+// with the clock readings a step would produce: an on-time poll, an overrun,
+// a step forward, and steps back shorter and far longer than the interval.
+// The long step back is the case that used to stall a bus for the length of
+// the step. Exits non-zero on the first rule that does not hold.
+//
+// Build with -DBUILD_BENCHMARKS=ON and run `scheduler_check` (or ctest).
+// ---------------------------------------------------------------------------
+
+#include "bus_scheduler.h"
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string_view>
+
+namespace {
+
+using namespace std::chrono_literals;
+using WallTime = BusScheduler::WallTime;
+
+// 2026-06-05 12:00:00 UTC, a multiple of every interval below.
+const WallTime noon{std::chrono::seconds{1780660800}};
+
+bool expect(std::string_view what, WallTime got, WallTime want) {
+  if (got == want)
+    return true;
+  const auto offset = [](WallTime t) {
+    return std::chrono::duration<double>(t - noon).count();
+  };
+  std::cerr << std::format("{}: next boundary at noon{:+.3f} s, expected "
+                           "noon{:+.3f} s\n",
+                           what, offset(got), offset(want));
+  return false;
+}
+
+} // namespace
+
+int main() {
+  const std::chrono::seconds interval = 4s;
+  bool ok = true;
+
+  // On time: the slot after the one that ran.
+  ok &= expect("on time",
+               BusScheduler::nextBoundary(noon, noon + 150ms, interval),
+               noon + 4s);
+
+  // Overran two boundaries: the first one still ahead, no catch-up burst.
+  ok &= expect("overrun",
+               BusScheduler::nextBoundary(noon, noon + 9s, interval),
+               noon + 12s);
+
+  // Wall clock stepped forward an hour: the first boundary after the step.
+  ok &= expect("step forward",
+               BusScheduler::nextBoundary(noon, noon + 1h + 1s, interval),
+               noon + 1h + 4s);
+
+  // Stepped back less than an interval: the slot after the one that ran,
+  // at most an interval late.
+  ok &= expect("short step back",
+               BusScheduler::nextBoundary(noon, noon - 3s, interval),
+               noon + 4s);
+
+  // Stepped back an hour (an RTC running ahead, corrected by NTP): realign
+  // to the new timeline instead of waiting for noon + 4 s an hour away.
+  ok &= expect("long step back",
+               BusScheduler::nextBoundary(noon, noon - 1h + 1s, interval),
+               noon - 1h + 4s);
+
+  // The same step with a longer interval than the step's excess.
+  ok &= expect("step back, 60 s interval",
+               BusScheduler::nextBoundary(noon, noon - 90s, 60s),
+               noon - 60s);
+
+  if (ok)
+    std::cout << "scheduler_check: all rescheduling rules hold\n";
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
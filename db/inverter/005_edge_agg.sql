@@ -0,0 +1,55 @@
+-- =============================================================================
+-- fronius-bridge: per-device inverter schema (migration 005)
+--
+-- power_edge: the envelope of the AC active power (total across phases) over
+-- each bucket the bridge aggregated itself (the optional `aggregate:`
+-- section). In that mode the bridge polls fast locally and ships one row per
+-- bucket instead of every sample:
+--
+--   samples     one representative row per bucket -- the bucket averages, with
+--               the energy counters at their last reading -- so the daily
+--               rollups and the power_30sec / power_5min averages work as
+--               before.
+--   power_edge  the bucket's average, minimum, maximum and last
+--               ac_power_active, and how many samples it folded: the min/max
+--               envelope the continuous aggregates can no longer see from one
+--               row per bucket.
+--
+-- A continuous aggregate is a view maintained by TimescaleDB and takes no
+-- INSERTs, so the bridge-side buckets go into this plain hypertable next to
+-- them, with the same column names. width is the bucket length in seconds; it
+-- divides 30, so a power_30sec bucket spans a whole number of edge buckets.
+-- Without the aggregate section the table stays empty.
+--
+-- Compressed after 7 days and kept for 2 years, like the aggregates it
+-- complements (migration 004).
+--
+-- ASCII only: this file is folded into the binary via #embed.
+-- =============================================================================
+
+CREATE TABLE IF NOT EXISTS power_edge (
+    bucket     TIMESTAMPTZ NOT NULL,
+    width      INTEGER     NOT NULL,   -- s
+    samples    INTEGER     NOT NULL,
+    avg_power  REAL,                   -- W, total ac_power_active
+    min_power  REAL,
+    max_power  REAL,
+    last_power REAL,
+
+    CONSTRAINT power_edge_width_chk   CHECK (width > 0),
+    CONSTRAINT power_edge_samples_chk CHECK (samples > 0),
+    -- One row per bucket (includes the partition column).
+    CONSTRAINT power_edge_bucket_uniq UNIQUE (bucket)
+);
+
+SELECT create_hypertable('power_edge', 'bucket', if_not_exists => TRUE);
+
+ALTER TABLE power_edge SET (
+    timescaledb.enable_columnstore = TRUE,
+    timescaledb.orderby            = 'bucket DESC');
+
+CALL add_columnstore_policy('power_edge',
+    after => INTERVAL '7 days', if_not_exists => TRUE);
+
+SELECT add_retention_policy('power_edge',
+    drop_after => INTERVAL '2 years', if_not_exists => TRUE);
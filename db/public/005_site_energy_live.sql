@@ -0,0 +1,88 @@
+-- =============================================================================
+-- fronius-bridge: public schema (migration 005)
+--
+-- add_site_energy(): the write path of the bridge's streaming site balance
+-- (the YAML `site_energy:` section). The bridge accumulates the day's energy
+-- as the samples arrive and, every interval, calls this with the increments
+-- since its previous call. The function adds them to the day's site_energy
+-- row, creating it if needed, and re-derives the dependent columns with the
+-- arithmetic of compute_site_energy() (migration 003):
+--
+--   measured   production, from_grid and to_grid are counter increments and
+--              are summed; self_consumption = GREATEST(production - to_grid,
+--              0); consumption = self_consumption + from_grid.
+--   simulated  production and consumption are counter increments and are
+--              summed; d_overlap, the integral of min(P, C), is added to
+--              self_consumption, which is clamped to LEAST(self_consumption,
+--              production, consumption); to_grid and from_grid follow by
+--              subtraction.
+--
+-- The row is a live view, not a settled figure: complete and continuous are
+-- left as they are (FALSE on a row created here), and the nightly
+-- compute_site_rollup() stays the reconciliation pass that overwrites the day
+-- from the stored samples. Energy the bridge did not see (while it was down)
+-- is missing from the live row until then. A current-day compute_site_rollup()
+-- job would overwrite the row under the bridge's increments, so a deployment
+-- with the streaming balance drops it and keeps only the nightly one.
+--
+-- ASCII only: this file is folded into the binary via #embed.
+-- =============================================================================
+
+CREATE OR REPLACE FUNCTION add_site_energy(
+    target_day    DATE,
+    measured      BOOLEAN,
+    d_production  DOUBLE PRECISION,
+    d_consumption DOUBLE PRECISION,
+    d_from_grid   DOUBLE PRECISION,
+    d_to_grid     DOUBLE PRECISION,
+    d_overlap     DOUBLE PRECISION)
+RETURNS VOID
+LANGUAGE plpgsql
+SET search_path FROM CURRENT
+AS $$
+DECLARE
+    v_prod      DOUBLE PRECISION;
+    v_cons      DOUBLE PRECISION;
+    v_self_cons DOUBLE PRECISION;
+    v_from_grid DOUBLE PRECISION;
+    v_to_grid   DOUBLE PRECISION;
+BEGIN
+    -- Create the day's row if needed, then lock it, so two calls for the same
+    -- day add up instead of one overwriting the other.
+    INSERT INTO site_energy (day, production_kwh, consumption_kwh,
+                             self_consumption_kwh, from_grid_kwh, to_grid_kwh)
+    VALUES (target_day, 0, 0, 0, 0, 0)
+    ON CONFLICT (day) DO NOTHING;
+
+    SELECT COALESCE(production_kwh, 0), COALESCE(consumption_kwh, 0),
+           COALESCE(self_consumption_kwh, 0), COALESCE(from_grid_kwh, 0),
+           COALESCE(to_grid_kwh, 0)
+      INTO v_prod, v_cons, v_self_cons, v_from_grid, v_to_grid
+      FROM site_energy
+     WHERE day = target_day
+       FOR UPDATE;
+
+    v_prod := v_prod + d_production;
+
+    IF measured THEN
+        v_from_grid := v_from_grid + d_from_grid;
+        v_to_grid   := v_to_grid + d_to_grid;
+        v_self_cons := GREATEST(v_prod - v_to_grid, 0);
+        v_cons      := v_self_cons + v_from_grid;
+    ELSE
+        v_cons      := v_cons + d_consumption;
+        v_self_cons := LEAST(v_self_cons + d_overlap, v_prod, v_cons);
+        v_to_grid   := v_prod - v_self_cons;
+        v_from_grid := v_cons - v_self_cons;
+    END IF;
+
+    UPDATE site_energy
+       SET production_kwh       = v_prod,
+           consumption_kwh      = v_cons,
+           self_consumption_kwh = v_self_cons,
+           from_grid_kwh        = v_from_grid,
+           to_grid_kwh          = v_to_grid,
+           computed_at          = now()
+     WHERE day = target_day;
+END;
+$$;
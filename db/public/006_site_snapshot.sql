@@ -0,0 +1,50 @@
+-- =============================================================================
+-- fronius-bridge: public schema (migration 006)
+--
+-- site_snapshot: one row per poll tick of the whole site, written by the
+-- bridge with a YAML `snapshot:` section. Every Modbus master then polls on
+-- the same wall-clock boundaries, and the bridge gathers each device's first
+-- sample of a tick into one record, so a consumer reads the site at an
+-- instant from one row instead of joining the per-device samples tables by
+-- time.
+--
+--   time              the tick's boundary; each device's own sample time is
+--                     in its document
+--   complete          every configured device reported in the tick; FALSE
+--                     when one was unreachable or its poll overran
+--   production_power  W, the sum of the reporting inverters' ac_power_active
+--   primary_power     W, the primary meter's power_active, NULL without one
+--                     or if it did not report
+--   document          the record published on <topic>/site/snapshot: the
+--                     summary above and each device's values document, keyed
+--                     by device name
+--
+-- The bridge upserts by time, so a restart within a tick rewrites the row.
+-- The table follows the raw samples' lifecycle (migration 004 of the device
+-- schemas): columnstore after 7 days, dropped after 90.
+--
+-- ASCII only: this file is folded into the binary via #embed.
+-- =============================================================================
+
+CREATE TABLE IF NOT EXISTS site_snapshot (
+    time              TIMESTAMPTZ      NOT NULL,
+    complete          BOOLEAN          NOT NULL,
+    production_power  REAL,               -- W
+    primary_power     REAL,               -- W
+    document          JSONB            NOT NULL,
+
+    -- One record per tick. Includes the hypertable partition column (time),
+    -- as TimescaleDB requires of any unique index.
+    CONSTRAINT site_snapshot_time_uniq UNIQUE (time)
+);
+
+SELECT create_hypertable('site_snapshot', 'time', if_not_exists => TRUE);
+
+ALTER TABLE site_snapshot SET (
+    timescaledb.enable_columnstore = TRUE,
+    timescaledb.orderby            = 'time DESC');
+
+CALL add_columnstore_policy('site_snapshot',
+    after => INTERVAL '7 days', if_not_exists => TRUE);
+SELECT add_retention_policy('site_snapshot',
+    drop_after => INTERVAL '90 days', if_not_exists => TRUE);
@@ -0,0 +1,70 @@
+#ifndef ADAPTIVE_INTERVAL_H_
+#define ADAPTIVE_INTERVAL_H_
+
+#include "config_yaml.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <optional>
+
+// ---------------------------------------------------------------------------
+// AdaptiveInterval — a Modbus master's poll interval, chosen after each poll.
+//
+// Without an `adaptive:` block the interval is the fixed update_interval.
+// With one (see AdaptivePollConfig) next() picks the interval to the next
+// poll from the power just read:
+//
+//   - idle, as the master defines it: max_interval;
+//   - moved by threshold or more since the last poll: min_interval;
+//   - otherwise the interval doubles up to update_interval, or falls straight
+//     back to it from max_interval;
+//
+// so a device reacts at once to a cloud edge or a heat pump starting, and a
+// quiet or sleeping one leaves its share of the bus to the busy ones. The
+// BusScheduler aligns each poll to a multiple of the interval it was given.
+//
+// Not thread-safe: owned by one master and touched only from its poll. A
+// reload's new interval replaces it there (see setUpdateInterval()).
+// ---------------------------------------------------------------------------
+
+class AdaptiveInterval {
+public:
+  AdaptiveInterval(int updateInterval,
+                   const std::optional<AdaptivePollConfig> &cfg)
+      : steady_(updateInterval), cfg_(cfg), current_(updateInterval) {}
+
+  bool enabled() const noexcept { return cfg_.has_value(); }
+
+  // The interval in effect, i.e. the one that led up to the current poll.
+  std::chrono::seconds current() const noexcept { return current_; }
+
+  // Power below which a meter counts as idle.
+  double threshold() const noexcept { return cfg_ ? cfg_->threshold : 0.0; }
+
+  // Choose the interval to the next poll after reading `power`.
+  std::chrono::seconds next(double power, bool idle) {
+    if (!cfg_)
+      return current_;
+
+    const std::chrono::seconds min{cfg_->minInterval};
+    const std::chrono::seconds max{cfg_->maxInterval};
+    if (idle)
+      current_ = max;
+    else if (last_ && std::fabs(power - *last_) >= cfg_->threshold)
+      current_ = min;
+    else if (current_ > steady_)
+      current_ = steady_;
+    else
+      current_ = std::min(current_ * 2, steady_);
+    last_ = power;
+    return current_;
+  }
+
+private:
+  std::chrono::seconds steady_;
+  std::optional<AdaptivePollConfig> cfg_;
+  std::chrono::seconds current_;
+  std::optional<double> last_;
+};
+
+#endif /* ADAPTIVE_INTERVAL_H_ */
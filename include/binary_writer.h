@@ -0,0 +1,86 @@
+#ifndef BINARY_WRITER_H_
+#define BINARY_WRITER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Binary — CBOR (RFC 8949) and MessagePack writer for the MQTT payloads.
+//
+// Drop-in for Json::Writer: the same calls, so the Json::Field descriptor
+// tuples Payload serialises from drive every encoding and a field added there
+// reaches all of them. Values go out in their native form: doubles (energies
+// included) as float64, the timestamp and counters as integers, strings as
+// UTF-8 text. NaN and infinities are kept as such rather than mapped to null.
+//
+// Both formats prefix a map or array with its length, which a streaming
+// writer only knows once the container is closed. Each container is opened
+// with a one-byte header, enough for up to 23 (CBOR) or 15 (MessagePack)
+// entries, and patched on close; a longer one has its header widened in
+// place, which shifts the container's bytes once. Like Json::Writer it
+// appends to a caller-owned string and allocates nothing once that string has
+// grown to the payload size.
+// ---------------------------------------------------------------------------
+
+namespace Binary {
+
+enum class Format { Cbor, MsgPack };
+
+class Writer {
+public:
+  // Clears `out` (keeping its capacity) and appends to it.
+  Writer(std::string &out, Format format) : out_(out), format_(format) {
+    out_.clear();
+  }
+
+  void beginObject() { open(true); }
+  void endObject() { close(); }
+  void beginArray() { open(false); }
+  void endArray() { close(); }
+
+  // Object key; the next value belongs to it.
+  void key(std::string_view k) { text(k); }
+
+  // `decimals` is accepted for Json::Writer's signature; a double is always
+  // written in full.
+  void number(double v, int decimals = -1);
+  void value(std::uint64_t v);
+  void value(int v);
+  void value(bool v);
+  void value(std::string_view v);
+  void value(const std::string &v) { value(std::string_view(v)); }
+  void value(const std::vector<std::string> &v);
+
+private:
+  // Payload nesting is at most three deep (document, phases, phase).
+  static constexpr std::size_t maxDepth = 8;
+
+  struct Container {
+    std::size_t pos;   // offset of the placeholder header byte
+    std::size_t count; // values (map: pairs) written so far
+    bool map;
+  };
+
+  // A value (or a container) inside the current container.
+  void item() {
+    if (depth_ > 0)
+      ++stack_[depth_ - 1].count;
+  }
+  void open(bool map);
+  void close();
+  void text(std::string_view s);
+  void uint(std::uint64_t v);
+
+  std::string &out_;
+  const Format format_;
+  std::array<Container, maxDepth> stack_{};
+  std::size_t depth_{0};
+};
+
+} // namespace Binary
+
+#endif /* BINARY_WRITER_H_ */
@@ -0,0 +1,125 @@
+#ifndef BUS_SCHEDULER_H_
+#define BUS_SCHEDULER_H_
+
+#include "metrics.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <spdlog/logger.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// BusScheduler — one poll thread per FroniusBus.
+//
+// The Modbus masters (InverterMaster, FroniusMeter) no longer own a thread
+// each. They register their poll cycle here, and the scheduler of their bus
+// runs every member's poll from a single thread in deadline order: a min-heap
+// keyed on the next due time, so the thread sleeps until exactly the earliest
+// deadline. Polls on one bus serialise on the wire anyway; running them from
+// one thread makes the order explicit instead of leaving it to whichever
+// sleeping thread wakes first.
+//
+// Each poll returns the interval to its next one, which may change from poll
+// to poll (see AdaptiveInterval); a fixed-rate master returns its
+// update_interval. Deadlines are aligned to wall-clock multiples of that
+// interval (a 4 s device polls at :00, :04, :08, ...), so devices with the
+// same interval sample in the same time bucket even across buses. They are
+// converted to the steady clock when scheduled, so a wall-clock step moves at
+// most the slot already waiting: after a step back, the next poll realigns
+// to the new timeline instead of waiting for the old one's boundary. Devices
+// due at the same instant run in the order they were added.
+//
+// Per device it reports how late each poll started against its deadline
+// (fronius_bridge_poll_jitter_seconds, which on a shared bus includes the
+// polls ahead of it in the same slot) and the polls that ran past the next
+// deadline (fronius_bridge_poll_overruns_total). An overrun skips the missed
+// slots rather than catching up with a burst.
+//
+// Lifetime: remove() blocks until an in-flight poll of that entry returns, so
+// a master removes itself in its destructor before tearing down the state its
+// poll touches. The scheduler must outlive every master added to it.
+// ---------------------------------------------------------------------------
+
+class BusScheduler {
+public:
+  using Id = std::uint64_t;
+  using SteadyTime = std::chrono::steady_clock::time_point;
+  using WallTime = std::chrono::system_clock::time_point;
+
+  // `bus` is the bus key, for the log lines.
+  explicit BusScheduler(std::string bus);
+  ~BusScheduler();
+
+  // Non-copyable, non-movable — owns a thread.
+  BusScheduler(const BusScheduler &) = delete;
+  BusScheduler &operator=(const BusScheduler &) = delete;
+  BusScheduler(BusScheduler &&) = delete;
+  BusScheduler &operator=(BusScheduler &&) = delete;
+
+  // Poll returning the interval to the next poll (clamped to 1 s or more).
+  using Poll = std::function<std::chrono::seconds()>;
+
+  // Run `poll` first after `interval`, at the next aligned boundary, and
+  // from then on after the interval each poll returns. `device` labels the
+  // metrics and log lines. Thread-safe.
+  Id add(const std::string &device, std::chrono::seconds interval, Poll poll);
+
+  // Stop running the entry, waiting out an in-flight poll of it. Must not be
+  // called from within a poll. Unknown ids are ignored.
+  void remove(Id id);
+
+  // The boundary a poll whose slot stood for `due`, and which finished at
+  // `finished`, is scheduled for next, with `interval` to go: the first one
+  // after the later of the two, so an overrun skips the slots it missed. A
+  // `due` more than an interval past `finished` is on the timeline from
+  // before a backward wall-clock step, and the poll realigns to the boundary
+  // after `finished` rather than waiting the step out.
+  static WallTime nextBoundary(WallTime due, WallTime finished,
+                               std::chrono::seconds interval);
+
+private:
+  struct Entry {
+    std::string device;
+    std::chrono::seconds interval; // of the pending slot
+    Poll poll;
+    WallTime dueWall; // the aligned boundary the pending slot stands for
+    bool overrunning{false};
+    Metrics::Histogram &jitter;
+    Metrics::Counter &overruns;
+  };
+
+  struct Slot {
+    SteadyTime due;
+    Id id;
+    auto operator<=>(const Slot &) const = default;
+  };
+
+  // The first multiple of `interval` since the epoch strictly after `after`.
+  static WallTime boundaryAfter(WallTime after, std::chrono::seconds interval);
+  // Queue `id` for the wall-clock boundary `due`. Caller holds mutex_.
+  void schedule(Id id, Entry &entry, WallTime due);
+  void runLoop();
+
+  const std::string bus_;
+  std::shared_ptr<spdlog::logger> logger_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;     // wakes runLoop: new slot, stop
+  std::condition_variable doneCv_; // wakes remove(): a poll returned
+  std::map<Id, Entry> entries_;
+  // Slots of removed entries stay queued and are dropped when they surface.
+  std::priority_queue<Slot, std::vector<Slot>, std::greater<>> slots_;
+  Id nextId_{1};
+  Id running_{0}; // entry whose poll is in flight, 0 for none
+  bool stop_{false};
+  std::thread worker_;
+};
+
+#endif /* BUS_SCHEDULER_H_ */
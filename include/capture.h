@@ -0,0 +1,136 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include "config_yaml.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Capture — a recording of the devices' inputs, replayed by
+// fronius-bridge-bench.
+//
+// `fronius-bridge --capture <file>` records what each master takes off the
+// wire before anything downstream of it runs:
+//
+//   - an EBZ Easymeter's raw telegrams, exactly as readTelegram() framed
+//     them, which replay through the same OBIS decoder;
+//   - an inverter's or Fronius meter's values as decoded from the register
+//     snapshot fetch*Registers() read, before rounding. libfronius decodes
+//     the registers inside the library and does not hand out the raw block,
+//     so this is the earliest point the bridge can tap; replay runs the
+//     rounding and serialisation the master does after it;
+//   - each Modbus device's shape (phases, inputs, hybrid), which the
+//     serialisers need, once per connect.
+//
+// The file is a header naming the devices (index = DeviceId, as in the
+// config's registry), then one record per input: a 16-byte record header
+// with the device, the kind, the length and the monotonic time since capture
+// start, followed by the bytes. Values are stored as the raw bytes of their
+// trivially copyable structs, like the PostgreSQL spool; the header carries
+// their sizes, so a capture from a build with a different layout is refused
+// rather than misread.
+//
+// CaptureWriter is called from the poll and reader threads, serialised under
+// a mutex, and flushes each record, so a capture cut short by a crash keeps
+// all but the record being written. Capture is a diagnostic mode: the file
+// I/O runs on the poll threads.
+// ---------------------------------------------------------------------------
+
+// What a capture knows about a device: enough to decode and serialise its
+// records without the config. `grid` is set for an EBZ only.
+struct CaptureDevice {
+  enum class Kind : std::uint8_t { Inverter, FroniusMeter, EasyMeter };
+  std::string name;
+  Kind kind{Kind::Inverter};
+  GridConfig grid;
+};
+
+// The part of a Modbus device's identity the serialisers use.
+struct CaptureShape {
+  std::int32_t phases{1};
+  std::int32_t inputs{1};
+  std::uint8_t hybrid{0};
+};
+
+// One captured input. `data` points into the reader's buffer and is valid
+// until the next CaptureReader::next().
+struct CaptureRecord {
+  enum class Type : std::uint8_t {
+    InverterValues = 1,
+    MeterValues = 2,
+    Telegram = 3,
+    Shape = 4,
+  };
+  Type type{Type::InverterValues};
+  DeviceId device{0};
+  std::chrono::nanoseconds at{0}; // since capture start
+  std::string_view data;
+};
+
+class CaptureWriter {
+public:
+  // Creates (or truncates) `path` and writes the header for cfg's devices.
+  // Throws std::runtime_error if the file cannot be written.
+  CaptureWriter(const std::filesystem::path &path, const AppConfig &cfg);
+  ~CaptureWriter();
+
+  CaptureWriter(const CaptureWriter &) = delete;
+  CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+  // Thread-safe. A failed write is logged once and the capture stops.
+  void inverterValues(DeviceId device, const InverterTypes::Values &values);
+  void meterValues(DeviceId device, const MeterTypes::Values &values);
+  void telegram(DeviceId device, std::string_view telegram);
+  void shape(DeviceId device, const CaptureShape &shape);
+
+  std::uint64_t records() const;
+
+private:
+  void write(CaptureRecord::Type type, DeviceId device, const void *data,
+             std::size_t length);
+
+  const std::filesystem::path path_;
+  const std::chrono::steady_clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::FILE *file_{nullptr};
+  std::uint64_t records_{0};
+};
+
+class CaptureReader {
+public:
+  // Opens `path` and reads its header. Throws std::runtime_error if the file
+  // cannot be read or was written by a build with another Values layout.
+  explicit CaptureReader(const std::filesystem::path &path);
+  ~CaptureReader();
+
+  CaptureReader(const CaptureReader &) = delete;
+  CaptureReader &operator=(const CaptureReader &) = delete;
+
+  // Indexed by DeviceId.
+  const std::vector<CaptureDevice> &devices() const noexcept {
+    return devices_;
+  }
+
+  // The next record, or std::nullopt at the end of the file. A truncated
+  // final record ends the capture. Throws std::runtime_error on a record
+  // that names an unknown device or kind.
+  std::optional<CaptureRecord> next();
+
+private:
+  const std::filesystem::path path_;
+  std::FILE *file_{nullptr};
+  std::vector<CaptureDevice> devices_;
+  std::string buf_;
+};
+
+#endif /* CAPTURE_H_ */
@@ -10,8 +10,8 @@
 // define a defaulted operator==).
 //
 // Not thread-safe by design: each master owns one gate and touches it only
-// from its own poll thread (runLoop), exactly where the previous per-master
-// "device updated" latch was used.
+// from the thread that polls it (poll(), or EasyMeter's runLoop), exactly
+// where the previous per-master "device updated" latch was used.
 template <typename T> class ChangeGate {
 public:
   // Returns true and records `value` as the new baseline when it differs from
@@ -31,6 +31,11 @@ public:
   // relies on changed() alone.
   bool hasValue() const noexcept { return last_.has_value(); }
 
+  // Forget the baseline, so the next value passes whatever it is. For a
+  // producer that stops publishing for a while, as a standby cluster node
+  // does, while its last value may have been overwritten downstream.
+  void reset() noexcept { last_.reset(); }
+
 private:
   std::optional<T> last_;
 };
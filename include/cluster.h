@@ -0,0 +1,173 @@
+#ifndef CLUSTER_H_
+#define CLUSTER_H_
+
+#include "config_yaml.h"
+#include "db_error.h"
+#include "metrics.h"
+#include "mpsc_ring.h"
+#include "pg.h"
+#include "signal_handler.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <spdlog/logger.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Cluster mode — several bridge instances ("nodes") sharing one config, each
+// serving a share of the devices.
+//
+// With a `cluster:` section (see ClusterConfig) every node runs with the same
+// file and its own --node name. Each device has a home node, its `home:` or,
+// without one, the node that ranks first for it by rendezvous hashing the
+// node and device names, so the devices spread evenly and a node joining or
+// leaving moves only its own share. The home serves the device while it is
+// up. A device a node reaches over Modbus TCP can be served from any node:
+// while its home is down it fails over to the next live node in its ranking,
+// and moves back once the home returns. A device on a serial line (an RTU
+// master, an EBZ) is wired to its home and is not served while that is down.
+//
+// The nodes coordinate through the PostgreSQL database they write to, with
+// session advisory locks, so a node's claims end with its connection and no
+// lease table has to be expired:
+//
+//   - On connecting, a node takes its node lock, (nodeLockClass,
+//     hashtext(node)). A node holding its lock is live; every `lease`
+//     seconds each node reads the live set from pg_locks and serves the
+//     devices whose first live node in preference order is itself.
+//   - Every node tries for the leader lock, (leaderLockClass, 0), each lease.
+//     The one holding it writes the roster into public.device_registry and
+//     public.site, the job each writer does at startup without a cluster, so
+//     the nodes do not rewrite it over each other; a node that takes over
+//     after the leader died writes it again. The day's site figures are
+//     computed by the pg_cron jobs in the database, once per cluster
+//     already.
+//
+// A node that exits releases its locks at once. One that vanishes (power
+// loss, a cut link) holds them until the server notices: the session sets
+// the server's TCP keepalives to the lease, so that takes about four leases.
+// Devices in transit may be polled by two nodes, or by neither, for up to a
+// lease. A node that loses the database serves its own home devices until it
+// is back, while the others see it as gone and take over the ones that can
+// move, so for the length of the outage those are polled twice.
+//
+// Every node builds the masters of the devices it may ever serve, its home
+// devices and the movable rest, each wired to the dispatcher under its usual
+// DeviceId, and connects their buses at startup, so a takeover only starts
+// the polls. The coordinator switches the masters through `onChange`:
+// setActive() on each one the node now serves or no longer serves. A reload
+// hands the coordinator the new roster (see reload()); the masters main
+// builds for it start inactive, and the next round hands over the full set
+// again, and, on the leader, writes the roster.
+//
+// Metrics: fronius_bridge_cluster_leader (1 on the leader) and
+// fronius_bridge_cluster_devices, the devices this node serves.
+//
+// Threading: one thread, which owns the connection and calls `onChange`. The
+// destructor stops and joins it and closes the connection, releasing the
+// locks.
+// ---------------------------------------------------------------------------
+
+// The nodes that may serve each device of cfg.deviceRegistry, by DeviceId, in
+// preference order: its home first, then, if it is movable, the other nodes
+// by rendezvous rank; empty for a vacant slot. Needs cfg.cluster.
+std::vector<std::vector<std::string>> clusterPreferences(const AppConfig &cfg);
+
+// Which devices `node` serves while the nodes in `live` are up: each device's
+// first live node in `preferences`. With `live` empty, its home devices.
+std::vector<bool>
+clusterOwnership(const std::vector<std::vector<std::string>> &preferences,
+                 const std::string &node,
+                 const std::vector<std::string> &live);
+
+class ClusterCoordinator {
+public:
+  using OwnershipCallback = std::function<void(const std::vector<bool> &)>;
+
+  // Coordinate as cfg.cluster->node through cfg.postgres's database. Calls
+  // `onChange` with the node's home devices before returning, then from the
+  // coordinator thread whenever the set changes.
+  ClusterCoordinator(const AppConfig &cfg, SignalHandler &signalHandler,
+                     OwnershipCallback onChange);
+  ~ClusterCoordinator();
+
+  // Non-copyable, non-movable — owns a thread.
+  ClusterCoordinator(const ClusterCoordinator &) = delete;
+  ClusterCoordinator &operator=(const ClusterCoordinator &) = delete;
+  ClusterCoordinator(ClusterCoordinator &&) = delete;
+  ClusterCoordinator &operator=(ClusterCoordinator &&) = delete;
+
+  bool leader() const noexcept { return leader_.load(); }
+
+  // Take a reload's roster, cfg.deviceRegistry and its preferences, at the
+  // start of the next round, which the call brings forward. Thread-safe.
+  void reload(const AppConfig &cfg);
+
+private:
+  // First keys of the session advisory locks, hex-ASCII like the migrator's
+  // "FRON": "FRND" for the node locks, "FRLD" for the leader lock.
+  static constexpr std::int32_t nodeLockClass = 0x46524E44;
+  static constexpr std::int32_t leaderLockClass = 0x46524C44;
+
+  void run();
+  // Open the connection and set its keepalives.
+  std::expected<void, DbError> connect();
+  // One round: take the locks still missing, sync the roster as a new
+  // leader, read the live nodes and apply the devices they leave this node.
+  std::expected<void, DbError> tick();
+  std::expected<bool, DbError> tryLock(std::int32_t key1,
+                                       const std::optional<std::string> &key2);
+  std::expected<std::vector<std::string>, DbError> liveNodes();
+  // Hand `owned` to onChange_ if it differs from what this node serves.
+  void apply(std::vector<bool> owned);
+  // Lost the database: serve the home devices, hold nothing.
+  void fallBack();
+  // Move to the roster reload() left, if any.
+  void adoptRoster();
+
+  struct Roster {
+    std::vector<DeviceRegistryEntry> registry;
+    std::vector<std::vector<std::string>> preferences;
+  };
+
+  const ClusterConfig cfg_;
+  const PostgresConfig pgCfg_;
+  // The roster: set by the constructor, replaced by adoptRoster() on the
+  // coordinator thread.
+  std::vector<DeviceRegistryEntry> registry_;
+  const std::optional<SiteConfig> site_;
+  std::vector<std::vector<std::string>> preferences_;
+  SignalHandler &handler_;
+  OwnershipCallback onChange_;
+  std::shared_ptr<spdlog::logger> logger_;
+
+  // Touched only by the coordinator thread (and the constructor, before it
+  // starts).
+  std::unique_ptr<pg::Conn> conn_;
+  bool nodeLocked_{false};
+  bool handOver_{false}; // call onChange_ even if owned_ did not change
+  bool registrySynced_{false};
+  std::vector<std::string> live_;
+  std::vector<bool> owned_;
+
+  std::atomic<bool> leader_{false};
+  std::atomic<std::size_t> served_{0};
+  std::atomic<bool> stop_{false};
+  // A reload's roster, until the thread takes it.
+  std::mutex reloadMutex_;
+  std::optional<Roster> pending_;
+  std::atomic<bool> reloaded_{false};
+  Wakeup wake_;
+  Metrics::Registration leaderMetric_;
+  Metrics::Registration servedMetric_;
+  std::jthread thread_; // last: started once the rest is set up
+};
+
+#endif /* CLUSTER_H_ */
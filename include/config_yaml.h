@@ -1,6 +1,8 @@
 #ifndef CONFIG_YAML_HPP
 #define CONFIG_YAML_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <fronius/fronius.h>
 #include <map>
 #include <optional>
@@ -32,11 +34,16 @@ void applyParity(termios &tty, Parity parity);
 struct ModbusTcpClientConfig {
   std::string host;
   int port{502};
+
+  bool operator==(const ModbusTcpClientConfig &) const = default;
 };
 
 struct ModbusTcpServerConfig {
   std::string listen{"0.0.0.0"};
   int port{502};
+  int maxConnections{8}; // concurrent clients; more are refused at accept
+
+  bool operator==(const ModbusTcpServerConfig &) const = default;
 };
 
 struct ModbusRtuConfig {
@@ -45,6 +52,8 @@ struct ModbusRtuConfig {
   int dataBits{8};
   int stopBits{1};
   Parity parity{Parity::None};
+
+  bool operator==(const ModbusRtuConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -55,11 +64,47 @@ struct ReconnectDelayConfig {
   int min{5};
   int max{320};
   bool exponential{true};
+
+  bool operator==(const ReconnectDelayConfig &) const = default;
 };
 
 struct ResponseTimeoutConfig {
   int sec{5};
   int usec{0};
+
+  bool operator==(const ResponseTimeoutConfig &) const = default;
+};
+
+// Adaptive polling of a Modbus master (the optional `adaptive:` block). The
+// device is polled every minInterval while its power moves by threshold or
+// more between polls, backs off towards its update_interval while it holds
+// steady, and drops to maxInterval while idle: an inverter at night (sun
+// below the site horizon, or without a `site` zero AC output), a meter whose
+// power magnitude is below threshold. min <= update_interval <= max.
+struct AdaptivePollConfig {
+  int minInterval{1};     // seconds
+  int maxInterval{30};    // seconds
+  double threshold{50.0}; // W, on acPowerActive / activePower
+
+  bool operator==(const AdaptivePollConfig &) const = default;
+};
+
+// A simulated Modbus device (the optional `simulate:` block, in place of
+// `tcp`/`rtu`). The master polls an in-process SunSpec server (see
+// SimulatedGateway) on 127.0.0.1:port over Modbus TCP; the devices that name
+// one port share its gateway, and with it one bus. Each reply is held back
+// by latency plus a uniform 0..jitter. `power` is an inverter's AC rating or
+// a meter's peak power; `inputs` and `hybrid` apply to inverters only.
+struct SimulateConfig {
+  int port{15020};
+  int latency{20}; // ms
+  int jitter{0};   // ms
+  double power{5000.0};
+  int phases{3};
+  int inputs{2};
+  bool hybrid{false};
+
+  bool operator==(const SimulateConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -77,6 +122,8 @@ struct MeterSlaveConfig {
   int requestTimeout{5};
   int idleTimeout{60};
   bool useFloatModel{false};
+
+  bool operator==(const MeterSlaveConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -90,7 +137,12 @@ struct InverterConfig {
   int slaveId{1};
   ResponseTimeoutConfig responseTimeout;
   int updateInterval{4};
+  std::optional<AdaptivePollConfig> adaptive;
   ReconnectDelayConfig reconnectDelay;
+  std::optional<SimulateConfig> simulate; // tcp then points at the simulator
+  std::optional<std::string> home;        // cluster node, see ClusterConfig
+
+  bool operator==(const InverterConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -124,7 +176,11 @@ struct FroniusMeterConfig {
   int slaveId{1};
   ResponseTimeoutConfig responseTimeout;
   int updateInterval{4};
+  std::optional<AdaptivePollConfig> adaptive;
   ReconnectDelayConfig reconnectDelay;
+  std::optional<SimulateConfig> simulate; // tcp then points at the simulator
+
+  bool operator==(const FroniusMeterConfig &) const = default;
 };
 
 // Grid assumptions for meters that report only active power (e.g. the EBZ
@@ -134,6 +190,8 @@ struct GridConfig {
   double powerFactor{0.95};
   double frequency{50.0};
   bool isLeading{false};
+
+  bool operator==(const GridConfig &) const = default;
 };
 
 // EBZ Easymeter read passively over a dedicated serial line. Unlike a Fronius
@@ -143,6 +201,8 @@ struct GridConfig {
 struct EasyMeterConfig {
   ModbusRtuConfig rtu;
   GridConfig grid;
+
+  bool operator==(const EasyMeterConfig &) const = default;
 };
 
 // Where a meter sits in the installation, in Fronius terms. It determines what
@@ -167,7 +227,10 @@ struct MeterConfig {
   std::optional<MeterSlaveConfig> slave;
   std::optional<MeterLocation> location;
   bool primary{false};
+  std::optional<std::string> home; // cluster node, see ClusterConfig
   std::variant<FroniusMeterConfig, EasyMeterConfig> body;
+
+  bool operator==(const MeterConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -192,10 +255,84 @@ struct MqttTlsConfig {
   std::optional<std::string> tlsVersion; // e.g. "tlsv1.2", "tlsv1.3"
   std::optional<std::string> ciphers;    // OpenSSL cipher list
   bool insecure{false};                  // skip broker verification (testing)
+
+  bool operator==(const MqttTlsConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// MQTT delta config
+//
+// Optional sub-block of the MQTT section. Present switches every values topic
+// to delta mode: the full document on `.../values` becomes a keyframe,
+// published on the first poll, every `keyframeInterval` seconds and on the
+// first poll after each broker (re)connect. Every other poll publishes only
+// the fields that moved since they were last published, as a sparse document
+// on `.../values/delta` (not retained), or nothing if none did. A field moves
+// when it differs from its last published value by more than the deadband of
+// its quantity, given in the payload's own units (W/VA/var, V, A, kWh); a
+// field without one (power factor, frequency, efficiency, counters) moves on
+// any change of its quantised value. Absent means every poll publishes the
+// full document, as before.
+// ---------------------------------------------------------------------------
+
+struct MqttDeadbandConfig {
+  double power{0.0};   // W, VA, var
+  double voltage{0.0}; // V
+  double current{0.0}; // A
+  double energy{0.0};  // kWh, kVAh, kvarh
+
+  bool operator==(const MqttDeadbandConfig &) const = default;
 };
 
+struct MqttDeltaConfig {
+  int keyframeInterval{60}; // seconds
+  MqttDeadbandConfig deadband;
+
+  bool operator==(const MqttDeltaConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// MQTT publish policy
+//
+// QoS, retain flag and payload encoding of one class of topics. Every class
+// defaults to QoS 1 retained JSON, as the bridge always published, except the
+// delta topics, which are of no use to a late subscriber and default to not
+// retained. Only the values and delta classes may use a binary encoding
+// (CBOR or MessagePack, see binary_writer.h); when any does, the client
+// connects with MQTT v5 and tags each message with its content type.
+// ---------------------------------------------------------------------------
+
+enum class MqttEncoding { Json, Cbor, MsgPack };
+
+struct MqttPublishPolicy {
+  int qos{1};
+  bool retain{true};
+  MqttEncoding encoding{MqttEncoding::Json};
+
+  bool operator==(const MqttPublishPolicy &) const = default;
+};
+
+struct MqttPublishConfig {
+  MqttPublishPolicy values;
+  MqttPublishPolicy delta{1, false};
+  MqttPublishPolicy events;
+  MqttPublishPolicy device;
+  MqttPublishPolicy availability;
+
+  bool operator==(const MqttPublishConfig &) const = default;
+};
+
+// MIME type of an encoding, for the MQTT v5 content-type property.
+const char *contentType(MqttEncoding encoding);
+
 // ---------------------------------------------------------------------------
 // MQTT config
+//
+// `maxInflight` bounds the messages handed to libmosquitto but not yet
+// completed (acknowledged for QoS 1/2, written out for QoS 0). The rest wait
+// in the per-topic queues, where drop-oldest applies, instead of piling up in
+// libmosquitto's own unbounded outgoing list while the broker is slow
+// (1-65535; libmosquitto's send window is set to match).
 // ---------------------------------------------------------------------------
 
 struct MqttConfig {
@@ -207,6 +344,11 @@ struct MqttConfig {
   size_t queueSize{100};
   ReconnectDelayConfig reconnectDelay;
   std::optional<MqttTlsConfig> tls;
+  std::optional<MqttDeltaConfig> delta;
+  MqttPublishConfig publish;
+  size_t maxInflight{20};
+
+  bool operator==(const MqttConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -220,24 +362,79 @@ struct MqttConfig {
 //
 // `dsn` is a standard libpq connection string. `queueSize` bounds the
 // in-memory FIFO of pending writes (drop-oldest on overflow, as for MQTT).
+// `batchSize` caps how many queued events the worker drains into one
+// transaction; `lingerMs` is how long it waits for a partial batch to fill
+// before writing it anyway (0 = write whatever is already queued).
+// `pipeline` sends a batch's value events back to back in libpq pipeline mode,
+// one implicit transaction per event, instead of one multi-row transaction.
+// `spool`, when present, spills value events to disk during an outage (see
+// PostgresSpoolConfig).
 // `autoMigrate` is not parsed from YAML: it defaults to true and is cleared
 // by the CLI `--no-migrate` flag to run schema verification only.
+// `syncRegistry` is not parsed either: loadConfig() clears it when a
+// `cluster:` section hands the roster sync to the cluster leader.
 // ---------------------------------------------------------------------------
 
+// When the outage spool flushes its memory-mapped segments to disk: never
+// (left to kernel writeback), when a segment fills or is closed, or after
+// every appended record.
+enum class SpoolFsync { Never, Segment, Always };
+
+// Optional on-disk overflow for the in-memory queue. Once `highWatermark`
+// events are queued, value events are appended to fixed-record segment files
+// under `dir` instead, up to `maxSizeMb` in total (oldest segment dropped
+// beyond that), and replayed once the database is reachable again.
+struct PostgresSpoolConfig {
+  std::string dir;
+  std::size_t highWatermark{0}; // defaults to queue_size / 2 at parse
+  std::size_t maxSizeMb{64};
+  SpoolFsync fsync{SpoolFsync::Segment};
+
+  bool operator==(const PostgresSpoolConfig &) const = default;
+};
+
 struct PostgresConfig {
   std::string dsn;
   std::size_t queueSize{10000};
+  std::size_t batchSize{100};
+  int lingerMs{0};
+  bool pipeline{false};
+  int migrateConnections{4}; // startup schema migration pool
+  int writers{1};            // connections writing, devices sharded over them
+  std::optional<PostgresSpoolConfig> spool;
   ReconnectDelayConfig reconnectDelay;
   bool autoMigrate{true}; // CLI-controlled (--no-migrate), not parsed
+  bool syncRegistry{true}; // cleared with a cluster section, not parsed
+
+  bool operator==(const PostgresConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
 // Logger config
+//
+// `async` is absent without a `logger.async` section, in which case every
+// message is written by the thread that logs it (see setupLogging()).
 // ---------------------------------------------------------------------------
 
+// What a logging thread does when the async queue is full: drop the oldest
+// queued message, or wait for the writer thread to make room.
+enum class LogOverflow { DropOldest, Block };
+
+// Asynchronous logging: messages queue in `queueSize` preallocated slots for
+// one writer thread.
+struct LoggerAsyncConfig {
+  std::size_t queueSize{8192}; // messages
+  LogOverflow overflow{LogOverflow::DropOldest};
+
+  bool operator==(const LoggerAsyncConfig &) const = default;
+};
+
 struct LoggerConfig {
   spdlog::level::level_enum globalLevel{spdlog::level::info};
   std::map<std::string, spdlog::level::level_enum> moduleLevels;
+  std::optional<LoggerAsyncConfig> async;
+
+  bool operator==(const LoggerConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -257,6 +454,115 @@ struct SiteConfig {
   double latitude{0.0};  // degrees north [-90, 90]; required when site present
   double longitude{0.0}; // degrees east [-180, 180]; required when site present
   double horizon{-0.833}; // sun-centre altitude at sunrise/sunset, in degrees
+
+  bool operator==(const SiteConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Metrics config
+//
+// Address of the Prometheus scrape endpoint. Optional in AppConfig and absent
+// when there is no `metrics:` section, in which case nothing is served; the
+// counters are still recorded, which costs a few relaxed atomic adds per poll.
+// ---------------------------------------------------------------------------
+
+struct MetricsConfig {
+  std::string listen{"0.0.0.0"};
+  int port{9464};
+
+  bool operator==(const MetricsConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Aggregate config
+//
+// Edge pre-aggregation (see EdgeAggregator). Optional in AppConfig and absent
+// when there is no `aggregate:` section, in which case every poll's sample
+// goes out as before. With it, each device's samples are folded into
+// `bucket`-second avg/min/max/last statistics and only the closed buckets are
+// published and written; forwardRaw sends the raw samples as well. The bucket
+// must divide 30 s, so the representative rows fill every 30-second window
+// the power_30sec aggregate and the daily continuity check count.
+// ---------------------------------------------------------------------------
+
+struct AggregateConfig {
+  int bucket{30};         // seconds, a divisor of 30
+  bool forwardRaw{false}; // also publish and write every raw sample
+
+  bool operator==(const AggregateConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Site energy config
+//
+// The streaming whole-site balance (see SiteEnergy). Optional in AppConfig
+// and absent when there is no `site_energy:` section, in which case the site
+// figures come from the SQL rollup alone. With it, the day's running totals
+// are published every `interval` seconds and, with a `postgres:` section,
+// added to the day's public.site_energy row. Needs what the rollup needs: at
+// least one inverter and a primary meter.
+// ---------------------------------------------------------------------------
+
+struct SiteEnergyConfig {
+  int interval{60}; // seconds between publishes / database updates
+
+  bool operator==(const SiteEnergyConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Snapshot config
+//
+// The coalesced site snapshot (see SiteSnapshot). Optional in AppConfig and
+// absent when there is no `snapshot:` section, in which case each device's
+// samples go out on their own. With it, every device's first sample of each
+// `interval`-second tick is gathered into one record, published on
+// `<topic>/site/snapshot` and, with a `postgres:` section, written to
+// public.site_snapshot. The Modbus masters poll on wall-clock multiples of
+// their update_interval, so every one must poll at `interval`, without
+// adaptive polling, for the whole site to be read in the same tick.
+// ---------------------------------------------------------------------------
+
+struct SnapshotConfig {
+  int interval{10}; // seconds, every Modbus master's update_interval
+
+  bool operator==(const SnapshotConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Cluster config
+//
+// Several bridge instances sharing one config file (see ClusterCoordinator).
+// Optional in AppConfig and absent when there is no `cluster:` section, in
+// which case the one instance serves every device. `nodes` names the
+// instances; each device is served by one of them, its `home:` or, without
+// one, a node picked by hashing the device name. `lease` is the coordination
+// period. Requires a `postgres:` section, the database the nodes coordinate
+// through.
+// ---------------------------------------------------------------------------
+
+struct ClusterConfig {
+  std::vector<std::string> nodes;
+  int lease{10};    // seconds
+  std::string node; // this instance, CLI-controlled (--node), not parsed
+
+  bool operator==(const ClusterConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Memory config
+//
+// The low-memory profile for small gateways (see MemoryBudget). Optional in
+// AppConfig and absent when there is no `memory:` section, in which case
+// every queue keeps its own count limit. `budgetKb` bounds the bytes the
+// queues and the slave register tables hold between them; `threadStackKb` is
+// the stack reserved for every thread the bridge starts.
+// ---------------------------------------------------------------------------
+
+struct MemoryConfig {
+  std::size_t budgetKb{4096};
+  std::size_t threadStackKb{256};
+
+  bool operator==(const MemoryConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -301,13 +607,31 @@ std::string busSummaryLine(const std::string &key, const BusInfo &info);
 // site-level SQL can resolve each device's role by name. `location` is the
 // canonical string ('feed-in'/'consumption') or nullopt; the consumer binds it
 // straight into SQL, so the enum is mapped to text here rather than there.
+// An entry with an empty name is a vacant slot (see AppConfig::deviceRegistry).
 struct DeviceRegistryEntry {
   std::string name;                    // device name == its schema name
   std::string kind;                    // "inverter" | "meter"
   std::optional<std::string> location; // "feed-in" | "consumption" | nullopt
   bool primary{false};
+
+  bool vacant() const noexcept { return name.empty(); }
+
+  bool operator==(const DeviceRegistryEntry &) const = default;
 };
 
+// Dense handle for a configured device: its index in AppConfig::deviceRegistry.
+// A device keeps its id for the life of the process, across config reloads
+// (see reloadConfig()), so main wires each master's callbacks with its
+// device's id once, and the consumers index flat per-device tables with it
+// instead of carrying and hashing the name on every sample. The name stays
+// available as deviceRegistry[id].name.
+using DeviceId = std::uint16_t;
+
+// Vacant registry slots loadConfig() adds past the configured devices, the
+// room a reload has for devices added beyond those it removes. The
+// consumers size their per-device tables once, by the registry.
+inline constexpr std::size_t spareDeviceSlots = 8;
+
 // ---------------------------------------------------------------------------
 // Root config
 // ---------------------------------------------------------------------------
@@ -319,6 +643,12 @@ struct AppConfig {
   std::optional<PostgresConfig> postgres;
   LoggerConfig logger;
   std::optional<SiteConfig> site;
+  std::optional<MetricsConfig> metrics;
+  std::optional<AggregateConfig> aggregate;
+  std::optional<SiteEnergyConfig> siteEnergy;
+  std::optional<SnapshotConfig> snapshot;
+  std::optional<ClusterConfig> cluster;
+  std::optional<MemoryConfig> memory;
 
   // Derived, not parsed: the deduplicated bus registry synthesised from
   // `inverters` and `meters` by loadConfig() (there is no [buses] YAML
@@ -326,13 +656,83 @@ struct AppConfig {
   // per entry.
   std::map<std::string, BusInfo> buses;
 
-  // Derived, not parsed: one entry per configured device, in section order,
-  // handed to the PostgreSQL consumer to populate public.device_registry.
+  // Derived, not parsed: the device slots, indexed by DeviceId, handed to the
+  // PostgreSQL consumer to populate public.device_registry. loadConfig() lays
+  // the devices out in section order, inverters first, followed by
+  // spareDeviceSlots vacant entries; a reload keeps the size and moves
+  // devices in and out of the slots.
   std::vector<DeviceRegistryEntry> deviceRegistry;
+  // Derived: the DeviceId of each entry of `inverters` / `meters`.
+  std::vector<DeviceId> inverterIds;
+  std::vector<DeviceId> meterIds;
 };
 
 AppConfig loadConfig(const std::string &path);
 
+// ---------------------------------------------------------------------------
+// Config reload
+//
+// What a reloaded config changes against the running one, for main's SIGHUP
+// handler. Every parsed struct above compares member-wise, so the diff is
+// exact: a reformatted file or a reordered key changes nothing.
+//
+// The logger levels and the devices are applied to a running bridge. A
+// device keeps its DeviceId, matched by name and kind, so the consumers keep
+// their per-device state; a new one takes the lowest slot free, which may be
+// one a removed device left this same reload. main tears down the masters
+// (and slaves) of the removed and rebuilt devices and builds those of the
+// added and rebuilt ones, on the buses already open or on new ones. A device
+// whose changes are limited to update_interval and its adaptive block is
+// retuned instead: its master keeps its connection and polls at the new
+// interval from its next poll. One on a bus whose settings change (the
+// reconnect delay the devices sharing it merge to, the RTU line) is rebuilt
+// with the bus.
+//
+// The other sections are wired into objects built once at startup (the MQTT
+// and PostgreSQL connections, the metrics port bound before the privilege
+// drop, the cluster's node set) and listed in `restartRequired`, one entry
+// each, e.g. "mqtt", "site_energy"; the running values stay in effect.
+// ---------------------------------------------------------------------------
+
+struct ConfigDiff {
+  bool logLevels{false}; // logger.level or logger.modules changed
+  // DeviceIds. A slot given to another device is both removed and added.
+  std::vector<DeviceId> removed; // running's devices gone from the file
+  std::vector<DeviceId> added;   // next's new devices
+  std::vector<DeviceId> rebuilt; // changed, or on a changed bus
+  std::vector<DeviceId> retuned; // only the poll interval changed
+  std::vector<std::string> restartRequired;
+
+  bool devicesChanged() const noexcept {
+    return !removed.empty() || !added.empty() || !rebuilt.empty() ||
+           !retuned.empty();
+  }
+  bool empty() const noexcept {
+    return !logLevels && !devicesChanged() && restartRequired.empty();
+  }
+};
+
+// Turn `next`, freshly loaded, into the config a reload puts in effect, and
+// report what that changes against `running`: next's devices, laid out in
+// running's slots as described above, and running's values of the sections
+// that need a restart. Throws std::runtime_error when the added devices do
+// not fit the free slots, or next's devices do not fit running's sections
+// (e.g. removing the primary meter along with site_energy).
+ConfigDiff reloadConfig(const AppConfig &running, AppConfig &next);
+
+// The DeviceId of cfg.inverters[index] / cfg.meters[index].
+inline DeviceId inverterDeviceId(const AppConfig &cfg, std::size_t index) {
+  return cfg.inverterIds[index];
+}
+inline DeviceId meterDeviceId(const AppConfig &cfg, std::size_t index) {
+  return cfg.meterIds[index];
+}
+
+// The config of device `id`, or nullptr when it is not an inverter / a
+// meter (or the slot is vacant). A linear search, for setup code.
+const InverterConfig *inverterOf(const AppConfig &cfg, DeviceId id);
+const MeterConfig *meterOf(const AppConfig &cfg, DeviceId id);
+
 inline const char *opt_c_str(const std::optional<std::string> &s) {
   return s ? s->c_str() : nullptr;
 }
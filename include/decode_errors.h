@@ -0,0 +1,79 @@
+#ifndef DECODE_ERRORS_H_
+#define DECODE_ERRORS_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <expected>
+#include <format>
+#include <fronius/fronius.h>
+#include <optional>
+#include <string>
+#include <utility>
+
+// ---------------------------------------------------------------------------
+// DecodeErrors — collects the getter failures of one register snapshot decode.
+//
+// The Modbus masters fetch a device's register block once per poll
+// (fetchInverterRegisters(), fetchMeterRegisters()); the libfronius getters
+// then decode fields from that cached snapshot without touching the wire.
+// The masters used to unwrap each getter with ModbusError::getOrThrow, so a
+// single bad field unwound the whole decode through an exception. They now
+// route every getter through take(), which stores the value or records the
+// failure and carries on, and check ok() once at the end: the decode is one
+// straight pass with no exception on the poll path, and a failing poll
+// reports every field that failed rather than only the first.
+//
+// A decode with any failure is still rejected as a whole (the caller returns
+// error() and publishes nothing), so consumers never see a half-filled
+// Values struct. Stack-only and allocation-free until a field fails.
+// ---------------------------------------------------------------------------
+
+class DecodeErrors {
+public:
+  // Store the getter result `r` in `dst`, or record the failure under `field`
+  // (a payload key, for the log) and leave `dst` untouched.
+  template <typename T, typename U>
+  void take(T &dst, std::expected<U, ModbusError> &&r, const char *field) {
+    if (r) {
+      dst = std::move(*r);
+      return;
+    }
+    if (!first_)
+      first_ = std::move(r.error());
+    if (failed_ < fields_.size())
+      fields_[failed_] = field;
+    ++failed_;
+  }
+
+  bool ok() const noexcept { return failed_ == 0; }
+
+  // The first failure, its message extended by the failed fields. Its
+  // severity decides how the master reacts, as for a single getter before.
+  // Only valid when !ok().
+  ModbusError error() const {
+    ModbusError err = *first_;
+    std::string fields;
+    for (std::size_t i = 0; i < std::min(failed_, fields_.size()); ++i) {
+      if (i > 0)
+        fields += ", ";
+      fields += fields_[i];
+    }
+    if (failed_ > fields_.size())
+      fields += ", ...";
+    err.message = std::format("{} ({} {} failed to decode: {})", err.message,
+                              failed_, failed_ == 1 ? "field" : "fields",
+                              fields);
+    return err;
+  }
+
+private:
+  // Field names kept for the message; further failures are only counted.
+  static constexpr std::size_t maxFields = 8;
+
+  std::optional<ModbusError> first_;
+  std::array<const char *, maxFields> fields_{};
+  std::size_t failed_{0};
+};
+
+#endif /* DECODE_ERRORS_H_ */
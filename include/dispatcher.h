@@ -0,0 +1,224 @@
+#ifndef DISPATCHER_H_
+#define DISPATCHER_H_
+
+#include "config_yaml.h"
+#include "edge_aggregator.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include "metrics.h"
+#include "mpsc_ring.h"
+#include "object_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <spdlog/logger.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Sample — one event off a device master, shared read-only by every sink.
+//
+// `payload` is what the master serialised with it: the values document in the
+// values encoding, or the events / device JSON. An availability sample's
+// payload is the state string. Buckets carry no payload; each sink renders
+// what it needs.
+//
+// Samples live in the dispatcher's ObjectPool and are reused, payload buffer
+// and all, so a sink must not keep a reference past consume().
+// ---------------------------------------------------------------------------
+
+struct Sample {
+  struct Availability {};
+
+  DeviceId device{0};
+  std::uint64_t epoch{0}; // the dispatcher's roster epoch when dispatched
+  std::string payload;
+  std::variant<InverterTypes::Values, InverterTypes::Events,
+               InverterTypes::Device, MeterTypes::Values, MeterTypes::Device,
+               Bucket<InverterTypes::Values>, Bucket<MeterTypes::Values>,
+               Availability>
+      data;
+};
+
+// A consumer of the dispatched samples (MQTT, PostgreSQL, a meter slave).
+class Sink {
+public:
+  virtual ~Sink() = default;
+
+  // Called on the sink's own dispatcher thread, one sample at a time in the
+  // order they were dispatched. Samples of devices the sink has no use for
+  // are ignored.
+  virtual void consume(const Sample &sample) = 0;
+
+  // A reload took `device` out of the roster: drop its state. Called on the
+  // sink's thread once it has consumed the device's last sample.
+  virtual void retire(DeviceId /*device*/) {}
+
+  // A reload put `device` into the roster, as `cfg` describes it. Called on
+  // the sink's thread before the device's first sample.
+  virtual void admit(const AppConfig & /*cfg*/, DeviceId /*device*/) {}
+};
+
+// ---------------------------------------------------------------------------
+// Dispatcher — fans the masters' samples out to the sinks.
+//
+// The masters fire their callbacks on a bus's poll thread (or the EBZ reader
+// thread), and that thread used to run every consumer inline: the MQTT
+// serialisation and delta bookkeeping, the PostgreSQL enqueue, and the meter
+// slave's register snapshot copy, so the whole bus waited on the slowest of
+// them. Now attach() points a master's callbacks at dispatch(), which wraps
+// the event into one immutable, ref-counted Sample and pushes a reference to
+// it onto each sink's ring: a copy into a pooled sample, then a couple of
+// atomics per sink, and the poll continues. The masters pass their payload and
+// values by reference, and the pool is sized for the rings, so once every
+// pooled sample has held a payload of its device's size the hand-off
+// allocates nothing; bench/dispatch_bench counts it.
+//
+// Every sink subscribed with subscribe() drains its own ring on its own
+// thread. A ring holds `queueSize` samples and drops the oldest when full,
+// counted per sink; the sinks' own queues (the MQTT topic rings, the
+// PostgreSQL queue and spool) keep their own overflow policies behind it.
+// Since one thread consumes a sink's samples in dispatch order, a device's
+// upsert still reaches PostgreSQL before its values.
+//
+// With an `aggregate:` section the dispatcher is also the edge aggregation
+// stage (see EdgeAggregator): each values sample is folded into its device's
+// bucket, and a closed bucket is dispatched as a sample of its own right
+// after. Only the dispatching master's thread touches a device's aggregator.
+//
+// Metrics per sink: fronius_bridge_dispatch_queue_depth and
+// fronius_bridge_dispatch_dropped_total, labelled `sink`; the samples that
+// found the pool empty: fronius_bridge_pool_misses_total{pool="dispatch"}.
+//
+// A reload changes the roster under running sinks: retire() and admit()
+// bump the roster epoch every sample is stamped with and have each sink's
+// thread call Sink::retire() / Sink::admit() at the first sample stamped
+// after the bump (or once its ring runs dry), so a sink sees a retired
+// device's last sample before its state goes, and an admitted device's state
+// before its first sample.
+//
+// Lifetime: subscribe() every sink before the first dispatch. The sinks must
+// outlive the dispatcher and the dispatcher every attached master. The
+// destructor lets each sink drain what was dispatched, then joins its thread.
+// ---------------------------------------------------------------------------
+
+class Dispatcher {
+public:
+  using SampleRef = ObjectPool<Sample>::Ref;
+
+  // One aggregator slot per registry entry; `aggregate` from AppConfig.
+  // Every sink's ring holds `queueSize` samples, and the pool as many plus
+  // the ones in flight.
+  Dispatcher(const std::vector<DeviceRegistryEntry> &registry,
+             const std::optional<AggregateConfig> &aggregate,
+             std::size_t queueSize);
+  ~Dispatcher();
+
+  // Take `devices` out of every sink, once their samples have been
+  // consumed, and drop their open buckets. Their masters must be gone.
+  // Blocks until every sink is done. Not thread-safe.
+  void retire(const std::vector<DeviceId> &devices);
+
+  // Set `devices` up in every sink as `cfg` describes them, with a bucket
+  // each under `aggregate:`. Call before their masters are attached. Blocks
+  // until every sink is done. Not thread-safe.
+  void admit(const AppConfig &cfg, const std::vector<DeviceId> &devices);
+
+  // Non-copyable, non-movable — owns threads.
+  Dispatcher(const Dispatcher &) = delete;
+  Dispatcher &operator=(const Dispatcher &) = delete;
+  Dispatcher(Dispatcher &&) = delete;
+  Dispatcher &operator=(Dispatcher &&) = delete;
+
+  // Start a thread draining a ring of samples into `sink`. `name` labels the
+  // metrics and log lines. Not thread-safe.
+  void subscribe(const std::string &name, Sink &sink);
+
+  // Point the master's callbacks (an InverterMaster's or a MeterMaster's) at
+  // dispatch() as `device`, and set its values encoding. Not thread-safe.
+  template <typename Master>
+  void attach(Master &master, DeviceId device, MqttEncoding encoding) {
+    auto forward = [this, device](std::string_view payload, const auto &data) {
+      dispatch(device, payload, data);
+    };
+    master.setValueCallback(forward);
+    if constexpr (requires { master.setEventCallback(forward); })
+      master.setEventCallback(forward);
+    master.setDeviceCallback(forward);
+    master.setAvailabilityCallback([this, device](std::string availability) {
+      dispatch(device, availability, Sample::Availability{});
+    });
+    master.setValuesEncoding(encoding);
+  }
+
+  // Hand `device`'s `data` and its `payload` to every sink, copied into a
+  // pooled sample. Thread-safe; never blocks.
+  template <typename Data>
+  void dispatch(DeviceId device, std::string_view payload, const Data &data) {
+    SampleRef sample = samples_.acquire();
+    sample->device = device;
+    sample->epoch = epoch_.load(std::memory_order_acquire);
+    // A quarter of headroom, so a payload a few digits longer than the one
+    // the buffer last held does not reallocate it.
+    if (sample->payload.capacity() < payload.size())
+      sample->payload.reserve(payload.size() + payload.size() / 4);
+    sample->payload.assign(payload);
+    sample->data = data;
+    dispatch(std::move(sample));
+  }
+
+private:
+  static constexpr std::uint64_t noTask =
+      std::numeric_limits<std::uint64_t>::max();
+
+  struct Lane {
+    Lane(const std::string &name, Sink &sink, std::size_t queueSize);
+    const std::string name;
+    Sink &sink;
+    MpscRing<SampleRef> ring;
+    Wakeup wake;
+    Metrics::Registration depthMetric;
+    Metrics::Registration droppedMetric;
+    // A roster change: run `task` at the first sample of epoch `due` or
+    // later, or on running dry; noTask when none is pending.
+    const std::function<void(Sink &)> *task{nullptr};
+    std::atomic<std::uint64_t> due{noTask};
+    std::mutex doneMutex;
+    std::condition_variable done;
+    std::thread worker;
+  };
+
+  void dispatch(SampleRef sample);
+  void push(const SampleRef &sample);
+  void run(Lane &lane);
+  // Run `task` on every sink's thread at the next epoch, and wait for it.
+  void broadcast(const std::function<void(Sink &)> &task);
+  void runTask(Lane &lane);
+
+  std::shared_ptr<spdlog::logger> logger_;
+  const std::size_t queueSize_;
+  // Declared before the lanes, whose rings hold its samples.
+  ObjectPool<Sample> samples_;
+  Metrics::Registration poolMissesMetric_;
+  std::vector<std::unique_ptr<Lane>> lanes_;
+  std::atomic<bool> stop_{false};
+  std::atomic<std::uint64_t> epoch_{0};
+  const std::optional<AggregateConfig> aggregate_;
+
+  // Indexed by DeviceId; empty without an `aggregate:` section and in the
+  // other kind's vector.
+  std::vector<std::optional<EdgeAggregator<InverterTypes::Values>>>
+      inverterBuckets_;
+  std::vector<std::optional<EdgeAggregator<MeterTypes::Values>>> meterBuckets_;
+};
+
+#endif /* DISPATCHER_H_ */
@@ -5,14 +5,18 @@
 #include "config_yaml.h"
 #include "meter_master.h"
 #include "meter_types.h"
+#include "metrics.h"
 #include "signal_handler.h"
+#include <array>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <expected>
 #include <fronius/fronius.h>
 #include <memory>
-#include <nlohmann/json.hpp>
 #include <spdlog/logger.h>
 #include <string>
+#include <string_view>
 #include <thread>
 
 // ---------------------------------------------------------------------------
@@ -48,6 +52,13 @@ public:
   static constexpr size_t BUFFER_SIZE = 64;
   static constexpr size_t TELEGRAM_SIZE = 368;
 
+  // Decodes one complete telegram, `text`, into `values`: the OBIS readings
+  // plus what `grid` derives from them. Leaves the time alone and does not
+  // round; the reader thread and fronius-bridge-bench's replay share it.
+  static std::expected<void, ModbusError>
+  decodeTelegram(std::string_view text, const GridConfig &grid,
+                 MeterTypes::Values &values);
+
 private:
   void runLoop();
   MeterTypes::ErrorAction
@@ -55,6 +66,9 @@ private:
   void disconnect(void);
   std::expected<void, ModbusError> tryConnect(void);
   std::expected<void, ModbusError> readTelegram(void);
+  std::string_view telegram() const noexcept {
+    return {telegram_.data(), telegramLen_};
+  }
   std::expected<void, ModbusError> updateValuesAndJson(void);
   std::expected<void, ModbusError> updateDeviceAndJson(void);
 
@@ -67,17 +81,39 @@ private:
 
   MeterTypes::Values values_;
   MeterTypes::Device device_;
-  std::string telegram_;
-  nlohmann::ordered_json jsonValues_;
-  nlohmann::json jsonDevice_;
+  // Serialised payloads (see payloads.h), rewritten in place under cbMutex_
+  // so their capacity carries over from one update to the next. jsonValues_
+  // is in valuesEncoding_, which need not be JSON.
+  std::string jsonValues_;
+  std::string jsonDevice_;
   std::shared_ptr<spdlog::logger> logger_;
+  // Time spent parsing each telegram into device and values.
+  Metrics::Histogram &parseDuration_;
   int serialPort_{-1};
 
+  // --- serial stream ---
+  // Fixed buffers owned by the worker, reused for every telegram so the read
+  // and parse path never allocates. rx_ holds the last read() chunk; bytes
+  // past the end of one telegram stay in it (rxPos_ < rxLen_) and start the
+  // next one instead of being dropped. telegram_ holds the last complete
+  // telegram, which the update methods scan in place through telegram().
+  // Only runLoop's thread touches these, so they need no lock.
+  std::array<char, BUFFER_SIZE> rx_{};
+  std::size_t rxPos_{0};
+  std::size_t rxLen_{0};
+  std::array<char, TELEGRAM_SIZE> telegram_{};
+  std::size_t telegramLen_{0};
+
   // --- threading ---
   // The value/device/availability callbacks and the mutex guarding them
   // (cbMutex_) live in the MeterMaster base; this master reads/fires them
   // under that mutex from runLoop.
+  // stop_ ends runLoop when the meter is destroyed before shutdown (a
+  // reload that drops or rebuilds it); set under cbMutex_ so the wait in
+  // disconnect() cannot miss it.
+  bool running() const noexcept { return handler_.isRunning() && !stop_; }
   SignalHandler &handler_;
+  std::atomic<bool> stop_{false};
   std::condition_variable cv_;
   std::thread worker_;
 
@@ -0,0 +1,230 @@
+#ifndef EDGE_AGGREGATOR_H_
+#define EDGE_AGGREGATOR_H_
+
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+// ---------------------------------------------------------------------------
+// EdgeAggregator — per-bucket statistics of one device's values, in-bridge.
+//
+// The TimescaleDB power_30sec / power_5min aggregates are computed
+// server-side from the raw samples, so every poll's sample has to reach the
+// database. On a metered uplink (LTE) the bridge can instead poll fast
+// locally and ship only the statistics: with an `aggregate:` section (see
+// AggregateConfig) main feeds each device's values through an aggregator,
+// which folds them into the running sum, minimum, maximum and last value of
+// every field of the current bucket and hands out the closed bucket once a
+// sample falls into a later one. Buckets are aligned to multiples of the
+// width since the epoch, like the time_bucket() windows of the aggregates.
+// Memory is four Values structs per device, whatever the poll rate.
+//
+// A bucket closes with the first sample past it, so it goes out at most one
+// poll late; a device that stops reporting keeps its last bucket until it
+// reports again, and the open bucket is lost on shutdown.
+//
+// The energy counters are aggregated like every other field; sample() builds
+// the one row per bucket that stands in for the raw samples in the database,
+// with the bucket averages and the counters' last readings.
+//
+// Not thread-safe: owned by one device's value callback, which runs on the
+// device master's poll (or reader) thread only.
+// ---------------------------------------------------------------------------
+
+// One closed bucket. The time of avg, min and max is the bucket start; last
+// is the bucket's last sample as read.
+template <typename Values> struct Bucket {
+  std::uint64_t start{0}; // ms since the epoch
+  int width{0};           // seconds
+  int samples{0};
+  Values avg;
+  Values min;
+  Values max;
+  Values last;
+};
+
+// A bucket's active power envelope: the row of the device's power_edge table
+// (migration 005), next to the averages the power_30sec / power_5min
+// aggregates compute from the sample() rows. Plain data, so the PostgreSQL
+// spool stores it like a Values struct.
+struct PowerBucket {
+  std::uint64_t start{0}; // ms since the epoch
+  int width{0};           // seconds
+  int samples{0};
+  double avg{0.0}; // W
+  double min{0.0};
+  double max{0.0};
+  double last{0.0};
+};
+
+namespace Edge {
+
+// Apply `f(dst.x, src.x)` to every aggregated field: all the measurements,
+// but not time and interval.
+template <typename F>
+void forEachField(InverterTypes::Phase &dst, const InverterTypes::Phase &src,
+                  F &&f) {
+  f(dst.acVoltage, src.acVoltage);
+  f(dst.acCurrent, src.acCurrent);
+}
+
+template <typename F>
+void forEachField(InverterTypes::Input &dst, const InverterTypes::Input &src,
+                  F &&f) {
+  f(dst.dcVoltage, src.dcVoltage);
+  f(dst.dcCurrent, src.dcCurrent);
+  f(dst.dcPower, src.dcPower);
+  f(dst.dcEnergy, src.dcEnergy);
+}
+
+template <typename F>
+void forEachField(InverterTypes::Values &dst, const InverterTypes::Values &src,
+                  F &&f) {
+  f(dst.acEnergy, src.acEnergy);
+  f(dst.acPowerActive, src.acPowerActive);
+  f(dst.acPowerApparent, src.acPowerApparent);
+  f(dst.acPowerReactive, src.acPowerReactive);
+  f(dst.acPowerFactor, src.acPowerFactor);
+  forEachField(dst.phase1, src.phase1, f);
+  forEachField(dst.phase2, src.phase2, f);
+  forEachField(dst.phase3, src.phase3, f);
+  f(dst.acFrequency, src.acFrequency);
+  f(dst.dcPower, src.dcPower);
+  f(dst.efficiency, src.efficiency);
+  forEachField(dst.input1, src.input1, f);
+  forEachField(dst.input2, src.input2, f);
+}
+
+template <typename F>
+void forEachField(MeterTypes::Phase &dst, const MeterTypes::Phase &src,
+                  F &&f) {
+  f(dst.phVoltage, src.phVoltage);
+  f(dst.ppVoltage, src.ppVoltage);
+  f(dst.current, src.current);
+  f(dst.activePower, src.activePower);
+  f(dst.reactivePower, src.reactivePower);
+  f(dst.apparentPower, src.apparentPower);
+  f(dst.powerFactor, src.powerFactor);
+}
+
+template <typename F>
+void forEachField(MeterTypes::Values &dst, const MeterTypes::Values &src,
+                  F &&f) {
+  f(dst.activeEnergyImport, src.activeEnergyImport);
+  f(dst.activeEnergyExport, src.activeEnergyExport);
+  f(dst.reactiveEnergyImport, src.reactiveEnergyImport);
+  f(dst.reactiveEnergyExport, src.reactiveEnergyExport);
+  f(dst.apparentEnergyImport, src.apparentEnergyImport);
+  f(dst.apparentEnergyExport, src.apparentEnergyExport);
+  f(dst.phVoltage, src.phVoltage);
+  f(dst.ppVoltage, src.ppVoltage);
+  f(dst.current, src.current);
+  f(dst.activePower, src.activePower);
+  f(dst.reactivePower, src.reactivePower);
+  f(dst.apparentPower, src.apparentPower);
+  f(dst.powerFactor, src.powerFactor);
+  f(dst.frequency, src.frequency);
+  forEachField(dst.phase1, src.phase1, f);
+  forEachField(dst.phase2, src.phase2, f);
+  forEachField(dst.phase3, src.phase3, f);
+}
+
+// The database row standing in for a bucket's raw samples: the averages,
+// stamped with the bucket start, with the monotonic counters at their last
+// reading so the daily rollups still see first and last counter values.
+inline InverterTypes::Values sample(const Bucket<InverterTypes::Values> &b) {
+  InverterTypes::Values v = b.avg;
+  v.acEnergy = b.last.acEnergy;
+  v.input1.dcEnergy = b.last.input1.dcEnergy;
+  v.input2.dcEnergy = b.last.input2.dcEnergy;
+  return v;
+}
+
+inline MeterTypes::Values sample(const Bucket<MeterTypes::Values> &b) {
+  MeterTypes::Values v = b.avg;
+  v.activeEnergyImport = b.last.activeEnergyImport;
+  v.activeEnergyExport = b.last.activeEnergyExport;
+  v.reactiveEnergyImport = b.last.reactiveEnergyImport;
+  v.reactiveEnergyExport = b.last.reactiveEnergyExport;
+  v.apparentEnergyImport = b.last.apparentEnergyImport;
+  v.apparentEnergyExport = b.last.apparentEnergyExport;
+  return v;
+}
+
+// The total AC (inverter) or active (meter) power envelope of a bucket.
+inline PowerBucket power(const Bucket<InverterTypes::Values> &b) {
+  return {.start = b.start,
+          .width = b.width,
+          .samples = b.samples,
+          .avg = b.avg.acPowerActive,
+          .min = b.min.acPowerActive,
+          .max = b.max.acPowerActive,
+          .last = b.last.acPowerActive};
+}
+
+inline PowerBucket power(const Bucket<MeterTypes::Values> &b) {
+  return {.start = b.start,
+          .width = b.width,
+          .samples = b.samples,
+          .avg = b.avg.activePower,
+          .min = b.min.activePower,
+          .max = b.max.activePower,
+          .last = b.last.activePower};
+}
+
+} // namespace Edge
+
+template <typename Values> class EdgeAggregator {
+public:
+  // `width` in seconds, from AggregateConfig::bucket.
+  explicit EdgeAggregator(int width) : width_(width) {}
+
+  // Fold `v` (already quantised) into its bucket. Returns the previous
+  // bucket if `v` is the first sample past it.
+  std::optional<Bucket<Values>> add(const Values &v) {
+    const std::uint64_t widthMs = static_cast<std::uint64_t>(width_) * 1000;
+    const std::uint64_t start = v.time / widthMs * widthMs;
+
+    std::optional<Bucket<Values>> closed;
+    if (cur_.samples > 0 && start != cur_.start)
+      closed = close();
+
+    if (cur_.samples == 0) {
+      cur_.start = start;
+      cur_.width = width_;
+      cur_.avg = cur_.min = cur_.max = v;
+    } else {
+      Edge::forEachField(cur_.avg, v, [](double &sum, double x) { sum += x; });
+      Edge::forEachField(cur_.min, v,
+                         [](double &lo, double x) { lo = std::min(lo, x); });
+      Edge::forEachField(cur_.max, v,
+                         [](double &hi, double x) { hi = std::max(hi, x); });
+    }
+    cur_.last = v;
+    ++cur_.samples;
+    return closed;
+  }
+
+private:
+  // Turn the running sums into averages and hand the bucket out.
+  Bucket<Values> close() {
+    Bucket<Values> b = cur_;
+    const double n = static_cast<double>(b.samples);
+    Edge::forEachField(b.avg, cur_.avg,
+                       [n](double &avg, double sum) { avg = sum / n; });
+    b.avg.round();
+    for (Values *v : {&b.avg, &b.min, &b.max}) {
+      v->time = b.start;
+      v->interval = 0;
+    }
+    cur_.samples = 0;
+    return b;
+  }
+
+  const int width_;
+  Bucket<Values> cur_; // avg holds the running sums until close()
+};
+
+#endif /* EDGE_AGGREGATOR_H_ */
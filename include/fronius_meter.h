@@ -1,28 +1,34 @@
 #ifndef FRONIUS_METER_H_
 #define FRONIUS_METER_H_
 
+#include "adaptive_interval.h"
+#include "bus_scheduler.h"
 #include "change_gate.h"
 #include "config_yaml.h"
 #include "meter_master.h"
 #include "meter_types.h"
+#include "metrics.h"
 #include "signal_handler.h"
 #include <atomic>
-#include <condition_variable>
 #include <expected>
 #include <fronius/fronius.h>
 #include <memory>
-#include <nlohmann/json.hpp>
+#include <optional>
 #include <spdlog/logger.h>
-#include <thread>
+#include <string>
 
 class FroniusMeter : public MeterMaster {
 public:
+  // Polls on `scheduler`, the BusScheduler of `bus`, which must outlive the
+  // master.
   explicit FroniusMeter(const MeterConfig &cfg, SignalHandler &signalHandler,
-                        std::shared_ptr<FroniusBus> bus);
+                        std::shared_ptr<FroniusBus> bus,
+                        BusScheduler &scheduler);
   ~FroniusMeter() override;
 
-  // Non-copyable, non-movable — owns a thread. (Also deleted in the base,
-  // restated here for clarity at the concrete type.)
+  // Non-copyable, non-movable — the scheduler and bus callbacks hold `this`.
+  // (Also deleted in the base, restated here for clarity at the concrete
+  // type.)
   FroniusMeter(const FroniusMeter &) = delete;
   FroniusMeter &operator=(const FroniusMeter &) = delete;
   FroniusMeter(FroniusMeter &&) = delete;
@@ -33,14 +39,29 @@ public:
 
   std::expected<void, ModbusError> updateValuesAndJson(void);
   // Returns true if the device identity was read on this call and differs
-  // from what was last emitted (so runLoop should publish it), false if the
+  // from what was last emitted (so poll() should publish it), false if the
   // identity was already read and is unchanged. The meter is read over Modbus,
   // so identity is read once and skipped thereafter.
   std::expected<bool, ModbusError> updateDeviceAndJson(void);
 
+  // Made active again, the meter first publishes its availability.
+  void setActive(bool active) override;
+  // Taken at the next poll, which returns the new interval to the scheduler.
+  void setUpdateInterval(
+      int updateInterval,
+      const std::optional<AdaptivePollConfig> &adaptive) override;
+  // Bring up a meter a reload added to a bus that is connected already,
+  // which does not validate devices registered after connect(). Call once
+  // the callbacks are wired.
+  void connectLate();
+
 private:
   static ModbusDeviceConfig makeDeviceConfig(const FroniusMeterConfig &cfg);
-  void runLoop();
+  // One poll cycle (device, values), run by the bus scheduler. Returns the
+  // interval to the next one; returns at once while the meter is not
+  // connected. An adaptive meter is idle while its power magnitude is below
+  // the threshold.
+  std::chrono::seconds poll();
 
   std::shared_ptr<FroniusBus> bus_;
   std::shared_ptr<Meter> meter_;
@@ -51,6 +72,8 @@ private:
   const MeterConfig cfg_;
   const FroniusMeterConfig fcfg_;
   std::shared_ptr<spdlog::logger> logger_;
+  // Duration of each connected poll cycle (device, values).
+  Metrics::Histogram &pollDuration_;
 
   // Bus-level callback IDs registered by this master. The destructor
   // removes them before tearing down state captured by their lambdas
@@ -61,17 +84,25 @@ private:
   // --- values and device info ---
   MeterTypes::Device device_;
   MeterTypes::Values values_;
-  nlohmann::ordered_json jsonValues_;
-  nlohmann::json jsonDevice_;
+  // Serialised payloads (see payloads.h), rewritten in place under cbMutex_
+  // so their capacity carries over from one update to the next. jsonValues_
+  // is in valuesEncoding_, which need not be JSON.
+  std::string jsonValues_;
+  std::string jsonDevice_;
 
   // --- threading ---
   // The value/device/availability callbacks and the mutex guarding them
   // (cbMutex_) live in the MeterMaster base; this master reads them under
-  // that mutex from runLoop and the bus/device callbacks.
+  // that mutex from poll() and the bus/device callbacks.
   SignalHandler &handler_;
-  std::thread worker_;
+  BusScheduler &scheduler_;
+  BusScheduler::Id scheduleId_{0};
+  // Touched only from poll(). retune_ is setUpdateInterval()'s, under
+  // cbMutex_, with retuned_ set until poll() takes it.
+  AdaptiveInterval interval_;
+  std::optional<AdaptiveInterval> retune_;
+  std::atomic<bool> retuned_{false};
   std::atomic<bool> connected_{false};
-  std::condition_variable cv_;
 
   // Emits the device callback only when the identity actually changes. The
   // meter is read over Modbus, so identity is read once (hasValue() guards the
@@ -1,29 +1,39 @@
 #ifndef INVERTER_MASTER_H_
 #define INVERTER_MASTER_H_
 
+#include "adaptive_interval.h"
+#include "bus_scheduler.h"
 #include "change_gate.h"
 #include "config_yaml.h"
 #include "inverter_types.h"
+#include "metrics.h"
 #include "signal_handler.h"
 #include <atomic>
-#include <condition_variable>
 #include <expected>
 #include <fronius/fronius.h>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <nlohmann/json.hpp>
+#include <optional>
 #include <spdlog/logger.h>
-#include <thread>
+#include <string>
+#include <string_view>
+
+class CaptureWriter;
 
 class InverterMaster {
 public:
+  // Polls on `scheduler`, the BusScheduler of `bus`, which must outlive the
+  // master. `site`, when configured, tells an adaptive inverter when it is
+  // night.
   explicit InverterMaster(const InverterConfig &cfg,
                           SignalHandler &signalHandler,
-                          std::shared_ptr<FroniusBus> bus);
+                          std::shared_ptr<FroniusBus> bus,
+                          BusScheduler &scheduler,
+                          const std::optional<SiteConfig> &site);
   virtual ~InverterMaster();
 
-  // Non-copyable, non-movable — owns a thread.
+  // Non-copyable, non-movable — the scheduler and bus callbacks hold `this`.
   InverterMaster(const InverterMaster &) = delete;
   InverterMaster &operator=(const InverterMaster &) = delete;
   InverterMaster(InverterMaster &&) = delete;
@@ -37,33 +47,68 @@ public:
   std::expected<void, ModbusError> updateValuesAndJson(void);
   std::expected<bool, ModbusError> updateEventsAndJson(void);
   // Returns true if the device identity was read on this call and differs
-  // from what was last emitted (so runLoop should publish it), false if the
+  // from what was last emitted (so poll() should publish it), false if the
   // identity was already read and is unchanged. The inverter is read over
   // Modbus, so identity is read once and skipped thereafter.
   std::expected<bool, ModbusError> updateDeviceAndJson(void);
 
-  void
-  setValueCallback(std::function<void(std::string, InverterTypes::Values)> cb);
-  void
-  setEventCallback(std::function<void(std::string, InverterTypes::Events)> cb);
-  void
-  setDeviceCallback(std::function<void(std::string, InverterTypes::Device)> cb);
+  // The callbacks get the master's own payload and data by reference, valid
+  // for the call only: a consumer copies what it keeps, into a buffer of its
+  // own choosing, and nothing is copied for a consumer not wired up.
+  using ValueCallback =
+      std::function<void(std::string_view, const InverterTypes::Values &)>;
+  using EventCallback =
+      std::function<void(std::string_view, const InverterTypes::Events &)>;
+  using DeviceCallback =
+      std::function<void(std::string_view, const InverterTypes::Device &)>;
+
+  void setValueCallback(ValueCallback cb);
+  void setEventCallback(EventCallback cb);
+  void setDeviceCallback(DeviceCallback cb);
   void setAvailabilityCallback(std::function<void(std::string)> cb);
+  // Encoding of the value callback's payload (mqtt.publish.values).
+  void setValuesEncoding(MqttEncoding encoding);
+  // Record the inverter's decoded inputs to `capture` (--capture) as
+  // `device`. Call before the bus connects.
+  void setCapture(CaptureWriter *capture, DeviceId device);
+  // Whether this instance serves the inverter (see ClusterCoordinator). An
+  // inactive master stays on its bus but skips its polls and publishes
+  // nothing; made active again, it first publishes its availability. Starts
+  // active. Thread-safe.
+  void setActive(bool active);
+  // A reload's update_interval and `adaptive:` block, taken at the next
+  // poll, which returns the new interval to the scheduler. Thread-safe.
+  void setUpdateInterval(int updateInterval,
+                         const std::optional<AdaptivePollConfig> &adaptive);
+  // Bring up an inverter a reload added to a bus that is connected already,
+  // which does not validate devices registered after connect(). Call once
+  // the callbacks are wired.
+  void connectLate();
 
 private:
   static ModbusDeviceConfig makeDeviceConfig(const InverterConfig &cfg);
-  void runLoop();
+  // One poll cycle (device, values, events), run by the bus scheduler.
+  // Returns the interval to the next one; returns at once while the inverter
+  // is not connected.
+  std::chrono::seconds poll();
+  // Whether the adaptive interval should drop to max_interval: the sun is
+  // below the site horizon, or without a site the inverter reports no AC
+  // output.
+  bool idle(const InverterTypes::Values &values) const;
 
   // Publish an availability state ("connected"/"disconnected")
   // through the gate, so each distinct state is emitted once on transition.
-  // Thread-safe; called from the bus callbacks and runLoop.
+  // Thread-safe; called from the bus callbacks and poll().
   void publishAvailability(std::string state);
 
   std::shared_ptr<FroniusBus> bus_;
   std::shared_ptr<Inverter> inverter_;
   // Held by value: AppConfig's std::vector<InverterConfig> may reallocate.
   const InverterConfig cfg_;
+  const std::optional<SiteConfig> site_;
   std::shared_ptr<spdlog::logger> logger_;
+  // Duration of each connected poll cycle (device, values, events).
+  Metrics::Histogram &pollDuration_;
 
   // Bus-level callback IDs registered by this master. The destructor
   // removes them before tearing down state captured by their lambdas
@@ -75,20 +120,32 @@ private:
   InverterTypes::Device device_;
   InverterTypes::Values values_;
   InverterTypes::Events events_;
-  nlohmann::ordered_json jsonValues_;
-  nlohmann::ordered_json jsonEvents_;
-  nlohmann::json jsonDevice_;
+  // Serialised payloads (see payloads.h), rewritten in place under cbMutex_
+  // so their capacity carries over from one poll to the next. jsonValues_ is
+  // in valuesEncoding_, which need not be JSON.
+  std::string jsonValues_;
+  std::string jsonEvents_;
+  std::string jsonDevice_;
 
   // --- threading / callbacks ---
-  std::function<void(std::string, InverterTypes::Values)> valueCallback_;
-  std::function<void(std::string, InverterTypes::Events)> eventCallback_;
-  std::function<void(std::string, InverterTypes::Device)> deviceCallback_;
+  ValueCallback valueCallback_;
+  EventCallback eventCallback_;
+  DeviceCallback deviceCallback_;
   std::function<void(std::string)> availabilityCallback_;
+  MqttEncoding valuesEncoding_{MqttEncoding::Json};
+  CaptureWriter *capture_{nullptr};
+  DeviceId captureDevice_{0};
   SignalHandler &handler_;
   mutable std::mutex cbMutex_;
-  std::thread worker_;
+  BusScheduler &scheduler_;
+  BusScheduler::Id scheduleId_{0};
+  // Touched only from poll(). retune_ is setUpdateInterval()'s, under
+  // cbMutex_, with retuned_ set until poll() takes it.
+  AdaptiveInterval interval_;
+  std::optional<AdaptiveInterval> retune_;
+  std::atomic<bool> retuned_{false};
   std::atomic<bool> connected_{false};
-  std::condition_variable cv_;
+  std::atomic<bool> active_{true};
 
   // --- change gates
   ChangeGate<InverterTypes::Events> eventsGate_;
@@ -36,6 +36,9 @@ struct InverterTypes {
 
   struct Values {
     uint64_t time{0};
+    // Seconds since the previous poll in adaptive mode (AdaptiveInterval),
+    // 0 at a fixed update_interval, where it is not published.
+    int interval{0};
     double acEnergy{0.0};
     double acPowerActive{0.0};
     double acPowerApparent{0.0};
@@ -0,0 +1,190 @@
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#include "utils.h"
+#include <concepts>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Json — append-only writer for the MQTT payloads, and the field descriptors
+// that describe them.
+//
+// The masters used to build an nlohmann::ordered_json tree for every poll and
+// dump() it, which costs an allocation per node and per key. The payloads are
+// flat, with a fixed set of fields, so Payload (payloads.h) instead describes
+// each struct as a constexpr tuple of Field descriptors (key, member pointer,
+// precision) and writes it straight into a caller-owned std::string. The
+// caller keeps that string across polls; Writer clears it without releasing
+// its capacity, so after the first poll nothing is allocated.
+//
+// Output is the compact form nlohmann's dump() produced, byte for byte:
+//
+//   - no whitespace; keys in the order written;
+//   - doubles in the shortest form that reads back to the same value, always
+//     with a fraction or exponent ("230.0", "0.001", "1e+15"), and null for
+//     NaN and infinities;
+//   - strings with '"', '\' and control characters escaped, the latter as
+//     \b \f \n \r \t or lowercase \u00XX. Other bytes are copied verbatim
+//     (dump() would have thrown on invalid UTF-8 instead).
+//
+// A double with a known precision (a Values field quantised by round()) is
+// formatted in fixed notation with that many decimals and trailing zeros
+// trimmed, which is exactly its shortest form and skips the digit search.
+// ---------------------------------------------------------------------------
+
+namespace Json {
+
+class Writer {
+public:
+  // Clears `out` (keeping its capacity) and appends to it.
+  explicit Writer(std::string &out) : out_(out) { out_.clear(); }
+
+  void beginObject() { open('{'); }
+  void endObject() { close('}'); }
+  void beginArray() { open('['); }
+  void endArray() { close(']'); }
+
+  // Object key; the next value belongs to it.
+  void key(std::string_view k);
+
+  // `decimals` is the precision the value was quantised to, or -1 if it was
+  // not quantised.
+  void number(double v, int decimals = -1);
+  void value(std::uint64_t v);
+  void value(int v);
+  void value(bool v);
+  void value(std::string_view v);
+  void value(const std::string &v) { value(std::string_view(v)); }
+  void value(const std::vector<std::string> &v);
+
+private:
+  // Comma before any value but the first in its container or one after a key.
+  void separate();
+  void open(char c) {
+    separate();
+    out_ += c;
+    first_ = true;
+  }
+  void close(char c) {
+    out_ += c;
+    first_ = false;
+  }
+  void shortest(double v);
+  void escaped(std::string_view s);
+
+  std::string &out_;
+  bool first_{true};
+  bool afterKey_{false};
+};
+
+// What a double measures, for the deadbands of the MQTT delta mode
+// (MqttDeltaConfig). None is compared exactly.
+enum class Quantity { None, Power, Voltage, Current, Energy };
+
+// One serialised member of T. A double member carries its quantised precision,
+// its quantity and whether it is scaled from Wh to kWh on the way out
+// (Utils::scaleToKilo, which adds three decimals).
+template <typename T, typename M> struct Field {
+  std::string_view key;
+  M T::*member;
+  int decimals{-1};
+  bool kilo{false};
+  Quantity quantity{Quantity::None};
+};
+
+template <typename T, typename M>
+constexpr Field<T, M> field(std::string_view key, M T::*member) {
+  return {key, member};
+}
+
+template <typename T>
+constexpr Field<T, double> number(std::string_view key, double T::*member,
+                                  int decimals,
+                                  Quantity quantity = Quantity::None) {
+  return {key, member, decimals, false, quantity};
+}
+
+// A Wh member rounded to whole Wh, written in kWh with three decimals.
+template <typename T>
+constexpr Field<T, double> kilo(std::string_view key, double T::*member) {
+  return {key, member, 3, true, Quantity::Energy};
+}
+
+// The value of double field `f` of `obj` as it is written.
+template <typename T>
+double written(const T &obj, const Field<T, double> &f) {
+  const double v = obj.*(f.member);
+  return f.kilo ? Utils::scaleToKilo(v) : v;
+}
+
+// Whether field `f` moved from `last` to `obj`: a double by more than its
+// deadband `band(f.quantity)` in written units, anything else by changing.
+template <typename T, typename M, typename Band>
+bool moved(const T &obj, const T &last, const Field<T, M> &f, Band &&band) {
+  if constexpr (std::same_as<M, double>) {
+    const double d = written(obj, f) - written(last, f);
+    return (d < 0 ? -d : d) > band(f.quantity);
+  } else {
+    return obj.*(f.member) != last.*(f.member);
+  }
+}
+
+// Write `obj`'s members as listed in `fields`, as key/value pairs of the
+// currently open object. `W` is Writer or any writer with its interface
+// (Binary::Writer), so one descriptor tuple serves every encoding.
+template <typename W, typename T, typename... Fs>
+void writeFields(W &w, const T &obj, const std::tuple<Fs...> &fields) {
+  std::apply(
+      [&](const auto &...f) {
+        (
+            [&] {
+              w.key(f.key);
+              const auto &v = obj.*(f.member);
+              using V = std::remove_cvref_t<decltype(v)>;
+              if constexpr (std::same_as<V, double>)
+                w.number(written(obj, f), f.decimals);
+              else
+                w.value(v);
+            }(),
+            ...);
+      },
+      fields);
+}
+
+// Whether any of `fields` moved from `last` to `obj` (see moved()).
+template <typename T, typename... Fs, typename Band>
+bool anyMoved(const T &obj, const T &last, const std::tuple<Fs...> &fields,
+              Band &&band) {
+  return std::apply(
+      [&](const auto &...f) { return (moved(obj, last, f, band) || ...); },
+      fields);
+}
+
+// writeFields() restricted to the fields that moved from `last`, which are
+// then copied into `last`: the baseline a field is compared against is the
+// value last written, so a slow drift is still published once it adds up.
+template <typename W, typename T, typename... Fs, typename Band>
+void writeMovedFields(W &w, const T &obj, T &last,
+                      const std::tuple<Fs...> &fields, Band &&band) {
+  std::apply(
+      [&](const auto &...f) {
+        (
+            [&] {
+              if (!moved(obj, last, f, band))
+                return;
+              writeFields(w, obj, std::tuple{f});
+              last.*(f.member) = obj.*(f.member);
+            }(),
+            ...);
+      },
+      fields);
+}
+
+} // namespace Json
+
+#endif /* JSON_WRITER_H_ */
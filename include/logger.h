@@ -2,21 +2,64 @@
 #define LOGGER_H_
 
 #include "config_yaml.h"
+#include "metrics.h"
+#include <memory>
+#include <spdlog/async.h>
+#include <spdlog/async_logger.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
 
-inline void setupLogging(const LoggerConfig &cfg) {
+// ---------------------------------------------------------------------------
+// Logging setup: the default logger and one logger per configured module,
+// all writing to one sink, the console unless the caller passes another.
+//
+// By default a message is formatted and written out by the thread that logs
+// it, under the sink's mutex, so a slow console (a terminal, a journald pipe
+// under back-pressure) holds up a poll or dispatcher thread logging at debug.
+// With `logger.async` (LoggerAsyncConfig) every logger only formats the
+// message text into a slot of a bounded queue, allocated up front, and one
+// spdlog writer thread applies the pattern and writes it to the sink. A full
+// queue drops its oldest message, or with overflow `block` makes the logging
+// thread wait; fronius_bridge_log_dropped_total counts the dropped ones. The
+// queue drains when spdlog's registry is destroyed at exit; a crash loses
+// what it still holds. A text longer than a slot's inline buffer (250 bytes,
+// e.g. a JSON values payload at debug) still allocates.
+//
+// Either way a message below its logger's level costs only the level check:
+// spdlog tests it before formatting. Its arguments are still evaluated, so
+// the debug and trace sites on per-sample paths whose arguments take work to
+// compute are guarded with should_log().
+// ---------------------------------------------------------------------------
+
+inline void setupLogging(const LoggerConfig &cfg,
+                         spdlog::sink_ptr sink = nullptr) {
   // single console sink
-  auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+  if (!sink)
+    sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+
+  if (cfg.async)
+    spdlog::init_thread_pool(cfg.async->queueSize, 1);
+  auto make = [&](const std::string &name) -> std::shared_ptr<spdlog::logger> {
+    if (!cfg.async)
+      return std::make_shared<spdlog::logger>(name, sink);
+    const auto overflow = cfg.async->overflow == LogOverflow::Block
+                              ? spdlog::async_overflow_policy::block
+                              : spdlog::async_overflow_policy::overrun_oldest;
+    return std::make_shared<spdlog::async_logger>(name, sink,
+                                                  spdlog::thread_pool(),
+                                                  overflow);
+  };
 
   // default/global logger
-  auto defaultLogger = std::make_shared<spdlog::logger>("", sink);
+  auto defaultLogger = make("");
   defaultLogger->set_level(cfg.globalLevel);
   spdlog::set_default_logger(defaultLogger);
 
   // per-module loggers
   for (const auto &kv : cfg.moduleLevels) {
-    auto logger = std::make_shared<spdlog::logger>(kv.first, sink);
+    auto logger = make(kv.first);
     logger->set_level(kv.second);
     spdlog::register_logger(logger);
   }
@@ -25,4 +68,37 @@ inline void setupLogging(const LoggerConfig &cfg) {
   spdlog::set_pattern("[%H:%M:%S.%e] [%n] [%^%l%$] %v");
 }
 
+// Apply a reloaded config's levels to the running loggers: each module logger
+// to its configured level, or the global one if it is no longer listed, and
+// the default logger to the global level. The components resolve their
+// logger once, at construction, and fall back to the default logger if the
+// module had none then, so a module new since startup cannot take effect;
+// its name is returned instead.
+inline std::vector<std::string> updateLogLevels(const LoggerConfig &cfg) {
+  spdlog::apply_all([&](const std::shared_ptr<spdlog::logger> &logger) {
+    const auto it = cfg.moduleLevels.find(logger->name());
+    logger->set_level(it != cfg.moduleLevels.end() ? it->second
+                                                   : cfg.globalLevel);
+  });
+  std::vector<std::string> unknown;
+  for (const auto &kv : cfg.moduleLevels)
+    if (!spdlog::get(kv.first))
+      unknown.push_back(kv.first);
+  return unknown;
+}
+
+// Export the messages dropped from the async queue until the returned
+// Registration is destroyed; an empty Registration without async logging.
+[[nodiscard]] inline Metrics::Registration logDroppedMetric() {
+  std::weak_ptr<spdlog::details::thread_pool> pool = spdlog::thread_pool();
+  if (pool.expired())
+    return {};
+  return Metrics::callback(
+      Metrics::Type::Counter, "fronius_bridge_log_dropped_total",
+      "Log messages dropped from the full async log queue", {}, [pool] {
+        const auto p = pool.lock();
+        return p ? static_cast<double>(p->overrun_counter()) : 0.0;
+      });
+}
+
 #endif /* LOGGER_H_ */
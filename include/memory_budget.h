@@ -0,0 +1,109 @@
+#ifndef MEMORY_BUDGET_H_
+#define MEMORY_BUDGET_H_
+
+#include "metrics.h"
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <string>
+
+// ---------------------------------------------------------------------------
+// MemoryBudget — the low-memory profile's shared byte limit (`memory:`).
+//
+// On a small gateway the bridge's resident size is mostly what its queues
+// and buffers hold, and each of them is sized on its own: a count per MQTT
+// topic, a count for the PostgreSQL queue, a register table per slave. A
+// burst or a broker outage then costs the sum of every limit at its
+// worst-case message size. With a `memory:` section the consumers draw from
+// one budget instead, each through its own Account:
+//
+//   - reserve() counts memory allocated once and held for good: the
+//     PostgreSQL ring's slots, the slaves' register snapshots. It is never
+//     refused, so the fixed costs come off the top at startup.
+//   - charge() claims memory a queued message holds until it leaves the
+//     queue (release()). It is refused once the budget is spent, and the
+//     consumer then drops its oldest message, as a full queue does, so the
+//     MQTT topics share what the fixed costs leave instead of each holding
+//     queue_size messages.
+//
+// Each account records its peak, exported as fronius_bridge_memory_bytes
+// {account=...} with the budget as fronius_bridge_memory_budget_bytes, and
+// summary() lists them for the shutdown log next to the process's peak
+// resident size. The accounts count the bytes their owner holds, not pages:
+// the kernel keeps no resident size per subsystem, so the peaks and the
+// process-wide figure need not add up.
+//
+// Thread-safety: charge(), reserve() and release() are a couple of atomics
+// from any thread. account() is not thread-safe; main() and the consumers'
+// constructors call it before their threads start.
+// ---------------------------------------------------------------------------
+
+class MemoryBudget {
+public:
+  class Account {
+  public:
+    Account(MemoryBudget &budget, std::string name);
+
+    Account(const Account &) = delete;
+    Account &operator=(const Account &) = delete;
+
+    // Claim `bytes` within the budget; false, claiming nothing, past it.
+    bool charge(std::size_t bytes) noexcept;
+    // Count `bytes` whether or not the budget has room.
+    void reserve(std::size_t bytes) noexcept;
+    // Return `bytes` claimed by charge() or reserve().
+    void release(std::size_t bytes) noexcept;
+
+    const std::string &name() const noexcept { return name_; }
+    std::size_t used() const noexcept {
+      return used_.load(std::memory_order_relaxed);
+    }
+    std::size_t peak() const noexcept {
+      return peak_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void add(std::size_t bytes) noexcept;
+
+    MemoryBudget &budget_;
+    const std::string name_;
+    std::atomic<std::size_t> used_{0};
+    std::atomic<std::size_t> peak_{0};
+    Metrics::Registration metric_;
+  };
+
+  explicit MemoryBudget(std::size_t limit);
+
+  MemoryBudget(const MemoryBudget &) = delete;
+  MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+  // The account `name`, created on first use. Accounts live as long as the
+  // budget.
+  Account &account(const std::string &name);
+
+  std::size_t limit() const noexcept { return limit_; }
+  std::size_t used() const noexcept {
+    return used_.load(std::memory_order_relaxed);
+  }
+
+  // "peak 1520 of 4096 KiB: postgres 1024 KiB, mqtt 480 KiB, slaves 16 KiB"
+  std::string summary() const;
+
+private:
+  const std::size_t limit_;
+  std::atomic<std::size_t> used_{0};
+  std::atomic<std::size_t> peak_{0};
+  std::deque<Account> accounts_; // stable addresses
+  Metrics::Registration limitMetric_;
+};
+
+// The process's peak resident set size so far, in bytes (getrusage()).
+std::size_t peakResidentBytes();
+
+// Reserve `bytes` of stack for every thread started from here on, instead of
+// the system default (8 MiB on glibc): the std::thread and std::jthread
+// workers, spdlog's async writer. Call before any thread starts. Throws
+// std::system_error if the size is refused.
+void setThreadStackSize(std::size_t bytes);
+
+#endif /* MEMORY_BUDGET_H_ */
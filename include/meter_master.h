@@ -1,12 +1,18 @@
 #ifndef METER_MASTER_H_
 #define METER_MASTER_H_
 
+#include "config_yaml.h"
 #include "meter_types.h"
+#include <atomic>
 #include <functional>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 
+class CaptureWriter;
+
 // ---------------------------------------------------------------------------
 // MeterMaster — abstract base for the wire-side reader of a single meter.
 //
@@ -18,21 +24,26 @@
 //   - device callback:       device identity / nameplate (MeterTypes::Device)
 //   - availability callback: a connectivity state string
 //
-// Concrete subclasses (FroniusMeter, EasyMeter) implement the
-// transport and their own worker thread; they invoke the stored callbacks
-// when fresh data arrives. main.cpp holds masters through this base so the
+// The values are handed over serialised in the encoding set with
+// setValuesEncoding() (JSON by default), alongside the struct.
+//
+// Concrete subclasses (FroniusMeter, EasyMeter) implement the transport and
+// the thread that reads it — FroniusMeter polls from its bus's BusScheduler,
+// EasyMeter owns a reader thread; they invoke the stored callbacks when fresh
+// data arrives. main.cpp holds masters through this base so the
 // callback-wiring is identical regardless of meter kind.
 //
 // Callback storage and the mutex that guards it live here in the base so the
 // locking discipline is shared and not re-implemented per subclass. The three
 // setters are non-virtual: subclasses must not change how callbacks are
 // stored, only when they are fired. Subclasses read the callbacks under
-// cbMutex_ from their worker thread.
+// cbMutex_ from their poll or reader thread.
 //
-// Lifetime: a master owns a thread that may invoke these callbacks, so a
+// Lifetime: a master runs on a thread that may invoke these callbacks, so a
 // master must outlive any object its callbacks touch. Subclass destructors
-// are responsible for joining their worker (and removing any bus callbacks)
-// before base teardown; the virtual destructor guarantees correct
+// are responsible for stopping that thread's calls into them (joining their
+// reader, or leaving the bus schedule, and removing any bus callbacks) before
+// base teardown; the virtual destructor guarantees correct
 // destruction through a base pointer.
 // ---------------------------------------------------------------------------
 
@@ -40,21 +51,28 @@ class MeterMaster {
 public:
   virtual ~MeterMaster() = default;
 
-  // Non-copyable, non-movable — subclasses own a thread.
+  // Non-copyable, non-movable — subclasses hand `this` to a thread.
   MeterMaster(const MeterMaster &) = delete;
   MeterMaster &operator=(const MeterMaster &) = delete;
   MeterMaster(MeterMaster &&) = delete;
   MeterMaster &operator=(MeterMaster &&) = delete;
 
-  // Install the callbacks invoked by the subclass worker thread. Thread-safe;
-  // each replaces any previously-installed callback under cbMutex_.
-  void
-  setValueCallback(std::function<void(std::string, MeterTypes::Values)> cb) {
+  // The callbacks get the master's own payload and data by reference, valid
+  // for the call only: a consumer copies what it keeps, into a buffer of its
+  // own choosing, and nothing is copied for a consumer not wired up.
+  using ValueCallback =
+      std::function<void(std::string_view, const MeterTypes::Values &)>;
+  using DeviceCallback =
+      std::function<void(std::string_view, const MeterTypes::Device &)>;
+
+  // Install the callbacks invoked by the subclass poll or reader thread.
+  // Thread-safe; each replaces any previously-installed callback under
+  // cbMutex_.
+  void setValueCallback(ValueCallback cb) {
     std::lock_guard<std::mutex> lock(cbMutex_);
     valueCallback_ = std::move(cb);
   }
-  void
-  setDeviceCallback(std::function<void(std::string, MeterTypes::Device)> cb) {
+  void setDeviceCallback(DeviceCallback cb) {
     std::lock_guard<std::mutex> lock(cbMutex_);
     deviceCallback_ = std::move(cb);
   }
@@ -62,18 +80,48 @@ public:
     std::lock_guard<std::mutex> lock(cbMutex_);
     availabilityCallback_ = std::move(cb);
   }
+  // Encoding of the value callback's payload (mqtt.publish.values).
+  void setValuesEncoding(MqttEncoding encoding) {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    valuesEncoding_ = encoding;
+  }
+  // Record the meter's inputs to `capture` (--capture) as `device`. Call
+  // once, right after construction; the capture must outlive the master.
+  void setCapture(CaptureWriter *capture, DeviceId device) {
+    captureDevice_ = device;
+    capture_.store(capture, std::memory_order_release);
+  }
+
+  // Whether this instance serves the meter (see ClusterCoordinator). An
+  // inactive meter skips its polls and publishes nothing. Starts active.
+  // Only a meter another node can take over, a Fronius meter on Modbus TCP,
+  // is ever made inactive; the EBZ's serial line ties it to its home node.
+  // Thread-safe.
+  virtual void setActive(bool active) { active_.store(active); }
+
+  // A reload's update_interval and `adaptive:` block (see FroniusMeter).
+  // The EBZ pushes its telegrams and has no interval. Thread-safe.
+  virtual void
+  setUpdateInterval(int /*updateInterval*/,
+                    const std::optional<AdaptivePollConfig> & /*adaptive*/) {}
 
 protected:
   MeterMaster() = default;
 
-  // Guards the three callbacks below (and is reused by subclasses to guard
-  // their own data that is published alongside a callback invocation).
-  // mutable so const accessors in subclasses may lock it.
+  // Guards the callbacks and the encoding below (and is reused by subclasses
+  // to guard their own data that is published alongside a callback
+  // invocation). mutable so const accessors in subclasses may lock it.
   mutable std::mutex cbMutex_;
 
-  std::function<void(std::string, MeterTypes::Values)> valueCallback_;
-  std::function<void(std::string, MeterTypes::Device)> deviceCallback_;
+  ValueCallback valueCallback_;
+  DeviceCallback deviceCallback_;
   std::function<void(std::string)> availabilityCallback_;
+  MqttEncoding valuesEncoding_{MqttEncoding::Json};
+  // An EBZ's reader is already running when setCapture() is called, so the
+  // pointer is published atomically, after the device id.
+  std::atomic<CaptureWriter *> capture_{nullptr};
+  DeviceId captureDevice_{0};
+  std::atomic<bool> active_{true};
 };
 
 #endif /* METER_MASTER_H_ */
@@ -2,21 +2,29 @@
 #define METER_SLAVE_H_
 
 #include "config_yaml.h"
+#include "memory_budget.h"
 #include "meter_types.h"
+#include "metrics.h"
+#include "register_store.h"
 #include "signal_handler.h"
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <expected>
 #include <fronius/fronius.h>
 #include <memory>
 #include <modbus/modbus.h>
-#include <mutex>
-#include <poll.h>
+#include <string>
 #include <thread>
+#include <unordered_map>
 
 class MeterSlave {
 public:
+  // With a `memory` budget the register snapshots are sparse and reserved
+  // from it (see RegisterStore).
   MeterSlave(const MeterSlaveConfig &cfg, std::string meterName,
-             SignalHandler &signalHandler);
+             SignalHandler &signalHandler, MemoryBudget *memory = nullptr);
   virtual ~MeterSlave();
 
   // Non-copyable, non-movable — owns threads and a server socket.
@@ -37,6 +45,8 @@ private:
   // Held by value: AppConfig's std::vector<MeterConfig> may reallocate,
   // which would dangle any reference into a nested slave config.
   const MeterSlaveConfig cfg_;
+  // Duration of each modbus_reply(), TCP and RTU alike.
+  Metrics::Histogram &replyDuration_;
   MeterTypes::ErrorAction
   handleResult(std::expected<void, ModbusError> &&result);
 
@@ -44,25 +54,55 @@ private:
   modbus_t *listenCtx_{nullptr};
   int serverSocket_{-1};
   std::expected<void, ModbusError> startListener(void);
+  // Write the value / identity registers into `regs`, the snapshot
+  // RegisterStore::update() hands out.
+  void packValues(modbus_mapping_t *regs, const MeterTypes::Values &values);
+  void packDevice(modbus_mapping_t *regs, const MeterTypes::Device &device);
   void rtuClientHandler(void);
   void tcpClientHandler();
-  void tcpClientWorker(int clientSocket);
 
-  // --- modbus registers and values
-  std::atomic<std::shared_ptr<modbus_mapping_t>> regs_{nullptr};
-  struct ModbusDeleter {
-    void operator()(modbus_mapping_t *p) {
-      if (p)
-        modbus_mapping_free(p);
-    }
+  // --- TCP reactor ---
+  // tcpClientHandler() is a single-threaded epoll loop over the listener and
+  // every client socket, so the thread count stays at one however many
+  // clients connect or reconnect. It assembles MBAP frames itself from
+  // non-blocking reads and answers each complete one with modbus_reply()
+  // against the current register snapshot. Clients beyond
+  // tcp.max_connections are refused at accept; clients idle longer than
+  // idle_timeout, or stalled mid-frame longer than request_timeout, are
+  // disconnected.
+  struct TcpClient {
+    ~TcpClient();
+    int socket{-1};
+    modbus_t *ctx{nullptr}; // reply context bound to `socket`
+    std::string peer;       // "ip:port", for logging
+    std::array<uint8_t, MODBUS_TCP_MAX_ADU_LENGTH> frame{};
+    size_t frameLen{0};
+    std::chrono::steady_clock::time_point frameStart; // first pending byte
+    std::chrono::steady_clock::time_point lastActivity;
   };
+  void acceptClients(int epollFd);
+  // Read from the client and answer what arrived. Returns false once the
+  // client must be dropped (closed, failed or misbehaving; already logged).
+  bool serviceClient(TcpClient &client, uint32_t events);
+  bool replyToFrames(TcpClient &client);
+  void expireClients(void);
+  // Keyed by socket. Touched only by the reactor thread.
+  std::unordered_map<int, std::unique_ptr<TcpClient>> clients_;
+
+  // --- modbus registers and values
+  // Published snapshots the TCP reactor and RTU loop reply from;
+  // updateValues() and updateDevice() write only the SunSpec blocks into the
+  // next one.
+  RegisterStore regs_;
   bool deviceUpdated_{false};
 
   // --- signals / threading / callbacks ---
+  // stop_ ends the worker when the slave is destroyed before shutdown (a
+  // reload that drops or rebuilds its meter).
+  bool running() const noexcept { return handler_.isRunning() && !stop_; }
   SignalHandler &handler_;
-  mutable std::mutex clientMutex_;
+  std::atomic<bool> stop_{false};
   std::thread worker_;
-  std::vector<std::thread> clientThreads_;
 };
 
 #endif /* METER_SLAVE_H_ */
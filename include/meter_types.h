@@ -32,6 +32,9 @@ struct MeterTypes {
 
   struct Values {
     uint64_t time{0};
+    // Seconds since the previous poll in adaptive mode (AdaptiveInterval),
+    // 0 at a fixed update_interval and for the EBZ, where it is not published.
+    int interval{0};
     double activeEnergyImport{0.0};
     double activeEnergyExport{0.0};
     double reactiveEnergyImport{0.0};
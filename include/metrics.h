@@ -0,0 +1,145 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Metrics — process-wide counters and latency histograms, rendered in the
+// Prometheus text exposition format by MetricsServer.
+//
+// Recording is on the poll, publish and reply hot paths, so it must not take a
+// lock or contend on a shared cache line. Every series is split into
+// shardCount cache-line-aligned shards; a thread picks its shard once, round
+// robin on first use, and from then on records with relaxed atomic adds to it
+// alone. The bridge runs a handful of long-lived threads, so in practice each
+// one owns its shard outright. The shards are summed only when the endpoint is
+// scraped. A scrape racing a recording may see a bucket count without the
+// matching _sum increment; the next scrape is exact again.
+//
+// Series live in one registry, like spdlog's loggers: counter() and
+// histogram() create a series on first use and return the same one for the
+// same name and labels afterwards, so a class resolves its series once in its
+// constructor and keeps the reference. Series are never removed and the
+// references stay valid for the life of the process. Values a class already
+// keeps (queue depths, ring drop counts) are exported through callbacks
+// instead, owned by a Registration that unhooks them on destruction.
+// ---------------------------------------------------------------------------
+
+namespace Metrics {
+
+// Label name/value pairs, in the order they are rendered.
+using Labels = std::vector<std::pair<std::string, std::string>>;
+
+enum class Type { Counter, Gauge, Histogram };
+
+inline constexpr std::size_t shardCount = 16;
+
+// The calling thread's shard, assigned round robin on first use.
+std::size_t shardIndex() noexcept;
+
+class Counter {
+public:
+  void inc(std::uint64_t n = 1) noexcept {
+    shards_[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  // Sum over all shards. Scrape-side only.
+  std::uint64_t value() const noexcept;
+
+private:
+  struct alignas(64) Shard {
+    std::atomic<std::uint64_t> value{0};
+  };
+  std::array<Shard, shardCount> shards_{};
+};
+
+// Latency histogram with fixed buckets from 100 us to 10 s, which spans a
+// Modbus reply at the fast end and a timed-out RTU poll at the slow one.
+class Histogram {
+public:
+  // Upper bucket bounds. A last, implicit bucket catches everything above.
+  static constexpr std::array<std::int64_t, 16> boundsNs = {
+      100'000,       250'000,       500'000,      1'000'000,
+      2'500'000,     5'000'000,     10'000'000,   25'000'000,
+      50'000'000,    100'000'000,   250'000'000,  500'000'000,
+      1'000'000'000, 2'500'000'000, 5'000'000'000, 10'000'000'000};
+  static constexpr std::size_t bucketCount = boundsNs.size() + 1;
+
+  void observe(std::chrono::nanoseconds d) noexcept;
+
+  // Observe the time elapsed since `start` on the steady clock.
+  void observeSince(std::chrono::steady_clock::time_point start) noexcept {
+    observe(std::chrono::steady_clock::now() - start);
+  }
+
+  // Per-bucket (not cumulative) counts and the sum, over all shards.
+  struct Snapshot {
+    std::array<std::uint64_t, bucketCount> buckets{};
+    std::uint64_t count{0};
+    double sumSeconds{0.0};
+  };
+  Snapshot snapshot() const noexcept;
+
+private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, bucketCount> buckets{};
+    std::atomic<std::uint64_t> sumNs{0};
+  };
+  std::array<Shard, shardCount> shards_{};
+};
+
+// Keeps a callback series registered; destroying it unhooks the callback.
+// Once the destructor returns, no scrape calls the callback again.
+class Registration {
+public:
+  Registration() = default;
+  explicit Registration(std::uint64_t id) : id_(id) {}
+  ~Registration() { reset(); }
+
+  Registration(Registration &&other) noexcept
+      : id_(std::exchange(other.id_, 0)) {}
+  Registration &operator=(Registration &&other) noexcept {
+    if (this != &other) {
+      reset();
+      id_ = std::exchange(other.id_, 0);
+    }
+    return *this;
+  }
+  Registration(const Registration &) = delete;
+  Registration &operator=(const Registration &) = delete;
+
+  void reset() noexcept;
+
+private:
+  std::uint64_t id_{0};
+};
+
+// The counter or histogram series `name` with `labels`, created on first use.
+// Throws std::logic_error if `name` is already registered with another type.
+Counter &counter(const std::string &name, const std::string &help,
+                 const Labels &labels = {});
+Histogram &histogram(const std::string &name, const std::string &help,
+                     const Labels &labels = {});
+
+// Export `read()` as a Counter or Gauge series until the returned
+// Registration is destroyed. read() runs on the scraping thread with the
+// registry locked, so it must be cheap and must not register metrics.
+[[nodiscard]] Registration callback(Type type, const std::string &name,
+                                    const std::string &help,
+                                    const Labels &labels,
+                                    std::function<double()> read);
+
+// Every registered series in the text exposition format, version 0.0.4.
+std::string render();
+
+} // namespace Metrics
+
+#endif /* METRICS_H_ */
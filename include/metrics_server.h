@@ -0,0 +1,46 @@
+#ifndef METRICS_SERVER_H_
+#define METRICS_SERVER_H_
+
+#include "config_yaml.h"
+#include "signal_handler.h"
+#include <memory>
+#include <spdlog/logger.h>
+#include <thread>
+
+// ---------------------------------------------------------------------------
+// MetricsServer
+//
+// Minimal HTTP/1.x endpoint answering `GET /metrics` with Metrics::render().
+// Scrapes arrive every few seconds at most, so one thread serves them in turn
+// and closes each connection after the response; anything other than a GET of
+// /metrics gets a 404. The listener is bound in the constructor, which throws
+// std::runtime_error if the address cannot be bound, so a port clash fails
+// startup like a meter slave's does. The thread polls the listener with a
+// 500 ms timeout to observe shutdown, and a client gets a few seconds to send
+// its request before it is dropped.
+//
+// Lifetime: held as std::unique_ptr<MetricsServer> in main(); the destructor
+// joins the thread and closes the listener.
+// ---------------------------------------------------------------------------
+
+class MetricsServer {
+public:
+  MetricsServer(const MetricsConfig &cfg, SignalHandler &signalHandler);
+  ~MetricsServer();
+
+  MetricsServer(const MetricsServer &) = delete;
+  MetricsServer &operator=(const MetricsServer &) = delete;
+
+private:
+  void run();
+  // Read one request from `client`, answer it and return.
+  void serve(int client);
+
+  MetricsConfig cfg_;
+  SignalHandler &handler_;
+  std::shared_ptr<spdlog::logger> logger_;
+  int listenSocket_{-1};
+  std::thread worker_;
+};
+
+#endif /* METRICS_SERVER_H_ */
@@ -0,0 +1,217 @@
+#ifndef MPSC_RING_H_
+#define MPSC_RING_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+// ---------------------------------------------------------------------------
+// MpscRing
+//
+// Bounded multi-producer queue shared by the consumers (PostgresClient,
+// MqttClient) as the hand-off from the device poll threads. It replaces a
+// mutex-guarded std::queue, so a producer callback costs a couple of atomic
+// operations and never waits on a consumer that is busy reading the queue.
+//
+// This is Vyukov's bounded MPMC array queue: every slot carries a sequence
+// number that says whether it is free for the push at a given position or
+// holds the value for the pop at it. A push or pop claims its position with
+// one CAS on the tail or head counter. The only cross-thread wait is a reader
+// spinning past a writer preempted between claiming a slot and publishing it,
+// which is why a single consumer is the intended use. Multi-consumer safety
+// is still needed for the overflow policy: when the ring is full, the producer
+// itself pops the oldest element and discards it (drop-oldest, the policy the
+// mutex queues had) and counts it in dropped().
+//
+// Positions are 64-bit and never wrap in practice, so the capacity need not be
+// a power of two and matches the configured queue_size exactly.
+// ---------------------------------------------------------------------------
+
+template <typename T> class MpscRing {
+public:
+  explicit MpscRing(std::size_t capacity)
+      : capacity_(capacity), slots_(std::make_unique<Slot[]>(capacity)) {
+    if (capacity_ == 0)
+      throw std::invalid_argument("MpscRing capacity must be positive");
+    for (std::size_t i = 0; i < capacity_; ++i)
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  MpscRing(const MpscRing &) = delete;
+  MpscRing &operator=(const MpscRing &) = delete;
+
+  // Push `value`, first discarding the oldest element if the ring is full.
+  // Returns true if an element was discarded to make room.
+  bool push(T value) {
+    return push(std::move(value), [](T &&) {});
+  }
+
+  // As push(), handing each discarded element to `onDrop` (e.g. to return
+  // what it held to a MemoryBudget).
+  template <typename OnDrop> bool push(T value, OnDrop &&onDrop) {
+    bool droppedOne = false;
+    while (!tryPush(value)) {
+      if (auto old = tryPop()) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        droppedOne = true;
+        onDrop(std::move(*old));
+      }
+    }
+    return droppedOne;
+  }
+
+  // Take the oldest element, or std::nullopt if the ring is empty.
+  std::optional<T> tryPop() {
+    std::uint64_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = slots_[pos % capacity_];
+      const std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<std::int64_t>(seq) - static_cast<std::int64_t>(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          std::optional<T> out{std::move(slot.value)};
+          slot.value.reset();
+          slot.seq.store(pos + capacity_, std::memory_order_release);
+          return out;
+        }
+      } else if (diff < 0) {
+        return std::nullopt;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Approximate element count: exact when no push or pop is in flight.
+  std::size_t size() const noexcept {
+    const std::uint64_t head = head_.load(std::memory_order_relaxed);
+    const std::uint64_t tail = tail_.load(std::memory_order_relaxed);
+    return tail > head ? static_cast<std::size_t>(tail - head) : 0;
+  }
+
+  bool empty() const noexcept { return size() == 0; }
+  std::size_t capacity() const noexcept { return capacity_; }
+
+  // Bytes of one slot; the ring allocates capacity() of them up front.
+  static constexpr std::size_t slotBytes() noexcept { return sizeof(Slot); }
+
+  // Elements discarded by push() since construction.
+  std::uint64_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  // Moves from `value` only on success.
+  bool tryPush(T &value) {
+    std::uint64_t pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot &slot = slots_[pos % capacity_];
+      const std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<std::int64_t>(seq) - static_cast<std::int64_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          slot.value.emplace(std::move(value));
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  struct Slot {
+    std::atomic<std::uint64_t> seq{0};
+    std::optional<T> value;
+  };
+
+  const std::size_t capacity_;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Producers and the consumer each hammer their own counter; keep them on
+  // separate cache lines (64 bytes on every target the bridge runs on).
+  alignas(64) std::atomic<std::uint64_t> head_{0};
+  alignas(64) std::atomic<std::uint64_t> tail_{0};
+  alignas(64) std::atomic<std::uint64_t> dropped_{0};
+};
+
+// ---------------------------------------------------------------------------
+// Wakeup
+//
+// Consumer-side sleep for one or more MpscRings, built on an eventfd. The one
+// waiting thread parks in poll() with a deadline. A producer pays for the
+// write() only when that thread is actually asleep, so a busy consumer costs
+// its producers nothing beyond the push. The wait methods mirror
+// std::condition_variable's predicate forms, minus the mutex: the predicate
+// reads state published by atomics (ring positions, SignalHandler's running
+// flag), and notify() must follow every change it depends on.
+//
+// One waiter per Wakeup: a second thread waiting on the same eventfd could
+// consume the wake meant for the first.
+// ---------------------------------------------------------------------------
+
+class Wakeup {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Throws std::system_error if the eventfd cannot be created.
+  Wakeup();
+  ~Wakeup();
+
+  Wakeup(const Wakeup &) = delete;
+  Wakeup &operator=(const Wakeup &) = delete;
+
+  // Wake the waiter if it is asleep. Safe from any thread.
+  void notify() noexcept;
+
+  template <typename Pred> void wait(Pred pred) {
+    waitUntil(std::nullopt, pred);
+  }
+
+  template <typename Rep, typename Period, typename Pred>
+  bool waitFor(std::chrono::duration<Rep, Period> timeout, Pred pred) {
+    return waitUntil(
+        Clock::now() + std::chrono::ceil<Clock::duration>(timeout), pred);
+  }
+
+  // Block until pred() holds or `deadline` (none = forever) passes. Returns
+  // the final pred().
+  template <typename Pred>
+  bool waitUntil(std::optional<Clock::time_point> deadline, Pred pred) {
+    while (!pred()) {
+      // Announce the sleep before the last look at the predicate, so a
+      // producer either finds the waiter flagged or its change is seen here.
+      sleeping_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (pred()) {
+        sleeping_.store(false, std::memory_order_relaxed);
+        return true;
+      }
+      const bool woken = block(deadline);
+      sleeping_.store(false, std::memory_order_relaxed);
+      if (!woken)
+        return pred();
+    }
+    return true;
+  }
+
+private:
+  // Sleep until notified (true) or the deadline passes (false).
+  bool block(std::optional<Clock::time_point> deadline);
+
+  int fd_{-1};
+  std::atomic<bool> sleeping_{false};
+};
+
+#endif /* MPSC_RING_H_ */
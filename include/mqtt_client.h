@@ -2,57 +2,176 @@
 #define MQTT_CLIENT_H
 
 #include "config_yaml.h"
+#include "memory_budget.h"
+#include "metrics.h"
+#include "mpsc_ring.h"
+#include "object_pool.h"
 #include "signal_handler.h"
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <mosquitto.h>
 #include <mutex>
-#include <queue>
+#include <optional>
 #include <spdlog/logger.h>
 #include <string>
+#include <string_view>
 #include <thread>
-#include <unordered_map>
+#include <vector>
 
 class MqttClient {
 public:
-  MqttClient(const MqttConfig &cfg, SignalHandler &signalHandler);
+  // Dense handle for a topic registered with addTopic().
+  using TopicId = std::uint16_t;
+
+  // With a `memory` budget the queued payloads are charged to it (see
+  // MemoryBudget) on top of the per-topic queue_size.
+  MqttClient(const MqttConfig &cfg, SignalHandler &signalHandler,
+             MemoryBudget *memory = nullptr);
   ~MqttClient();
 
-  // Producer pushes JSON payloads here
-  void publish(std::string payload, const std::string &topic);
+  // Register a topic, published with `policy` (one of cfg.publish), and
+  // return its id. Called by the sinks while registering their devices, so
+  // no topic string is built or compared per message. A topic registered
+  // before returns its id again; a new one takes the slot of a released
+  // topic whose queue has drained, if any. Throws std::length_error beyond
+  // maxTopics.
+  TopicId addTopic(std::string topic, const MqttPublishPolicy &policy);
+
+  // Hand back a topic whose device a reload took out. Its queued messages
+  // are still published; after that addTopic() may reuse its slot. The
+  // caller publishes to it no more.
+  void releaseTopic(TopicId topic);
+
+  // Producer pushes payloads here. Lock-free: the payload is copied into a
+  // pooled buffer on the topic's own ring (drop-oldest at queue_size) and the
+  // publish thread is woken.
+  void publish(std::string_view payload, TopicId topic);
+
+  // Messages dropped from full topic queues, or past the memory budget, since
+  // construction.
+  std::uint64_t droppedMessages() const noexcept;
+
+  // Successful broker connections since construction. A publisher that
+  // relies on the broker's state (the delta mode's keyframes) compares it
+  // across publishes to notice a reconnect.
+  std::uint64_t connections() const noexcept;
 
 private:
   void run();
 
+  // Hand queued messages to libmosquitto, one per topic per pass so a chatty
+  // topic cannot hold back the others, until the queues are empty, the
+  // connection drops or (unless `ignoreWindow`) the in-flight window is full.
+  void drain(bool ignoreWindow);
+  bool windowOpen() const noexcept;
+
   // Drives mosquitto_loop() with our own reconnect/backoff, replacing
   // mosquitto_loop_start() (whose thread quits on a TLS/protocol rejection).
   void networkLoop();
   MqttConfig cfg_;
+  // MQTT v5, so messages can carry their content type; chosen when a topic
+  // class uses a binary encoding.
+  bool v5_{false};
 
   // Logger
   std::shared_ptr<spdlog::logger> logger_;
 
   // State
   std::atomic<bool> connected_{false};
+  std::atomic<std::uint64_t> connections_{0};
+  // Messages published but not yet completed (see MqttConfig::maxInflight).
+  // onPublish() counts them down; a (re)connect starts from zero, as
+  // libmosquitto either resends or drops what was in flight on the old link.
+  std::atomic<std::size_t> inflight_{0};
   struct mosquitto *mosq_ = nullptr;
   std::thread worker_;
   std::thread networkThread_;
   SignalHandler &handler_;
+  // Backoff sleep of networkLoop() only; run() sleeps on wake_.
   std::mutex mutex_;
   std::condition_variable cv_;
+  Wakeup wake_;
 
   // --- queued messages setup
-  struct QueuedMessage {
-    std::string payload;
+  //
+  // One ring per topic, so a chatty topic cannot evict another topic's
+  // (retained) messages. The table is indexed by TopicId, in chunks of
+  // topicChunk allocated as it grows: ids [0, topicCount_) are published,
+  // and publish() indexes them without a lock. Only addTopic() and
+  // releaseTopic() take topicMutex_. A released topic's queue is marked idle
+  // by the publish thread once it has nothing left to send, and only an
+  // idle queue has its topic and policy rewritten. `lastHash` suppresses
+  // a payload identical to the topic's previous one; `held` is a message
+  // taken off the ring whose publish failed, retried first (publish thread
+  // only). Each message carries its enqueue time for the publish latency
+  // metric. The payload buffers come from payloads_, which holds queue_size
+  // of them: enough for every topic's backlog while the broker keeps up, and
+  // past that (a broker outage) the overflow is plain heap buffers.
+  //
+  // Under a memory budget every queued message is charged its buffer's
+  // capacity (`charged`) until it is published or dropped, so the topics
+  // share the budget's bytes rather than each holding queue_size messages. A
+  // message the budget refuses evicts its topic's oldest ones, and is itself
+  // dropped if the topic has none left; both count as dropped.
+  struct Message {
+    ObjectPool<std::string>::Ref payload;
+    std::chrono::steady_clock::time_point enqueued;
+    std::size_t charged{0};
   };
-  std::map<std::string, std::queue<QueuedMessage>> topicQueues_;
-  std::unordered_map<std::string, std::size_t> lastPayloadHashes_;
-  std::map<std::string, size_t> droppedCount_;
+  // `properties` carries the MQTT v5 content type (nullptr on a v3
+  // connection).
+  enum class TopicState : std::uint8_t { Live, Released, Idle };
+  struct TopicQueue {
+    TopicQueue(std::string name, const MqttPublishPolicy &publishPolicy,
+               std::size_t capacity)
+        : topic(std::move(name)), policy(publishPolicy), ring(capacity) {}
+    ~TopicQueue() { mosquitto_property_free_all(&properties); }
+    TopicQueue(const TopicQueue &) = delete;
+    TopicQueue &operator=(const TopicQueue &) = delete;
+    std::string topic;
+    MqttPublishPolicy policy;
+    mosquitto_property *properties{nullptr};
+    MpscRing<Message> ring;
+    std::atomic<std::size_t> lastHash{0};
+    std::optional<Message> held;
+    std::atomic<TopicState> state{TopicState::Live};
+  };
+  // Set the content type of `queue` for its policy (MQTT v5 only).
+  void setProperties(TopicQueue &queue);
+  TopicQueue &queue(std::size_t id) const noexcept {
+    return *(*topics_[id / topicChunk])[id % topicChunk];
+  }
+  ObjectPool<std::string> payloads_;
+  static constexpr std::size_t topicChunk = 256;
+  static constexpr std::size_t maxTopics =
+      std::size_t{std::numeric_limits<TopicId>::max()} + 1;
+  using TopicChunk = std::array<TopicQueue *, topicChunk>;
+  std::array<std::unique_ptr<TopicChunk>, maxTopics / topicChunk> topics_;
+  std::atomic<std::size_t> topicCount_{0};
+  std::mutex topicMutex_;
+  std::vector<std::unique_ptr<TopicQueue>> topicStorage_;
   bool hasQueuedMessages() const;
+  MemoryBudget::Account *memory_{nullptr};
+  std::atomic<std::uint64_t> overBudget_{0};
+
+  // --- metrics. The callbacks read the topic rings, so they are declared
+  //     after them and unhooked before they are destroyed.
+  Metrics::Histogram &publishLatency_;
+  Metrics::Registration queueDepthMetric_;
+  Metrics::Registration droppedMetric_;
+  Metrics::Registration inflightMetric_;
+  Metrics::Registration poolMissesMetric_;
 
   // --- callbacks
   static void onConnect(struct mosquitto *mosq, void *obj, int rc);
   static void onDisconnect(struct mosquitto *mosq, void *obj, int rc);
+  static void onPublish(struct mosquitto *mosq, void *obj, int mid);
   static void onLog(struct mosquitto *mosq, void *obj, int level,
                     const char *str);
 };
@@ -0,0 +1,100 @@
+#ifndef OBIS_PARSER_H_
+#define OBIS_PARSER_H_
+
+#include <cstddef>
+#include <expected>
+#include <optional>
+#include <string_view>
+
+// ---------------------------------------------------------------------------
+// Obis — allocation-free scanner for the EBZ's plain-text OBIS telegrams.
+//
+// A telegram is an identification line, data lines and an end line, each
+// terminated by CR LF (a bare LF is accepted too):
+//
+//   /EBZ5DD3BZ06ETA_107
+//
+//   1-0:96.1.0*255(1EBZ0100507409)
+//   1-0:1.8.0*255(000125.25688570*kWh)
+//   1-0:16.7.0*255(000259.20*W)
+//   ...
+//   !
+//
+// Every data line follows the grammar x-0:a.b.c*255(value*unit), where x is
+// one digit, a, b and c are decimal groups and the "*unit" suffix is
+// optional. Text after the closing parenthesis is ignored, as the regex this
+// replaced did.
+//
+// All results are std::string_views into the caller's buffer, so the scan
+// itself never allocates or copies. The caller keeps the telegram alive (and
+// unchanged) while it uses them. EasyMeter scans its worker-owned telegram
+// buffer in place, without taking cbMutex_ and without a copy.
+// ---------------------------------------------------------------------------
+
+namespace Obis {
+
+// One data line. `code` is the full OBIS code including "*255", `value` the
+// text before the first '*' inside the parentheses, `unit` the text after it
+// (empty when the line carries no unit, e.g. the serial number).
+struct DataSet {
+  std::string_view code;
+  std::string_view value;
+  std::string_view unit;
+};
+
+// The line a scan stopped at, and why. `line` points into the telegram,
+// `what` at static storage.
+struct ParseError {
+  std::string_view line;
+  const char *what;
+};
+
+// Split one data line. Returns std::nullopt if it does not match the grammar.
+std::optional<DataSet> parseDataSet(std::string_view line) noexcept;
+
+// Parse a decimal value such as "000125.25688570" or "-12.5". The whole view
+// must be consumed. Returns std::nullopt on malformed input.
+std::optional<double> parseNumber(std::string_view text) noexcept;
+
+// The firmware version from an identification line "/<vendor>_<version>"
+// (both parts alphanumeric), or std::nullopt if the line is malformed.
+std::optional<std::string_view>
+firmwareVersion(std::string_view identification) noexcept;
+
+// Walk `telegram` line by line. Calls onIdentification(line) for the '/'
+// line and onDataSet(const DataSet &) for each data line, skipping blank
+// lines and the '!' end line. A callback returns nullptr to continue, or a
+// static reason string to abort the scan with a ParseError for that line.
+// Stops at the first malformed data line.
+template <typename OnIdentification, typename OnDataSet>
+std::expected<void, ParseError> scan(std::string_view telegram,
+                                     OnIdentification &&onIdentification,
+                                     OnDataSet &&onDataSet) {
+  while (!telegram.empty()) {
+    const std::size_t eol = telegram.find('\n');
+    std::string_view line = telegram.substr(0, eol);
+    telegram.remove_prefix(eol == std::string_view::npos ? telegram.size()
+                                                         : eol + 1);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+
+    if (line.empty() || line.front() == '!')
+      continue;
+
+    const char *err = nullptr;
+    if (line.front() == '/') {
+      err = onIdentification(line);
+    } else if (auto ds = parseDataSet(line)) {
+      err = onDataSet(*ds);
+    } else {
+      err = "Malformed OBIS expression";
+    }
+    if (err)
+      return std::unexpected(ParseError{line, err});
+  }
+  return {};
+}
+
+} // namespace Obis
+
+#endif /* OBIS_PARSER_H_ */
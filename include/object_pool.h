@@ -0,0 +1,119 @@
+#ifndef OBJECT_POOL_H_
+#define OBJECT_POOL_H_
+
+#include "mpsc_ring.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// ---------------------------------------------------------------------------
+// ObjectPool — a fixed set of reusable, reference-counted objects.
+//
+// The hand-off from a poll thread to its consumers used to build a fresh
+// std::string (and with it a heap block) per callback and again per queue.
+// A pool allocates its objects once; acquire() hands one out behind a Ref,
+// copies of the Ref share it, and the last Ref to go returns it to the pool.
+// The object itself is not destroyed on the way, so a std::string keeps its
+// capacity and the next assign() of a payload of similar size allocates
+// nothing. The caller overwrites what it uses; nothing is reset.
+//
+// The free list is an MpscRing of the idle objects, so acquire() and the
+// final release are a couple of atomics from any thread. When every object is
+// out (a consumer backed up behind a broker or database outage), acquire()
+// falls back to a heap object that is deleted on release rather than
+// pooled, counted in misses(): the pool never blocks a producer and never
+// drops a sample itself, and its size only decides how much of a backlog is
+// allocation-free.
+//
+// Lifetime: the pool must outlive every Ref it handed out.
+// ---------------------------------------------------------------------------
+
+template <typename T> class ObjectPool {
+  struct Node {
+    T value{};
+    std::atomic<std::uint32_t> refs{0};
+    ObjectPool *owner{nullptr}; // nullptr: a heap fallback, deleted on release
+  };
+
+public:
+  // Shared handle to a pooled object, like a std::shared_ptr whose count
+  // lives in the object (so copying it allocates nothing).
+  class Ref {
+  public:
+    Ref() = default;
+    Ref(const Ref &other) noexcept : node_(other.node_) {
+      if (node_)
+        node_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    Ref(Ref &&other) noexcept : node_(std::exchange(other.node_, nullptr)) {}
+    Ref &operator=(Ref other) noexcept {
+      std::swap(node_, other.node_);
+      return *this;
+    }
+    ~Ref() { reset(); }
+
+    void reset() noexcept {
+      Node *node = std::exchange(node_, nullptr);
+      // acq_rel: every holder's reads happen before the object is reused.
+      if (!node || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+      if (node->owner)
+        node->owner->free_.push(node);
+      else
+        delete node;
+    }
+
+    T &operator*() const noexcept { return node_->value; }
+    T *operator->() const noexcept { return &node_->value; }
+    explicit operator bool() const noexcept { return node_ != nullptr; }
+
+  private:
+    friend class ObjectPool;
+    explicit Ref(Node *node) noexcept : node_(node) {
+      node_->refs.store(1, std::memory_order_relaxed);
+    }
+    Node *node_{nullptr};
+  };
+
+  // Allocates all `capacity` objects up front.
+  explicit ObjectPool(std::size_t capacity)
+      : nodes_(std::make_unique<Node[]>(capacity)), free_(capacity) {
+    for (std::size_t i = 0; i < capacity; ++i) {
+      nodes_[i].owner = this;
+      free_.push(&nodes_[i]);
+    }
+  }
+
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool &operator=(const ObjectPool &) = delete;
+
+  // An idle object, or a heap one if none is left. Thread-safe.
+  Ref acquire() {
+    // tryPop() also comes back empty-handed while a release is between
+    // claiming its slot and filling it; only an empty list is a miss.
+    do {
+      if (auto node = free_.tryPop())
+        return Ref(*node);
+    } while (!free_.empty());
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return Ref(new Node{});
+  }
+
+  std::size_t capacity() const noexcept { return free_.capacity(); }
+  std::size_t idle() const noexcept { return free_.size(); }
+
+  // acquire() calls that had to allocate, since construction.
+  std::uint64_t misses() const noexcept {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::unique_ptr<Node[]> nodes_;
+  // Holds at most `capacity` nodes, so push() never drops one.
+  MpscRing<Node *> free_;
+  std::atomic<std::uint64_t> misses_{0};
+};
+
+#endif /* OBJECT_POOL_H_ */
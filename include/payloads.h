@@ -0,0 +1,89 @@
+#ifndef PAYLOADS_H_
+#define PAYLOADS_H_
+
+#include "config_yaml.h"
+#include "edge_aggregator.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include "site_energy.h"
+#include "site_snapshot.h"
+#include <string>
+
+// ---------------------------------------------------------------------------
+// Payload — the MQTT JSON payloads of the device masters.
+//
+// Each function writes one payload into `out`, replacing its contents but
+// keeping its capacity, so a master that passes the same buffer every poll
+// serialises without allocating. The field lists live in payloads.cpp as
+// Json::Field descriptor tuples; the layout is the one the masters built with
+// nlohmann::ordered_json, byte for byte (see the README payload examples).
+// The values payloads can also be written as CBOR or MessagePack
+// (mqtt.publish): the same maps and arrays with the same keys, from the same
+// descriptors.
+//
+// The device payloads list their keys alphabetically. The masters stored
+// them in an (unordered) nlohmann::json, which sorts its keys, so that is the
+// order subscribers have always received.
+// ---------------------------------------------------------------------------
+
+namespace Payload {
+
+// `phases` (1-3) and `inputs` (1-2) are the device's counts, clamped; the
+// per-input dc_energy is left out for a hybrid inverter.
+void inverterValues(std::string &out, const InverterTypes::Values &v,
+                    int phases, int inputs, bool hybrid,
+                    MqttEncoding encoding = MqttEncoding::Json);
+void inverterEvents(std::string &out, const InverterTypes::Events &e);
+void inverterDevice(std::string &out, const InverterTypes::Device &d);
+
+// Fronius (Modbus) meter; `phases` (1-3) is clamped.
+void froniusMeterValues(std::string &out, const MeterTypes::Values &v,
+                        int phases,
+                        MqttEncoding encoding = MqttEncoding::Json);
+void froniusMeterDevice(std::string &out, const MeterTypes::Device &d);
+
+// EBZ Easymeter: always three phases, and no total current.
+void easyMeterValues(std::string &out, const MeterTypes::Values &v,
+                     MqttEncoding encoding = MqttEncoding::Json);
+void easyMeterDevice(std::string &out, const MeterTypes::Device &d);
+
+// Edge aggregate (AggregateConfig): {"time", "bucket", "samples"} and the
+// bucket's "avg", "min", "max" and "last", each a full values document laid
+// out as above for the same device.
+void inverterAggregate(std::string &out,
+                       const Bucket<InverterTypes::Values> &b, int phases,
+                       int inputs, bool hybrid,
+                       MqttEncoding encoding = MqttEncoding::Json);
+void froniusMeterAggregate(std::string &out,
+                           const Bucket<MeterTypes::Values> &b, int phases,
+                           MqttEncoding encoding = MqttEncoding::Json);
+void easyMeterAggregate(std::string &out, const Bucket<MeterTypes::Values> &b,
+                        MqttEncoding encoding = MqttEncoding::Json);
+
+// Site energy (SiteEnergy): {"time", "day"} and the day's running
+// production, consumption, self_consumption, from_grid and to_grid.
+void siteEnergy(std::string &out, const SiteEnergyTotals &t,
+                MqttEncoding encoding = MqttEncoding::Json);
+
+// Site snapshot (SiteSnapshot): {"time", "complete", "production_power"},
+// "primary_power" when the primary meter reported, and "devices", each
+// reported device's values document keyed by its name.
+void siteSnapshot(std::string &out, const Snapshot &s,
+                  MqttEncoding encoding = MqttEncoding::Json);
+
+// Delta mode (MqttDeltaConfig): the time and the fields of `v` that moved
+// beyond `deadband` since `last`, laid out like the full document with only
+// the moved phases and inputs, each keeping its id. The written fields are
+// copied into `last`. Returns false, leaving `out` unspecified, if nothing
+// moved.
+bool valuesDelta(std::string &out, const InverterTypes::Values &v,
+                 InverterTypes::Values &last,
+                 const MqttDeadbandConfig &deadband,
+                 MqttEncoding encoding = MqttEncoding::Json);
+bool valuesDelta(std::string &out, const MeterTypes::Values &v,
+                 MeterTypes::Values &last, const MqttDeadbandConfig &deadband,
+                 MqttEncoding encoding = MqttEncoding::Json);
+
+} // namespace Payload
+
+#endif /* PAYLOADS_H_ */
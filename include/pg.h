@@ -2,14 +2,19 @@
 #define PG_H_
 
 #include "db_error.h"
+#include <chrono>
 #include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <expected>
 #include <libpq-fe.h>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <unordered_set>
 #include <vector>
 
 // ---------------------------------------------------------------------------
@@ -17,7 +22,7 @@
 //
 // A thin RAII layer over libpq, sized to exactly what the PostgreSQL consumer
 // and the schema migrator need: an owning connection, an explicit-transaction
-// guard, an owning result, and a text-format parameter builder. It exists so
+// guard, an owning result, and a parameter builder. It exists so
 // those two translation units can talk to libpq without hand-rolling PQclear /
 // PQfinish lifetimes or the const char* const* parameter marshalling, and so
 // the rest of the project keeps depending only on the stable C client library
@@ -96,15 +101,22 @@ private:
 // ---------------------------------------------------------------------------
 // Params
 //
-// Builds the parameter arrays for PQexecParams in text format. Every value is
-// rendered to a string up front; a SQL NULL is a std::nullopt slot, surfaced
-// to libpq as a null pointer. Pointers into the stored strings are materialized
-// only by values(), after the builder is fully populated, so vector growth
-// during construction can never dangle them.
+// Builds the parameter arrays for PQexecParams / PQexecPrepared. Numbers,
+// booleans and timestamps are encoded up front in the server's binary wire
+// format, tagged with their type OID, so the hot insert path neither formats
+// nor parses a float; strings go as text with an unspecified type, left for
+// the server to infer from the use site. A SQL NULL is a std::nullopt slot,
+// surfaced to libpq as a null pointer. Pointers into the stored cells are
+// materialized only by values(), after the builder is fully populated, so
+// vector growth during construction can never dangle them.
 //
-// Booleans render as "t"/"f"; non-finite floats render as the canonical
-// PostgreSQL spellings "NaN"/"Infinity"/"-Infinity"; finite floats use the
-// shortest round-trippable form. std::optional<T> binds *value or NULL.
+// Binary encodings (network byte order): bool -> bool, short -> int2, int ->
+// int4, long / long long -> int8, float -> float4, double -> float8 (NaN and
+// the infinities carry through natively), and a std::chrono::sys_time ->
+// timestamptz as int64 microseconds since 2000-01-01 UTC, which assumes the
+// integer-datetimes server build every supported PostgreSQL release uses.
+// std::optional<T> binds *value, or NULL typed as T so a statement prepared on
+// a NULL row keeps the type the non-NULL rows are encoded in.
 // ---------------------------------------------------------------------------
 
 class Params {
@@ -119,41 +131,52 @@ public:
     requires(sizeof...(Ts) != 1 ||
              (!std::same_as<std::remove_cvref_t<Ts>, Params> && ...))
   explicit Params(Ts &&...values) {
-    cells_.reserve(sizeof...(Ts));
+    reserve(sizeof...(Ts));
     (add(std::forward<Ts>(values)), ...);
   }
 
-  Params &add(std::nullptr_t) {
-    cells_.emplace_back(std::nullopt);
-    return *this;
-  }
+  Params &add(std::nullptr_t) { return addCell(std::nullopt, 0, 0); }
   Params &add(std::string value) {
-    cells_.emplace_back(std::move(value));
-    return *this;
+    return addCell(std::move(value), 0, 0);
   }
   Params &add(std::string_view value) {
-    cells_.emplace_back(std::string{value});
-    return *this;
-  }
-  Params &add(const char *value) {
-    cells_.emplace_back(std::string{value});
-    return *this;
+    return addCell(std::string{value}, 0, 0);
   }
+  Params &add(const char *value) { return addCell(std::string{value}, 0, 0); }
   Params &add(bool value) {
-    cells_.emplace_back(value ? "t" : "f");
-    return *this;
+    return addCell(std::string(1, value ? '\1' : '\0'), BOOLOID, 1);
+  }
+  Params &add(short value) { return addInteger<std::int16_t>(value, INT2OID); }
+  Params &add(int value) { return addInteger<std::int32_t>(value, INT4OID); }
+  Params &add(long value) { return addInteger<std::int64_t>(value, INT8OID); }
+  Params &add(long long value) {
+    return addInteger<std::int64_t>(value, INT8OID);
+  }
+  Params &add(float value);
+  Params &add(double value);
+
+  template <typename Duration>
+  Params &add(std::chrono::sys_time<Duration> value) {
+    using std::chrono::microseconds;
+    return addTimestamp(
+        std::chrono::floor<microseconds>(value).time_since_epoch());
   }
-  Params &add(short value) { return addInteger(value); }
-  Params &add(int value) { return addInteger(value); }
-  Params &add(long value) { return addInteger(value); }
-  Params &add(long long value) { return addInteger(value); }
-  Params &add(float value) { return addFloat(value); }
-  Params &add(double value) { return addFloat(value); }
 
   template <typename T> Params &add(const std::optional<T> &value) {
     if (value)
       return add(*value);
-    return add(nullptr);
+    add(T{});
+    cells_.back().reset();
+    lengths_.back() = 0;
+    return *this;
+  }
+
+  // Reserve room for n parameters (e.g. a multi-row statement's full width).
+  void reserve(std::size_t n) {
+    cells_.reserve(n);
+    types_.reserve(n);
+    lengths_.reserve(n);
+    formats_.reserve(n);
   }
 
   // Number of bound parameters (the nParams argument to PQexecParams).
@@ -165,14 +188,46 @@ public:
   // until this Params is destroyed.
   const char *const *values() const;
 
+  // The paramTypes / paramLengths / paramFormats arrays: the type OID (0 for a
+  // text cell, left to the server), the byte length of a binary cell, and the
+  // format code (0 text, 1 binary), one entry per parameter.
+  const Oid *types() const noexcept { return types_.data(); }
+  const int *lengths() const noexcept { return lengths_.data(); }
+  const int *formats() const noexcept { return formats_.data(); }
+
 private:
-  template <typename T> Params &addInteger(T value) {
-    cells_.emplace_back(std::to_string(value));
+  // Built-in type OIDs (pg_type.dat); stable across server versions.
+  static constexpr Oid BOOLOID = 16;
+  static constexpr Oid INT8OID = 20;
+  static constexpr Oid INT2OID = 21;
+  static constexpr Oid INT4OID = 23;
+  static constexpr Oid FLOAT4OID = 700;
+  static constexpr Oid FLOAT8OID = 701;
+  static constexpr Oid TIMESTAMPTZOID = 1184;
+
+  // Append one cell. A zero type OID marks a text cell; any other is binary
+  // and `length` is its byte count.
+  Params &addCell(std::optional<std::string> cell, Oid type, int length) {
+    cells_.push_back(std::move(cell));
+    types_.push_back(type);
+    lengths_.push_back(length);
+    formats_.push_back(type == 0 ? 0 : 1);
     return *this;
   }
-  template <typename T> Params &addFloat(T value);
+
+  template <typename Int, typename T> Params &addInteger(T value, Oid type) {
+    return addBinary(static_cast<std::uint64_t>(static_cast<Int>(value)),
+                     sizeof(Int), type);
+  }
+  Params &addTimestamp(std::chrono::microseconds sinceUnixEpoch);
+
+  // Append the low `size` bytes of `bits` in network byte order.
+  Params &addBinary(std::uint64_t bits, std::size_t size, Oid type);
 
   std::vector<std::optional<std::string>> cells_;
+  std::vector<Oid> types_;
+  std::vector<int> lengths_;
+  std::vector<int> formats_;
   mutable std::vector<const char *> ptrs_;
 };
 
@@ -186,12 +241,18 @@ private:
 // free of <libpq-fe.h>.
 //
 // Statements run directly on the connection: exec() wraps PQexec (no
-// parameters, accepts a multi-statement body, e.g. a migration file) and
-// execParams() wraps PQexecParams (text-format parameters, single statement).
-// Both return the result or a DbError built from the server SQLSTATE; a dropped
-// link is reported as PROTOCOL. There is no transaction object in libpq: a
-// transaction is a BEGIN/COMMIT bracket on the connection, expressed by the
-// Transaction guard below, and execs issued while it is alive run inside it.
+// parameters, accepts a multi-statement body, e.g. a migration file),
+// execParams() wraps PQexecParams (one statement, parsed per call) and
+// execPrepared() runs a named prepared statement, preparing it on this
+// connection the first time the name is used. All return the result or a
+// DbError built from the server SQLSTATE; a dropped link is reported as
+// PROTOCOL. Prepared statements live and die with the session, so the set of
+// names already prepared is tracked here and starts empty on a new Conn: a
+// caller that reconnects just keeps passing the same name and SQL, and each
+// statement is re-prepared on its first use. There is no transaction object
+// in libpq: a transaction is a BEGIN/COMMIT bracket on the connection,
+// expressed by the Transaction guard below, and execs issued while it is alive
+// run inside it.
 // ---------------------------------------------------------------------------
 
 class Conn {
@@ -200,11 +261,15 @@ public:
       : conn_(PQconnectdb(dsn.c_str())) {}
   ~Conn() { close(); }
 
-  Conn(Conn &&other) noexcept : conn_(other.conn_) { other.conn_ = nullptr; }
+  Conn(Conn &&other) noexcept
+      : conn_(other.conn_), prepared_(std::move(other.prepared_)) {
+    other.conn_ = nullptr;
+  }
   Conn &operator=(Conn &&other) noexcept {
     if (this != &other) {
       close();
       conn_ = other.conn_;
+      prepared_ = std::move(other.prepared_);
       other.conn_ = nullptr;
     }
     return *this;
@@ -227,12 +292,21 @@ public:
   std::expected<Result, DbError>
   exec(std::string_view sql, DbError::Kind errKind = DbError::Kind::QUERY);
 
-  // Run a single parameterized statement via PQexecParams in text format. See
-  // Params for how values are marshalled; errKind handling matches exec().
+  // Run a single parameterized statement via PQexecParams. See Params for how
+  // values are marshalled; errKind handling matches exec().
   std::expected<Result, DbError>
   execParams(std::string_view sql, const Params &params,
              DbError::Kind errKind = DbError::Kind::QUERY);
 
+  // Run the prepared statement `name` via PQexecPrepared, first preparing
+  // `sql` under that name (PQprepare, parameter types taken from `params`) if
+  // this connection has not prepared it yet. A name must always be paired with
+  // the same SQL and parameter types. errKind handling matches exec().
+  std::expected<Result, DbError>
+  execPrepared(const std::string &name, std::string_view sql,
+               const Params &params,
+               DbError::Kind errKind = DbError::Kind::QUERY);
+
   // Quote an SQL identifier (schema name) for safe interpolation into DDL, via
   // PQescapeIdentifier. Returns the quoted identifier including the surrounding
   // double quotes. An allocation failure yields an empty string, which surfaces
@@ -259,12 +333,18 @@ public:
     if (conn_)
       PQfinish(conn_);
     conn_ = nullptr;
+    prepared_.clear();
   }
 
   PGconn *get() const noexcept { return conn_; }
 
 private:
+  // Pipeline sends prepared statements itself and records the ones it has
+  // seen prepared successfully.
+  friend class Pipeline;
+
   PGconn *conn_{nullptr};
+  std::unordered_set<std::string> prepared_;
 };
 
 // ---------------------------------------------------------------------------
@@ -311,6 +391,89 @@ private:
   Conn *conn_{nullptr};
 };
 
+// ---------------------------------------------------------------------------
+// Pipeline
+//
+// Scope guard for libpq pipeline mode (PQenterPipelineMode), which sends
+// statements back to back without waiting for each result, so a batch costs
+// one round trip instead of one per statement. Work is grouped into units: the
+// statements send()s queue up to the next sync() form one unit, which the
+// server runs as one implicit transaction. If a statement fails, the server
+// skips the rest of its unit and rolls it back, but the next unit runs
+// normally, so a caller that makes one unit per event gets per-event error
+// attribution: collect() returns the outcome of the oldest synced unit, its
+// first failure classified exactly like exec() (a dropped link is PROTOCOL).
+//
+// A named send() runs as that prepared statement. If the connection has not
+// prepared it yet, the Prepare is sent inline and the name is recorded on the
+// Conn once it is confirmed; until then later sends of the same name go out
+// as unnamed statements, so a Prepare skipped by an earlier failure in its unit
+// can never leave another unit pointing at a missing statement.
+//
+// send()/sync() fail only when libpq cannot queue the message, which leaves
+// the pipeline in an unknown state, so that is always reported as PROTOCOL and
+// the caller reconnects. Results are read in blocking mode: a caller sending
+// many units should collect() every so often so the unread results stay well
+// within the socket buffers. On destruction any synced units are drained and
+// pipeline mode is exited; a unit sent but never synced cannot be discarded
+// without committing it, so the guard closes the connection instead, which the
+// server treats as a rollback. While the guard is alive the connection is in
+// pipeline mode, where libpq rejects Conn's synchronous calls (exec(),
+// execParams(), execPrepared(), Transaction): use only the guard's own.
+//
+// Move-only and move-constructible (so enter() can return it by value); the
+// moved-from guard is inert.
+// ---------------------------------------------------------------------------
+
+class Pipeline {
+public:
+  static std::expected<Pipeline, DbError> enter(Conn &conn);
+
+  ~Pipeline();
+
+  Pipeline(Pipeline &&other) noexcept
+      : conn_(other.conn_), steps_(std::move(other.steps_)),
+        preparing_(std::move(other.preparing_)), units_(other.units_),
+        unsynced_(other.unsynced_) {
+    other.conn_ = nullptr;
+  }
+  Pipeline &operator=(Pipeline &&) = delete;
+  Pipeline(const Pipeline &) = delete;
+  Pipeline &operator=(const Pipeline &) = delete;
+
+  // Queue one statement of the current unit. An empty name sends `sql` as an
+  // unnamed statement (PQsendQueryParams); otherwise see the class comment.
+  std::expected<void, DbError> send(const std::string &name,
+                                    std::string_view sql, const Params &params);
+
+  // Close the current unit with a sync point (PQpipelineSync) and flush.
+  std::expected<void, DbError> sync();
+
+  // Wait for the oldest synced unit and return its outcome. errKind labels
+  // statement failures, as for Conn::exec().
+  std::expected<void, DbError>
+  collect(DbError::Kind errKind = DbError::Kind::QUERY);
+
+  // Synced units not yet collected.
+  std::size_t outstanding() const noexcept { return units_; }
+
+private:
+  explicit Pipeline(Conn &conn) noexcept : conn_(&conn) {}
+
+  // One expected result, in send order.
+  struct Step {
+    enum class Kind { PREPARE, QUERY, SYNC };
+    Kind kind;
+    std::string name; // PREPARE only
+  };
+
+  Conn *conn_{nullptr};
+  std::deque<Step> steps_;
+  std::unordered_set<std::string> preparing_;
+  std::size_t units_{0};
+  std::size_t unsynced_{0};
+};
+
 } // namespace pg
 
 #endif /* PG_H_ */
@@ -3,22 +3,30 @@
 
 #include "config_yaml.h"
 #include "db_error.h"
+#include "edge_aggregator.h"
 #include "inverter_types.h"
+#include "memory_budget.h"
 #include "meter_types.h"
+#include "metrics.h"
+#include "mpsc_ring.h"
 #include "signal_handler.h"
+#include "site_energy.h"
+#include "site_snapshot.h"
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <expected>
 #include <memory>
 #include <mutex>
 #include <optional>
-#include <queue>
+#include <span>
 #include <spdlog/logger.h>
 #include <string>
+#include <string_view>
 #include <thread>
-#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -28,31 +36,103 @@
 // (notably main.cpp).
 namespace pg {
 class Conn;
+class Pipeline;
 }
+class Spool;
 
 // ---------------------------------------------------------------------------
 // PostgresClient
 //
 // Optional time-series consumer for inverter and meter data, peer to
 // MqttClient. Receives typed device and value structs via callbacks, enqueues
-// them onto a bounded in-memory queue, and writes them out from a single worker
-// thread that owns the libpq connection.
+// them onto a bounded in-memory queue, and writes them out from a worker
+// thread that owns the libpq connection. The queue is a lock-free MpscRing, so
+// a producer callback never blocks on the worker; the worker sleeps on an
+// eventfd Wakeup between batches.
+//
+// Writer pool: with PostgresConfig::writers above 1 there are that many
+// workers ("writers"), each with its own connection, queue, prepared
+// statements and reconnect backoff. Device `id` belongs to writer
+// `id % writers` for the life of the process, so a device's events stay in
+// order, and a slow transaction or a dropped link holds up only the devices
+// of its writer. The assignment is not moved on a reconnect: moving a device
+// would first have to drain its events from the old writer to keep their
+// order, and the writers all reach the same server. queueSize and the spool
+// high watermark are split evenly between the writers.
 //
 // Per-device schemas: each configured device gets its own PostgreSQL schema
 // named after the device (e.g. "primo", "grid", "heatpump"). There is no
 // central device registry and no device_id - identity is the schema. The
-// device's configured `name`, threaded through every callback, is both the
-// schema name and the key into the in-memory caches. On a device's first
+// callbacks carry the device's DeviceId, its index in the registry passed to
+// the constructor; it indexes the in-memory caches, and the registry entry's
+// `name` is the schema name. On a device's first
 // Device event the worker lazily creates/verifies its schema (via
 // SchemaMigrator) and builds the schema-qualified SQL it will reuse for that
 // device; value rows then insert straight into that schema.
 //
+// Startup migration: so that a large roster does not sit on one schema's DDL
+// after another while its first samples queue up, the worker first migrates
+// (or verifies) every registry schema at once, on PostgresConfig::
+// migrateConnections short-lived connections of its own, and builds the SQL
+// up front. The first Device event then only upserts. The time to the ready
+// schemas and to the first inserted sample is logged and exported.
+//
 // All fallible setup beyond config validation (connect, extension check,
 // schema migration, device upserts) happens on the worker thread so a
 // transient DB outage at startup does not block the rest of the bridge.
 //
+// Batching: the worker drains up to PostgresConfig::batchSize queued events at
+// a time (lingering up to lingerMs for a partial batch to fill) and writes each
+// run of consecutive value events in one transaction, as one multi-row INSERT
+// per device and table. Device events are written on their own between runs,
+// so a first-sight migration still lands before the device's values. A
+// row-level failure rolls the run back and it is retried one event per
+// transaction, so only the offending event is lost, as in the unbatched path.
+// With PostgresConfig::pipeline the run is instead sent in libpq pipeline mode
+// as one unit (implicit transaction) per event, and each unit's result is
+// attributed back to its event, so no retry pass is needed.
+//
+// Edge aggregates: with an `aggregate:` section main hands each closed
+// bucket's power envelope to onPowerBucket(), for the device's power_edge
+// table, and without forward_raw the bucket's representative row
+// (Edge::sample()) to onInverter()/onMeter() in place of the raw samples.
+// Power buckets are value events: batched, and spooled in an outage.
+//
+// Site energy: with a `site_energy:` section SiteSink hands the streaming
+// site balance's increments to onSiteEnergy(), and writer 0 adds them to the
+// day's public.site_energy row through public.add_site_energy(). They are
+// written on their own, like device events, and neither batched nor spooled:
+// the nightly rollup rewrites the row from the stored samples anyway.
+//
+// Site snapshot: with a `snapshot:` section SnapshotSink hands every closed
+// tick to onSiteSnapshot(), and writer 0 upserts it into
+// public.site_snapshot, keyed by its time. Each is written on its own like
+// the site energy, and not spooled: a snapshot is a view of samples the
+// device tables keep anyway.
+//
+// Outage spool: with PostgresConfig::spool, value events stop going to the
+// memory queue once it holds highWatermark events and are appended to an
+// on-disk Spool instead, and keep going there until the spool has drained, so
+// replay stays in arrival order. Device events always stay in memory. Once
+// connected, fillBatch() takes from the spool after the memory queue, into the
+// same batched write path. The spool is one file shared by the writers: a
+// writer replaying it hands each record to the writer owning its device, up
+// to a batch each, so the replay moves at the pace of the slowest writer. A
+// spooled record is committed on disk only once every record handed out has
+// been written. A spooled record waits for its device's upsert (after a
+// restart the caches start empty), for at most spoolDeviceWait. On shutdown
+// the value events still in memory are spilled too, so they survive the
+// restart.
+//
+// Memory budget: in the low-memory profile the memory queue is capped at
+// half the MemoryBudget's worth of slots, reserved from it at construction,
+// and the spool's watermark at the queue's capacity. The PostgreSQL charge is
+// the preallocated ring itself: an Event is a fixed-size record, the value
+// structs the spool stores with one memcpy; only the rare device events carry
+// strings.
+//
 // Lifetime: held as std::unique_ptr<PostgresClient> in main(); the
-// destructor wakes and joins the worker (std::jthread).
+// destructor wakes and joins the writers (std::jthread).
 // ---------------------------------------------------------------------------
 
 class PostgresClient {
@@ -60,9 +140,12 @@ public:
   // Throws std::invalid_argument on bad config (empty DSN). Connection
   // failures are not raised here - the worker handles them via the reconnect
   // loop. autoMigrate (from cfg) selects migrate vs verify per schema.
+  // With a `memory` budget the queue's slots are reserved from it (see
+  // MemoryBudget), at most half of it.
   PostgresClient(const PostgresConfig &cfg,
                  std::vector<DeviceRegistryEntry> registry,
-                 std::optional<SiteConfig> site, SignalHandler &signalHandler);
+                 std::optional<SiteConfig> site, SignalHandler &signalHandler,
+                 MemoryBudget *memory = nullptr);
 
   ~PostgresClient();
 
@@ -73,117 +156,308 @@ public:
 
   // Producer-side callbacks, wired in main() to InverterMaster / MeterMaster.
   // Non-blocking: they enqueue and return. Safe to call from any thread.
-  // `deviceName` is the configured device name; it selects the schema and the
+  // `device` is an index into the registry; it selects the schema and the
   // cache slot the worker routes to.
-  void onInverterDevice(std::string deviceName, InverterTypes::Device dev);
-  void onMeterDevice(std::string deviceName, MeterTypes::Device dev);
-  void onInverter(std::string deviceName, InverterTypes::Values values);
-  void onMeter(std::string deviceName, MeterTypes::Values values);
+  void onInverterDevice(DeviceId device, InverterTypes::Device dev);
+  void onMeterDevice(DeviceId device, MeterTypes::Device dev);
+  void onInverter(DeviceId device, InverterTypes::Values values);
+  void onMeter(DeviceId device, MeterTypes::Values values);
+  void onPowerBucket(DeviceId device, PowerBucket bucket);
+  void onSiteEnergy(SiteEnergyDelta delta);
+  void onSiteSnapshot(SnapshotRow row);
+
+  // Take a reload's roster, the slots `registry` holds now (a DeviceId keeps
+  // its slot). Each writer moves to it at its first event enqueued after
+  // this, dropping the cache of a slot whose device changed; writer 0 then
+  // syncs public.device_registry, unless PostgresConfig::syncRegistry is
+  // cleared. Call with the changed devices' samples dispatched and before
+  // the new ones'.
+  void reload(std::vector<DeviceRegistryEntry> registry);
+
+  // Events dropped from the full memory queue since construction.
+  std::uint64_t droppedEvents() const noexcept;
+
+  // Upsert `registry` into public.device_registry, drop the rows of devices
+  // no longer in it, and write `site` into public.site. The writers run it
+  // once per process, after the public schema is brought up to date, and
+  // writer 0 after each reload(), unless PostgresConfig::syncRegistry is
+  // cleared; with a cluster the leader runs
+  // it on its own connection instead (see ClusterCoordinator).
+  static std::expected<void, DbError>
+  syncRegistry(pg::Conn &conn, const std::vector<DeviceRegistryEntry> &registry,
+               const std::optional<SiteConfig> &site);
 
 private:
-  // Tagged payload for the worker queue. `deviceName` carries the schema /
-  // cache identity so the worker need not inspect the payload to route it.
+  // Tagged payload for the worker queue. `device` carries the schema / cache
+  // identity so the worker need not inspect the payload to route it.
+  // `spooled` marks an event replayed from the spool, which still holds it.
+  // `enqueued` is stamped by enqueue() for the commit latency metric, and
+  // `roster` with the reloads taken so far. RosterChange is the event
+  // reload() sends writer 0.
+  struct RosterChange {};
   struct Event {
-    std::string deviceName;
+    DeviceId device{0};
     std::variant<InverterTypes::Device, MeterTypes::Device,
-                 InverterTypes::Values, MeterTypes::Values>
+                 InverterTypes::Values, MeterTypes::Values, PowerBucket,
+                 SiteEnergyDelta, SnapshotRow, RosterChange>
         payload;
+    bool spooled{false};
+    std::uint64_t roster{0};
+    std::chrono::steady_clock::time_point enqueued{};
   };
 
-  // Producer-side: push respecting the overflow policy (drop-oldest), with
-  // rate-limited drop logging.
+  // One worker of the pool: its thread, connection and queue, and the events
+  // of the devices it owns. Everything but `replay` is touched only by the
+  // writer's thread and, for `queue` and `wake`, the producers.
+  struct Writer {
+    Writer(std::size_t index, std::size_t queueSize);
+    const std::size_t index;
+    MpscRing<Event> queue;
+    Wakeup wake;
+    std::unique_ptr<pg::Conn> conn;
+    // Events taken off the queue but not yet written. Survives a reconnect so
+    // a batch interrupted by a dropped link is retried, not lost.
+    std::vector<Event> batch;
+    // Spooled records handed to this writer by replaySpool(), oldest first.
+    // Under spoolMutex_.
+    std::deque<Event> replay;
+    // The roster the writer's events are written under, and its epoch.
+    std::vector<DeviceRegistryEntry> registry;
+    std::uint64_t roster{0};
+    // Writer 0: public.device_registry holds `registry`.
+    bool registrySynced{false};
+    std::jthread thread; // joined by ~PostgresClient()
+  };
+
+  // Producer-side: push respecting the overflow policy (drop-oldest, or the
+  // spool past its watermark), with rate-limited drop logging.
   void enqueue(Event ev);
 
-  // Worker entry point. Owns the connection and the caches.
-  void run();
+  // The writer owning `device`.
+  Writer &writerOf(DeviceId device) const;
+
+  // Writer entry point. Owns the writer's connection and its devices' cache
+  // slots.
+  void run(Writer &w);
+
+  // Writer helpers.
+  std::expected<void, DbError> connectAndPrepare(Writer &w);
+  // Write one event. With a pipeline, a value event's statements are queued
+  // on it as one unit instead of run; device events always run directly.
+  std::expected<void, DbError> processEvent(Writer &w, const Event &ev,
+                                            pg::Pipeline *pipeline = nullptr);
+
+  // Top w.batch up from the queue and then the spool, waiting for the first
+  // event and then up to the linger window for the batch to fill. Returns
+  // false on shutdown.
+  bool fillBatch(Writer &w);
+
+  // Hand the spool's oldest records to the replay queues of the writers
+  // owning their devices, while each record's device upsert has run and its
+  // writer has room: `self`'s is what its batch can still take, the others'
+  // a batch. Records of a device that stays unknown past spoolDeviceWait are
+  // dropped. Called under spoolMutex_.
+  void replaySpool(Writer &self);
+
+  // The registry index of `name`, for spooled records, which store the name
+  // so they survive a roster change across restarts.
+  std::optional<DeviceId> deviceIdOf(std::string_view name) const;
+
+  // The name of `device` in the latest roster, and of `ev`'s device in the
+  // roster it was enqueued under.
+  std::string nameOf(DeviceId device) const;
+  std::string nameOf(const Writer &w, const Event &ev) const;
+
+  // Move the writer to the latest roster (see reload()). Returns writer 0's
+  // registry sync error.
+  std::expected<void, DbError> adoptRoster(Writer &w);
+
+  // Move the writer's unwritten value events still in memory into the spool
+  // on shutdown.
+  void spillOnShutdown(Writer &w);
+
+  // Write w.batch out, erasing each event once it is committed or dropped.
+  // Returns only the errors that end the drain loop (FATAL, or PROTOCOL), in
+  // which case w.batch keeps the unwritten events for the next connection.
+  std::expected<void, DbError> writeBatch(Writer &w);
 
-  // Worker helpers.
-  std::expected<void, DbError> connectAndPrepare();
-  std::expected<void, DbError> processEvent(const Event &ev);
+  // Record the enqueue-to-commit latency of w.batch[0, end), once those
+  // events are written or dropped. Spooled events are skipped: their wait is
+  // the outage, not the write path.
+  void observeWritten(const Writer &w, std::size_t end);
 
-  // Upsert the configured device roster into public.device_registry and drop
-  // rows for devices no longer configured. Runs once per process, after the
-  // public schema is brought up to date.
-  std::expected<void, DbError> syncRegistry();
+  // Pipelined write of the value events w.batch[done, end), advancing `done`
+  // past each event as its result is collected. Returns only drain-ending
+  // errors, like writeBatch().
+  std::expected<void, DbError> writePipelined(Writer &w, std::size_t &done,
+                                              std::size_t end);
+
+  // Migrate or verify every schema of `registry` in parallel, each worker on
+  // its own connection, then build their SQL into readyInverters_ /
+  // readyMeters_. Runs once per process, after the roster sync. A schema that
+  // fails is logged and left to the lazy path, which retries it and reports
+  // its error as before.
+  void migrateRoster(const pg::Conn &conn,
+                     const std::vector<DeviceRegistryEntry> &registry);
+
+  // Log and export the time from construction to the first value row
+  // written. Called after each successful value insert; acts only once.
+  void noteFirstInsert();
 
   std::expected<void, DbError>
-  upsertInverterDevice(const std::string &name,
+  upsertInverterDevice(Writer &w, DeviceId device,
                        const InverterTypes::Device &dev);
-  std::expected<void, DbError> upsertMeterDevice(const std::string &name,
-                                                 const MeterTypes::Device &dev);
   std::expected<void, DbError>
-  insertInverterValues(const std::string &name, const InverterTypes::Values &v);
-  std::expected<void, DbError> insertMeterValues(const std::string &name,
-                                                 const MeterTypes::Values &v);
+  upsertMeterDevice(Writer &w, DeviceId device, const MeterTypes::Device &dev);
+  // Add one day's site-energy increments through public.add_site_energy().
+  std::expected<void, DbError> addSiteEnergy(Writer &w,
+                                             const SiteEnergyDelta &delta);
+  // Upsert one snapshot into public.site_snapshot.
+  std::expected<void, DbError> upsertSiteSnapshot(Writer &w,
+                                                  const SnapshotRow &row);
+  // Insert a run of value events (inverter and/or meter values, power
+  // buckets) in one transaction, batching the rows of each device into one
+  // multi-row INSERT per table.
+  // With a pipeline the statements are queued on it and closed with a sync
+  // point, the unit taking the place of the transaction.
+  std::expected<void, DbError>
+  insertValues(Writer &w, std::span<const Event> events,
+               pg::Pipeline *pipeline = nullptr);
 
   // Sleep with backoff, observing handler_.isRunning() so shutdown is
   // responsive.
-  void sleepBackoff(std::chrono::seconds duration);
+  void sleepBackoff(Writer &w, std::chrono::seconds duration);
 
   // Open the libpq SQL trace file (lazy, once per process) and attach the
-  // current connection. Guarded by the caller on trace log level.
-  void attachSqlTrace();
+  // writer's current connection. Guarded by the caller on trace log level;
+  // called under setupMutex_.
+  void attachSqlTrace(Writer &w);
 
   // ------ config / shared services
   PostgresConfig cfg_;
+  // The latest roster, and the number of reloads taken. The writers work
+  // from their own copy (Writer::registry); rosterMutex_ guards registry_
+  // for reload() and the cold paths that name a device.
+  mutable std::mutex rosterMutex_;
   std::vector<DeviceRegistryEntry> registry_;
+  std::atomic<std::uint64_t> roster_{0};
   std::optional<SiteConfig> site_;
   SignalHandler &handler_;
   std::shared_ptr<spdlog::logger> postgresLogger_;
+  const std::chrono::steady_clock::time_point started_{
+      std::chrono::steady_clock::now()};
+
+  // libpq SQL trace sink, shared by the writers' connections. Declared
+  // before writers_ so reverse-order member destruction tears the
+  // connections down first (PQfinish stops libpq writing to the FILE*) and
+  // only then closes the file.
+  struct FileCloser {
+    void operator()(std::FILE *f) const noexcept {
+      if (f)
+        std::fclose(f);
+    }
+  };
+  std::unique_ptr<std::FILE, FileCloser> sqlTraceFile_;
 
-  // ------ producer/consumer queue
-  mutable std::mutex queueMutex_;
-  std::condition_variable queueCv_;
-  std::queue<Event> queue_;
-  std::size_t droppedSinceLastLog_{0};
+  // ------ producer/consumer queues, one per writer. The threads are started
+  //        by the constructor once every member is valid.
+  std::vector<std::unique_ptr<Writer>> writers_;
+  std::size_t spoolWatermark_{0}; // per writer's queue
+  std::atomic<std::size_t> droppedSinceLastLog_{0};
 
-  // ------ worker-thread-only state (no locking required)
+  // Seconds from construction to the ready schemas / the first value row,
+  // 0 until reached. Written by the worker, read by the metrics callbacks.
+  std::atomic<double> schemasReadySeconds_{0.0};
+  std::atomic<double> firstInsertSeconds_{0.0};
+
+  // ------ metrics. The callbacks read the queues and the startup times, so
+  //        they are declared after them and unhooked before they are
+  //        destroyed.
+  Metrics::Histogram &commitLatency_;
+  Metrics::Registration queueDepthMetric_;
+  Metrics::Registration droppedMetric_;
+  Metrics::Registration schemasReadyMetric_;
+  Metrics::Registration firstInsertMetric_;
+
+  // ------ outage spool, shared by the producers and the worker under
+  //        spoolMutex_ (taken only while spilling or replaying)
+  std::mutex spoolMutex_;
+  std::unique_ptr<Spool> spool_; // null without PostgresConfig::spool
+  // Set while value events go to the spool instead of the memory queues.
+  std::atomic<bool> spooling_{false};
+  // Set while the spool's oldest record waits for its device's upsert.
+  std::optional<std::chrono::steady_clock::time_point> spoolWaitUntil_;
+  // Spooled records handed to a writer and not yet written or dropped. The
+  // spool is committed when this drops to zero.
+  std::size_t spoolInFlight_{0};
+
+  // ------ writer-thread state
   //
-  // Keyed on the configured device name (= schema name). Each entry caches the
-  // device descriptor, the cardinality/modal flags that decide which child
-  // rows to write, and the schema-qualified SQL built once when the schema is
-  // first set up. Caching the SQL (rather than preparing statements) keeps the
-  // per-schema story simple and survives reconnects unchanged: the strings are
-  // connection-independent, so a reconnect just replays the cached upserts with
-  // no statements to re-register.
+  // Indexed by DeviceId, one slot per registry entry, empty until the device's
+  // first upsert (an inverter's slot in cachedMeters_ stays empty, and the
+  // other way round). A slot is touched only by the writer owning the device,
+  // so needs no lock. Each entry caches the device descriptor, the
+  // cardinality/modal flags that decide which child rows to write, and the
+  // schema-qualified SQL built once when the schema is first set up, together
+  // with the prepared-statement name for each statement ("<device>.<table>",
+  // unique because device names are). The name/SQL pairs are
+  // connection-independent: pg::Conn prepares a statement the first time its
+  // name is used on a connection, so after a reconnect the replayed upserts
+  // and the first values re-prepare from this cache with no separate
+  // re-registration step. The *Sql value/phase/input strings are the "INSERT
+  // INTO ... (cols) VALUES " prefixes; insertValues() appends one placeholder
+  // tuple per row.
 
   struct CachedInverter {
     InverterTypes::Device device; // last upsert, replayed on reconnect
     bool isHybrid{false};
     int phases{0};
     int inputs{0};
+    std::string upsertStmt;
+    std::string valuesStmt;
+    std::string phaseStmt;
+    std::string inputStmt;
+    std::string edgeStmt;
     std::string upsertSql;
     std::string valuesSql;
     std::string phaseSql;
     std::string inputSql;
+    std::string edgeSql;
   };
 
   struct CachedMeter {
     MeterTypes::Device device;
     int phases{0};
+    std::string upsertStmt;
+    std::string valuesStmt;
+    std::string phaseStmt;
+    std::string edgeStmt;
     std::string upsertSql;
     std::string valuesSql;
     std::string phaseSql;
+    std::string edgeSql;
   };
 
-  // libpq SQL trace sink. Declared before conn_ so reverse-order member
-  // destruction tears the connection down first (PQfinish stops libpq writing
-  // to the FILE*) and only then closes the file.
-  struct FileCloser {
-    void operator()(std::FILE *f) const noexcept {
-      if (f)
-        std::fclose(f);
-    }
-  };
-  std::unique_ptr<std::FILE, FileCloser> sqlTraceFile_;
+  std::vector<std::optional<CachedInverter>> cachedInverters_;
+  std::vector<std::optional<CachedMeter>> cachedMeters_;
+  // Built by migrateRoster() for schemas that are ready, and moved into the
+  // cache above by the device's first upsert, which then skips the migrator.
+  std::vector<std::optional<CachedInverter>> readyInverters_;
+  std::vector<std::optional<CachedMeter>> readyMeters_;
+  // Set once the device's cache slot is, for replaySpool(), which runs on any
+  // writer.
+  std::unique_ptr<std::atomic<bool>[]> deviceCached_;
 
-  std::unique_ptr<pg::Conn> conn_;
-  std::unordered_map<std::string, CachedInverter> cachedInverters_;
-  std::unordered_map<std::string, CachedMeter> cachedMeters_;
-  bool extensionsChecked_{false};
+  // The cache entry for schema `name`, SQL built, device not yet upserted.
+  static CachedInverter inverterCache(const pg::Conn &conn,
+                                      const std::string &name);
+  static CachedMeter meterCache(const pg::Conn &conn, const std::string &name);
 
-  // ------ thread (must be last; joined in destructor)
-  std::jthread worker_;
+  // The one-time setup (extensions, public schema, registry, startup
+  // migration) runs on the first writer to connect; the others wait for it.
+  std::mutex setupMutex_;
+  bool extensionsChecked_{false}; // under setupMutex_
+  std::atomic<bool> firstInsertSeen_{false};
 };
 
 #endif /* POSTGRES_CLIENT_H_ */
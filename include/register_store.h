@@ -0,0 +1,139 @@
+#ifndef REGISTER_STORE_H_
+#define REGISTER_STORE_H_
+
+#include "memory_budget.h"
+#include <atomic>
+#include <expected>
+#include <fronius/fronius.h>
+#include <memory>
+#include <modbus/modbus.h>
+#include <mutex>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// RegisterStore — published holding-register snapshots for a Modbus slave.
+//
+// The slave's client workers answer requests with modbus_reply(), which reads
+// a whole modbus_mapping_t. The meter callback rewrites values in it about
+// once a second. Each update used to allocate a fresh 65535-register mapping
+// and memcpy 128 KiB into it, then pack about 60 registers. This store keeps
+// a small pool of mappings instead, allocated once and reused:
+//
+//   - readers call current() and reply from a std::shared_ptr to an immutable
+//     snapshot, with no lock and no copy;
+//   - update() picks a pooled mapping that no reader holds any more, brings
+//     it up to date by copying only the served spans (the SunSpec blocks,
+//     a few hundred bytes) from the published snapshot, lets the caller
+//     write its registers, and publishes it with one atomic store.
+//
+// With one writer and replies far shorter than the update interval, this is
+// plain double buffering: two mappings alternate. A mapping still pinned by a
+// slow reply is skipped, and the pool only grows when every spare is pinned,
+// so it is bounded by the number of concurrent replies plus one.
+//
+// Registers outside the served spans stay zero in every mapping, exactly as
+// in the full-table copy this replaced. Each mapping still spans the whole
+// address range, because libmodbus and libfronius' packToModbus index
+// tab_registers by absolute address.
+//
+// Sparse mode (the low-memory profile: constructed with a MemoryBudget
+// account): a whole-range mapping is 128 KiB, and every slave holds two or
+// more. Here each snapshot covers only the window from the first served
+// register to the last, a few hundred bytes, with modbus_mapping_new_
+// start_address(), so modbus_reply() answers a read outside it with an
+// illegal data address exception rather than zeros. The writer, which packs
+// by absolute address, writes into one whole-range staging table shared by
+// every sparse store instead: update() copies the served spans of the next
+// snapshot into it, lets the caller write, and copies them back. The slaves
+// take turns on it under a process-wide mutex, about once a second each. The
+// snapshots and the staging table are reserved from the account.
+// ---------------------------------------------------------------------------
+
+class RegisterStore {
+public:
+  // A run of holding registers the slave serves: [addr, addr + count).
+  struct Span {
+    int addr;
+    int count;
+  };
+
+  // `registers` is the size of each mapping's holding-register table, or
+  // with an `account` the address range of the sparse snapshots. Nothing is
+  // allocated until the first update().
+  explicit RegisterStore(int registers,
+                         MemoryBudget::Account *account = nullptr)
+      : registers_(registers), account_(account) {}
+
+  RegisterStore(const RegisterStore &) = delete;
+  RegisterStore &operator=(const RegisterStore &) = delete;
+
+  // Declare the served spans. Call before the first update(). Overlapping
+  // and adjacent spans are merged.
+  void serve(std::vector<Span> spans);
+
+  // The published snapshot, or nullptr before the first update(). Readers
+  // must not write through it.
+  std::shared_ptr<modbus_mapping_t> current() const {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  // Prepare a mapping holding the published registers, call write(mapping)
+  // to change some of them, then publish it. Serialised against other
+  // updates. Fails only if a new mapping cannot be allocated, in which case
+  // the published snapshot is left as it was.
+  template <typename Write>
+  std::expected<void, ModbusError> update(Write &&write) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    auto next = acquire();
+    if (!next)
+      return std::unexpected(next.error());
+    if (!account_) {
+      write((*next).get());
+    } else {
+      std::lock_guard<std::mutex> stagingLock(stagingMutex_);
+      auto staging = stageIn(**next);
+      if (!staging)
+        return std::unexpected(staging.error());
+      write(*staging);
+      stageOut(**staging, **next);
+    }
+    current_.store(std::move(*next), std::memory_order_release);
+    return {};
+  }
+
+private:
+  struct Deleter {
+    void operator()(modbus_mapping_t *p) const {
+      if (p)
+        modbus_mapping_free(p);
+    }
+  };
+
+  // A pooled mapping no reader holds, synced to the published one. Called
+  // under writeMutex_.
+  std::expected<std::shared_ptr<modbus_mapping_t>, ModbusError> acquire();
+
+  // Sparse mode, under stagingMutex_: the staging table, allocated on first
+  // use, with the served spans of `snapshot` copied into it; and back.
+  std::expected<modbus_mapping_t *, ModbusError>
+  stageIn(const modbus_mapping_t &snapshot);
+  void stageOut(const modbus_mapping_t &staging,
+                modbus_mapping_t &snapshot) const;
+
+  // Copy the served spans from `from` to `to`, each indexed from its
+  // start_registers.
+  void copySpans(const modbus_mapping_t &from, modbus_mapping_t &to) const;
+
+  const int registers_;
+  MemoryBudget::Account *const account_;
+  std::vector<Span> spans_;
+  Span window_{0, 0}; // sparse mode: the snapshots' address range
+  std::mutex writeMutex_;
+  std::vector<std::shared_ptr<modbus_mapping_t>> pool_;
+  std::atomic<std::shared_ptr<modbus_mapping_t>> current_{nullptr};
+
+  static inline std::mutex stagingMutex_;
+  static inline std::unique_ptr<modbus_mapping_t, Deleter> staging_;
+};
+
+#endif /* REGISTER_STORE_H_ */
@@ -0,0 +1,73 @@
+#ifndef SAMPLE_CLOCK_H_
+#define SAMPLE_CLOCK_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// ---------------------------------------------------------------------------
+// SampleClock — the time every values sample is stamped with.
+//
+// The masters used to read system_clock::now() once the fetch had returned,
+// so a sample's time carried the whole bus round trip, and, on a shared bus,
+// the polls queued ahead of it in the same slot. Two devices read in the
+// same tick were stamped tens or hundreds of milliseconds apart, which
+// skews the overlap of their powers wherever samples are matched by time
+// (the site balance, the Regime B min(P, C) of compute_site_energy()).
+// Instead the Modbus masters take a steady_clock reading on either side of
+// the register fetch and stamp the sample with the midpoint, the best
+// estimate of when the device took its reading; the EBZ stamps a telegram
+// when it is decoded, on the same clock.
+//
+// Steady instants become epoch milliseconds through one process-wide
+// offset, wall minus steady, so every device is on one timeline. NTP slews
+// CLOCK_MONOTONIC along with CLOCK_REALTIME, so the offset does not drift;
+// it moves only when the wall clock is stepped (set at boot on a board
+// without an RTC, a manual date). Each conversion compares the offset with
+// the current one and re-anchors when they differ by more than stepTolerance,
+// so the stamps follow a step at once and are monotonic between steps. A
+// step within the tolerance is not followed, and the stamps keep that error.
+//
+// Thread-safety: any thread; the offset is one relaxed atomic.
+// ---------------------------------------------------------------------------
+
+class SampleClock {
+public:
+  using Steady = std::chrono::steady_clock;
+
+  // A larger disagreement between the offset and the clocks is a step. Well
+  // above the gap between reading the two clocks, even when preempted.
+  static constexpr std::chrono::milliseconds stepTolerance{50};
+
+  // `t` in milliseconds since the epoch.
+  static std::uint64_t epochMs(Steady::time_point t) noexcept {
+    using namespace std::chrono;
+    const auto steady = Steady::now().time_since_epoch();
+    const auto wall = system_clock::now().time_since_epoch();
+    const std::int64_t actual =
+        duration_cast<nanoseconds>(wall - steady).count();
+    std::int64_t offset = offset_.load(std::memory_order_relaxed);
+    const std::int64_t drift =
+        actual > offset ? actual - offset : offset - actual;
+    if (offset == 0 || drift > nanoseconds(stepTolerance).count()) {
+      offset = actual;
+      offset_.store(offset, std::memory_order_relaxed);
+    }
+    const std::int64_t ns =
+        duration_cast<nanoseconds>(t.time_since_epoch()).count() + offset;
+    return static_cast<std::uint64_t>(ns / 1'000'000);
+  }
+
+  // The midpoint of a request sent at `request` and answered at `response`.
+  static std::uint64_t stamp(Steady::time_point request,
+                             Steady::time_point response) noexcept {
+    return epochMs(request + (response - request) / 2);
+  }
+
+  static std::uint64_t now() noexcept { return epochMs(Steady::now()); }
+
+private:
+  inline static std::atomic<std::int64_t> offset_{0}; // ns; 0 until anchored
+};
+
+#endif /* SAMPLE_CLOCK_H_ */
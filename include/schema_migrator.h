@@ -40,9 +40,12 @@ struct Migration {
 // no central registry: a meter schema and an inverter schema each carry their
 // own gapless 1..N version history, fed from the matching per-kind registry.
 //
-// All work for one schema runs in a single transaction gated by a session-wide
-// advisory lock, so two fronius-bridge instances starting against the same
-// database cannot race and a partially-migrated schema is impossible.
+// All work for one schema runs in a single transaction gated by an advisory
+// lock on that schema, so two fronius-bridge instances starting against the
+// same database cannot race and a partially-migrated schema is impossible.
+// The lock is per schema rather than database-wide, so migrators on separate
+// connections (PostgresClient's startup pool) work on different schemas in
+// parallel.
 //
 // Usage (per connection, driven by PostgresClient):
 //   SchemaMigrator m{conn};
@@ -83,11 +86,13 @@ public:
                                       std::string_view schemaName);
 
 private:
-  // Constant identifier for pg_advisory_xact_lock(int8). Hex-ASCII for
-  // "FRONIUSB" - recognizable in pg_locks and unlikely to collide.
-  static constexpr int64_t advisoryLockKey = 0x46524F4E49555342LL;
+  // First key of pg_advisory_xact_lock(int4, int4); the second is the hash of
+  // the schema name. Hex-ASCII for "FRON" - recognizable in pg_locks
+  // (classid) and unlikely to collide. Two schemas whose names hash alike
+  // merely share a lock.
+  static constexpr int32_t advisoryLockClass = 0x46524F4E;
 
-  std::expected<void, DbError> acquireAdvisoryLock();
+  std::expected<void, DbError> acquireAdvisoryLock(std::string_view schemaName);
   std::expected<void, DbError> createSchema(std::string_view schemaName);
   std::expected<void, DbError> setSearchPath(std::string_view schemaName);
   std::expected<void, DbError> ensureSchemaVersionTable();
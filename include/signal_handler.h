@@ -13,7 +13,11 @@ public:
     struct sigaction action{};
     action.sa_flags = SA_SIGINFO;
     action.sa_sigaction = [](int sig, siginfo_t *, void *) {
-      if (instance_ && instance_->running_.load()) {
+      if (!instance_ || !instance_->running_.load())
+        return;
+      if (sig == SIGHUP) {
+        instance_->requestReload();
+      } else {
         instance_->signal_ = sig;
         instance_->shutdown();
       }
@@ -22,6 +26,7 @@ public:
     instance_ = this;
     sigaction(SIGINT, &action, nullptr);
     sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGHUP, &action, nullptr);
   }
 
   ~SignalHandler() {
@@ -29,6 +34,7 @@ public:
     defaultAction.sa_handler = SIG_DFL;
     sigaction(SIGINT, &defaultAction, nullptr);
     sigaction(SIGTERM, &defaultAction, nullptr);
+    sigaction(SIGHUP, &defaultAction, nullptr);
     instance_ = nullptr;
   }
 
@@ -59,6 +65,27 @@ public:
     cv_.wait(lock, [&] { return !running_.load(); });
   }
 
+  // --- Config reload (SIGHUP) ---
+  void requestReload() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      reload_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  // Wait for a reload request or shutdown: true for a reload, whose request
+  // this consumes, false once shut down. A reload requested while one is
+  // being handled is served by the next call.
+  bool waitForReload() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock, [&] { return !running_.load() || reload_; });
+    if (!running_.load())
+      return false;
+    reload_ = false;
+    return true;
+  }
+
   const char *signalName() const { return strsignal(signal_); }
 
   int signal() const { return signal_; }
@@ -70,6 +97,7 @@ private:
   std::atomic<bool> running_;
   std::atomic<bool> failed_{false};
   std::string reason_;
+  bool reload_{false}; // guarded by mtx_
   std::mutex mtx_;
   std::condition_variable cv_;
   static inline SignalHandler *instance_ = nullptr;
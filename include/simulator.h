@@ -0,0 +1,130 @@
+#ifndef SIMULATOR_H_
+#define SIMULATOR_H_
+
+#include "config_yaml.h"
+#include "signal_handler.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <modbus/modbus.h>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// SimulatedGateway — an in-process Modbus TCP gateway serving synthetic
+// SunSpec devices, for profiling the bridge against a fleet-sized roster
+// without the hardware.
+//
+// A device with a `simulate:` block is parsed into an ordinary Modbus TCP
+// device that connects to 127.0.0.1:<simulate.port>, so it goes through the
+// same FroniusBus, BusScheduler, master, dispatcher and sinks as a real one;
+// only the far end of the socket is fake. main() starts one gateway per
+// simulated port, before the buses connect, and every device naming that
+// port becomes a unit behind it, addressed by its unit_id. Like a real
+// Modbus TCP gateway in front of an RS-485 line, a gateway answers one
+// request at a time: each reply is held back by the unit's latency plus a
+// uniform 0..jitter, and requests for the other units wait behind it. Spread
+// the devices over several ports to model several gateways.
+//
+// Each unit serves a register set a libfronius device detects and decodes as
+// the real thing, in the int+sf encoding:
+//
+//   - an inverter: C001 common, inverter model 101/102/103 (by phases),
+//     nameplate and settings 120-123, the multiple-MPPT model 160 with one
+//     module per input, the storage model 124 if hybrid, and the end marker;
+//   - a Fronius meter: C001 common, meter model 201/202/203 (by phases)
+//     and the end marker.
+//
+// libfronius's own register map is not part of this tree, so the layout
+// follows the published SunSpec model chain at the Fronius base address
+// (40001, register 40000 zero-based) rather than libfronius's definitions.
+//
+// The values move about once a second: an inverter's AC power follows a
+// ten-minute sine between zero and its rating, a meter's swings between
+// import and export, both with a little noise, a per-unit phase offset so a
+// fleet does not move in lockstep, and energy counters that integrate the
+// power. The noise is seeded from the port and unit id, so a run repeats.
+//
+// The serving thread also runs the generator, so the registers need no
+// lock. It stops when the SignalHandler does; the destructor joins it.
+// ---------------------------------------------------------------------------
+
+class SimulatedGateway {
+public:
+  // One simulated device behind the gateway.
+  struct Unit {
+    enum class Kind { Inverter, Meter };
+    Kind kind{Kind::Inverter};
+    std::string name;
+    int slaveId{1};
+    SimulateConfig simulate;
+
+    bool operator==(const Unit &) const = default;
+  };
+
+  // Binds 127.0.0.1:port and starts serving `units`. Throws
+  // std::runtime_error if the port cannot be bound.
+  SimulatedGateway(int port, const std::vector<Unit> &units,
+                   SignalHandler &signalHandler);
+  ~SimulatedGateway();
+
+  SimulatedGateway(const SimulatedGateway &) = delete;
+  SimulatedGateway &operator=(const SimulatedGateway &) = delete;
+
+private:
+  struct State {
+    ~State();
+    Unit unit;
+    modbus_mapping_t *regs{nullptr};
+    std::mt19937 rng;
+    double phaseOffset{0.0};  // s, into the power cycle
+    double acEnergy{0.0};     // Wh, inverter
+    double dcEnergy[2]{};     // Wh, per inverter input
+    double importEnergy{0.0}; // Wh, meter
+    double exportEnergy{0.0}; // Wh, meter
+  };
+
+  struct Client {
+    ~Client();
+    int socket{-1};
+    modbus_t *ctx{nullptr};
+    std::array<std::uint8_t, 2 * MODBUS_TCP_MAX_ADU_LENGTH> frame{};
+    std::size_t frameLen{0};
+  };
+
+  void run();
+  void acceptClient();
+  bool serviceClient(Client &client);
+  void reply(Client &client, const std::uint8_t *adu, int length);
+  void tick(std::chrono::steady_clock::time_point now);
+
+  void fillStatic(State &state);
+  void generate(State &state, double now, double dt);
+  void generateInverter(State &state, double now, double dt);
+  void generateMeter(State &state, double now, double dt);
+
+  // stop_ ends run() when the gateway is destroyed before shutdown (a
+  // reload that drops or changes its units).
+  bool running() const noexcept { return handler_.isRunning() && !stop_; }
+
+  const int port_;
+  SignalHandler &handler_;
+  std::atomic<bool> stop_{false};
+  std::shared_ptr<spdlog::logger> logger_;
+  std::map<int, std::unique_ptr<State>> units_; // by unit id
+  modbus_t *listenCtx_{nullptr};
+  int serverSocket_{-1};
+  std::map<int, std::unique_ptr<Client>> clients_; // by socket
+  const std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point lastTick_;
+  std::thread worker_;
+};
+
+#endif /* SIMULATOR_H_ */
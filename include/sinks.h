@@ -0,0 +1,162 @@
+#ifndef SINKS_H_
+#define SINKS_H_
+
+#include "config_yaml.h"
+#include "dispatcher.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include "mqtt_client.h"
+#include "site_energy.h"
+#include "site_snapshot.h"
+#include "values_publisher.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MeterSlave;
+class PostgresClient;
+
+// ---------------------------------------------------------------------------
+// The Dispatcher sinks main subscribes: one per consumer, each an adapter
+// from Samples to the consumer's own API. A sink is fed by a single
+// dispatcher thread, so its per-device state needs no lock.
+//
+// With an `aggregate:` section (see EdgeAggregator) the MQTT and PostgreSQL
+// sinks forward the raw values only with forward_raw, and the closed buckets
+// in any case; the slave and site sinks always take the raw values, since an
+// inverter limiting its export needs the live reading and the site balance
+// the samples' own power.
+// ---------------------------------------------------------------------------
+
+// Publishes every device's topics: `<topic>/<class>/<name>/values` (through
+// its ValuesPublisher, so in delta mode the deltas too), `.../events`,
+// `.../device`, `.../availability`, and `.../values/aggregate` for the edge
+// aggregates.
+class MqttSink : public Sink {
+public:
+  // Registers every device's topics with `mqtt`.
+  MqttSink(const AppConfig &cfg, MqttClient &mqtt);
+
+  void consume(const Sample &sample) override;
+  // Releases the device's topics, for another device to reuse.
+  void retire(DeviceId device) override;
+  // Registers the device's topics; those of a device that was in the roster
+  // before are its old ones. A device whose topics could not be registered
+  // stays out, and its samples are dropped.
+  void admit(const AppConfig &cfg, DeviceId device) override;
+
+private:
+  struct Device {
+    // A device of the roster has one of the values publishers.
+    bool admitted() const noexcept { return inverterValues || meterValues; }
+    bool easyMeter{false};
+    std::vector<MqttClient::TopicId> topics; // the ids below, to release
+    MqttClient::TopicId eventsTopic{0}; // inverters only
+    MqttClient::TopicId deviceTopic{0};
+    MqttClient::TopicId availabilityTopic{0};
+    MqttClient::TopicId aggregateTopic{0}; // with `aggregate:` only
+    std::unique_ptr<ValuesPublisher<InverterTypes::Values>> inverterValues;
+    std::unique_ptr<ValuesPublisher<MeterTypes::Values>> meterValues;
+    // The device's shape from its last device sample, for the aggregate
+    // payload, which lists the phases and inputs like the values document.
+    int phases{1};
+    int inputs{1};
+    bool hybrid{false};
+  };
+  // Release the topics `d` registered, and empty it.
+  void release(Device &d);
+
+  MqttClient &mqtt_;
+  const bool forwardRaw_;
+  const MqttEncoding encoding_;
+  std::vector<Device> devices_; // indexed by DeviceId
+  std::string buf_;             // aggregate payloads; keeps its capacity
+};
+
+// Writes the devices, values and edge aggregates to PostgreSQL. Without
+// forward_raw a bucket's representative row (Edge::sample()) goes into the
+// samples table in place of the raw values; the two share its UNIQUE(time),
+// so only one of them is written.
+class PostgresSink : public Sink {
+public:
+  PostgresSink(const AppConfig &cfg, PostgresClient &postgres);
+
+  void consume(const Sample &sample) override;
+
+private:
+  PostgresClient &postgres_;
+  const bool forwardRaw_;
+};
+
+// Feeds each meter's SunSpec slave (the meters with a `slave:` block).
+class SlaveSink : public Sink {
+public:
+  // `slaves` is main's table, indexed by DeviceId, nullptr where a device
+  // has no slave. It keeps its size; a reload fills a slot before admit()
+  // and empties it after retire().
+  explicit SlaveSink(const std::vector<std::unique_ptr<MeterSlave>> &slaves);
+
+  void consume(const Sample &sample) override;
+  void retire(DeviceId device) override;
+  void admit(const AppConfig &cfg, DeviceId device) override;
+
+private:
+  const std::vector<std::unique_ptr<MeterSlave>> &table_;
+  std::vector<MeterSlave *> slaves_; // this thread's copy of table_
+};
+
+// Runs the streaming site balance (SiteEnergy, with a `site_energy:`
+// section) over the raw values. Every `interval` seconds of sample time, and
+// at the first sample past local midnight, it publishes the day's totals on
+// `<topic>/site/energy` and hands the increments to PostgreSQL.
+class SiteSink : public Sink {
+public:
+  // `postgres` is null without a `postgres:` section.
+  SiteSink(const AppConfig &cfg, MqttClient &mqtt, PostgresClient *postgres);
+
+  void consume(const Sample &sample) override;
+  void retire(DeviceId device) override;
+  void admit(const AppConfig &cfg, DeviceId device) override;
+
+private:
+  void flush();
+
+  SiteEnergy energy_;
+  MqttClient &mqtt_;
+  PostgresClient *postgres_;
+  const MqttEncoding encoding_;
+  const MqttClient::TopicId topic_;
+  const std::uint64_t intervalMs_;
+  std::uint64_t flushed_{0}; // ms, sample time of the last flush
+  std::string buf_;
+};
+
+// Coalesces the raw values into site snapshots (SiteSnapshot, with a
+// `snapshot:` section). Each closed tick is published on
+// `<topic>/site/snapshot` in the values encoding and, as JSON, handed to
+// PostgreSQL.
+class SnapshotSink : public Sink {
+public:
+  // `postgres` is null without a `postgres:` section.
+  SnapshotSink(const AppConfig &cfg, MqttClient &mqtt,
+               PostgresClient *postgres);
+
+  void consume(const Sample &sample) override;
+  // A retired device no longer holds the open tick back.
+  void retire(DeviceId device) override;
+  void admit(const AppConfig &cfg, DeviceId device) override;
+
+private:
+  void flush();
+
+  SiteSnapshot snapshot_;
+  MqttClient &mqtt_;
+  PostgresClient *postgres_;
+  const MqttEncoding encoding_;
+  const MqttClient::TopicId topic_;
+  std::string buf_;
+  std::string json_; // the database's document with a binary encoding
+};
+
+#endif /* SINKS_H_ */
@@ -0,0 +1,152 @@
+#ifndef SITE_ENERGY_H_
+#define SITE_ENERGY_H_
+
+#include "config_yaml.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// SiteEnergy — the whole-site energy balance of the current day, in-bridge.
+//
+// public.compute_site_energy() derives the day's site figures from the
+// per-device rollups, so they exist only once the rollups have run: the
+// nightly job for the finished day, and a scheduled refresh for the running
+// one, which re-reads the whole day on every run. With a `site_energy:`
+// section (see SiteEnergyConfig) main instead feeds every inverter's and the
+// primary meter's raw values through this accumulator as they arrive, and
+// SiteSink publishes the running totals and adds the increments to the
+// day's public.site_energy row. The nightly rollup stays, as the
+// reconciliation pass that overwrites the row with the figures computed from
+// the stored samples.
+//
+// The figures follow compute_site_energy(), regime for regime:
+//
+//   feed-in primary      production = the inverters' AC energy counters;
+//                        from_grid / to_grid = the meter's import / export
+//                        counters; self_consumption = production - to_grid,
+//                        floored at 0; consumption = self + from_grid.
+//   consumption primary  production as above; consumption = the meter's
+//                        import counter; self_consumption = the overlap
+//                        min(P, C) of the summed inverter power P and the
+//                        meter power C (both floored at 0), integrated over
+//                        time and clamped to production and consumption;
+//                        to_grid / from_grid follow by subtraction.
+//
+// Every counter contributes its increase between consecutive samples, so the
+// totals count the energy seen while the bridge runs and a counter that goes
+// backwards (a meter swap, a reset) is re-based rather than subtracted. The
+// overlap is integrated sample-and-hold: between two samples each device
+// holds its last power, and a device silent for longer than staleMs counts
+// as zero, so a gap biases the estimate low as in the SQL. Where the SQL
+// overlaps 30-second bucket averages this uses the samples themselves, which
+// removes the averaging's slight over-estimate.
+//
+// A sample is attributed to the local calendar day of its time. The day is
+// closed by the first sample, of any device, past local midnight; its last
+// increments are handed out by take() before the new day's. A device's
+// sample from before midnight that arrives after that counts for the new
+// day.
+//
+// Not thread-safe: owned by SiteSink, which runs on one dispatcher thread.
+// ---------------------------------------------------------------------------
+
+// The day's running totals. Energies in Wh.
+struct SiteEnergyTotals {
+  std::string day;        // local calendar day, "YYYY-MM-DD"
+  std::uint64_t time{0};  // ms since the epoch, of the latest sample
+  double production{0.0}; // Wh
+  double consumption{0.0};
+  double selfConsumption{0.0};
+  double fromGrid{0.0};
+  double toGrid{0.0};
+};
+
+// The raw increments of one day since the previous take(), the arguments of
+// public.add_site_energy(). The measured regime fills fromGrid and toGrid,
+// the simulated one consumption and overlap. Energies in Wh.
+struct SiteEnergyDelta {
+  std::string day; // "YYYY-MM-DD"
+  bool measured{false};
+  double production{0.0};
+  double consumption{0.0};
+  double fromGrid{0.0};
+  double toGrid{0.0};
+  double overlap{0.0};
+};
+
+class SiteEnergy {
+public:
+  // A device silent for this long no longer holds its power in the overlap.
+  static constexpr std::uint64_t staleMs = 120'000;
+
+  // `registry` from AppConfig::deviceRegistry, which validateConfig() made
+  // sure holds an inverter and a primary meter.
+  explicit SiteEnergy(const std::vector<DeviceRegistryEntry> &registry);
+
+  // Whether the primary meter sits at the feed-in point (measured regime).
+  bool measured() const noexcept { return measured_; }
+
+  // Fold a sample in. Meters other than the primary one are ignored.
+  void add(DeviceId device, const InverterTypes::Values &v);
+  void add(DeviceId device, const MeterTypes::Values &v);
+
+  // A reload took `device` out of the registry, or put it in as `entry`.
+  // A new primary meter re-bases the meter counters; one at the other
+  // location switches the regime, handing the day's increments so far out
+  // under the old one (see dayClosed()).
+  void retire(DeviceId device);
+  void admit(DeviceId device, const DeviceRegistryEntry &entry);
+
+  // The current day's totals; day is empty before the first sample.
+  const SiteEnergyTotals &totals() const noexcept { return totals_; }
+
+  // Whether a day (or a regime) has closed since the previous take().
+  bool dayClosed() const noexcept { return !closed_.empty(); }
+
+  // Hand out the increments since the previous take(): the closed day's, if
+  // any, then the current day's, each only if it moved.
+  std::vector<SiteEnergyDelta> take();
+
+private:
+  // Move to the local day of `time` if it lies past the current one.
+  void roll(std::uint64_t time);
+  // Integrate the overlap of the held powers up to `time`.
+  void integrate(std::uint64_t time);
+  // Recompute the derived totals from the running sums.
+  void derive();
+  // Add `wh` to a field of the running sums and of the untaken part.
+  void credit(double SiteEnergyDelta::*field, double wh);
+
+  // A counter's increase since its previous reading: 0 for the first
+  // reading and for one that went backwards, and a reading that is not a
+  // positive number (a failed decode) is skipped.
+  static double increase(std::optional<double> &last, double reading);
+
+  struct Source {
+    std::optional<double> energy; // Wh, the last counter reading
+    double power{0.0};            // W, held, floored at 0
+    std::uint64_t seen{0};        // ms, of the held power
+  };
+
+  bool measured_{false};
+  std::optional<DeviceId> primary_;
+  std::vector<bool> inverter_;        // indexed by DeviceId
+  std::vector<Source> sources_;       // inverters' slots, by DeviceId
+  Source meter_;                      // the primary meter, import counter
+  std::optional<double> meterExport_; // Wh, the last export reading
+
+  std::uint64_t dayEnd_{0};      // ms, the next local midnight; 0 at start
+  std::uint64_t integrated_{0};  // ms, the overlap is integrated up to here
+
+  // The day's running sums, and the part of them not yet taken.
+  SiteEnergyDelta sums_;
+  SiteEnergyDelta pending_;
+  std::vector<SiteEnergyDelta> closed_;
+  SiteEnergyTotals totals_;
+};
+
+#endif /* SITE_ENERGY_H_ */
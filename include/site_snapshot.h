@@ -0,0 +1,124 @@
+#ifndef SITE_SNAPSHOT_H_
+#define SITE_SNAPSHOT_H_
+
+#include "config_yaml.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// SiteSnapshot — the whole site's readings of one poll tick, as one record.
+//
+// Each device's samples go out on their own topic and into their own
+// schema, so a consumer that wants the site at an instant (the inverters'
+// production against the meter's power) has to join rows that were stamped
+// apart. With a `snapshot:` section (see SnapshotConfig) every Modbus master
+// polls on the same wall-clock boundaries, and main feeds the raw values
+// through this coalescer, which gathers them by tick, floor(time / interval)
+// * interval, and closes each tick into a Snapshot for SnapshotSink to
+// publish and write.
+//
+// A device contributes its first sample of a tick; the EBZ, which pushes a
+// telegram every second or so, its first telegram past the boundary. A tick
+// closes complete once every device has reported. A device that has not
+// reported by the time another device's sample of a later tick arrives is
+// missing (unreachable, or its poll overran): the tick closes without it,
+// marked incomplete, and its sample, should it still come, is dropped as
+// late. The snapshot stands for the tick: its time is the boundary, and each
+// device's values keep their own midpoint stamp (see SampleClock).
+//
+// A sample more than one tick behind the open one means the wall clock was
+// stepped back; the open tick is dropped and gathering restarts from there.
+//
+// Not thread-safe: owned by SnapshotSink, which runs on one dispatcher
+// thread.
+// ---------------------------------------------------------------------------
+
+// One device's reading in a snapshot, with what its values document needs.
+struct SnapshotReading {
+  std::string_view name; // the device's; valid until it is retired
+  bool easyMeter{false};
+  int phases{1};
+  int inputs{1};
+  bool hybrid{false};
+  std::variant<InverterTypes::Values, MeterTypes::Values> values;
+};
+
+struct Snapshot {
+  std::uint64_t time{0}; // ms since the epoch, the tick's boundary
+  bool complete{false};  // every device reported
+  double productionPower{0.0};        // W, the inverters' ac_power_active
+  std::optional<double> primaryPower; // W, the primary meter's power_active
+  std::vector<SnapshotReading> readings; // DeviceId order
+};
+
+// A snapshot as public.site_snapshot stores it: the summary columns and the
+// JSON document published on <topic>/site/snapshot.
+struct SnapshotRow {
+  std::uint64_t time{0}; // ms since the epoch
+  bool complete{false};
+  double productionPower{0.0};
+  std::optional<double> primaryPower;
+  std::string document; // JSON
+};
+
+class SiteSnapshot {
+public:
+  // Gathers every device of cfg.deviceRegistry at cfg.snapshot->interval.
+  explicit SiteSnapshot(const AppConfig &cfg);
+
+  // Record a device's shape from its device sample, for its documents.
+  void shape(DeviceId device, const InverterTypes::Device &d);
+  void shape(DeviceId device, const MeterTypes::Device &d);
+
+  // A reload put `device` into cfg.deviceRegistry, or took it out. A
+  // retired device no longer holds the open tick back: it closes complete
+  // if the rest have reported.
+  void admit(const AppConfig &cfg, DeviceId device);
+  void retire(DeviceId device);
+
+  // Fold a values sample in.
+  void add(DeviceId device, const InverterTypes::Values &v);
+  void add(DeviceId device, const MeterTypes::Values &v);
+
+  // Whether a tick has closed since the previous take().
+  bool ready() const noexcept { return !closed_.empty(); }
+
+  // Hand out the ticks closed since the previous take(), oldest first.
+  std::vector<Snapshot> take();
+
+private:
+  template <typename Values> void fold(DeviceId device, const Values &v);
+  // Discard the open tick and start gathering `tick`.
+  void start(std::uint64_t tick);
+  // Close the open tick into closed_.
+  void close(bool complete);
+
+  struct Slot {
+    std::string name;
+    bool easyMeter{false};
+    bool primary{false};
+    int phases{1};
+    int inputs{1};
+    bool hybrid{false};
+    bool occupied{false}; // a device of the registry
+    bool reported{false}; // in the open tick
+    std::variant<InverterTypes::Values, MeterTypes::Values> values;
+  };
+
+  const std::uint64_t intervalMs_;
+  std::vector<Slot> slots_; // indexed by DeviceId
+  std::uint64_t tick_{0};   // ms, the open tick's boundary; 0 before any
+  std::size_t occupied_{0}; // slots of a device
+  std::size_t reported_{0}; // slots reported in the open tick
+  bool open_{false};        // the tick has not closed yet
+  std::vector<Snapshot> closed_;
+};
+
+#endif /* SITE_SNAPSHOT_H_ */
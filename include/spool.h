@@ -0,0 +1,125 @@
+#ifndef SPOOL_H_
+#define SPOOL_H_
+
+#include "config_yaml.h"
+#include "edge_aggregator.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <spdlog/logger.h>
+#include <string>
+#include <string_view>
+#include <variant>
+
+// ---------------------------------------------------------------------------
+// Spool
+//
+// Durable FIFO of value samples that PostgresClient spills into while the
+// database is unreachable, so an outage longer than the in-memory queue costs
+// disk space instead of data. Records go in memory-mapped segment files
+// ("spool-<seq>.seg") under PostgresSpoolConfig::dir. Each segment holds a
+// fixed number of fixed-size records behind a small header. A record is the
+// device name plus the raw bytes of the Values struct, or of the PowerBucket
+// of an edge aggregate. All three are trivially copyable, so a record is
+// written and read back with one memcpy and no serialisation.
+//
+// The header holds two counters. `written` is the number of records stored.
+// `consumed` is the number of records replayed and committed. Together they
+// make the spool restart-safe. The constructor recovers leftover segments in
+// sequence order and resumes replay at each one's `consumed` mark. A segment
+// whose header does not match this build's layout is discarded with a
+// warning.
+//
+// Replay is at-least-once. pop() hands out records without consuming them,
+// and commit() advances `consumed` only once the caller has written
+// everything taken so far. A crash in between replays those records again.
+// The samples table's UNIQUE(time) turns the repeats into benign duplicate
+// warnings.
+//
+// The size cap is enforced at segment granularity. When a new segment would
+// take the spool past maxSizeMb, the oldest segment is deleted with a warning,
+// which keeps the same drop-oldest policy as the memory queue.
+//
+// Segments are flushed per PostgresSpoolConfig::fsync, and on destruction
+// unless the policy is `never`. Not thread-safe: PostgresClient calls every
+// method under its queue mutex.
+// ---------------------------------------------------------------------------
+
+class Spool {
+public:
+  // One replayed sample: the device it belongs to, and its values.
+  struct Entry {
+    std::string deviceName;
+    std::variant<InverterTypes::Values, MeterTypes::Values, PowerBucket>
+        values;
+  };
+
+  // Creates `cfg.dir` if needed and recovers any segments left in it. Throws
+  // std::runtime_error if the directory cannot be created or read.
+  Spool(const PostgresSpoolConfig &cfg, std::shared_ptr<spdlog::logger> logger);
+  ~Spool();
+
+  Spool(const Spool &) = delete;
+  Spool &operator=(const Spool &) = delete;
+  Spool(Spool &&) = delete;
+  Spool &operator=(Spool &&) = delete;
+
+  // Append one sample. Returns false if the record could not be stored
+  // (segment creation or mapping failed, already logged); the caller keeps
+  // the event in memory instead.
+  bool append(std::string_view deviceName, const InverterTypes::Values &values);
+  bool append(std::string_view deviceName, const MeterTypes::Values &values);
+  bool append(std::string_view deviceName, const PowerBucket &bucket);
+
+  // Records appended but not yet taken.
+  std::size_t pending() const noexcept { return pending_; }
+
+  // The oldest record not yet taken, without taking it, or std::nullopt when
+  // nothing is pending. A record that does not decode is skipped with a
+  // warning.
+  std::optional<Entry> front();
+
+  // Take the record front() returned. It stays on disk until commit().
+  void pop();
+
+  // Mark every record taken so far as consumed and delete the segments that
+  // are left with nothing to replay. Call only once all of them are written.
+  void commit();
+
+private:
+  struct Segment {
+    std::uint64_t seq{0};
+    std::filesystem::path path;
+    std::byte *map{nullptr};
+    std::uint32_t taken{0}; // in-memory replay cursor, >= header consumed
+  };
+
+  bool appendRecord(std::uint32_t kind, std::string_view deviceName,
+                    const void *values, std::size_t size);
+  std::optional<Segment> createSegment();
+  std::optional<Segment> openSegment(std::uint64_t seq,
+                                     const std::filesystem::path &path);
+  void recover();
+  // Delete the oldest segment to honour the size cap, pending records
+  // included.
+  void dropOldest();
+  void sync(const Segment &seg);
+  void closeSegment(Segment &seg, bool remove);
+
+  const PostgresSpoolConfig cfg_;
+  std::shared_ptr<spdlog::logger> logger_;
+  std::filesystem::path dir_;
+  std::size_t maxSegments_{0};
+  std::uint64_t nextSeq_{1};
+  std::size_t pending_{0};
+
+  // Oldest first; only the back segment is appended to.
+  std::deque<Segment> segments_;
+};
+
+#endif /* SPOOL_H_ */
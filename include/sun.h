@@ -0,0 +1,26 @@
+#ifndef SUN_H_
+#define SUN_H_
+
+#include <chrono>
+
+// ---------------------------------------------------------------------------
+// Sun — solar position for the site, from the low-precision USNO almanac
+// formulae (good to about one arcminute within a few centuries of J2000).
+//
+// The daily rollups compute the daylight window in SQL; the bridge itself
+// only needs to know whether the sun is up right now, to let an adaptive
+// inverter drop to its night interval (see AdaptiveInterval). Refraction is
+// not modelled: compare against SiteConfig::horizon, which by default already
+// accounts for it at sunrise and sunset.
+// ---------------------------------------------------------------------------
+
+namespace Sun {
+
+// Altitude of the sun's centre above the geometric horizon, in degrees, at
+// `latitude` (degrees north) and `longitude` (degrees east) at time `t`.
+double altitude(double latitude, double longitude,
+                std::chrono::system_clock::time_point t);
+
+} // namespace Sun
+
+#endif /* SUN_H_ */
@@ -0,0 +1,98 @@
+#ifndef VALUES_PUBLISHER_H_
+#define VALUES_PUBLISHER_H_
+
+#include "config_yaml.h"
+#include "mqtt_client.h"
+#include "payloads.h"
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// ---------------------------------------------------------------------------
+// ValuesPublisher — publishes one device's values topic.
+//
+// Without mqtt.delta every poll's full document goes to `<base>/values`, as
+// the masters serialised it. With mqtt.delta (see MqttDeltaConfig) the full
+// document is only a keyframe, and between keyframes Payload::valuesDelta()
+// writes the fields that moved to `<base>/values/delta`, by default not
+// retained: a late subscriber starts from the retained keyframe and applies
+// the deltas that follow it.
+//
+// A keyframe is due on the first poll, once the interval has elapsed, and
+// after the broker connection was (re)established, since messages may have
+// been dropped from the queue while it was down. The baseline the deltas are
+// computed against is what was last published; `Values` must already be
+// quantised (round()), so a field compares equal when its published text is.
+//
+// publish() is called from the MQTT sink's dispatcher thread only, so the
+// state needs no lock.
+// ---------------------------------------------------------------------------
+
+template <typename Values> class ValuesPublisher {
+public:
+  // Registers `<base>/values`, plus `<base>/values/delta` in delta mode.
+  ValuesPublisher(const MqttConfig &cfg, MqttClient &mqtt,
+                  const std::string &base)
+      : mqtt_(mqtt), delta_(cfg.delta),
+        deltaEncoding_(cfg.publish.delta.encoding),
+        valuesTopic_(mqtt.addTopic(base + "/values", cfg.publish.values)) {
+    if (!delta_)
+      return;
+    try {
+      deltaTopic_ = mqtt.addTopic(base + "/values/delta", cfg.publish.delta);
+    } catch (...) {
+      mqtt.releaseTopic(valuesTopic_);
+      throw;
+    }
+  }
+
+  // Hand the topics back (see MqttClient::releaseTopic()) once the device
+  // is gone; publish() is not called after.
+  void release() {
+    mqtt_.releaseTopic(valuesTopic_);
+    if (delta_)
+      mqtt_.releaseTopic(deltaTopic_);
+  }
+
+  // `json` is the full document of `values`, in the values encoding (which
+  // the master was set to serialise in).
+  void publish(std::string_view json, const Values &values) {
+    if (!delta_) {
+      mqtt_.publish(json, valuesTopic_);
+      return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const std::uint64_t connections = mqtt_.connections();
+    if (!last_ || connections != connections_ ||
+        now - keyframeAt_ >= std::chrono::seconds(delta_->keyframeInterval)) {
+      mqtt_.publish(json, valuesTopic_);
+      last_ = values;
+      connections_ = connections;
+      keyframeAt_ = now;
+      return;
+    }
+
+    // buf_ keeps its capacity; the queue copies it into a pooled buffer.
+    if (Payload::valuesDelta(buf_, values, *last_, delta_->deadband,
+                             deltaEncoding_))
+      mqtt_.publish(buf_, deltaTopic_);
+  }
+
+private:
+  MqttClient &mqtt_;
+  const std::optional<MqttDeltaConfig> delta_;
+  const MqttEncoding deltaEncoding_;
+  const MqttClient::TopicId valuesTopic_;
+  MqttClient::TopicId deltaTopic_{0};
+
+  // --- delta mode state
+  std::optional<Values> last_;
+  std::uint64_t connections_{0};
+  std::chrono::steady_clock::time_point keyframeAt_;
+  std::string buf_;
+};
+
+#endif /* VALUES_PUBLISHER_H_ */
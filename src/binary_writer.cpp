@@ -0,0 +1,206 @@
+#include "binary_writer.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// Longest header either format writes: a marker byte and a 64-bit argument.
+constexpr std::size_t maxHead = 9;
+
+// CBOR major types (RFC 8949 section 3.1).
+constexpr std::uint8_t cborUnsigned = 0;
+constexpr std::uint8_t cborNegative = 1;
+constexpr std::uint8_t cborText = 3;
+constexpr std::uint8_t cborArray = 4;
+constexpr std::uint8_t cborMap = 5;
+constexpr char cborFalse = '\xf4';
+constexpr char cborTrue = '\xf5';
+constexpr char cborFloat64 = '\xfb';
+
+// MessagePack markers (msgpack spec, "formats").
+constexpr std::uint8_t mpFixMap = 0x80;
+constexpr std::uint8_t mpFixArray = 0x90;
+constexpr std::uint8_t mpFixStr = 0xa0;
+constexpr char mpFalse = '\xc2';
+constexpr char mpTrue = '\xc3';
+constexpr char mpFloat64 = '\xcb';
+constexpr char mpUint8 = '\xcc';
+constexpr char mpUint16 = '\xcd';
+constexpr char mpUint32 = '\xce';
+constexpr char mpUint64 = '\xcf';
+constexpr char mpInt8 = '\xd0';
+constexpr char mpInt16 = '\xd1';
+constexpr char mpInt32 = '\xd2';
+constexpr char mpStr8 = '\xd9';
+constexpr char mpStr16 = '\xda';
+constexpr char mpStr32 = '\xdb';
+constexpr char mpArray16 = '\xdc';
+constexpr char mpArray32 = '\xdd';
+constexpr char mpMap16 = '\xde';
+constexpr char mpMap32 = '\xdf';
+
+// Write `v` big-endian into `buf` in `bytes` bytes; returns the end.
+char *bigEndian(char *buf, std::uint64_t v, int bytes) {
+  for (int i = bytes - 1; i >= 0; --i)
+    *buf++ = static_cast<char>((v >> (8 * i)) & 0xff);
+  return buf;
+}
+
+// A marker byte followed by `v` in `bytes` bytes; returns the length.
+std::size_t marked(char *buf, char marker, std::uint64_t v, int bytes) {
+  buf[0] = marker;
+  return static_cast<std::size_t>(bigEndian(buf + 1, v, bytes) - buf);
+}
+
+// The header of a CBOR item of major type `major` with argument `v`.
+std::size_t cborHead(char *buf, std::uint8_t major, std::uint64_t v) {
+  const auto m = static_cast<std::uint8_t>(major << 5);
+  if (v < 24) {
+    buf[0] = static_cast<char>(m | v);
+    return 1;
+  }
+  if (v <= 0xff)
+    return marked(buf, static_cast<char>(m | 24), v, 1);
+  if (v <= 0xffff)
+    return marked(buf, static_cast<char>(m | 25), v, 2);
+  if (v <= 0xffffffff)
+    return marked(buf, static_cast<char>(m | 26), v, 4);
+  return marked(buf, static_cast<char>(m | 27), v, 8);
+}
+
+// The header of a MessagePack map or array of `n` entries.
+std::size_t msgPackContainer(char *buf, bool map, std::size_t n) {
+  if (n <= 15) {
+    buf[0] = static_cast<char>((map ? mpFixMap : mpFixArray) | n);
+    return 1;
+  }
+  if (n <= 0xffff)
+    return marked(buf, map ? mpMap16 : mpArray16, n, 2);
+  return marked(buf, map ? mpMap32 : mpArray32, n, 4);
+}
+
+} // namespace
+
+namespace Binary {
+
+void Writer::open(bool map) {
+  item();
+  if (depth_ == maxDepth)
+    throw std::logic_error("Binary::Writer: containers nested too deeply");
+  stack_[depth_++] = Container{out_.size(), 0, map};
+  // Placeholder for the length header, patched by close().
+  out_ += '\0';
+}
+
+void Writer::close() {
+  const Container c = stack_[--depth_];
+  char head[maxHead];
+  const std::size_t n =
+      format_ == Format::Cbor
+          ? cborHead(head, c.map ? cborMap : cborArray, c.count)
+          : msgPackContainer(head, c.map, c.count);
+  out_.replace(c.pos, 1, head, n);
+}
+
+void Writer::uint(std::uint64_t v) {
+  char head[maxHead];
+  std::size_t n = 0;
+  if (format_ == Format::Cbor) {
+    n = cborHead(head, cborUnsigned, v);
+  } else if (v <= 0x7f) {
+    head[0] = static_cast<char>(v);
+    n = 1;
+  } else if (v <= 0xff) {
+    n = marked(head, mpUint8, v, 1);
+  } else if (v <= 0xffff) {
+    n = marked(head, mpUint16, v, 2);
+  } else if (v <= 0xffffffff) {
+    n = marked(head, mpUint32, v, 4);
+  } else {
+    n = marked(head, mpUint64, v, 8);
+  }
+  out_.append(head, n);
+}
+
+void Writer::text(std::string_view s) {
+  char head[maxHead];
+  std::size_t n = 0;
+  if (format_ == Format::Cbor)
+    n = cborHead(head, cborText, s.size());
+  else if (s.size() <= 31) {
+    head[0] = static_cast<char>(mpFixStr | s.size());
+    n = 1;
+  } else if (s.size() <= 0xff)
+    n = marked(head, mpStr8, s.size(), 1);
+  else if (s.size() <= 0xffff)
+    n = marked(head, mpStr16, s.size(), 2);
+  else
+    n = marked(head, mpStr32, s.size(), 4);
+  out_.append(head, n);
+  out_ += s;
+}
+
+void Writer::number(double v, int) {
+  item();
+  char buf[maxHead];
+  const std::size_t n =
+      marked(buf, format_ == Format::Cbor ? cborFloat64 : mpFloat64,
+             std::bit_cast<std::uint64_t>(v), 8);
+  out_.append(buf, n);
+}
+
+void Writer::value(std::uint64_t v) {
+  item();
+  uint(v);
+}
+
+void Writer::value(int v) {
+  if (v >= 0) {
+    value(static_cast<std::uint64_t>(v));
+    return;
+  }
+  item();
+  char head[maxHead];
+  std::size_t n = 0;
+  if (format_ == Format::Cbor) {
+    // Major type 1 carries -1 - v.
+    n = cborHead(head, cborNegative, static_cast<std::uint64_t>(-(v + 1)));
+  } else if (v >= -32) {
+    head[0] = static_cast<char>(v); // negative fixint
+    n = 1;
+  } else if (v >= -128) {
+    n = marked(head, mpInt8, static_cast<std::uint8_t>(v), 1);
+  } else if (v >= -32768) {
+    n = marked(head, mpInt16, static_cast<std::uint16_t>(v), 2);
+  } else {
+    n = marked(head, mpInt32, static_cast<std::uint32_t>(v), 4);
+  }
+  out_.append(head, n);
+}
+
+void Writer::value(bool v) {
+  item();
+  if (format_ == Format::Cbor)
+    out_ += v ? cborTrue : cborFalse;
+  else
+    out_ += v ? mpTrue : mpFalse;
+}
+
+void Writer::value(std::string_view v) {
+  item();
+  text(v);
+}
+
+void Writer::value(const std::vector<std::string> &v) {
+  beginArray();
+  for (const auto &s : v)
+    value(std::string_view(s));
+  endArray();
+}
+
+} // namespace Binary
@@ -0,0 +1,161 @@
+#include "bus_scheduler.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <utility>
+
+BusScheduler::BusScheduler(std::string bus) : bus_(std::move(bus)) {
+  // Scheduling is bus-side behaviour, so it logs to the 'bus' module.
+  logger_ = spdlog::get("bus");
+  if (!logger_)
+    logger_ = spdlog::default_logger();
+
+  worker_ = std::thread(&BusScheduler::runLoop, this);
+}
+
+BusScheduler::~BusScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (worker_.joinable())
+    worker_.join();
+}
+
+BusScheduler::Id BusScheduler::add(const std::string &device,
+                                   std::chrono::seconds interval,
+                                   Poll poll) {
+  auto &jitter = Metrics::histogram(
+      "fronius_bridge_poll_jitter_seconds",
+      "Delay of a device poll's start past its scheduled deadline",
+      {{"device", device}});
+  auto &overruns = Metrics::counter(
+      "fronius_bridge_poll_overruns_total",
+      "Device polls that ran past their next deadline, skipping it",
+      {{"device", device}});
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Id id = nextId_++;
+  auto [it, inserted] = entries_.emplace(
+      id, Entry{device, std::max(interval, std::chrono::seconds(1)),
+                std::move(poll), {}, false, jitter, overruns});
+  const WallTime first =
+      boundaryAfter(std::chrono::system_clock::now(), it->second.interval);
+  schedule(id, it->second, first);
+  cv_.notify_all();
+
+  logger_->debug("Bus '{}' schedules '{}', first interval {} s", bus_, device,
+                 interval.count());
+  return id;
+}
+
+void BusScheduler::remove(Id id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  entries_.erase(id);
+  doneCv_.wait(lock, [&] { return running_ != id; });
+}
+
+BusScheduler::WallTime
+BusScheduler::boundaryAfter(WallTime after, std::chrono::seconds interval) {
+  const auto periods = std::chrono::duration_cast<std::chrono::seconds>(
+                           after.time_since_epoch()) /
+                       interval;
+  return WallTime((periods + 1) * interval);
+}
+
+BusScheduler::WallTime
+BusScheduler::nextBoundary(WallTime due, WallTime finished,
+                           std::chrono::seconds interval) {
+  if (due - finished > interval)
+    return boundaryAfter(finished, interval);
+  return boundaryAfter(std::max(finished, due), interval);
+}
+
+void BusScheduler::schedule(Id id, Entry &entry, WallTime due) {
+  entry.dueWall = due;
+
+  const auto steadyNow = std::chrono::steady_clock::now();
+  const auto wallNow = std::chrono::system_clock::now();
+  slots_.push({steadyNow + (entry.dueWall - wallNow), id});
+}
+
+void BusScheduler::runLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    if (slots_.empty()) {
+      cv_.wait(lock, [this] { return stop_ || !slots_.empty(); });
+      continue;
+    }
+
+    const Slot next = slots_.top();
+    if (!entries_.contains(next.id)) {
+      slots_.pop(); // removed since it was scheduled
+      continue;
+    }
+    if (std::chrono::steady_clock::now() < next.due) {
+      // Woken early by add() or stop; re-evaluate the earliest slot.
+      cv_.wait_until(lock, next.due);
+      continue;
+    }
+    slots_.pop();
+
+    // Copy what the poll needs: remove() may erase the entry while it runs,
+    // then waits for running_ to move on.
+    const auto &entry = entries_.find(next.id)->second;
+    running_ = next.id;
+    const WallTime dueWall = entry.dueWall;
+    Poll poll = entry.poll;
+    Metrics::Histogram &jitter = entry.jitter;
+    Metrics::Counter &overruns = entry.overruns;
+    lock.unlock();
+
+    const auto start = std::chrono::steady_clock::now();
+    jitter.observe(start - next.due);
+    const std::chrono::seconds interval =
+        std::max(poll(), std::chrono::seconds(1));
+    const WallTime finished = std::chrono::system_clock::now();
+
+    lock.lock();
+    running_ = 0;
+    doneCv_.notify_all();
+
+    auto it = entries_.find(next.id);
+    if (it == entries_.end())
+      continue;
+    const std::string &device = it->second.device;
+
+    // Ran past the next boundary: that slot is gone. Skip to the first one
+    // still ahead rather than polling back to back to catch up.
+    const WallTime intended = boundaryAfter(dueWall, interval);
+    const bool overrun = finished >= intended;
+    if (overrun) {
+      overruns.inc();
+      const auto late = std::chrono::duration<double>(finished - intended);
+      if (!it->second.overrunning)
+        logger_->warn("Bus '{}': poll of '{}' overran its {} s interval by "
+                      "{:.3f} s, skipping the missed slots",
+                      bus_, device, interval.count(), late.count());
+      else
+        logger_->debug("Bus '{}': poll of '{}' overran by {:.3f} s", bus_,
+                       device, late.count());
+    } else if (it->second.overrunning) {
+      logger_->info("Bus '{}': poll of '{}' back within its interval", bus_,
+                    device);
+    }
+    it->second.overrunning = overrun;
+    it->second.interval = interval;
+    const WallTime due = nextBoundary(dueWall, finished, interval);
+    if (dueWall - finished > interval)
+      logger_->info("Bus '{}': wall clock stepped back {:.3f} s, realigning "
+                    "'{}' to the new time",
+                    bus_,
+                    std::chrono::duration<double>(dueWall - finished).count(),
+                    device);
+    schedule(next.id, it->second, due);
+  }
+}
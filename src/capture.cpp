@@ -0,0 +1,245 @@
+#include "capture.h"
+#include "config_yaml.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// File layout
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Stored as raw bytes, like the spool records; see Spool for the rationale.
+static_assert(std::is_trivially_copyable_v<InverterTypes::Values>);
+static_assert(std::is_trivially_copyable_v<MeterTypes::Values>);
+static_assert(std::is_trivially_copyable_v<GridConfig>);
+static_assert(std::is_trivially_copyable_v<CaptureShape>);
+
+constexpr char captureMagic[8] = {'F', 'B', 'C', 'A', 'P', 'T', 'R', '1'};
+constexpr std::uint32_t captureVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t inverterValuesSize;
+  std::uint32_t meterValuesSize;
+  std::uint32_t deviceCount;
+};
+
+// Followed by the name (nameLength bytes, no NUL).
+struct DeviceHeader {
+  std::uint8_t kind;
+  std::uint8_t nameLength;
+  std::uint8_t reserved[6];
+  GridConfig grid;
+};
+
+struct RecordHeader {
+  std::int64_t at; // ns since capture start
+  std::uint32_t length;
+  std::uint16_t device;
+  std::uint8_t type;
+  std::uint8_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 16);
+
+// A telegram is at most EasyMeter::TELEGRAM_SIZE bytes; anything much longer
+// is a corrupt length field.
+constexpr std::uint32_t maxRecordLength = 4096;
+
+std::shared_ptr<spdlog::logger> mainLogger() {
+  auto logger = spdlog::get("main");
+  return logger ? logger : spdlog::default_logger();
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// CaptureWriter
+// ---------------------------------------------------------------------------
+
+CaptureWriter::CaptureWriter(const std::filesystem::path &path,
+                             const AppConfig &cfg)
+    : path_(path), start_(std::chrono::steady_clock::now()) {
+  file_ = std::fopen(path.c_str(), "wb");
+  if (!file_)
+    throw std::runtime_error(std::format("Capture: cannot create '{}': {}",
+                                         path.string(), std::strerror(errno)));
+
+  std::vector<CaptureDevice> devices;
+  for (const auto &inv : cfg.inverters)
+    devices.push_back({inv.name, CaptureDevice::Kind::Inverter, {}});
+  for (const auto &m : cfg.meters) {
+    if (const auto *ebz = std::get_if<EasyMeterConfig>(&m.body))
+      devices.push_back({m.name, CaptureDevice::Kind::EasyMeter, ebz->grid});
+    else
+      devices.push_back({m.name, CaptureDevice::Kind::FroniusMeter, {}});
+  }
+
+  FileHeader header{};
+  std::memcpy(header.magic, captureMagic, sizeof(captureMagic));
+  header.version = captureVersion;
+  header.inverterValuesSize = sizeof(InverterTypes::Values);
+  header.meterValuesSize = sizeof(MeterTypes::Values);
+  header.deviceCount = static_cast<std::uint32_t>(devices.size());
+  bool ok = std::fwrite(&header, sizeof(header), 1, file_) == 1;
+  for (const auto &d : devices) {
+    DeviceHeader dh{};
+    dh.kind = static_cast<std::uint8_t>(d.kind);
+    dh.nameLength = static_cast<std::uint8_t>(d.name.size());
+    dh.grid = d.grid;
+    ok = ok && std::fwrite(&dh, sizeof(dh), 1, file_) == 1 &&
+         std::fwrite(d.name.data(), 1, d.name.size(), file_) == d.name.size();
+  }
+  if (!ok || std::fflush(file_) != 0) {
+    const int err = errno;
+    std::fclose(file_);
+    throw std::runtime_error(std::format("Capture: cannot write '{}': {}",
+                                         path.string(), std::strerror(err)));
+  }
+  mainLogger()->info("Capturing device inputs to '{}'", path.string());
+}
+
+CaptureWriter::~CaptureWriter() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_) {
+    std::fclose(file_);
+    mainLogger()->info("Captured {} records to '{}'", records_,
+                       path_.string());
+  }
+}
+
+void CaptureWriter::inverterValues(DeviceId device,
+                                   const InverterTypes::Values &values) {
+  write(CaptureRecord::Type::InverterValues, device, &values, sizeof(values));
+}
+
+void CaptureWriter::meterValues(DeviceId device,
+                                const MeterTypes::Values &values) {
+  write(CaptureRecord::Type::MeterValues, device, &values, sizeof(values));
+}
+
+void CaptureWriter::telegram(DeviceId device, std::string_view telegram) {
+  write(CaptureRecord::Type::Telegram, device, telegram.data(),
+        telegram.size());
+}
+
+void CaptureWriter::shape(DeviceId device, const CaptureShape &shape) {
+  write(CaptureRecord::Type::Shape, device, &shape, sizeof(shape));
+}
+
+std::uint64_t CaptureWriter::records() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return records_;
+}
+
+void CaptureWriter::write(CaptureRecord::Type type, DeviceId device,
+                          const void *data, std::size_t length) {
+  RecordHeader rh{};
+  rh.at = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start_)
+              .count();
+  rh.length = static_cast<std::uint32_t>(length);
+  rh.device = device;
+  rh.type = static_cast<std::uint8_t>(type);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_)
+    return;
+  if (std::fwrite(&rh, sizeof(rh), 1, file_) != 1 ||
+      std::fwrite(data, 1, length, file_) != length ||
+      std::fflush(file_) != 0) {
+    mainLogger()->error("Capture: write to '{}' failed, capture stopped: {}",
+                        path_.string(), std::strerror(errno));
+    std::fclose(file_);
+    file_ = nullptr;
+    return;
+  }
+  ++records_;
+}
+
+// ---------------------------------------------------------------------------
+// CaptureReader
+// ---------------------------------------------------------------------------
+
+CaptureReader::CaptureReader(const std::filesystem::path &path) : path_(path) {
+  file_ = std::fopen(path.c_str(), "rb");
+  if (!file_)
+    throw std::runtime_error(std::format("Capture: cannot open '{}': {}",
+                                         path.string(), std::strerror(errno)));
+
+  auto fail = [&](std::string_view what) {
+    std::fclose(file_);
+    file_ = nullptr;
+    return std::runtime_error(
+        std::format("Capture: '{}': {}", path.string(), what));
+  };
+
+  FileHeader header{};
+  if (std::fread(&header, sizeof(header), 1, file_) != 1 ||
+      std::memcmp(header.magic, captureMagic, sizeof(captureMagic)) != 0)
+    throw fail("not a capture file");
+  if (header.version != captureVersion ||
+      header.inverterValuesSize != sizeof(InverterTypes::Values) ||
+      header.meterValuesSize != sizeof(MeterTypes::Values))
+    throw fail("written by a build with another record layout");
+
+  for (std::uint32_t i = 0; i < header.deviceCount; ++i) {
+    DeviceHeader dh{};
+    if (std::fread(&dh, sizeof(dh), 1, file_) != 1 ||
+        dh.kind > static_cast<std::uint8_t>(CaptureDevice::Kind::EasyMeter))
+      throw fail("truncated or corrupt device table");
+    CaptureDevice d;
+    d.kind = static_cast<CaptureDevice::Kind>(dh.kind);
+    d.grid = dh.grid;
+    d.name.resize(dh.nameLength);
+    if (std::fread(d.name.data(), 1, d.name.size(), file_) != d.name.size())
+      throw fail("truncated device table");
+    devices_.push_back(std::move(d));
+  }
+}
+
+CaptureReader::~CaptureReader() {
+  if (file_)
+    std::fclose(file_);
+}
+
+std::optional<CaptureRecord> CaptureReader::next() {
+  RecordHeader rh{};
+  if (std::fread(&rh, sizeof(rh), 1, file_) != 1)
+    return std::nullopt;
+  if (rh.device >= devices_.size() || rh.type == 0 ||
+      rh.type > static_cast<std::uint8_t>(CaptureRecord::Type::Shape) ||
+      rh.length > maxRecordLength)
+    throw std::runtime_error(
+        std::format("Capture: '{}': corrupt record", path_.string()));
+
+  buf_.resize(rh.length);
+  if (std::fread(buf_.data(), 1, buf_.size(), file_) != buf_.size())
+    return std::nullopt;
+
+  CaptureRecord record;
+  record.type = static_cast<CaptureRecord::Type>(rh.type);
+  record.device = rh.device;
+  record.at = std::chrono::nanoseconds(rh.at);
+  record.data = buf_;
+  return record;
+}
@@ -0,0 +1,341 @@
+#include "cluster.h"
+#include "postgres_client.h"
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <mutex>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+// 64-bit FNV-1a of "<node>/<device>": a rank every node computes alike,
+// whatever its standard library.
+std::uint64_t rank(std::string_view node, std::string_view device) {
+  std::uint64_t h = 0xcbf29ce484222325ULL;
+  auto mix = [&](std::string_view s) {
+    for (const unsigned char c : s) {
+      h ^= c;
+      h *= 0x100000001b3ULL;
+    }
+  };
+  mix(node);
+  mix("/");
+  mix(device);
+  return h;
+}
+
+std::string join(const std::vector<std::string> &list,
+                 std::string_view separator) {
+  std::string out;
+  for (const auto &s : list) {
+    if (!out.empty())
+      out += separator;
+    out += s;
+  }
+  return out;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Device placement
+// ---------------------------------------------------------------------------
+
+std::vector<std::vector<std::string>> clusterPreferences(const AppConfig &cfg) {
+  const auto &nodes = cfg.cluster->nodes;
+
+  auto preference = [&](const std::string &device,
+                        const std::optional<std::string> &home,
+                        bool movable) {
+    std::vector<std::string> order = nodes;
+    std::sort(order.begin(), order.end(),
+              [&](const std::string &a, const std::string &b) {
+                const auto ra = rank(a, device), rb = rank(b, device);
+                return ra != rb ? ra > rb : a < b;
+              });
+    if (home) {
+      std::erase(order, *home);
+      order.insert(order.begin(), *home);
+    }
+    if (!movable)
+      order.resize(1);
+    return order;
+  };
+
+  std::vector<std::vector<std::string>> preferences(cfg.deviceRegistry.size());
+  for (std::size_t i = 0; i < cfg.inverters.size(); ++i) {
+    const auto &inv = cfg.inverters[i];
+    preferences[inverterDeviceId(cfg, i)] =
+        preference(inv.name, inv.home, !inv.rtu);
+  }
+  for (std::size_t i = 0; i < cfg.meters.size(); ++i) {
+    const auto &m = cfg.meters[i];
+    const auto *f = asFronius(m);
+    preferences[meterDeviceId(cfg, i)] =
+        preference(m.name, m.home, f && !f->rtu);
+  }
+  return preferences;
+}
+
+std::vector<bool>
+clusterOwnership(const std::vector<std::vector<std::string>> &preferences,
+                 const std::string &node,
+                 const std::vector<std::string> &live) {
+  std::vector<bool> owned(preferences.size(), false);
+  for (std::size_t id = 0; id < preferences.size(); ++id) {
+    const auto &order = preferences[id];
+    if (order.empty())
+      continue; // a vacant slot
+    if (live.empty()) {
+      owned[id] = order.front() == node;
+      continue;
+    }
+    const auto it = std::find_if(order.begin(), order.end(), [&](auto &n) {
+      return std::find(live.begin(), live.end(), n) != live.end();
+    });
+    owned[id] = it != order.end() && *it == node;
+  }
+  return owned;
+}
+
+// ---------------------------------------------------------------------------
+// ClusterCoordinator
+// ---------------------------------------------------------------------------
+
+ClusterCoordinator::ClusterCoordinator(const AppConfig &cfg,
+                                       SignalHandler &signalHandler,
+                                       OwnershipCallback onChange)
+    : cfg_(*cfg.cluster), pgCfg_(*cfg.postgres),
+      registry_(cfg.deviceRegistry), site_(cfg.site),
+      preferences_(clusterPreferences(cfg)), handler_(signalHandler),
+      onChange_(std::move(onChange)),
+      owned_(cfg.deviceRegistry.size(), false) {
+  logger_ = spdlog::get("cluster");
+  if (!logger_)
+    logger_ = spdlog::default_logger();
+
+  leaderMetric_ = Metrics::callback(
+      Metrics::Type::Gauge, "fronius_bridge_cluster_leader",
+      "Whether this node is the cluster leader", {},
+      [this] { return leader_.load() ? 1.0 : 0.0; });
+  servedMetric_ = Metrics::callback(
+      Metrics::Type::Gauge, "fronius_bridge_cluster_devices",
+      "Devices this cluster node serves", {},
+      [this] { return static_cast<double>(served_.load()); });
+
+  // Until the database is reached, serve the home devices. Handed over in
+  // full, since every master starts active.
+  owned_ = clusterOwnership(preferences_, cfg_.node, {});
+  served_.store(static_cast<std::size_t>(
+      std::count(owned_.begin(), owned_.end(), true)));
+  onChange_(owned_);
+  logger_->info("Cluster node '{}' of {} ({})", cfg_.node, cfg_.nodes.size(),
+                join(cfg_.nodes, ", "));
+
+  thread_ = std::jthread([this] { run(); });
+}
+
+void ClusterCoordinator::reload(const AppConfig &cfg) {
+  {
+    std::lock_guard<std::mutex> lock(reloadMutex_);
+    pending_ = Roster{cfg.deviceRegistry, clusterPreferences(cfg)};
+  }
+  reloaded_.store(true);
+  wake_.notify();
+}
+
+ClusterCoordinator::~ClusterCoordinator() {
+  stop_.store(true);
+  wake_.notify();
+  if (thread_.joinable())
+    thread_.join();
+  // Closing the session releases the node and leader locks, so the other
+  // nodes take over at their next round.
+  if (conn_)
+    conn_->close();
+}
+
+void ClusterCoordinator::run() {
+  const std::chrono::seconds lease{cfg_.lease};
+  const std::chrono::seconds minDelay{pgCfg_.reconnectDelay.min};
+  const std::chrono::seconds maxDelay{pgCfg_.reconnectDelay.max};
+  std::chrono::seconds backoff{minDelay};
+  auto stopping = [&] { return stop_.load() || !handler_.isRunning(); };
+  auto due = [&] { return stopping() || reloaded_.load(); };
+
+  while (!stopping()) {
+    adoptRoster();
+    auto round = conn_ ? std::expected<void, DbError>{} : connect();
+    if (round)
+      round = tick();
+    if (!round) {
+      logger_->warn("Cluster coordination failed: {} - retrying in {}s",
+                    round.error().describe(), backoff.count());
+      fallBack();
+      wake_.waitFor(backoff, due);
+      backoff = pgCfg_.reconnectDelay.exponential
+                    ? std::min(backoff * 2, maxDelay)
+                    : minDelay;
+      continue;
+    }
+    backoff = minDelay;
+    wake_.waitFor(lease, due);
+  }
+}
+
+void ClusterCoordinator::adoptRoster() {
+  if (!reloaded_.exchange(false))
+    return;
+  std::optional<Roster> roster;
+  {
+    std::lock_guard<std::mutex> lock(reloadMutex_);
+    roster = std::exchange(pending_, std::nullopt);
+  }
+  if (!roster)
+    return;
+  registry_ = std::move(roster->registry);
+  preferences_ = std::move(roster->preferences);
+  // The leader writes the new roster this round, and the new masters, which
+  // start inactive, get their state with the next apply().
+  registrySynced_ = false;
+  handOver_ = true;
+  logger_->info("Cluster roster reloaded");
+}
+
+std::expected<void, DbError> ClusterCoordinator::connect() {
+  conn_ = std::make_unique<pg::Conn>(pgCfg_.dsn);
+  if (!conn_->isOpen()) {
+    DbError err = conn_->connectError();
+    conn_.reset();
+    return std::unexpected(err);
+  }
+  // Let the server drop a vanished node's session, and with it its locks,
+  // after about four leases instead of the system's two hours.
+  if (auto r = conn_->exec(std::format("SET tcp_keepalives_idle = {0}; "
+                                       "SET tcp_keepalives_interval = {0}; "
+                                       "SET tcp_keepalives_count = 3",
+                                       cfg_.lease));
+      !r) {
+    conn_.reset();
+    return std::unexpected(r.error());
+  }
+  logger_->info("Cluster coordination connected");
+  return {};
+}
+
+std::expected<void, DbError> ClusterCoordinator::tick() {
+  if (!nodeLocked_) {
+    auto locked = tryLock(nodeLockClass, cfg_.node);
+    if (!locked)
+      return std::unexpected(locked.error());
+    nodeLocked_ = *locked;
+    if (nodeLocked_)
+      logger_->info("Cluster node '{}' joined", cfg_.node);
+    else
+      logger_->warn("Cluster node '{}' is held by another session: a second "
+                    "instance with this --node, or an earlier run whose "
+                    "exit the server has not seen yet",
+                    cfg_.node);
+  }
+
+  if (!leader_.load()) {
+    auto locked = tryLock(leaderLockClass, std::nullopt);
+    if (!locked)
+      return std::unexpected(locked.error());
+    if (*locked) {
+      leader_.store(true);
+      registrySynced_ = false;
+      logger_->info("Cluster node '{}' is the leader", cfg_.node);
+    }
+  }
+
+  // A new leader writes the roster. A failure other than a lost connection
+  // (the public schema not migrated yet, on a first start) retries next
+  // round.
+  if (leader_.load() && !registrySynced_) {
+    if (auto r = PostgresClient::syncRegistry(*conn_, registry_, site_); !r) {
+      if (r.error().kind == DbError::Kind::PROTOCOL)
+        return std::unexpected(r.error());
+      logger_->warn("Cluster leader registry sync failed: {} - retrying",
+                    r.error().describe());
+    } else {
+      registrySynced_ = true;
+      logger_->info("Cluster leader synced the device registry");
+    }
+  }
+
+  auto live = liveNodes();
+  if (!live)
+    return std::unexpected(live.error());
+  if (*live != live_) {
+    live_ = std::move(*live);
+    logger_->info("Cluster nodes up: {}", join(live_, ", "));
+  }
+  apply(clusterOwnership(preferences_, cfg_.node, live_));
+  return {};
+}
+
+std::expected<bool, DbError>
+ClusterCoordinator::tryLock(std::int32_t key1,
+                            const std::optional<std::string> &key2) {
+  auto r = key2 ? conn_->execParams(
+                      "SELECT pg_try_advisory_lock($1, hashtext($2))",
+                      pg::Params{static_cast<int>(key1), *key2})
+                : conn_->execParams("SELECT pg_try_advisory_lock($1, 0)",
+                                    pg::Params{static_cast<int>(key1)});
+  if (!r)
+    return std::unexpected(r.error());
+  return std::string_view{r->value(0, 0)} == "t";
+}
+
+std::expected<std::vector<std::string>, DbError>
+ClusterCoordinator::liveNodes() {
+  // The names are [A-Za-z0-9_-] (see parseCluster), so the array literal
+  // needs no quoting.
+  auto r = conn_->execParams(
+      "SELECT n FROM unnest($1::text[]) WITH ORDINALITY AS u(n, i) "
+      "WHERE EXISTS (SELECT 1 FROM pg_locks l "
+      "WHERE l.locktype = 'advisory' AND l.granted AND l.objsubid = 2 "
+      "AND l.database = (SELECT oid FROM pg_database "
+      "WHERE datname = current_database()) "
+      "AND l.classid = $2::int::oid AND l.objid = hashtext(n)::oid) "
+      "ORDER BY i",
+      pg::Params{"{" + join(cfg_.nodes, ",") + "}",
+                 static_cast<int>(nodeLockClass)});
+  if (!r)
+    return std::unexpected(r.error());
+  std::vector<std::string> live;
+  for (int row = 0; row < r->rows(); ++row)
+    live.emplace_back(r->value(row, 0));
+  return live;
+}
+
+void ClusterCoordinator::apply(std::vector<bool> owned) {
+  if (owned == owned_ && !handOver_)
+    return;
+  handOver_ = false;
+  for (std::size_t id = 0; id < owned.size(); ++id) {
+    if (owned[id] == owned_[id] || preferences_[id].empty() ||
+        preferences_[id].front() == cfg_.node)
+      continue;
+    if (owned[id])
+      logger_->info("Taking over '{}' from its home '{}'", registry_[id].name,
+                    preferences_[id].front());
+    else
+      logger_->info("Handing '{}' back", registry_[id].name);
+  }
+  owned_ = std::move(owned);
+  served_.store(static_cast<std::size_t>(
+      std::count(owned_.begin(), owned_.end(), true)));
+  onChange_(owned_);
+}
+
+void ClusterCoordinator::fallBack() {
+  conn_.reset();
+  nodeLocked_ = false;
+  if (leader_.exchange(false))
+    logger_->warn("Cluster node '{}' is no longer the leader", cfg_.node);
+  live_.clear();
+  apply(clusterOwnership(preferences_, cfg_.node, {}));
+}
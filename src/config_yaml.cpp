@@ -107,6 +107,18 @@ tcflag_t dataBitsToFlag(int dataBits) {
   }
 }
 
+const char *contentType(MqttEncoding encoding) {
+  switch (encoding) {
+  case MqttEncoding::Cbor:
+    return "application/cbor";
+  case MqttEncoding::MsgPack:
+    return "application/vnd.msgpack";
+  case MqttEncoding::Json:
+    break;
+  }
+  return "application/json";
+}
+
 char parityToChar(Parity parity) {
   switch (parity) {
   case Parity::Even:
@@ -178,9 +190,13 @@ parseTcpServer(const YAML::Node &node) {
   ModbusTcpServerConfig tcp;
   tcp.listen = node["listen"].as<std::string>("0.0.0.0");
   tcp.port = node["port"].as<int>(502);
+  tcp.maxConnections = node["max_connections"].as<int>(8);
 
   if (tcp.port <= 0 || tcp.port > 65535)
     throw std::invalid_argument(".tcp.port must be in range [1-65535]");
+  if (tcp.maxConnections < 1 || tcp.maxConnections > 1024)
+    throw std::invalid_argument(".tcp.max_connections must be in range "
+                                "[1-1024]");
 
   return tcp;
 }
@@ -233,6 +249,68 @@ static ReconnectDelayConfig parseReconnectDelay(const YAML::Node &node) {
   return cfg;
 }
 
+// The optional `adaptive:` block; checked against the device's
+// update_interval by the caller.
+static std::optional<AdaptivePollConfig> parseAdaptive(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+
+  AdaptivePollConfig cfg;
+  cfg.minInterval = node["min_interval"].as<int>(1);
+  cfg.maxInterval = node["max_interval"].as<int>(30);
+  cfg.threshold = node["threshold"].as<double>(50.0);
+
+  if (cfg.minInterval <= 0)
+    throw std::invalid_argument(".adaptive.min_interval must be positive");
+  if (cfg.maxInterval > 3600)
+    throw std::invalid_argument(".adaptive.max_interval must be at most 3600");
+  if (!(cfg.threshold >= 0.0))
+    throw std::invalid_argument(".adaptive.threshold must not be negative");
+
+  return cfg;
+}
+
+// The optional `simulate:` block. `inverter` selects the checks of the
+// inverter-only keys, which a meter rejects.
+static std::optional<SimulateConfig> parseSimulate(const YAML::Node &node,
+                                                   bool inverter) {
+  if (!node)
+    return std::nullopt;
+
+  if (!inverter)
+    for (const char *key : {"inputs", "hybrid"})
+      if (node[key])
+        throw std::invalid_argument(std::string(".simulate.") + key +
+                                    " applies to inverters only");
+
+  SimulateConfig cfg;
+  cfg.port = node["port"].as<int>(15020);
+  cfg.latency = node["latency"].as<int>(20);
+  cfg.jitter = node["jitter"].as<int>(0);
+  cfg.power = node["power"].as<double>(5000.0);
+  cfg.phases = node["phases"].as<int>(3);
+  cfg.inputs = node["inputs"].as<int>(2);
+  cfg.hybrid = node["hybrid"].as<bool>(false);
+
+  if (cfg.port <= 0 || cfg.port > 65535)
+    throw std::invalid_argument(".simulate.port must be in range [1-65535]");
+  if (cfg.latency < 0 || cfg.latency > 10000)
+    throw std::invalid_argument(
+        ".simulate.latency must be in range [0-10000] ms");
+  if (cfg.jitter < 0 || cfg.jitter > 10000)
+    throw std::invalid_argument(
+        ".simulate.jitter must be in range [0-10000] ms");
+  if (!(cfg.power > 0.0 && cfg.power <= 1000000.0))
+    throw std::invalid_argument(
+        ".simulate.power must be in range (0-1000000] W");
+  if (cfg.phases < 1 || cfg.phases > 3)
+    throw std::invalid_argument(".simulate.phases must be [1,2,3]");
+  if (cfg.inputs < 1 || cfg.inputs > 2)
+    throw std::invalid_argument(".simulate.inputs must be [1,2]");
+
+  return cfg;
+}
+
 static ResponseTimeoutConfig parseResponseTimeout(const YAML::Node &node) {
   ResponseTimeoutConfig cfg;
   if (!node)
@@ -306,6 +384,20 @@ static std::string parseName(const YAML::Node &node) {
   return name;
 }
 
+// The optional `home:` of a device, the cluster node that serves it. Names
+// follow the device name rules; validateConfig() checks the node exists.
+static std::optional<std::string> parseHome(const YAML::Node &node) {
+  const auto h = node["home"];
+  if (!h)
+    return std::nullopt;
+  const auto home = h.as<std::string>("");
+  static const std::regex pattern("[A-Za-z0-9_-]{1,32}");
+  if (!std::regex_match(home, pattern))
+    throw std::invalid_argument(
+        ".home must be 1-32 [A-Za-z0-9_-] characters");
+  return home;
+}
+
 // Shared logic for any Modbus master-role section (inverter or meter).
 // Fills the fields that InverterConfig and MeterConfig have in common;
 // the caller is responsible for `name` and any role-specific extras
@@ -315,12 +407,24 @@ template <typename T> static T parseModbusMaster(const YAML::Node &node) {
 
   cfg.tcp = parseTcpClient(node["tcp"]);
   cfg.rtu = parseRtu(node["rtu"]);
+  cfg.simulate =
+      parseSimulate(node["simulate"], std::is_same_v<T, InverterConfig>);
+
+  // A simulated device is a Modbus TCP device whose far end is the
+  // in-process gateway; everything downstream of the config sees only that.
+  if (cfg.simulate) {
+    if (cfg.tcp || cfg.rtu)
+      throw std::runtime_error(
+          ": simulate replaces tcp and rtu and cannot be combined with them");
+    cfg.tcp = ModbusTcpClientConfig{"127.0.0.1", cfg.simulate->port};
+  }
 
   if (cfg.tcp.has_value() == cfg.rtu.has_value())
     throw std::runtime_error(": exactly one of tcp or rtu must be specified");
 
   cfg.slaveId = node["unit_id"].as<int>(1);
   cfg.updateInterval = node["update_interval"].as<int>(4);
+  cfg.adaptive = parseAdaptive(node["adaptive"]);
   cfg.responseTimeout = parseResponseTimeout(node["response_timeout"]);
   cfg.reconnectDelay = parseReconnectDelay(node["reconnect_delay"]);
 
@@ -328,6 +432,10 @@ template <typename T> static T parseModbusMaster(const YAML::Node &node) {
     throw std::invalid_argument(".unit_id must be in range [1-247]");
   if (cfg.updateInterval <= 0)
     throw std::invalid_argument(".update_interval must be positive");
+  if (cfg.adaptive && (cfg.adaptive->minInterval > cfg.updateInterval ||
+                       cfg.updateInterval > cfg.adaptive->maxInterval))
+    throw std::invalid_argument(".adaptive requires min_interval <= "
+                                "update_interval <= max_interval");
 
   return cfg;
 }
@@ -351,6 +459,7 @@ static std::vector<InverterConfig> parseInverters(const YAML::Node &node) {
     try {
       auto cfg = parseModbusMaster<InverterConfig>(node[i]);
       cfg.name = parseName(node[i]);
+      cfg.home = parseHome(node[i]);
       result.push_back(std::move(cfg));
     } catch (const std::exception &e) {
       throw std::runtime_error(prefix + e.what());
@@ -418,8 +527,11 @@ static EasyMeterConfig parseEasyMeter(const YAML::Node &node) {
       {"unit_id", "the EasyMeter is not a Modbus device"},
       {"update_interval",
        "the EasyMeter publishes on telegram arrival, not on an interval"},
+      {"adaptive",
+       "the EasyMeter publishes on telegram arrival, not on an interval"},
       {"response_timeout", "the EasyMeter is not a Modbus device"},
       {"reconnect_delay", "the EasyMeter manages its own serial reconnect"},
+      {"simulate", "only Modbus devices can be simulated"},
   };
   for (const auto &[key, why] : rejected)
     if (node[key])
@@ -485,6 +597,7 @@ static std::vector<MeterConfig> parseMeters(const YAML::Node &node) {
       if (cfg.primary && !cfg.location)
         throw std::runtime_error(
             ".primary requires .location ('feed-in' or 'consumption')");
+      cfg.home = parseHome(node[i]);
 
       // Kind-specific body, selected by the `type` field. "fronius" (the
       // default) is a SunSpec meter over Modbus; "ebz" is an EasyMeter
@@ -563,6 +676,97 @@ static std::optional<MqttTlsConfig> parseMqttTls(const YAML::Node &node) {
   return cfg;
 }
 
+// The mqtt.delta section is optional: a missing section returns nullopt and
+// every poll publishes the full values document. Deadbands default to 0, so an
+// empty block ({}) publishes every change of a quantised value.
+static std::optional<MqttDeltaConfig> parseMqttDelta(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+
+  MqttDeltaConfig cfg;
+  cfg.keyframeInterval = node["keyframe_interval"].as<int>(60);
+  if (cfg.keyframeInterval <= 0)
+    throw std::invalid_argument(
+        "mqtt.delta.keyframe_interval must be greater than zero");
+
+  const YAML::Node band = node["deadband"];
+  if (!band)
+    return cfg;
+
+  const auto parseBand = [&band](const char *key) {
+    const double value = band[key].as<double>(0.0);
+    if (!(value >= 0.0))
+      throw std::invalid_argument(
+          std::format("mqtt.delta.deadband.{} must not be negative", key));
+    return value;
+  };
+  cfg.deadband.power = parseBand("power");
+  cfg.deadband.voltage = parseBand("voltage");
+  cfg.deadband.current = parseBand("current");
+  cfg.deadband.energy = parseBand("energy");
+
+  return cfg;
+}
+
+// Map an encoding name to its enum, or std::nullopt for an unknown value; the
+// caller validates, as for parseParity().
+static std::optional<MqttEncoding> parseEncoding(const std::string &s) {
+  if (s == "json")
+    return MqttEncoding::Json;
+  if (s == "cbor")
+    return MqttEncoding::Cbor;
+  if (s == "msgpack")
+    return MqttEncoding::MsgPack;
+  return std::nullopt;
+}
+
+// One class of mqtt.publish, defaulting to `def` key by key. Only the classes
+// that carry Values (`binary`) have a binary serialiser.
+static MqttPublishPolicy parsePublishPolicy(const YAML::Node &node,
+                                            const char *name,
+                                            MqttPublishPolicy def,
+                                            bool binary) {
+  if (!node)
+    return def;
+
+  MqttPublishPolicy policy;
+  policy.qos = node["qos"].as<int>(def.qos);
+  policy.retain = node["retain"].as<bool>(def.retain);
+  if (policy.qos < 0 || policy.qos > 2)
+    throw std::invalid_argument(
+        std::format("mqtt.publish.{}.qos must be 0, 1 or 2", name));
+
+  if (node["encoding"]) {
+    const auto encoding = parseEncoding(node["encoding"].as<std::string>());
+    if (!encoding)
+      throw std::invalid_argument(std::format(
+          "mqtt.publish.{}.encoding must be [json, cbor, msgpack]", name));
+    if (*encoding != MqttEncoding::Json && !binary)
+      throw std::invalid_argument(std::format(
+          "mqtt.publish.{}.encoding: only values and delta can be binary",
+          name));
+    policy.encoding = *encoding;
+  }
+  return policy;
+}
+
+// The mqtt.publish section is optional; each topic class in it is too.
+static MqttPublishConfig parsePublish(const YAML::Node &node) {
+  MqttPublishConfig cfg;
+  if (!node)
+    return cfg;
+
+  cfg.values = parsePublishPolicy(node["values"], "values", cfg.values, true);
+  cfg.delta = parsePublishPolicy(node["delta"], "delta", cfg.delta, true);
+  cfg.events =
+      parsePublishPolicy(node["events"], "events", cfg.events, false);
+  cfg.device =
+      parsePublishPolicy(node["device"], "device", cfg.device, false);
+  cfg.availability = parsePublishPolicy(node["availability"], "availability",
+                                        cfg.availability, false);
+  return cfg;
+}
+
 static MqttConfig parseMqtt(const YAML::Node &node) {
   if (!node)
     throw std::runtime_error("Missing mqtt section in config");
@@ -580,9 +784,16 @@ static MqttConfig parseMqtt(const YAML::Node &node) {
 
   cfg.reconnectDelay = parseReconnectDelay(node["reconnect_delay"]);
   cfg.tls = parseMqttTls(node["tls"]);
+  cfg.delta = parseMqttDelta(node["delta"]);
+  cfg.publish = parsePublish(node["publish"]);
+  cfg.maxInflight =
+      parsePositiveSize(node["max_inflight"], "mqtt.max_inflight", 20);
 
   if (cfg.port <= 0 || cfg.port > 65535)
     throw std::invalid_argument("mqtt.port must be in range [1-65535]");
+  // MQTT v5's Receive Maximum, which libmosquitto's send window mirrors.
+  if (cfg.maxInflight > 65535)
+    throw std::invalid_argument("mqtt.max_inflight must be at most 65535");
 
   return cfg;
 }
@@ -592,6 +803,51 @@ static MqttConfig parseMqtt(const YAML::Node &node) {
 // default for a connection string); queue_size and reconnect_delay mirror the
 // mqtt semantics. autoMigrate is intentionally not read here — it is a runtime
 // flag set from the CLI, not config.
+// Map an fsync policy name to its enum, or std::nullopt for an unknown value;
+// the caller validates, as for parseParity().
+static std::optional<SpoolFsync> parseSpoolFsync(const std::string &val) {
+  if (val == "never")
+    return SpoolFsync::Never;
+  if (val == "segment")
+    return SpoolFsync::Segment;
+  if (val == "always")
+    return SpoolFsync::Always;
+  return std::nullopt;
+}
+
+static std::optional<PostgresSpoolConfig>
+parsePostgresSpool(const YAML::Node &node, std::size_t queueSize) {
+  if (!node)
+    return std::nullopt;
+
+  if (!node["dir"])
+    throw std::runtime_error("postgres.spool.dir is required");
+
+  PostgresSpoolConfig spool;
+  spool.dir = node["dir"].as<std::string>();
+  if (spool.dir.empty())
+    throw std::invalid_argument("postgres.spool.dir must not be empty");
+
+  const auto defaultWatermark = std::max<std::size_t>(queueSize / 2, 1);
+  spool.highWatermark = parsePositiveSize(
+      node["high_watermark"], "postgres.spool.high_watermark",
+      static_cast<long long>(defaultWatermark));
+  if (spool.highWatermark > queueSize)
+    throw std::invalid_argument(
+        "postgres.spool.high_watermark must not exceed postgres.queue_size");
+
+  spool.maxSizeMb =
+      parsePositiveSize(node["max_size_mb"], "postgres.spool.max_size_mb", 64);
+
+  auto fsync = parseSpoolFsync(node["fsync"].as<std::string>("segment"));
+  if (!fsync)
+    throw std::invalid_argument(
+        "postgres.spool.fsync must be [never,segment,always]");
+  spool.fsync = *fsync;
+
+  return spool;
+}
+
 static std::optional<PostgresConfig> parsePostgres(const YAML::Node &node) {
   if (!node)
     return std::nullopt;
@@ -606,6 +862,20 @@ static std::optional<PostgresConfig> parsePostgres(const YAML::Node &node) {
 
   cfg.queueSize =
       parsePositiveSize(node["queue_size"], "postgres.queue_size", 10000);
+  cfg.batchSize =
+      parsePositiveSize(node["batch_size"], "postgres.batch_size", 100);
+  cfg.lingerMs = node["linger_ms"].as<int>(0);
+  if (cfg.lingerMs < 0)
+    throw std::invalid_argument("postgres.linger_ms must not be negative");
+  cfg.pipeline = node["pipeline"].as<bool>(false);
+  cfg.migrateConnections = node["migrate_connections"].as<int>(4);
+  if (cfg.migrateConnections < 1 || cfg.migrateConnections > 32)
+    throw std::invalid_argument(
+        "postgres.migrate_connections must be in range [1-32]");
+  cfg.writers = node["writers"].as<int>(1);
+  if (cfg.writers < 1 || cfg.writers > 16)
+    throw std::invalid_argument("postgres.writers must be in range [1-16]");
+  cfg.spool = parsePostgresSpool(node["spool"], cfg.queueSize);
   cfg.reconnectDelay = parseReconnectDelay(node["reconnect_delay"]);
 
   return cfg;
@@ -650,6 +920,19 @@ static LoggerConfig parseLogger(const YAML::Node &node) {
     }
   }
 
+  if (const auto async = node["async"]) {
+    LoggerAsyncConfig a;
+    a.queueSize =
+        parsePositiveSize(async["queue_size"], "logger.async.queue_size", 8192);
+    const auto overflow = async["overflow"].as<std::string>("drop_oldest");
+    if (overflow == "block")
+      a.overflow = LogOverflow::Block;
+    else if (overflow != "drop_oldest")
+      throw std::invalid_argument(
+          "logger.async.overflow must be [drop_oldest,block]");
+    cfg.async = a;
+  }
+
   return cfg;
 }
 
@@ -680,6 +963,104 @@ static SiteConfig parseSite(const YAML::Node &node) {
   return cfg;
 }
 
+// Parse the `metrics:` section: the scrape endpoint's address. Both keys are
+// optional; an empty section serves on all interfaces at the default port.
+static MetricsConfig parseMetrics(const YAML::Node &node) {
+  MetricsConfig cfg;
+  cfg.listen = node["listen"].as<std::string>("0.0.0.0");
+  cfg.port = node["port"].as<int>(9464);
+
+  if (cfg.listen.empty())
+    throw std::invalid_argument("metrics.listen must not be empty");
+  if (cfg.port <= 0 || cfg.port > 65535)
+    throw std::invalid_argument("metrics.port must be in range [1-65535]");
+
+  return cfg;
+}
+
+// Parse the `aggregate:` section: the bucket width and whether the raw
+// samples still go out. Both keys are optional.
+static AggregateConfig parseAggregate(const YAML::Node &node) {
+  AggregateConfig cfg;
+  cfg.bucket = node["bucket"].as<int>(30);
+  cfg.forwardRaw = node["forward_raw"].as<bool>(false);
+
+  if (cfg.bucket <= 0 || 30 % cfg.bucket != 0)
+    throw std::invalid_argument(
+        "aggregate.bucket must divide 30 (1, 2, 3, 5, 6, 10, 15 or 30)");
+
+  return cfg;
+}
+
+// Parse the `site_energy:` section: the publish interval, optional. The
+// devices it needs are checked by validateConfig().
+static SiteEnergyConfig parseSiteEnergy(const YAML::Node &node) {
+  SiteEnergyConfig cfg;
+  cfg.interval = node["interval"].as<int>(60);
+
+  if (cfg.interval < 1 || cfg.interval > 3600)
+    throw std::invalid_argument(
+        "site_energy.interval must be in range [1-3600]");
+
+  return cfg;
+}
+
+// Parse the `snapshot:` section: the tick, optional. That the masters poll
+// on it is checked by validateConfig().
+static SnapshotConfig parseSnapshot(const YAML::Node &node) {
+  SnapshotConfig cfg;
+  cfg.interval = node["interval"].as<int>(10);
+
+  if (cfg.interval < 1 || cfg.interval > 3600)
+    throw std::invalid_argument("snapshot.interval must be in range [1-3600]");
+
+  return cfg;
+}
+
+// Parse the `cluster:` section: the node names, required, and the lease
+// period. This instance's own node comes from the command line.
+static ClusterConfig parseCluster(const YAML::Node &node) {
+  ClusterConfig cfg;
+  const auto nodes = node["nodes"];
+  if (!nodes || !nodes.IsSequence() || nodes.size() == 0)
+    throw std::invalid_argument(
+        "cluster.nodes must be a non-empty sequence of node names");
+  static const std::regex pattern("[A-Za-z0-9_-]{1,32}");
+  for (const auto &n : nodes) {
+    auto name = n.as<std::string>("");
+    if (!std::regex_match(name, pattern))
+      throw std::invalid_argument(
+          "cluster.nodes entries must be 1-32 [A-Za-z0-9_-] characters");
+    if (std::find(cfg.nodes.begin(), cfg.nodes.end(), name) != cfg.nodes.end())
+      throw std::invalid_argument("cluster.nodes lists '" + name + "' twice");
+    cfg.nodes.push_back(std::move(name));
+  }
+  cfg.lease = node["lease"].as<int>(10);
+
+  if (cfg.lease < 1 || cfg.lease > 300)
+    throw std::invalid_argument("cluster.lease must be in range [1-300]");
+
+  return cfg;
+}
+
+// Parse the `memory:` section: the shared queue budget and the thread stack
+// size, both optional.
+static MemoryConfig parseMemory(const YAML::Node &node) {
+  MemoryConfig cfg;
+  cfg.budgetKb = parsePositiveSize(node["budget_kb"], "memory.budget_kb", 4096);
+  cfg.threadStackKb =
+      parsePositiveSize(node["thread_stack_kb"], "memory.thread_stack_kb", 256);
+
+  if (cfg.budgetKb < 256 || cfg.budgetKb > 1048576)
+    throw std::invalid_argument(
+        "memory.budget_kb must be in range [256-1048576]");
+  if (cfg.threadStackKb < 64 || cfg.threadStackKb > 8192)
+    throw std::invalid_argument(
+        "memory.thread_stack_kb must be in range [64-8192]");
+
+  return cfg;
+}
+
 // ---------------------------------------------------------------------------
 // Cross section validation
 // ---------------------------------------------------------------------------
@@ -704,6 +1085,7 @@ struct DeviceRef {
   const ModbusTcpClientConfig *tcp;
   const ModbusRtuConfig *rtu;
   int slaveId;
+  bool simulated; // tcp points at a SimulatedGateway
 };
 
 std::string describe(const DeviceRef &d) {
@@ -869,7 +1251,9 @@ static std::string_view meterLocationName(MeterLocation loc) {
 // One registry entry per configured device, in section order: inverters first
 // (kind 'inverter', no location), then meters (kind 'meter', carrying their
 // location and primary role). The PostgreSQL consumer writes these into
-// public.device_registry at startup.
+// public.device_registry at startup. loadConfig() takes the order for the
+// DeviceIds (see inverterDeviceId/meterDeviceId), reloadConfig() moves the
+// entries into the running slots.
 static std::vector<DeviceRegistryEntry>
 deriveDeviceRegistry(const AppConfig &cfg) {
   std::vector<DeviceRegistryEntry> registry;
@@ -895,7 +1279,8 @@ static void validateConfig(const AppConfig &cfg) {
   for (std::size_t i = 0; i < cfg.inverters.size(); ++i) {
     const auto &c = cfg.inverters[i];
     masters.push_back({"inverters", i, c.name, c.tcp ? &*c.tcp : nullptr,
-                       c.rtu ? &*c.rtu : nullptr, c.slaveId});
+                       c.rtu ? &*c.rtu : nullptr, c.slaveId,
+                       c.simulate.has_value()});
   }
   for (std::size_t i = 0; i < cfg.meters.size(); ++i) {
     const auto &c = cfg.meters[i];
@@ -908,7 +1293,8 @@ static void validateConfig(const AppConfig &cfg) {
     if (!f)
       continue;
     masters.push_back({"meters", i, c.name, f->tcp ? &*f->tcp : nullptr,
-                       f->rtu ? &*f->rtu : nullptr, f->slaveId});
+                       f->rtu ? &*f->rtu : nullptr, f->slaveId,
+                       f->simulate.has_value()});
   }
 
   // --- Collect the EBZ meter (non-bus, exclusive-serial reader) ---
@@ -1033,6 +1419,39 @@ static void validateConfig(const AppConfig &cfg) {
     }
   }
 
+  // --- Simulated gateway ports ---
+  // A simulated port belongs to its in-process gateway: a real device
+  // pointed at it on the loopback would be answered by the simulator under
+  // another device's name, and a meter slave listening on it could not bind.
+  {
+    std::map<int, std::string> simulated; // port -> first owner desc
+    for (const auto &d : masters)
+      if (d.simulated)
+        simulated.try_emplace(d.tcp->port, describe(d));
+
+    for (const auto &d : masters) {
+      if (d.simulated || !d.tcp)
+        continue;
+      const auto &host = d.tcp->host;
+      if (host != "127.0.0.1" && host != "localhost" && host != "::1")
+        continue;
+      if (auto it = simulated.find(d.tcp->port); it != simulated.end())
+        throw std::runtime_error(std::format(
+            "{} connects to {}:{}, which is the simulated gateway of {}",
+            describe(d), host, d.tcp->port, it->second));
+    }
+    for (std::size_t i = 0; i < cfg.meters.size(); ++i) {
+      const auto &m = cfg.meters[i];
+      if (!m.slave || !m.slave->tcp)
+        continue;
+      if (auto it = simulated.find(m.slave->tcp->port); it != simulated.end())
+        throw std::runtime_error(std::format(
+            "meters[{}].slave ('{}') listens on port {}, which is the "
+            "simulated gateway of {}",
+            i, m.name, m.slave->tcp->port, it->second));
+    }
+  }
+
   // --- RTU device exclusivity across master, slave, and EBZ roles ---
   // Rules per /dev/tty* path:
   //   - Multiple Modbus masters may share a path (that is the shared RTU
@@ -1094,6 +1513,114 @@ static void validateConfig(const AppConfig &cfg) {
       }
     }
   }
+
+  // The streaming site balance reads the same devices as the SQL rollup: the
+  // inverters for production and the primary meter for the grid side.
+  if (cfg.siteEnergy) {
+    if (cfg.inverters.empty())
+      throw std::runtime_error("site_energy requires at least one inverter");
+    if (std::none_of(cfg.meters.begin(), cfg.meters.end(),
+                     [](const MeterConfig &m) { return m.primary; }))
+      throw std::runtime_error(
+          "site_energy requires a meter marked 'primary: true'");
+  }
+
+  // A snapshot gathers one tick of the scheduler's wall-aligned polls, so
+  // every Modbus master has to be due on each tick boundary. The EBZ pushes a
+  // telegram every second or so and is in every tick anyway.
+  if (cfg.snapshot) {
+    const int interval = cfg.snapshot->interval;
+    auto check = [&](const std::string &owner, int updateInterval,
+                     bool adaptive) {
+      if (adaptive)
+        throw std::runtime_error(
+            owner + ": adaptive polling cannot be combined with snapshot");
+      if (updateInterval != interval)
+        throw std::runtime_error(std::format(
+            "{}: update_interval must equal snapshot.interval ({} s) to "
+            "be polled in every snapshot",
+            owner, interval));
+    };
+    for (std::size_t i = 0; i < cfg.inverters.size(); ++i) {
+      const auto &c = cfg.inverters[i];
+      check(std::format("inverters[{}] ('{}')", i, c.name), c.updateInterval,
+            c.adaptive.has_value());
+    }
+    for (std::size_t i = 0; i < cfg.meters.size(); ++i)
+      if (const auto *f = asFronius(cfg.meters[i]))
+        check(std::format("meters[{}] ('{}')", i, cfg.meters[i].name),
+              f->updateInterval, f->adaptive.has_value());
+  }
+
+  // --- Cluster ---
+  // Every node sees only the devices it serves, and they coordinate through
+  // the database. A serial line is wired to one box, so a device on one (an
+  // RTU master, an EBZ, a meter with an RTU slave) names the node it is on,
+  // and all the devices of one line name the same.
+  struct Homed {
+    std::string owner;
+    const std::optional<std::string> *home;
+    const ModbusRtuConfig *rtu;
+  };
+  std::vector<Homed> homed;
+  for (std::size_t i = 0; i < cfg.inverters.size(); ++i) {
+    const auto &c = cfg.inverters[i];
+    homed.push_back({std::format("inverters[{}] ('{}')", i, c.name), &c.home,
+                     c.rtu ? &*c.rtu : nullptr});
+  }
+  for (std::size_t i = 0; i < cfg.meters.size(); ++i) {
+    const auto &m = cfg.meters[i];
+    const ModbusRtuConfig *rtu = nullptr;
+    if (const auto *f = std::get_if<FroniusMeterConfig>(&m.body); f && f->rtu)
+      rtu = &*f->rtu;
+    else if (const auto *e = std::get_if<EasyMeterConfig>(&m.body))
+      rtu = &e->rtu;
+    if (!rtu && m.slave && m.slave->rtu)
+      rtu = &*m.slave->rtu;
+    homed.push_back(
+        {std::format("meters[{}] ('{}')", i, m.name), &m.home, rtu});
+  }
+
+  if (!cfg.cluster) {
+    for (const auto &d : homed)
+      if (*d.home)
+        throw std::runtime_error(d.owner +
+                                 ": home requires a cluster section");
+    return;
+  }
+  if (!cfg.postgres)
+    throw std::runtime_error("cluster requires a postgres section, the "
+                             "database the nodes coordinate through");
+  if (cfg.siteEnergy)
+    throw std::runtime_error(
+        "site_energy cannot be combined with cluster: each node sees only "
+        "the samples of the devices it serves");
+  if (cfg.snapshot)
+    throw std::runtime_error(
+        "snapshot cannot be combined with cluster: each node sees only the "
+        "samples of the devices it serves");
+
+  const auto &nodes = cfg.cluster->nodes;
+  std::map<std::string, std::pair<std::string, std::string>> lines;
+  for (const auto &d : homed) {
+    const auto &home = *d.home;
+    if (home && std::find(nodes.begin(), nodes.end(), *home) == nodes.end())
+      throw std::runtime_error(std::format(
+          "{}: home '{}' is not one of cluster.nodes", d.owner, *home));
+    if (!d.rtu)
+      continue;
+    if (!home)
+      throw std::runtime_error(
+          d.owner + ": a device on a RTU line needs a home in cluster mode");
+    auto [it, inserted] =
+        lines.try_emplace(d.rtu->device, std::pair{*home, d.owner});
+    if (!inserted && it->second.first != *home)
+      throw std::runtime_error(std::format(
+          "the devices on RTU line '{}' must share a home: {} names '{}', {} "
+          "names '{}'",
+          d.rtu->device, it->second.second, it->second.first, d.owner,
+          *home));
+  }
 }
 
 // ---------------------------------------------------------------------------
@@ -1117,14 +1644,223 @@ AppConfig loadConfig(const std::string &path) {
   cfg.logger = parseLogger(root["logger"]);
   if (root["site"])
     cfg.site = parseSite(root["site"]);
+  if (root["metrics"])
+    cfg.metrics = parseMetrics(root["metrics"]);
+  if (root["aggregate"])
+    cfg.aggregate = parseAggregate(root["aggregate"]);
+  if (root["site_energy"])
+    cfg.siteEnergy = parseSiteEnergy(root["site_energy"]);
+  if (root["snapshot"])
+    cfg.snapshot = parseSnapshot(root["snapshot"]);
+  if (root["cluster"])
+    cfg.cluster = parseCluster(root["cluster"]);
+  if (root["memory"])
+    cfg.memory = parseMemory(root["memory"]);
 
   validateConfig(cfg);
 
+  // With a cluster the leader, not every node, writes the roster.
+  if (cfg.cluster)
+    cfg.postgres->syncRegistry = false;
+
   // Derive the deduplicated bus registry from the validated device sections.
   cfg.buses = deriveBuses(cfg);
 
-  // Derive the device roster the PostgreSQL consumer writes to the registry.
+  // Derive the device roster the PostgreSQL consumer writes to the registry,
+  // and the spare slots a reload adds devices in.
   cfg.deviceRegistry = deriveDeviceRegistry(cfg);
+  for (std::size_t i = 0; i < cfg.inverters.size(); ++i)
+    cfg.inverterIds.push_back(static_cast<DeviceId>(i));
+  for (std::size_t i = 0; i < cfg.meters.size(); ++i)
+    cfg.meterIds.push_back(static_cast<DeviceId>(cfg.inverters.size() + i));
+  cfg.deviceRegistry.resize(cfg.deviceRegistry.size() + spareDeviceSlots);
 
   return cfg;
-}
\ No newline at end of file
+}
+
+const InverterConfig *inverterOf(const AppConfig &cfg, DeviceId id) {
+  for (std::size_t i = 0; i < cfg.inverters.size(); ++i)
+    if (cfg.inverterIds[i] == id)
+      return &cfg.inverters[i];
+  return nullptr;
+}
+
+const MeterConfig *meterOf(const AppConfig &cfg, DeviceId id) {
+  for (std::size_t i = 0; i < cfg.meters.size(); ++i)
+    if (cfg.meterIds[i] == id)
+      return &cfg.meters[i];
+  return nullptr;
+}
+// ---------------------------------------------------------------------------
+// Config reload
+// ---------------------------------------------------------------------------
+
+// Whether two derived buses are opened alike. The bus key already fixes
+// the TCP endpoint or the RTU device path; what is left is the line and the
+// merged reconnect delay. libfronius's ModbusBusConfig has no operator==.
+static bool sameBus(const ModbusBusConfig &a, const ModbusBusConfig &b) {
+  if (a.reconnectDelay != b.reconnectDelay ||
+      a.reconnectDelayMax != b.reconnectDelayMax ||
+      a.exponential != b.exponential || a.isRtu() != b.isRtu())
+    return false;
+  if (!a.isRtu())
+    return true;
+  const auto &x = a.rtu();
+  const auto &y = b.rtu();
+  return x.baud == y.baud && x.dataBits == y.dataBits &&
+         x.stopBits == y.stopBits && x.parity == y.parity;
+}
+
+// Whether `to` differs from `from` in no more than the poll interval.
+static bool onlyRetuned(const InverterConfig &from, InverterConfig to) {
+  to.updateInterval = from.updateInterval;
+  to.adaptive = from.adaptive;
+  return to == from;
+}
+
+static bool onlyRetuned(const MeterConfig &from, MeterConfig to) {
+  const auto *f = asFronius(from);
+  auto *t = std::get_if<FroniusMeterConfig>(&to.body);
+  if (!f || !t)
+    return false;
+  t->updateInterval = f->updateInterval;
+  t->adaptive = f->adaptive;
+  return to == from;
+}
+
+ConfigDiff reloadConfig(const AppConfig &running, AppConfig &next) {
+  ConfigDiff diff;
+  auto &out = diff.restartRequired;
+
+  if (!(running.mqtt == next.mqtt))
+    out.push_back("mqtt");
+  if (running.postgres != next.postgres)
+    out.push_back("postgres");
+  if (running.site != next.site)
+    out.push_back("site");
+  if (running.metrics != next.metrics)
+    out.push_back("metrics");
+  if (running.aggregate != next.aggregate)
+    out.push_back("aggregate");
+  if (running.siteEnergy != next.siteEnergy)
+    out.push_back("site_energy");
+  if (running.snapshot != next.snapshot)
+    out.push_back("snapshot");
+  if (running.cluster != next.cluster)
+    out.push_back("cluster");
+  if (running.memory != next.memory)
+    out.push_back("memory");
+  if (running.logger.async != next.logger.async)
+    out.push_back("logger.async");
+
+  diff.logLevels = running.logger.globalLevel != next.logger.globalLevel ||
+                   running.logger.moduleLevels != next.logger.moduleLevels;
+
+  // Those sections keep running's values, and next's devices have to fit
+  // them.
+  next.mqtt = running.mqtt;
+  next.postgres = running.postgres;
+  next.site = running.site;
+  next.metrics = running.metrics;
+  next.aggregate = running.aggregate;
+  next.siteEnergy = running.siteEnergy;
+  next.snapshot = running.snapshot;
+  next.cluster = running.cluster;
+  next.memory = running.memory;
+  next.logger.async = running.logger.async;
+  try {
+    validateConfig(next);
+  } catch (const std::exception &ex) {
+    throw std::runtime_error(std::format(
+        "{} (with the sections that take effect only after a restart)",
+        ex.what()));
+  }
+  next.buses = deriveBuses(next);
+
+  // Lay next's devices out in running's slots: a device found in running,
+  // by name and kind, keeps its slot, a new one takes the lowest free.
+  const auto &slots = running.deviceRegistry;
+  const std::vector<DeviceRegistryEntry> devices = deriveDeviceRegistry(next);
+  std::vector<std::optional<DeviceId>> ids(devices.size());
+  std::vector<bool> taken(slots.size(), false);
+  for (std::size_t k = 0; k < devices.size(); ++k) {
+    for (std::size_t id = 0; id < slots.size() && !ids[k]; ++id)
+      if (slots[id].name == devices[k].name &&
+          slots[id].kind == devices[k].kind)
+        ids[k] = static_cast<DeviceId>(id);
+    if (ids[k])
+      taken[*ids[k]] = true;
+  }
+  std::size_t free = 0;
+  for (std::size_t k = 0; k < devices.size(); ++k) {
+    if (ids[k])
+      continue;
+    while (free < slots.size() && taken[free])
+      ++free;
+    if (free == slots.size())
+      throw std::runtime_error(std::format(
+          "no device slot left for {} '{}': a reload adds at most {} devices "
+          "beyond those it removes, a restart makes room",
+          devices[k].kind, devices[k].name, spareDeviceSlots));
+    ids[k] = static_cast<DeviceId>(free);
+    taken[free] = true;
+  }
+  next.deviceRegistry.assign(slots.size(), DeviceRegistryEntry{});
+  next.inverterIds.clear();
+  next.meterIds.clear();
+  for (std::size_t k = 0; k < devices.size(); ++k) {
+    next.deviceRegistry[*ids[k]] = devices[k];
+    (k < next.inverters.size() ? next.inverterIds : next.meterIds)
+        .push_back(*ids[k]);
+  }
+
+  // A bus opened differently now takes its devices down with it.
+  auto busChanged = [&](const std::optional<std::string> &key) {
+    if (!key)
+      return false;
+    const auto from = running.buses.find(*key);
+    const auto to = next.buses.find(*key);
+    return from != running.buses.end() && to != next.buses.end() &&
+           !sameBus(from->second.config, to->second.config);
+  };
+
+  for (std::size_t i = 0; i < slots.size(); ++i) {
+    const auto id = static_cast<DeviceId>(i);
+    const auto &from = slots[i];
+    const auto &to = next.deviceRegistry[i];
+    if (from.name != to.name || from.kind != to.kind) {
+      if (!from.vacant())
+        diff.removed.push_back(id);
+      if (!to.vacant())
+        diff.added.push_back(id);
+      continue;
+    }
+    if (to.vacant())
+      continue;
+
+    bool same = false;
+    bool retuned = false;
+    std::optional<std::string> key;
+    if (const auto *inv = inverterOf(next, id)) {
+      const auto &was = *inverterOf(running, id);
+      same = was == *inv;
+      retuned = onlyRetuned(was, *inv);
+      key = busKeyOf(*inv);
+    } else {
+      const auto &m = *meterOf(next, id);
+      const auto &was = *meterOf(running, id);
+      same = was == m;
+      retuned = onlyRetuned(was, m);
+      key = busKeyOf(m);
+    }
+    if (busChanged(key))
+      diff.rebuilt.push_back(id);
+    else if (same)
+      continue;
+    else if (retuned)
+      diff.retuned.push_back(id);
+    else
+      diff.rebuilt.push_back(id);
+  }
+  return diff;
+}
@@ -0,0 +1,198 @@
+#include "dispatcher.h"
+#include "metrics.h"
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+Dispatcher::Lane::Lane(const std::string &laneName, Sink &laneSink,
+                       std::size_t queueSize)
+    : name(laneName), sink(laneSink), ring(queueSize),
+      depthMetric(Metrics::callback(
+          Metrics::Type::Gauge, "fronius_bridge_dispatch_queue_depth",
+          "Samples waiting for a sink's dispatcher thread", {{"sink", name}},
+          [this] { return static_cast<double>(ring.size()); })),
+      droppedMetric(Metrics::callback(
+          Metrics::Type::Counter, "fronius_bridge_dispatch_dropped_total",
+          "Samples dropped from a sink's full dispatcher queue",
+          {{"sink", name}},
+          [this] { return static_cast<double>(ring.dropped()); })) {}
+
+// Beyond the rings: a sample being dispatched (and the bucket it closes) per
+// device, and one being consumed per sink.
+Dispatcher::Dispatcher(const std::vector<DeviceRegistryEntry> &registry,
+                       const std::optional<AggregateConfig> &aggregate,
+                       std::size_t queueSize)
+    : queueSize_(queueSize), samples_(queueSize + 2 * registry.size() + 8),
+      poolMissesMetric_(Metrics::callback(
+          Metrics::Type::Counter, "fronius_bridge_pool_misses_total",
+          "Buffers allocated because their pool was empty",
+          {{"pool", "dispatch"}},
+          [this] { return static_cast<double>(samples_.misses()); })),
+      aggregate_(aggregate), inverterBuckets_(registry.size()),
+      meterBuckets_(registry.size()) {
+  logger_ = spdlog::get("main");
+  if (!logger_)
+    logger_ = spdlog::default_logger();
+
+  if (!aggregate)
+    return;
+  for (std::size_t id = 0; id < registry.size(); ++id) {
+    if (registry[id].vacant())
+      continue;
+    if (registry[id].kind == "inverter")
+      inverterBuckets_[id].emplace(aggregate->bucket);
+    else
+      meterBuckets_[id].emplace(aggregate->bucket);
+  }
+}
+
+Dispatcher::~Dispatcher() {
+  stop_.store(true, std::memory_order_release);
+  for (auto &lane : lanes_) {
+    lane->wake.notify();
+    if (lane->worker.joinable())
+      lane->worker.join();
+  }
+}
+
+void Dispatcher::subscribe(const std::string &name, Sink &sink) {
+  auto &lane =
+      lanes_.emplace_back(std::make_unique<Lane>(name, sink, queueSize_));
+  // The lane is complete and stays put (held by unique_ptr), so its thread
+  // may start on it.
+  lane->worker = std::thread(&Dispatcher::run, this, std::ref(*lane));
+  logger_->debug("Dispatcher: sink '{}' subscribed (queue {})", name,
+                 queueSize_);
+}
+
+void Dispatcher::retire(const std::vector<DeviceId> &devices) {
+  // No master dispatches as these devices any more, so their buckets are
+  // the main thread's to drop.
+  for (const DeviceId id : devices) {
+    inverterBuckets_[id].reset();
+    meterBuckets_[id].reset();
+  }
+  broadcast([&](Sink &sink) {
+    for (const DeviceId id : devices)
+      sink.retire(id);
+  });
+}
+
+void Dispatcher::admit(const AppConfig &cfg,
+                       const std::vector<DeviceId> &devices) {
+  if (aggregate_)
+    for (const DeviceId id : devices) {
+      if (cfg.deviceRegistry[id].kind == "inverter")
+        inverterBuckets_[id].emplace(aggregate_->bucket);
+      else
+        meterBuckets_[id].emplace(aggregate_->bucket);
+    }
+  broadcast([&](Sink &sink) {
+    for (const DeviceId id : devices)
+      sink.admit(cfg, id);
+  });
+}
+
+void Dispatcher::broadcast(const std::function<void(Sink &)> &task) {
+  if (lanes_.empty())
+    return;
+  // Every sample stamped before the bump was pushed before any stamped
+  // after it, so a lane that pops one of the new epoch has consumed the
+  // old ones.
+  const std::uint64_t epoch =
+      epoch_.fetch_add(1, std::memory_order_acq_rel) + 1;
+  for (auto &lane : lanes_) {
+    lane->task = &task;
+    lane->due.store(epoch, std::memory_order_release);
+    lane->wake.notify();
+  }
+  for (auto &lane : lanes_) {
+    std::unique_lock lock(lane->doneMutex);
+    lane->done.wait(lock, [&] {
+      return lane->due.load(std::memory_order_acquire) == noTask;
+    });
+  }
+}
+
+void Dispatcher::runTask(Lane &lane) {
+  try {
+    (*lane.task)(lane.sink);
+  } catch (const std::exception &ex) {
+    logger_->error("Dispatcher: sink '{}' failed on a roster change: {}",
+                   lane.name, ex.what());
+  }
+  {
+    std::lock_guard lock(lane.doneMutex);
+    lane.due.store(noTask, std::memory_order_release);
+  }
+  lane.done.notify_all();
+}
+
+void Dispatcher::dispatch(SampleRef sample) {
+  // Fold a values sample into its bucket before handing it on; the bucket
+  // it closes, if any, follows it.
+  SampleRef bucket;
+  auto close = [&](const auto &closed) {
+    bucket = samples_.acquire();
+    bucket->device = sample->device;
+    bucket->epoch = sample->epoch;
+    bucket->payload.clear();
+    bucket->data = closed;
+  };
+  if (const auto *v = std::get_if<InverterTypes::Values>(&sample->data)) {
+    if (auto &agg = inverterBuckets_[sample->device])
+      if (auto closed = agg->add(*v))
+        close(*closed);
+  } else if (const auto *v = std::get_if<MeterTypes::Values>(&sample->data)) {
+    if (auto &agg = meterBuckets_[sample->device])
+      if (auto closed = agg->add(*v))
+        close(*closed);
+  }
+
+  push(sample);
+  if (bucket)
+    push(bucket);
+}
+
+void Dispatcher::push(const SampleRef &sample) {
+  for (auto &lane : lanes_) {
+    lane->ring.push(sample);
+    lane->wake.notify();
+  }
+}
+
+void Dispatcher::run(Lane &lane) {
+  for (;;) {
+    lane.wake.wait([&] {
+      return !lane.ring.empty() || stop_.load(std::memory_order_acquire) ||
+             lane.due.load(std::memory_order_acquire) != noTask;
+    });
+    // Looked at before draining, so the drain finds every sample dispatched
+    // ahead of a pending roster change.
+    std::uint64_t due = lane.due.load(std::memory_order_acquire);
+    // Drain before looking at stop_, so what was dispatched before the
+    // masters stopped still reaches the sink.
+    while (auto sample = lane.ring.tryPop()) {
+      if ((*sample)->epoch >= due) {
+        runTask(lane);
+        due = noTask;
+      }
+      try {
+        lane.sink.consume(**sample);
+      } catch (const std::exception &ex) {
+        logger_->error("Dispatcher: sink '{}' failed on a sample: {}",
+                       lane.name, ex.what());
+      }
+    }
+    if (due != noTask)
+      runTask(lane);
+    if (stop_.load(std::memory_order_acquire) && lane.ring.empty())
+      return;
+  }
+}
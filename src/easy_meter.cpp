@@ -1,10 +1,14 @@
 #include "easy_meter.h"
+#include "capture.h"
 #include "config.h"
 #include "config_yaml.h"
 #include "meter_types.h"
+#include "metrics.h"
+#include "obis_parser.h"
+#include "payloads.h"
+#include "sample_clock.h"
 #include "signal_handler.h"
 #include "utils.h"
-#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
@@ -12,20 +16,19 @@
 #include <fcntl.h>
 #include <format>
 #include <mutex>
-#include <nlohmann/json.hpp>
-#include <regex>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <sys/file.h>
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
-#include <vector>
-
-using json = nlohmann::ordered_json;
 
 EasyMeter::EasyMeter(const MeterConfig &cfg, SignalHandler &signalHandler)
     : cfg_(cfg), ecfg_(std::get<EasyMeterConfig>(cfg.body)),
+      parseDuration_(Metrics::histogram(
+          "fronius_bridge_telegram_parse_duration_seconds",
+          "Time to parse one EBZ telegram into device and values",
+          {{"device", cfg.name}})),
       handler_(signalHandler) {
 
   // Logger chain: meter.master -> meter -> default. Same convention as
@@ -42,6 +45,10 @@ EasyMeter::EasyMeter(const MeterConfig &cfg, SignalHandler &signalHandler)
 }
 
 EasyMeter::~EasyMeter() {
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    stop_ = true;
+  }
   cv_.notify_all();
   if (worker_.joinable())
     worker_.join();
@@ -61,7 +68,7 @@ void EasyMeter::disconnect(void) {
   {
     std::unique_lock<std::mutex> lock(cbMutex_);
     cv_.wait_for(lock, std::chrono::seconds(1),
-                 [this] { return !handler_.isRunning(); });
+                 [this] { return !running(); });
   }
 }
 
@@ -99,7 +106,7 @@ EasyMeter::handleResult(std::expected<void, ModbusError> &&result) {
 }
 
 std::expected<void, ModbusError> EasyMeter::tryConnect(void) {
-  if (!handler_.isRunning()) {
+  if (!running()) {
     return std::unexpected(
         ModbusError::custom(EINTR, "tryConnect(): Shutdown in progress"));
   }
@@ -208,8 +215,10 @@ std::expected<void, ModbusError> EasyMeter::tryConnect(void) {
   }
 
   // flush both directions after applying settings so the next read starts on
-  // a fresh telegram boundary
+  // a fresh telegram boundary, and forget whatever the previous connection
+  // left in the receive buffer
   tcflush(serialPort_, TCIOFLUSH);
+  rxPos_ = rxLen_ = 0;
 
   logger_->info("Meter '{}' connected ({}{}{}, {} baud)", cfg_.name,
                 ecfg_.rtu.dataBits, parityToChar(ecfg_.rtu.parity),
@@ -222,7 +231,7 @@ std::expected<void, ModbusError> EasyMeter::tryConnect(void) {
 }
 
 std::expected<void, ModbusError> EasyMeter::readTelegram() {
-  if (!handler_.isRunning()) {
+  if (!running()) {
     return std::unexpected(
         ModbusError::custom(EINTR, "readTelegram(): Shutdown in progress"));
   }
@@ -231,41 +240,47 @@ std::expected<void, ModbusError> EasyMeter::readTelegram() {
     return std::unexpected(
         ModbusError::custom(ENOTCONN, "readTelegram(): Meter not connected"));
 
-  std::vector<char> buffer(BUFFER_SIZE);
-  std::vector<char> packet(TELEGRAM_SIZE);
-  size_t packetPos = 0;
+  // Start a new telegram, overwriting the previous one in place. The update
+  // methods only run after this returns success, so they never see a partial
+  // telegram.
+  telegramLen_ = 0;
   bool messageBegin = false;
   bool telegramComplete = false;
 
-  while (packetPos < TELEGRAM_SIZE && !telegramComplete) {
-    // Shutdown check BEFORE blocking read
-    if (!handler_.isRunning()) {
-      return std::unexpected(
-          ModbusError::custom(EINTR, "readTelegram(): Shutdown in progress"));
-    }
+  while (telegramLen_ < TELEGRAM_SIZE && !telegramComplete) {
+    if (rxPos_ == rxLen_) {
+      // Shutdown check BEFORE blocking read
+      if (!running()) {
+        return std::unexpected(
+            ModbusError::custom(EINTR, "readTelegram(): Shutdown in progress"));
+      }
 
-    std::fill(buffer.begin(), buffer.end(), '\0');
-    ssize_t bytesReceived = ::read(serialPort_, buffer.data(), BUFFER_SIZE);
+      ssize_t bytesReceived = ::read(serialPort_, rx_.data(), rx_.size());
 
-    if (bytesReceived == -1) {
-      return std::unexpected(
-          ModbusError::fromErrno("Failed to read serial device"));
-    }
+      if (bytesReceived == -1) {
+        return std::unexpected(
+            ModbusError::fromErrno("Failed to read serial device"));
+      }
+
+      if (bytesReceived == 0) {
+        // Timeout - shouldn't happen mid-telegram
+        return std::unexpected(ModbusError::custom(
+            ETIMEDOUT, "readTelegram(): Timeout during read"));
+      }
 
-    if (bytesReceived == 0) {
-      // Timeout - shouldn't happen mid-telegram
-      return std::unexpected(ModbusError::custom(
-          ETIMEDOUT, "readTelegram(): Timeout during read"));
+      rxPos_ = 0;
+      rxLen_ = static_cast<std::size_t>(bytesReceived);
     }
 
-    // Process bytes
-    for (ssize_t i = 0; i < bytesReceived && packetPos < TELEGRAM_SIZE; ++i) {
-      char c = buffer[i];
+    // Process bytes; whatever follows the end of this telegram stays in rx_
+    // for the next call.
+    while (rxPos_ < rxLen_ && telegramLen_ < TELEGRAM_SIZE) {
+      char c = rx_[rxPos_++];
       if (c == '/')
         messageBegin = true;
       if (messageBegin) {
-        packet[packetPos++] = c;
-        if (packetPos >= 3 && packet[packetPos - 3] == '!') {
+        telegram_[telegramLen_++] = c;
+        if (telegramLen_ >= 3 && telegram_[telegramLen_ - 3] == '!') {
           telegramComplete = true;
           break;
         }
@@ -273,102 +288,68 @@ std::expected<void, ModbusError> EasyMeter::readTelegram() {
     }
   }
 
-  // Ensure we have at least 3 bytes and the third-from-last is '!'
-  if (packetPos < 3 || packet[packetPos - 3] != '!') {
+  // Buffer full without seeing the '!' end line
+  if (!telegramComplete) {
+    telegramLen_ = 0;
     return std::unexpected(ModbusError::custom(
         EPROTO, "readTelegram(): telegram stream not in sync"));
   }
 
-  logger_->trace("Received telegram (len {}):\n{}", packetPos,
-                 std::string(packet.begin(), packet.begin() + packetPos));
-
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    telegram_.assign(packet.begin(), packet.begin() + packetPos);
-  }
+  logger_->trace("Received telegram (len {}):\n{}", telegramLen_, telegram());
 
   return {};
 }
 
-std::expected<void, ModbusError> EasyMeter::updateValuesAndJson() {
-  if (!handler_.isRunning()) {
-    return std::unexpected(ModbusError::custom(
-        EINTR, "updateValuesAndJson(): Shutdown in progress"));
-  }
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    if (telegram_.empty())
-      return {};
-  }
-
-  MeterTypes::Values values{};
-
-  std::istringstream iss;
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    iss.str(telegram_);
-  }
-
-  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch())
-                    .count();
+std::expected<void, ModbusError>
+EasyMeter::decodeTelegram(std::string_view text, const GridConfig &grid,
+                          MeterTypes::Values &values) {
   double activeEnergy = 0.0;
 
-  std::regex obexRegex(R"(^([0-9]-0:[0-9]+.[0-9]+.[0-9]+\*255)\(([^)]+)\))");
-  std::string line;
-
-  while (std::getline(iss, line)) {
-    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-
-    if (line.empty() || (line.size() && (line[0] == '/' || line[0] == '!')))
-      continue;
+  // Map each OBIS code of interest to the field it fills. The codes differ
+  // only in the a.b.c group, so a short linear scan beats any hashing.
+  struct Field {
+    std::string_view code;
+    double *target;
+  };
+  const Field fields[] = {
+      // OBIS 1.8.0 reports active energy in kWh; scaled to Wh below so the
+      // Values struct holds Wh like every other source. All derived energy
+      // fields inherit this unit, and each sink scales back via scaleToKilo.
+      {"1-0:1.8.0*255", &activeEnergy},
+      {"1-0:16.7.0*255", &values.activePower},
+      {"1-0:36.7.0*255", &values.phase1.activePower},
+      {"1-0:56.7.0*255", &values.phase2.activePower},
+      {"1-0:76.7.0*255", &values.phase3.activePower},
+      {"1-0:32.7.0*255", &values.phase1.phVoltage},
+      {"1-0:52.7.0*255", &values.phase2.phVoltage},
+      {"1-0:72.7.0*255", &values.phase3.phVoltage},
+  };
 
-    try {
-      std::smatch match;
-      if (!std::regex_search(line, match, obexRegex))
-        throw std::invalid_argument("Malformed OBEX expression");
-
-      std::string obis = match[1];
-      std::string value_unit = match[2];
-
-      if (obis == "1-0:1.8.0*255") {
-        size_t pos = value_unit.find("*");
-        // OBIS 1.8.0 reports active energy in kWh; scale to Wh so the Values
-        // struct holds Wh like every other source. All derived energy fields
-        // below inherit this unit, and each sink scales back via scaleToKilo.
-        activeEnergy = std::stod(value_unit.substr(0, pos)) * 1000.0;
-      } else if (obis == "1-0:16.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.activePower = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:36.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase1.activePower = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:56.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase2.activePower = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:76.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase3.activePower = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:32.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase1.phVoltage = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:52.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase2.phVoltage = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:72.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase3.phVoltage = std::stod(value_unit.substr(0, pos));
-      }
-    } catch (const std::exception &err) {
-      std::ostringstream oss;
-      oss << "[" << line << "]: " << err.what();
-      return std::unexpected(ModbusError::custom(EPROTO, oss.str()));
-    }
+  auto scanned = Obis::scan(
+      text,
+      [](std::string_view) -> const char * { return nullptr; },
+      [&fields](const Obis::DataSet &ds) -> const char * {
+        for (const Field &f : fields) {
+          if (ds.code != f.code)
+            continue;
+          auto number = Obis::parseNumber(ds.value);
+          if (!number)
+            return "Malformed OBIS value";
+          *f.target = *number;
+          break;
+        }
+        return nullptr;
+      });
+  if (!scanned) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, std::format("[{}]: {}", scanned.error().line,
+                            scanned.error().what)));
   }
+  activeEnergy *= 1000.0;
 
-  const bool isLeading = ecfg_.grid.isLeading;
-  values.powerFactor = ecfg_.grid.powerFactor;
-  values.frequency = ecfg_.grid.frequency;
+  const bool isLeading = grid.isLeading;
+  values.powerFactor = grid.powerFactor;
+  values.frequency = grid.frequency;
 
   values.phase1.powerFactor = values.powerFactor;
   values.phase2.powerFactor = values.powerFactor;
@@ -457,137 +438,76 @@ std::expected<void, ModbusError> EasyMeter::updateValuesAndJson() {
   values.current =
       values.phase1.current + values.phase2.current + values.phase3.current;
 
+  return {};
+}
+
+std::expected<void, ModbusError> EasyMeter::updateValuesAndJson() {
+  if (!running()) {
+    return std::unexpected(ModbusError::custom(
+        EINTR, "updateValuesAndJson(): Shutdown in progress"));
+  }
+  if (telegramLen_ == 0)
+    return {};
+
+  MeterTypes::Values values{};
+
+  values.time = SampleClock::now();
+  auto decoded = decodeTelegram(telegram(), ecfg_.grid, values);
+  if (!decoded)
+    return decoded;
+
   // Quantise to the output precision; every consumer (MQTT JSON, Postgres, the
   // debug log) then sees the same values.
   values.round();
 
-  json newJson;
-  json phases = json::array();
-
-  phases.push_back({
-      {"id", 1},
-      {"power_active", values.phase1.activePower},
-      {"power_apparent", values.phase1.apparentPower},
-      {"power_reactive", values.phase1.reactivePower},
-      {"power_factor", values.phase1.powerFactor},
-      {"voltage_ph", values.phase1.phVoltage},
-      {"voltage_pp", values.phase1.ppVoltage},
-      {"current", values.phase1.current},
-  });
-
-  phases.push_back({
-      {"id", 2},
-      {"power_active", values.phase2.activePower},
-      {"power_apparent", values.phase2.apparentPower},
-      {"power_reactive", values.phase2.reactivePower},
-      {"power_factor", values.phase2.powerFactor},
-      {"voltage_ph", values.phase2.phVoltage},
-      {"voltage_pp", values.phase2.ppVoltage},
-      {"current", values.phase2.current},
-  });
-
-  phases.push_back({
-      {"id", 3},
-      {"power_active", values.phase3.activePower},
-      {"power_apparent", values.phase3.apparentPower},
-      {"power_reactive", values.phase3.reactivePower},
-      {"power_factor", values.phase3.powerFactor},
-      {"voltage_ph", values.phase3.phVoltage},
-      {"voltage_pp", values.phase3.ppVoltage},
-      {"current", values.phase3.current},
-  });
-
-  newJson["time"] = values.time;
-  newJson["energy_active_import"] =
-      Utils::scaleToKilo(values.activeEnergyImport);
-  newJson["energy_active_export"] =
-      Utils::scaleToKilo(values.activeEnergyExport);
-  newJson["energy_apparent_import"] =
-      Utils::scaleToKilo(values.apparentEnergyImport);
-  newJson["energy_apparent_export"] =
-      Utils::scaleToKilo(values.apparentEnergyExport);
-  newJson["energy_reactive_import"] =
-      Utils::scaleToKilo(values.reactiveEnergyImport);
-  newJson["energy_reactive_export"] =
-      Utils::scaleToKilo(values.reactiveEnergyExport);
-  newJson["power_active"] = values.activePower;
-  newJson["power_apparent"] = values.apparentPower;
-  newJson["power_reactive"] = values.reactivePower;
-  newJson["power_factor"] = values.powerFactor;
-  newJson["frequency"] = values.frequency;
-  newJson["voltage_ph"] = values.phVoltage;
-  newJson["voltage_pp"] = values.ppVoltage;
-  newJson["phases"] = phases;
-
-  logger_->debug("'{}' values: {}", cfg_.name, newJson.dump());
-
   // Update shared values and JSON with lock
+  MqttEncoding encoding;
   {
     std::lock_guard<std::mutex> lock(cbMutex_);
+    encoding = valuesEncoding_;
+    Payload::easyMeterValues(jsonValues_, values, encoding);
     values_ = std::move(values);
-    jsonValues_ = std::move(newJson);
   }
 
+  // Only this thread writes jsonValues_, so it can be read without the lock.
+  if (encoding == MqttEncoding::Json)
+    logger_->debug("'{}' values: {}", cfg_.name, jsonValues_);
+  else
+    logger_->debug("'{}' values: {} bytes of {}", cfg_.name,
+                   jsonValues_.size(), contentType(encoding));
+
   return {};
 }
 
 std::expected<void, ModbusError> EasyMeter::updateDeviceAndJson() {
-  if (!handler_.isRunning()) {
+  if (!running()) {
     return std::unexpected(ModbusError::custom(
         EINTR, "updateDeviceAndJson(): Shutdown in progress"));
   }
 
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    if (telegram_.empty())
-      return {};
-  }
+  if (telegramLen_ == 0)
+    return {};
 
   MeterTypes::Device newDevice{};
 
-  std::istringstream iss;
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    iss.str(telegram_);
-  }
-
-  std::regex obexRegex(R"(^([0-9]-0:[0-9]+.[0-9]+.[0-9]+\*255)\(([^)]+)\))");
-  std::regex versionRegex(R"(^(\/[A-Za-z0-9]+)_([A-Za-z0-9]+)$)");
-  std::string line;
-
-  while (std::getline(iss, line)) {
-    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-
-    if (line.empty() || line[0] == '!')
-      continue;
-
-    try {
-      // Version line
-      if (!line.empty() && line[0] == '/') {
-        std::smatch versionMatch;
-        if (!std::regex_search(line, versionMatch, versionRegex)) {
-          throw std::invalid_argument("Malformed version expression");
-        }
-        newDevice.fwVersion = versionMatch[2].str();
-        continue;
-      }
-
-      // OBEX line
-      std::smatch obexMatch;
-      if (!std::regex_search(line, obexMatch, obexRegex)) {
-        throw std::invalid_argument("Malformed OBEX expression");
-      }
-
-      std::string obis = obexMatch[1];
-      if (obis == "1-0:96.1.0*255") {
-        newDevice.serialNumber = obexMatch[2].str();
-      }
-
-    } catch (const std::exception &err) {
-      std::ostringstream oss;
-      oss << "[" << line << "]: " << err.what();
-      return std::unexpected(ModbusError::custom(EPROTO, oss.str()));
-    }
+  auto scanned = Obis::scan(
+      telegram(),
+      [&newDevice](std::string_view line) -> const char * {
+        auto version = Obis::firmwareVersion(line);
+        if (!version)
+          return "Malformed version expression";
+        newDevice.fwVersion = *version;
+        return nullptr;
+      },
+      [&newDevice](const Obis::DataSet &ds) -> const char * {
+        if (ds.code == "1-0:96.1.0*255")
+          newDevice.serialNumber = ds.value;
+        return nullptr;
+      });
+  if (!scanned) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, std::format("[{}]: {}", scanned.error().line,
+                            scanned.error().what)));
   }
 
   newDevice.manufacturer = "EasyMeter";
@@ -595,20 +515,10 @@ std::expected<void, ModbusError> EasyMeter::updateDeviceAndJson() {
   newDevice.options = std::string(PROJECT_VERSION) + "-" + GIT_COMMIT_HASH;
   newDevice.phases = 3;
 
-  // ---- Build ordered JSON ----
-  json newJson;
-
-  newJson["manufacturer"] = newDevice.manufacturer;
-  newJson["model"] = newDevice.model;
-  newJson["serial_number"] = newDevice.serialNumber;
-  newJson["firmware_version"] = newDevice.fwVersion;
-  newJson["options"] = newDevice.options;
-  newJson["phases"] = newDevice.phases;
-
   // ---- Commit values ----
   {
     std::lock_guard<std::mutex> lock(cbMutex_);
-    jsonDevice_ = std::move(newJson);
+    Payload::easyMeterDevice(jsonDevice_, newDevice);
     device_ = std::move(newDevice);
   }
 
@@ -617,7 +527,7 @@ std::expected<void, ModbusError> EasyMeter::updateDeviceAndJson() {
 
 void EasyMeter::runLoop() {
 
-  while (handler_.isRunning()) {
+  while (running()) {
 
     // Connect to meter
     auto connectAction = handleResult(tryConnect());
@@ -632,37 +542,46 @@ void EasyMeter::runLoop() {
       break;
     else if (readAction == MeterTypes::ErrorAction::RECONNECT)
       continue;
-
-    // Update device
-    auto deviceAction = handleResult(updateDeviceAndJson());
+    if (auto *capture = capture_.load(std::memory_order_acquire))
+      capture->telegram(captureDevice_, telegram());
+
+    // Update device. Only the two parses are timed, not the callbacks.
+    auto parseStart = std::chrono::steady_clock::now();
+    auto deviceResult = updateDeviceAndJson();
+    auto parseTime = std::chrono::steady_clock::now() - parseStart;
+    auto deviceAction = handleResult(std::move(deviceResult));
     if (deviceAction == MeterTypes::ErrorAction::SHUTDOWN)
       break;
     else if (deviceAction == MeterTypes::ErrorAction::RECONNECT)
       continue;
 
-    if (handler_.isRunning()) {
+    if (running()) {
       std::lock_guard<std::mutex> lock(cbMutex_);
       // The EBZ re-parses the identity from every telegram. Gate the log and
       // the publish on a single change check so they fire once, together, and
       // the gate keeps a single owner regardless of whether a callback is set.
       if (deviceGate_.changed(device_)) {
-        logger_->debug("'{}' device: {}", cfg_.name, jsonDevice_.dump());
+        logger_->debug("'{}' device: {}", cfg_.name, jsonDevice_);
         if (deviceCallback_)
-          deviceCallback_(jsonDevice_.dump(), device_);
+          deviceCallback_(jsonDevice_, device_);
       }
     }
 
     // Update values
-    auto updateAction = handleResult(updateValuesAndJson());
+    parseStart = std::chrono::steady_clock::now();
+    auto valuesResult = updateValuesAndJson();
+    parseTime += std::chrono::steady_clock::now() - parseStart;
+    auto updateAction = handleResult(std::move(valuesResult));
     if (updateAction == MeterTypes::ErrorAction::SHUTDOWN)
       break;
     else if (updateAction == MeterTypes::ErrorAction::RECONNECT)
       continue;
+    parseDuration_.observe(parseTime);
 
-    if (handler_.isRunning()) {
+    if (running()) {
       std::lock_guard<std::mutex> lock(cbMutex_);
       if (valueCallback_) {
-        valueCallback_(jsonValues_.dump(), values_);
+        valueCallback_(jsonValues_, values_);
       }
     }
   }
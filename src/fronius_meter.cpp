@@ -1,8 +1,14 @@
 #include "fronius_meter.h"
+#include "capture.h"
 #include "config.h"
 #include "config_yaml.h"
+#include "decode_errors.h"
 #include "meter_types.h"
+#include "metrics.h"
+#include "payloads.h"
+#include "sample_clock.h"
 #include "utils.h"
+#include <array>
 #include <chrono>
 #include <cmath>
 #include <expected>
@@ -10,15 +16,39 @@
 #include <fronius/fronius.h>
 #include <functional>
 #include <mutex>
-#include <nlohmann/json.hpp>
+#include <optional>
 #include <sys/socket.h>
-
-using json = nlohmann::ordered_json;
+#include <utility>
+
+namespace {
+
+// Payload keys of the per-phase fields, for the decode error log.
+using PhaseKeys = std::array<const char *, 7>;
+constexpr std::array<PhaseKeys, 3> phaseKeys = {{
+    {"phases[1].power_active", "phases[1].power_apparent",
+     "phases[1].power_reactive", "phases[1].power_factor",
+     "phases[1].voltage_ph", "phases[1].voltage_pp", "phases[1].current"},
+    {"phases[2].power_active", "phases[2].power_apparent",
+     "phases[2].power_reactive", "phases[2].power_factor",
+     "phases[2].voltage_ph", "phases[2].voltage_pp", "phases[2].current"},
+    {"phases[3].power_active", "phases[3].power_apparent",
+     "phases[3].power_reactive", "phases[3].power_factor",
+     "phases[3].voltage_ph", "phases[3].voltage_pp", "phases[3].current"},
+}};
+
+} // namespace
 
 FroniusMeter::FroniusMeter(const MeterConfig &cfg, SignalHandler &signalHandler,
-                           std::shared_ptr<FroniusBus> bus)
+                           std::shared_ptr<FroniusBus> bus,
+                           BusScheduler &scheduler)
     : bus_(std::move(bus)), cfg_(cfg),
-      fcfg_(std::get<FroniusMeterConfig>(cfg.body)), handler_(signalHandler) {
+      fcfg_(std::get<FroniusMeterConfig>(cfg.body)),
+      pollDuration_(Metrics::histogram(
+          "fronius_bridge_poll_duration_seconds",
+          "Duration of one connected device poll cycle",
+          {{"device", cfg.name}})),
+      handler_(signalHandler), scheduler_(scheduler),
+      interval_(fcfg_.updateInterval, fcfg_.adaptive) {
 
   // Fixed class-based logger chain: meter.master -> meter -> default.
   // The device name is no longer part of the logger name (it already
@@ -68,14 +98,14 @@ FroniusMeter::FroniusMeter(const MeterConfig &cfg, SignalHandler &signalHandler,
                    FroniusTypes::toString(map));
     connected_.store(true);
 
-    if (availabilityCallback_)
+    if (active_.load() && availabilityCallback_)
       availabilityCallback_("connected");
   });
 
   meter_->setDeviceUnavailableCallback([this] {
     connected_.store(false);
 
-    if (availabilityCallback_)
+    if (active_.load() && availabilityCallback_)
       availabilityCallback_("disconnected");
   });
 
@@ -86,7 +116,9 @@ FroniusMeter::FroniusMeter(const MeterConfig &cfg, SignalHandler &signalHandler,
                         std::format("meter '{}' Modbus error", cfg_.name));
 
     } else if (err.severity == ModbusError::Severity::TRANSIENT) {
-      logger_->debug("Transient Modbus error: {}", err.describe());
+      // describe() builds a string; a device that is down fails every poll.
+      if (logger_->should_log(spdlog::level::debug))
+        logger_->debug("Transient Modbus error: {}", err.describe());
       connected_.store(false);
       bus_->scheduleDeviceRetry(meter_);
 
@@ -107,10 +139,11 @@ FroniusMeter::FroniusMeter(const MeterConfig &cfg, SignalHandler &signalHandler,
   // and registered its callbacks; connecting from each master would race
   // with later masters' registrations.
 
-  // Start update loop thread. The loop body only runs once connected_
+  // Join the bus's poll schedule. poll() only does work once connected_
   // flips true, which the device-ready callback above does after
   // bus->connect() + validation.
-  worker_ = std::thread(&FroniusMeter::runLoop, this);
+  scheduleId_ = scheduler_.add(cfg_.name, interval_.current(),
+                               [this] { return poll(); });
 }
 
 FroniusMeter::~FroniusMeter() {
@@ -128,73 +161,81 @@ FroniusMeter::~FroniusMeter() {
   }
   busCallbackIds_.clear();
 
-  // Stop the local update loop. The worker observes handler_.isRunning()
-  // (cleared at signal time) and our cv_, so under graceful shutdown it
-  // is usually already at its wait point and exits immediately on notify.
+  // Leave the poll schedule. remove() waits out a poll in flight, so
+  // nothing below races with update*AndJson().
   connected_.store(false);
-  cv_.notify_all();
-  if (worker_.joinable())
-    worker_.join();
+  scheduler_.remove(scheduleId_);
 
   // Fire one final availability update so MQTT consumers see this meter
-  // go offline. Done after the worker join so it can't race with an
-  // in-flight updateValuesAndJson(). Safe because main destroys masters
+  // go offline. Done after leaving the schedule so it can't race with
+  // updateValuesAndJson(). Safe because main destroys masters
   // before destroying MqttClient.
-  if (availabilityCallback_)
+  if (active_.load() && availabilityCallback_)
     availabilityCallback_("disconnected");
 
   logger_->info("Meter '{}' disconnected", cfg_.name);
 }
 
-void FroniusMeter::runLoop() {
-  while (handler_.isRunning()) {
-
-    if (connected_.load()) {
-      {
-        // --- Device (once per connect; bool tells us whether to publish) ---
-        auto deviceResult = updateDeviceAndJson();
-        if (!deviceResult) {
-          connected_.store(false);
-        } else if (*deviceResult && deviceCallback_ && handler_.isRunning()) {
-          std::string json;
-          MeterTypes::Device dev;
-          {
-            std::lock_guard<std::mutex> lock(cbMutex_);
-            json = jsonDevice_.dump();
-            dev = device_;
-          }
-          deviceCallback_(std::move(json), std::move(dev));
-        }
+void FroniusMeter::setActive(bool active) {
+  if (active_.exchange(active) == active)
+    return;
+  logger_->debug("Meter '{}' {} by this node", cfg_.name,
+                 active ? "served" : "no longer served");
+  if (active && availabilityCallback_)
+    availabilityCallback_(connected_.load() ? "connected" : "disconnected");
+}
 
-        // --- Values ---
-        auto valuesResult = updateValuesAndJson();
-        if (!valuesResult) {
-          connected_.store(false);
-        } else if (valueCallback_ && handler_.isRunning()) {
-          std::string json;
-          MeterTypes::Values vals;
-          {
-            std::lock_guard<std::mutex> lock(cbMutex_);
-            json = jsonValues_.dump();
-            vals = values_;
-          }
-          valueCallback_(std::move(json), std::move(vals));
-        }
-      }
-    }
+void FroniusMeter::setUpdateInterval(
+    int updateInterval, const std::optional<AdaptivePollConfig> &adaptive) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  retune_.emplace(updateInterval, adaptive);
+  retuned_.store(true);
+}
+
+void FroniusMeter::connectLate() { bus_->scheduleDeviceRetry(meter_); }
 
-    // --- Wait for next update interval ---
-    std::unique_lock<std::mutex> lock(cbMutex_);
-    cv_.wait_for(lock, std::chrono::seconds(fcfg_.updateInterval),
-                 [this] { return !handler_.isRunning(); });
+std::chrono::seconds FroniusMeter::poll() {
+  if (retuned_.exchange(false)) {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    interval_ = *std::exchange(retune_, std::nullopt);
   }
+  if (!connected_.load() || !active_.load() || !handler_.isRunning())
+    return interval_.current();
 
-  logger_->debug("Modbus master run loop stopped.");
+  const auto pollStart = std::chrono::steady_clock::now();
+
+  // --- Device (once per connect; bool tells us whether to publish) ---
+  auto deviceResult = updateDeviceAndJson();
+  if (!deviceResult) {
+    connected_.store(false);
+  } else if (*deviceResult && deviceCallback_ && handler_.isRunning()) {
+    // Only this thread writes the payloads and their data, so the callbacks
+    // get them by reference, without the lock, and copy what they keep.
+    deviceCallback_(jsonDevice_, device_);
+  }
+
+  // --- Values ---
+  auto valuesResult = updateValuesAndJson();
+  std::chrono::seconds next = interval_.current();
+  // Only this thread writes values_, so it can be read without the lock.
+  if (valuesResult)
+    next = interval_.next(values_.activePower,
+                          std::fabs(values_.activePower) <
+                              interval_.threshold());
+
+  if (!valuesResult) {
+    connected_.store(false);
+  } else if (valueCallback_ && handler_.isRunning()) {
+    valueCallback_(jsonValues_, values_);
+  }
+
+  pollDuration_.observeSince(pollStart);
+  return next;
 }
 
 std::string FroniusMeter::getJsonDump() const {
   std::lock_guard<std::mutex> lock(cbMutex_);
-  return jsonValues_.dump();
+  return jsonValues_;
 }
 
 MeterTypes::Values FroniusMeter::getValues() const {
@@ -220,220 +261,155 @@ std::expected<void, ModbusError> FroniusMeter::updateValuesAndJson() {
         EINTR, "updateValuesAndJson(): Shutdown in progress"));
   }
 
+  // Stamped at the midpoint of the fetch rather than after it (see
+  // SampleClock).
+  const auto request = SampleClock::Steady::now();
   auto regs = meter_->fetchMeterRegisters();
+  const auto response = SampleClock::Steady::now();
   if (!regs) {
     return std::unexpected(regs.error());
   }
 
   MeterTypes::Values values{};
 
-  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch())
-                    .count();
-
-  try {
-    values.activeEnergyImport = ModbusError::getOrThrow(
-        meter_->getAcEnergyActive(FroniusTypes::EnergyDirection::IMPORT));
-    values.activeEnergyExport = ModbusError::getOrThrow(
-        meter_->getAcEnergyActive(FroniusTypes::EnergyDirection::EXPORT));
-
-    values.activePower = ModbusError::getOrThrow(
-        meter_->getAcPowerActive(FroniusTypes::Phase::TOTAL));
-
-    values.apparentPower = ModbusError::getOrThrow(
-        meter_->getAcPowerApparent(FroniusTypes::Phase::TOTAL));
-
-    values.reactivePower = ModbusError::getOrThrow(
-        meter_->getAcPowerReactive(FroniusTypes::Phase::TOTAL));
-
-    values.powerFactor = ModbusError::getOrThrow(
-        meter_->getAcPowerFactor(FroniusTypes::Phase::AVERAGE));
-
-    values.phVoltage =
-        ModbusError::getOrThrow(meter_->getAcVoltage(FroniusTypes::Phase::PHV));
-    values.ppVoltage =
-        ModbusError::getOrThrow(meter_->getAcVoltage(FroniusTypes::Phase::PPV));
-
-    values.frequency = ModbusError::getOrThrow(meter_->getAcFrequency());
-
-    // --- Per-phase (1 phase) ---
-    values.phase1.activePower = ModbusError::getOrThrow(
-        meter_->getAcPowerActive(FroniusTypes::Phase::A));
-    values.phase1.apparentPower = ModbusError::getOrThrow(
-        meter_->getAcPowerApparent(FroniusTypes::Phase::A));
-    values.phase1.reactivePower = ModbusError::getOrThrow(
-        meter_->getAcPowerReactive(FroniusTypes::Phase::A));
-    values.phase1.powerFactor = ModbusError::getOrThrow(
-        meter_->getAcPowerFactor(FroniusTypes::Phase::A));
-    values.phase1.phVoltage =
-        ModbusError::getOrThrow(meter_->getAcVoltage(FroniusTypes::Phase::A));
-    values.phase1.ppVoltage =
-        ModbusError::getOrThrow(meter_->getAcVoltage(FroniusTypes::Phase::AB));
-    values.phase1.current =
-        ModbusError::getOrThrow(meter_->getAcCurrent(FroniusTypes::Phase::A));
-
-    // --- Per-phase (2 phases) ---
-    if (meter_->getPhases() > 1) {
-      values.phase2.activePower = ModbusError::getOrThrow(
-          meter_->getAcPowerActive(FroniusTypes::Phase::B));
-      values.phase2.apparentPower = ModbusError::getOrThrow(
-          meter_->getAcPowerApparent(FroniusTypes::Phase::B));
-      values.phase2.reactivePower = ModbusError::getOrThrow(
-          meter_->getAcPowerReactive(FroniusTypes::Phase::B));
-      values.phase2.powerFactor = ModbusError::getOrThrow(
-          meter_->getAcPowerFactor(FroniusTypes::Phase::B));
-      values.phase2.phVoltage =
-          ModbusError::getOrThrow(meter_->getAcVoltage(FroniusTypes::Phase::B));
-      values.phase2.ppVoltage = ModbusError::getOrThrow(
-          meter_->getAcVoltage(FroniusTypes::Phase::BC));
-      values.phase2.current =
-          ModbusError::getOrThrow(meter_->getAcCurrent(FroniusTypes::Phase::B));
-    }
-
-    // --- Per-phase (3 phases) ---
-    if (meter_->getPhases() > 2) {
-      values.phase3.activePower = ModbusError::getOrThrow(
-          meter_->getAcPowerActive(FroniusTypes::Phase::C));
-      values.phase3.apparentPower = ModbusError::getOrThrow(
-          meter_->getAcPowerApparent(FroniusTypes::Phase::C));
-      values.phase3.reactivePower = ModbusError::getOrThrow(
-          meter_->getAcPowerReactive(FroniusTypes::Phase::C));
-      values.phase3.powerFactor = ModbusError::getOrThrow(
-          meter_->getAcPowerFactor(FroniusTypes::Phase::C));
-      values.phase3.phVoltage =
-          ModbusError::getOrThrow(meter_->getAcVoltage(FroniusTypes::Phase::C));
-      values.phase3.ppVoltage = ModbusError::getOrThrow(
-          meter_->getAcVoltage(FroniusTypes::Phase::CA));
-      values.phase3.current =
-          ModbusError::getOrThrow(meter_->getAcCurrent(FroniusTypes::Phase::C));
-    }
-
-    // Proprietary register map exposes only per-phase current; sum them.
-    if (meter_->getRegisterMap() == FroniusTypes::RegisterMap::PROPRIETARY) {
-      values.current =
-          values.phase1.current + values.phase2.current + values.phase3.current;
-    } else {
-      values.current = ModbusError::getOrThrow(
-          meter_->getAcCurrent(FroniusTypes::Phase::TOTAL));
-    }
+  values.time = SampleClock::stamp(request, response);
+  if (interval_.enabled())
+    values.interval = static_cast<int>(interval_.current().count());
+
+  // One pass over the fetched snapshot; failures are collected, not thrown.
+  const int phases = meter_->getPhases();
+  const FroniusTypes::RegisterMap map = meter_->getRegisterMap();
+  DecodeErrors errors;
+
+  errors.take(values.activeEnergyImport,
+              meter_->getAcEnergyActive(FroniusTypes::EnergyDirection::IMPORT),
+              "energy_active_import");
+  errors.take(values.activeEnergyExport,
+              meter_->getAcEnergyActive(FroniusTypes::EnergyDirection::EXPORT),
+              "energy_active_export");
+
+  errors.take(values.activePower,
+              meter_->getAcPowerActive(FroniusTypes::Phase::TOTAL),
+              "power_active");
+  errors.take(values.apparentPower,
+              meter_->getAcPowerApparent(FroniusTypes::Phase::TOTAL),
+              "power_apparent");
+  errors.take(values.reactivePower,
+              meter_->getAcPowerReactive(FroniusTypes::Phase::TOTAL),
+              "power_reactive");
+  errors.take(values.powerFactor,
+              meter_->getAcPowerFactor(FroniusTypes::Phase::AVERAGE),
+              "power_factor");
+
+  errors.take(values.phVoltage, meter_->getAcVoltage(FroniusTypes::Phase::PHV),
+              "voltage_ph");
+  errors.take(values.ppVoltage, meter_->getAcVoltage(FroniusTypes::Phase::PPV),
+              "voltage_pp");
+
+  errors.take(values.frequency, meter_->getAcFrequency(), "frequency");
+
+  // --- Per-phase: phase n reads phase registers a and line-to-line ab ---
+  const auto readPhase = [&](MeterTypes::Phase &ph, FroniusTypes::Phase a,
+                             FroniusTypes::Phase ab, const PhaseKeys &keys) {
+    errors.take(ph.activePower, meter_->getAcPowerActive(a), keys[0]);
+    errors.take(ph.apparentPower, meter_->getAcPowerApparent(a), keys[1]);
+    errors.take(ph.reactivePower, meter_->getAcPowerReactive(a), keys[2]);
+    errors.take(ph.powerFactor, meter_->getAcPowerFactor(a), keys[3]);
+    errors.take(ph.phVoltage, meter_->getAcVoltage(a), keys[4]);
+    errors.take(ph.ppVoltage, meter_->getAcVoltage(ab), keys[5]);
+    errors.take(ph.current, meter_->getAcCurrent(a), keys[6]);
+  };
+  readPhase(values.phase1, FroniusTypes::Phase::A, FroniusTypes::Phase::AB,
+            phaseKeys[0]);
+  if (phases > 1)
+    readPhase(values.phase2, FroniusTypes::Phase::B, FroniusTypes::Phase::BC,
+              phaseKeys[1]);
+  if (phases > 2)
+    readPhase(values.phase3, FroniusTypes::Phase::C, FroniusTypes::Phase::CA,
+              phaseKeys[2]);
+
+  // Proprietary register map exposes only per-phase current; sum them.
+  if (map == FroniusTypes::RegisterMap::PROPRIETARY) {
+    values.current =
+        values.phase1.current + values.phase2.current + values.phase3.current;
+  } else {
+    errors.take(values.current,
+                meter_->getAcCurrent(FroniusTypes::Phase::TOTAL), "current");
+  }
 
-    // Energy: each register map exposes only two of the three energy types
-    // directly; derive the third from the other two.
-    if (meter_->getRegisterMap() == FroniusTypes::RegisterMap::SUNSPEC) {
-      values.apparentEnergyImport = ModbusError::getOrThrow(
-          meter_->getAcEnergyApparent(FroniusTypes::EnergyDirection::IMPORT));
-      values.apparentEnergyExport = ModbusError::getOrThrow(
-          meter_->getAcEnergyApparent(FroniusTypes::EnergyDirection::EXPORT));
-
-      // Derive reactive from apparent and active, signed by reactive power
-      // direction.
-      const double sign = values.reactivePower >= 0.0 ? 1.0 : -1.0;
-      values.reactiveEnergyImport =
-          sign *
-          std::sqrt(values.apparentEnergyImport * values.apparentEnergyImport -
-                    values.activeEnergyImport * values.activeEnergyImport);
-      values.reactiveEnergyExport =
-          sign *
-          std::sqrt(values.apparentEnergyExport * values.apparentEnergyExport -
-                    values.activeEnergyExport * values.activeEnergyExport);
-
-    } else if (meter_->getRegisterMap() ==
-               FroniusTypes::RegisterMap::PROPRIETARY) {
-      values.reactiveEnergyImport = ModbusError::getOrThrow(
-          meter_->getAcEnergyReactive(FroniusTypes::EnergyDirection::IMPORT));
-      values.reactiveEnergyExport = ModbusError::getOrThrow(
-          meter_->getAcEnergyReactive(FroniusTypes::EnergyDirection::EXPORT));
-
-      // Derive apparent from active and reactive.
-      values.apparentEnergyImport =
-          std::hypot(values.activeEnergyImport, values.reactiveEnergyImport);
-      values.apparentEnergyExport =
-          std::hypot(values.activeEnergyExport, values.reactiveEnergyExport);
-    }
+  // Energy: each register map exposes only two of the three energy types
+  // directly; derive the third from the other two.
+  if (map == FroniusTypes::RegisterMap::SUNSPEC) {
+    errors.take(
+        values.apparentEnergyImport,
+        meter_->getAcEnergyApparent(FroniusTypes::EnergyDirection::IMPORT),
+        "energy_apparent_import");
+    errors.take(
+        values.apparentEnergyExport,
+        meter_->getAcEnergyApparent(FroniusTypes::EnergyDirection::EXPORT),
+        "energy_apparent_export");
+  } else if (map == FroniusTypes::RegisterMap::PROPRIETARY) {
+    errors.take(
+        values.reactiveEnergyImport,
+        meter_->getAcEnergyReactive(FroniusTypes::EnergyDirection::IMPORT),
+        "energy_reactive_import");
+    errors.take(
+        values.reactiveEnergyExport,
+        meter_->getAcEnergyReactive(FroniusTypes::EnergyDirection::EXPORT),
+        "energy_reactive_export");
+  }
 
-  } catch (const ModbusError &err) {
+  if (!errors.ok()) {
+    const ModbusError err = errors.error();
     logger_->warn("{}", err.message);
     return std::unexpected(err);
   }
 
-  // Quantise to the output precision; every consumer (MQTT JSON, Postgres, the
-  // debug log) then sees the same values.
-  values.round();
-
-  // ---- Build JSON ----
-  json newJson;
-  json phases = json::array();
-
-  phases.push_back({
-      {"id", 1},
-      {"power_active", values.phase1.activePower},
-      {"power_apparent", values.phase1.apparentPower},
-      {"power_reactive", values.phase1.reactivePower},
-      {"power_factor", values.phase1.powerFactor},
-      {"voltage_ph", values.phase1.phVoltage},
-      {"voltage_pp", values.phase1.ppVoltage},
-      {"current", values.phase1.current},
-
-  });
-
-  if (meter_->getPhases() > 1) {
-    phases.push_back({
-        {"id", 2},
-        {"power_active", values.phase2.activePower},
-        {"power_apparent", values.phase2.apparentPower},
-        {"power_reactive", values.phase2.reactivePower},
-        {"power_factor", values.phase2.powerFactor},
-        {"voltage_ph", values.phase2.phVoltage},
-        {"voltage_pp", values.phase2.ppVoltage},
-        {"current", values.phase2.current},
-
-    });
+  // The derived energies, once every input decoded.
+  if (map == FroniusTypes::RegisterMap::SUNSPEC) {
+    // Derive reactive from apparent and active, signed by reactive power
+    // direction.
+    const double sign = values.reactivePower >= 0.0 ? 1.0 : -1.0;
+    values.reactiveEnergyImport =
+        sign *
+        std::sqrt(values.apparentEnergyImport * values.apparentEnergyImport -
+                  values.activeEnergyImport * values.activeEnergyImport);
+    values.reactiveEnergyExport =
+        sign *
+        std::sqrt(values.apparentEnergyExport * values.apparentEnergyExport -
+                  values.activeEnergyExport * values.activeEnergyExport);
+  } else if (map == FroniusTypes::RegisterMap::PROPRIETARY) {
+    // Derive apparent from active and reactive.
+    values.apparentEnergyImport =
+        std::hypot(values.activeEnergyImport, values.reactiveEnergyImport);
+    values.apparentEnergyExport =
+        std::hypot(values.activeEnergyExport, values.reactiveEnergyExport);
   }
 
-  if (meter_->getPhases() > 2) {
-    phases.push_back({
-        {"id", 3},
-        {"power_active", values.phase3.activePower},
-        {"power_apparent", values.phase3.apparentPower},
-        {"power_reactive", values.phase3.reactivePower},
-        {"power_factor", values.phase3.powerFactor},
-        {"voltage_ph", values.phase3.phVoltage},
-        {"voltage_pp", values.phase3.ppVoltage},
-        {"current", values.phase3.current},
-    });
-  }
+  // The decoded values are the capture's replay input; the rest of this
+  // method is what fronius-bridge-bench replays.
+  if (auto *capture = capture_.load(std::memory_order_acquire))
+    capture->meterValues(captureDevice_, values);
 
-  newJson["time"] = values.time;
-  newJson["energy_active_import"] =
-      Utils::scaleToKilo(values.activeEnergyImport);
-  newJson["energy_active_export"] =
-      Utils::scaleToKilo(values.activeEnergyExport);
-  newJson["energy_apparent_import"] =
-      Utils::scaleToKilo(values.apparentEnergyImport);
-  newJson["energy_apparent_export"] =
-      Utils::scaleToKilo(values.apparentEnergyExport);
-  newJson["energy_reactive_import"] =
-      Utils::scaleToKilo(values.reactiveEnergyImport);
-  newJson["energy_reactive_export"] =
-      Utils::scaleToKilo(values.reactiveEnergyExport);
-  newJson["power_active"] = values.activePower;
-  newJson["power_apparent"] = values.apparentPower;
-  newJson["power_reactive"] = values.reactivePower;
-  newJson["power_factor"] = values.powerFactor;
-  newJson["frequency"] = values.frequency;
-  newJson["voltage_ph"] = values.phVoltage;
-  newJson["voltage_pp"] = values.ppVoltage;
-  newJson["current"] = values.current;
-  newJson["phases"] = phases;
-
-  logger_->debug("'{}' values: {}", cfg_.name, newJson.dump());
+  // Quantise to the output precision; every consumer (MQTT JSON, Postgres, the
+  // debug log) then sees the same values.
+  values.round();
 
+  MqttEncoding encoding;
   {
     std::lock_guard<std::mutex> lock(cbMutex_);
+    encoding = valuesEncoding_;
+    Payload::froniusMeterValues(jsonValues_, values, phases, encoding);
     values_ = std::move(values);
-    jsonValues_ = std::move(newJson);
   }
 
+  // Only this thread writes jsonValues_, so it can be read without the lock.
+  if (encoding == MqttEncoding::Json)
+    logger_->debug("'{}' values: {}", cfg_.name, jsonValues_);
+  else
+    logger_->debug("'{}' values: {} bytes of {}", cfg_.name,
+                   jsonValues_.size(), contentType(encoding));
+
   return {};
 }
 
@@ -472,31 +448,21 @@ std::expected<bool, ModbusError> FroniusMeter::updateDeviceAndJson() {
                   cfg_.name, fcfg_.slaveId, newDevice.slaveID);
   }
 
-  // ---- Build ordered JSON ----
-  json newJson;
-
-  newJson["manufacturer"] = newDevice.manufacturer;
-  newJson["model"] = newDevice.model;
-  newJson["serial_number"] = newDevice.serialNumber;
-  newJson["firmware_version"] = newDevice.fwVersion;
-  newJson["register_model"] = newDevice.registerModel;
-  newJson["slave_id"] = newDevice.slaveID;
-  newJson["meter_id"] = newDevice.id;
-  newJson["phases"] = newDevice.phases;
-
-  logger_->debug("'{}' device: {}", cfg_.name, newJson.dump());
-
   // Record the identity as the baseline so the hasValue() guard short-circuits
   // the Modbus re-read on subsequent polls; this is the first (and only) read,
   // so the callback fires once.
   deviceGate_.changed(newDevice);
+  if (auto *capture = capture_.load(std::memory_order_acquire))
+    capture->shape(captureDevice_, {newDevice.phases, 1, 0});
 
   // ---- Commit values ----
   {
     std::lock_guard<std::mutex> lock(cbMutex_);
-    jsonDevice_ = std::move(newJson);
+    Payload::froniusMeterDevice(jsonDevice_, newDevice);
     device_ = std::move(newDevice);
   }
 
+  logger_->debug("'{}' device: {}", cfg_.name, jsonDevice_);
+
   return true;
 }
@@ -1,6 +1,12 @@
 #include "inverter_master.h"
+#include "capture.h"
 #include "config_yaml.h"
+#include "decode_errors.h"
 #include "inverter_types.h"
+#include "metrics.h"
+#include "payloads.h"
+#include "sample_clock.h"
+#include "sun.h"
 #include "utils.h"
 #include <chrono>
 #include <expected>
@@ -8,14 +14,22 @@
 #include <fronius/fronius.h>
 #include <functional>
 #include <mutex>
-#include <nlohmann/json.hpp>
-
-using json = nlohmann::ordered_json;
+#include <optional>
+#include <string>
+#include <utility>
 
 InverterMaster::InverterMaster(const InverterConfig &cfg,
                                SignalHandler &signalHandler,
-                               std::shared_ptr<FroniusBus> bus)
-    : bus_(std::move(bus)), cfg_(cfg), handler_(signalHandler) {
+                               std::shared_ptr<FroniusBus> bus,
+                               BusScheduler &scheduler,
+                               const std::optional<SiteConfig> &site)
+    : bus_(std::move(bus)), cfg_(cfg), site_(site),
+      pollDuration_(Metrics::histogram(
+          "fronius_bridge_poll_duration_seconds",
+          "Duration of one connected device poll cycle",
+          {{"device", cfg.name}})),
+      handler_(signalHandler), scheduler_(scheduler),
+      interval_(cfg.updateInterval, cfg.adaptive) {
 
   // Fixed class-based logger chain: inverter -> default. The device name
   // is no longer part of the logger name (it already appears in every
@@ -76,7 +90,9 @@ InverterMaster::InverterMaster(const InverterConfig &cfg,
                         std::format("inverter '{}' Modbus error", cfg_.name));
 
     } else if (err.severity == ModbusError::Severity::TRANSIENT) {
-      logger_->debug("Transient Modbus error: {}", err.describe());
+      // describe() builds a string; a device that is down fails every poll.
+      if (logger_->should_log(spdlog::level::debug))
+        logger_->debug("Transient Modbus error: {}", err.describe());
       connected_.store(false);
       bus_->scheduleDeviceRetry(inverter_);
 
@@ -97,10 +113,11 @@ InverterMaster::InverterMaster(const InverterConfig &cfg,
   // and registered its callbacks; connecting from each master would race
   // with later masters' registrations.
 
-  // Start update loop thread. The loop body only runs once connected_
+  // Join the bus's poll schedule. poll() only does work once connected_
   // flips true, which the device-ready callback above does after
   // bus->connect() + validation.
-  worker_ = std::thread(&InverterMaster::runLoop, this);
+  scheduleId_ = scheduler_.add(cfg_.name, interval_.current(),
+                               [this] { return poll(); });
 }
 
 InverterMaster::~InverterMaster() {
@@ -118,118 +135,138 @@ InverterMaster::~InverterMaster() {
   }
   busCallbackIds_.clear();
 
-  // Stop the local update loop. The worker observes handler_.isRunning()
-  // (cleared at signal time) and our cv_, so under graceful shutdown it
-  // is usually already at its wait point and exits immediately on notify.
+  // Leave the poll schedule. remove() waits out a poll in flight, so
+  // nothing below races with update*AndJson().
   connected_.store(false);
-  cv_.notify_all();
-  if (worker_.joinable())
-    worker_.join();
+  scheduler_.remove(scheduleId_);
 
   // Fire one final availability update so MQTT consumers see this inverter
-  // go offline. Done after the worker join so it can't race with an
-  // in-flight update*AndJson(). Safe because main destroys masters before
-  // destroying MqttClient. The gate suppresses it only if already offline.
+  // go offline. Done after leaving the schedule so it can't race with
+  // update*AndJson(). Safe because main destroys masters before destroying
+  // MqttClient. The gate suppresses it only if already offline.
   publishAvailability("disconnected");
 
   logger_->info("Inverter '{}' disconnected", cfg_.name);
 }
 
-void InverterMaster::runLoop() {
-  while (handler_.isRunning()) {
-
-    if (connected_.load()) {
-      {
-        // --- Device (once per connect; bool tells us whether to publish) ---
-        auto deviceResult = updateDeviceAndJson();
-        if (!deviceResult) {
-          connected_.store(false);
-        } else if (*deviceResult && deviceCallback_ && handler_.isRunning()) {
-          std::string json;
-          InverterTypes::Device dev;
-          {
-            std::lock_guard<std::mutex> lock(cbMutex_);
-            json = jsonDevice_.dump();
-            dev = device_;
-          }
-          deviceCallback_(std::move(json), std::move(dev));
-        }
+std::chrono::seconds InverterMaster::poll() {
+  if (retuned_.exchange(false)) {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    interval_ = *std::exchange(retune_, std::nullopt);
+  }
+  if (!connected_.load() || !active_.load() || !handler_.isRunning())
+    return interval_.current();
 
-        // --- Values ---
-        auto valuesResult = updateValuesAndJson();
-        if (!valuesResult) {
-          connected_.store(false);
-        } else if (valueCallback_ && handler_.isRunning()) {
-          std::string json;
-          InverterTypes::Values vals;
-          {
-            std::lock_guard<std::mutex> lock(cbMutex_);
-            json = jsonValues_.dump();
-            vals = values_;
-          }
-          valueCallback_(std::move(json), std::move(vals));
-        }
+  const auto pollStart = std::chrono::steady_clock::now();
 
-        // --- Events (de-duplicated by eventsGate_; published on change) ---
-        auto eventsResult = updateEventsAndJson();
-        if (!eventsResult) {
-          connected_.store(false);
-        } else if (*eventsResult && eventCallback_ && handler_.isRunning()) {
-          std::string json;
-          InverterTypes::Events evts;
-          {
-            std::lock_guard<std::mutex> lock(cbMutex_);
-            json = jsonEvents_.dump();
-            evts = events_;
-          }
-          eventCallback_(std::move(json), std::move(evts));
-        }
-      }
-    }
+  // --- Device (once per connect; bool tells us whether to publish) ---
+  auto deviceResult = updateDeviceAndJson();
+  if (!deviceResult) {
+    connected_.store(false);
+  } else if (*deviceResult && deviceCallback_ && handler_.isRunning()) {
+    // Only this thread writes the payloads and their data, so the callbacks
+    // get them by reference, without the lock, and copy what they keep.
+    deviceCallback_(jsonDevice_, device_);
+  }
 
-    // --- Wait for next update interval ---
-    std::unique_lock<std::mutex> lock(cbMutex_);
-    cv_.wait_for(lock, std::chrono::seconds(cfg_.updateInterval),
-                 [this] { return !handler_.isRunning(); });
+  // --- Values ---
+  auto valuesResult = updateValuesAndJson();
+  std::chrono::seconds next = interval_.current();
+  // Only this thread writes values_, so it can be read without the lock.
+  if (valuesResult)
+    next = interval_.next(values_.acPowerActive, idle(values_));
+
+  if (!valuesResult) {
+    connected_.store(false);
+  } else if (valueCallback_ && handler_.isRunning()) {
+    valueCallback_(jsonValues_, values_);
+  }
+
+  // --- Events (de-duplicated by eventsGate_; published on change) ---
+  auto eventsResult = updateEventsAndJson();
+  if (!eventsResult) {
+    connected_.store(false);
+  } else if (*eventsResult && eventCallback_ && handler_.isRunning()) {
+    eventCallback_(jsonEvents_, events_);
   }
 
-  logger_->debug("Modbus master run loop stopped.");
+  pollDuration_.observeSince(pollStart);
+  return next;
+}
+
+bool InverterMaster::idle(const InverterTypes::Values &values) const {
+  if (site_)
+    return Sun::altitude(site_->latitude, site_->longitude,
+                         std::chrono::system_clock::now()) < site_->horizon;
+  return values.acPowerActive == 0.0;
 }
 
-void InverterMaster::setValueCallback(
-    std::function<void(std::string, InverterTypes::Values)> cb) {
+void InverterMaster::setValueCallback(ValueCallback cb) {
   std::lock_guard<std::mutex> lock(cbMutex_);
   valueCallback_ = std::move(cb);
 }
 
-void InverterMaster::setEventCallback(
-    std::function<void(std::string, InverterTypes::Events)> cb) {
+void InverterMaster::setEventCallback(EventCallback cb) {
   std::lock_guard<std::mutex> lock(cbMutex_);
   eventCallback_ = std::move(cb);
 }
 
-void InverterMaster::setDeviceCallback(
-    std::function<void(std::string, InverterTypes::Device)> cb) {
+void InverterMaster::setDeviceCallback(DeviceCallback cb) {
   std::lock_guard<std::mutex> lock(cbMutex_);
   deviceCallback_ = std::move(cb);
 }
 
+void InverterMaster::setValuesEncoding(MqttEncoding encoding) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  valuesEncoding_ = encoding;
+}
+
+void InverterMaster::setCapture(CaptureWriter *capture, DeviceId device) {
+  capture_ = capture;
+  captureDevice_ = device;
+}
+
 void InverterMaster::setAvailabilityCallback(
     std::function<void(std::string)> cb) {
   std::lock_guard<std::mutex> lock(cbMutex_);
   availabilityCallback_ = std::move(cb);
 }
 
+void InverterMaster::setActive(bool active) {
+  {
+    // While inactive another node publishes for this inverter, so the gate
+    // forgets what this one last said.
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    if (active_.exchange(active) == active)
+      return;
+    availabilityGate_.reset();
+  }
+  logger_->debug("Inverter '{}' {} by this node", cfg_.name,
+                 active ? "served" : "no longer served");
+  if (active)
+    publishAvailability(connected_.load() ? "connected" : "disconnected");
+}
+
+void InverterMaster::setUpdateInterval(
+    int updateInterval, const std::optional<AdaptivePollConfig> &adaptive) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  retune_.emplace(updateInterval, adaptive);
+  retuned_.store(true);
+}
+
+void InverterMaster::connectLate() { bus_->scheduleDeviceRetry(inverter_); }
+
 void InverterMaster::publishAvailability(std::string state) {
   // Decide under the lock (availabilityGate_ is shared with the bus-callback
   // threads and the destructor), then fire outside it, matching the
-  // release-before-callback pattern used for values and events in runLoop.
+  // release-before-callback pattern used for values and events in poll().
   // Unwired: the short-circuit skips changed(), so nothing latches and a later
   // publish still fires; otherwise emit only on a real transition.
   bool emit;
   {
     std::lock_guard<std::mutex> lock(cbMutex_);
-    emit = availabilityCallback_ && availabilityGate_.changed(state);
+    emit = active_.load() && availabilityCallback_ &&
+           availabilityGate_.changed(state);
   }
   if (emit)
     availabilityCallback_(std::move(state));
@@ -237,7 +274,7 @@ void InverterMaster::publishAvailability(std::string state) {
 
 std::string InverterMaster::getJsonDump() const {
   std::lock_guard<std::mutex> lock(cbMutex_);
-  return jsonValues_.dump();
+  return jsonValues_;
 }
 
 InverterTypes::Values InverterMaster::getValues() const {
@@ -262,79 +299,107 @@ std::expected<void, ModbusError> InverterMaster::updateValuesAndJson() {
         EINTR, "updateValuesAndJson(): Shutdown in progress"));
   }
 
+  // Stamped at the midpoint of the fetch rather than after it (see
+  // SampleClock).
+  const auto request = SampleClock::Steady::now();
   auto regs = inverter_->fetchInverterRegisters();
+  const auto response = SampleClock::Steady::now();
   if (!regs) {
     return std::unexpected(regs.error());
   }
 
   InverterTypes::Values values{};
 
-  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch())
-                    .count();
-
-  try {
-    // AC values
-    values.acEnergy = ModbusError::getOrThrow(inverter_->getAcEnergy());
-    values.acPowerActive = ModbusError::getOrThrow(
-        inverter_->getAcPower(FroniusTypes::Output::ACTIVE));
-    values.acPowerApparent = ModbusError::getOrThrow(
-        inverter_->getAcPower(FroniusTypes::Output::APPARENT));
-    values.acPowerReactive = ModbusError::getOrThrow(
-        inverter_->getAcPower(FroniusTypes::Output::REACTIVE));
-    values.acPowerFactor = ModbusError::getOrThrow(
-        inverter_->getAcPower(FroniusTypes::Output::FACTOR));
-
-    // Phase 1
-    values.phase1.acVoltage = ModbusError::getOrThrow(
-        inverter_->getAcVoltage(FroniusTypes::Phase::A));
-    values.phase1.acCurrent = ModbusError::getOrThrow(
-        inverter_->getAcCurrent(FroniusTypes::Phase::A));
-
-    // Phase 2
-    if (inverter_->getPhases() > 1) {
-      values.phase2.acVoltage = ModbusError::getOrThrow(
-          inverter_->getAcVoltage(FroniusTypes::Phase::B));
-      values.phase2.acCurrent = ModbusError::getOrThrow(
-          inverter_->getAcCurrent(FroniusTypes::Phase::B));
-    }
+  values.time = SampleClock::stamp(request, response);
+  if (interval_.enabled())
+    values.interval = static_cast<int>(interval_.current().count());
+
+  // One pass over the fetched snapshot; failures are collected, not thrown.
+  const int phases = inverter_->getPhases();
+  const int inputs = inverter_->getInputs();
+  const bool hybrid = inverter_->isHybrid();
+  DecodeErrors errors;
+
+  // AC values
+  errors.take(values.acEnergy, inverter_->getAcEnergy(), "ac_energy");
+  errors.take(values.acPowerActive,
+              inverter_->getAcPower(FroniusTypes::Output::ACTIVE),
+              "ac_power_active");
+  errors.take(values.acPowerApparent,
+              inverter_->getAcPower(FroniusTypes::Output::APPARENT),
+              "ac_power_apparent");
+  errors.take(values.acPowerReactive,
+              inverter_->getAcPower(FroniusTypes::Output::REACTIVE),
+              "ac_power_reactive");
+  errors.take(values.acPowerFactor,
+              inverter_->getAcPower(FroniusTypes::Output::FACTOR),
+              "ac_power_factor");
+
+  // Phase 1
+  errors.take(values.phase1.acVoltage,
+              inverter_->getAcVoltage(FroniusTypes::Phase::A),
+              "phases[1].ac_voltage");
+  errors.take(values.phase1.acCurrent,
+              inverter_->getAcCurrent(FroniusTypes::Phase::A),
+              "phases[1].ac_current");
+
+  // Phase 2
+  if (phases > 1) {
+    errors.take(values.phase2.acVoltage,
+                inverter_->getAcVoltage(FroniusTypes::Phase::B),
+                "phases[2].ac_voltage");
+    errors.take(values.phase2.acCurrent,
+                inverter_->getAcCurrent(FroniusTypes::Phase::B),
+                "phases[2].ac_current");
+  }
 
-    // Phase 3
-    if (inverter_->getPhases() > 2) {
-      values.phase3.acVoltage = ModbusError::getOrThrow(
-          inverter_->getAcVoltage(FroniusTypes::Phase::C));
-      values.phase3.acCurrent = ModbusError::getOrThrow(
-          inverter_->getAcCurrent(FroniusTypes::Phase::C));
-    }
+  // Phase 3
+  if (phases > 2) {
+    errors.take(values.phase3.acVoltage,
+                inverter_->getAcVoltage(FroniusTypes::Phase::C),
+                "phases[3].ac_voltage");
+    errors.take(values.phase3.acCurrent,
+                inverter_->getAcCurrent(FroniusTypes::Phase::C),
+                "phases[3].ac_current");
+  }
 
-    values.acFrequency = ModbusError::getOrThrow(inverter_->getAcFrequency());
-
-    // DC values
-    values.dcPower = ModbusError::getOrThrow(
-        inverter_->getDcPower(FroniusTypes::Input::TOTAL));
-    values.input1.dcPower =
-        ModbusError::getOrThrow(inverter_->getDcPower(FroniusTypes::Input::A));
-    values.input1.dcVoltage = ModbusError::getOrThrow(
-        inverter_->getDcVoltage(FroniusTypes::Input::A));
-    values.input1.dcCurrent = ModbusError::getOrThrow(
-        inverter_->getDcCurrent(FroniusTypes::Input::A));
-    if (!inverter_->isHybrid())
-      values.input1.dcEnergy = ModbusError::getOrThrow(
-          inverter_->getDcEnergy(FroniusTypes::Input::A));
-
-    if (inverter_->getInputs() == 2) {
-      values.input2.dcPower = ModbusError::getOrThrow(
-          inverter_->getDcPower(FroniusTypes::Input::B));
-      values.input2.dcVoltage = ModbusError::getOrThrow(
-          inverter_->getDcVoltage(FroniusTypes::Input::B));
-      values.input2.dcCurrent = ModbusError::getOrThrow(
-          inverter_->getDcCurrent(FroniusTypes::Input::B));
-      if (!inverter_->isHybrid())
-        values.input2.dcEnergy = ModbusError::getOrThrow(
-            inverter_->getDcEnergy(FroniusTypes::Input::B));
-    }
+  errors.take(values.acFrequency, inverter_->getAcFrequency(), "ac_frequency");
+
+  // DC values
+  errors.take(values.dcPower, inverter_->getDcPower(FroniusTypes::Input::TOTAL),
+              "dc_power");
+  errors.take(values.input1.dcPower,
+              inverter_->getDcPower(FroniusTypes::Input::A),
+              "inputs[1].dc_power");
+  errors.take(values.input1.dcVoltage,
+              inverter_->getDcVoltage(FroniusTypes::Input::A),
+              "inputs[1].dc_voltage");
+  errors.take(values.input1.dcCurrent,
+              inverter_->getDcCurrent(FroniusTypes::Input::A),
+              "inputs[1].dc_current");
+  if (!hybrid)
+    errors.take(values.input1.dcEnergy,
+                inverter_->getDcEnergy(FroniusTypes::Input::A),
+                "inputs[1].dc_energy");
+
+  if (inputs == 2) {
+    errors.take(values.input2.dcPower,
+                inverter_->getDcPower(FroniusTypes::Input::B),
+                "inputs[2].dc_power");
+    errors.take(values.input2.dcVoltage,
+                inverter_->getDcVoltage(FroniusTypes::Input::B),
+                "inputs[2].dc_voltage");
+    errors.take(values.input2.dcCurrent,
+                inverter_->getDcCurrent(FroniusTypes::Input::B),
+                "inputs[2].dc_current");
+    if (!hybrid)
+      errors.take(values.input2.dcEnergy,
+                  inverter_->getDcEnergy(FroniusTypes::Input::B),
+                  "inputs[2].dc_energy");
+  }
 
-  } catch (const ModbusError &err) {
+  if (!errors.ok()) {
+    const ModbusError err = errors.error();
     logger_->warn("{}", err.message);
     return std::unexpected(err);
   }
@@ -345,76 +410,32 @@ std::expected<void, ModbusError> InverterMaster::updateValuesAndJson() {
     values.efficiency = 0.0;
   }
 
+  // The decoded values are the capture's replay input; the rest of this
+  // method is what fronius-bridge-bench replays.
+  if (capture_)
+    capture_->inverterValues(captureDevice_, values);
+
   // Quantise to the output precision; every consumer (MQTT JSON, Postgres, the
   // debug log) then sees the same values.
   values.round();
 
-  // ---- Build JSON ----
-  json newJson;
-
-  newJson["time"] = values.time;
-  newJson["ac_energy"] = Utils::scaleToKilo(values.acEnergy);
-
-  // AC power metrics
-  newJson["ac_power_active"] = values.acPowerActive;
-  newJson["ac_power_apparent"] = values.acPowerApparent;
-  newJson["ac_power_reactive"] = values.acPowerReactive;
-  newJson["ac_power_factor"] = values.acPowerFactor;
-
-  // ---- Phases ----
-  json phases = json::array();
-  std::array<const InverterTypes::Phase *, 3> phaseList = {
-      &values.phase1, &values.phase2, &values.phase3};
-
-  int phaseCount =
-      std::clamp(inverter_->getPhases(), 1, static_cast<int>(phaseList.size()));
-
-  for (int i = 0; i < phaseCount; ++i) {
-    phases.push_back({
-        {"id", i + 1},
-        {"ac_voltage", phaseList[i]->acVoltage},
-        {"ac_current", phaseList[i]->acCurrent},
-    });
-  }
-
-  newJson["phases"] = std::move(phases);
-  newJson["ac_frequency"] = values.acFrequency;
-  newJson["dc_power"] = values.dcPower;
-  newJson["efficiency"] = values.efficiency;
-
-  // ---- DC Inputs ----
-  json inputs = json::array();
-  std::array<const InverterTypes::Input *, 2> inputList = {&values.input1,
-                                                           &values.input2};
-
-  int inputCount =
-      std::clamp(inverter_->getInputs(), 1, static_cast<int>(inputList.size()));
-
-  for (int i = 0; i < inputCount; ++i) {
-    json input = {
-        {"id", i + 1},
-        {"dc_voltage", inputList[i]->dcVoltage},
-        {"dc_current", inputList[i]->dcCurrent},
-        {"dc_power", inputList[i]->dcPower},
-    };
-
-    if (!inverter_->isHybrid()) {
-      input["dc_energy"] = Utils::scaleToKilo(inputList[i]->dcEnergy);
-    }
-
-    inputs.push_back(std::move(input));
-  }
-  newJson["inputs"] = std::move(inputs);
-
-  logger_->debug("'{}' values: {}", cfg_.name, newJson.dump());
-
   // ---- Commit values ----
+  MqttEncoding encoding;
   {
     std::lock_guard<std::mutex> lock(cbMutex_);
-    jsonValues_ = std::move(newJson);
+    encoding = valuesEncoding_;
+    Payload::inverterValues(jsonValues_, values, phases, inputs, hybrid,
+                            encoding);
     values_ = std::move(values);
   }
 
+  // Only this thread writes jsonValues_, so it can be read without the lock.
+  if (encoding == MqttEncoding::Json)
+    logger_->debug("'{}' values: {}", cfg_.name, jsonValues_);
+  else
+    logger_->debug("'{}' values: {} bytes of {}", cfg_.name,
+                   jsonValues_.size(), contentType(encoding));
+
   return {};
 }
 
@@ -426,39 +447,32 @@ std::expected<bool, ModbusError> InverterMaster::updateEventsAndJson() {
 
   InverterTypes::Events newEvents;
 
-  try {
-    newEvents.activeCode = inverter_->getActiveStateCode();
-    newEvents.state = ModbusError::getOrThrow(inverter_->getState());
-    newEvents.events = ModbusError::getOrThrow(inverter_->getEvents());
-  } catch (const ModbusError &err) {
+  // Read every poll, so decoded like the values: no exception on failure.
+  DecodeErrors errors;
+  newEvents.activeCode = inverter_->getActiveStateCode();
+  errors.take(newEvents.state, inverter_->getState(), "state");
+  errors.take(newEvents.events, inverter_->getEvents(), "events");
+  if (!errors.ok()) {
+    const ModbusError err = errors.error();
     logger_->warn("{}", err.message);
     return std::unexpected(err);
   }
 
-  // ---- Build JSON ----
-  json newJson;
-
-  newJson["active_code"] = newEvents.activeCode;
-  newJson["state"] = newEvents.state;
-  newJson["events"] = nlohmann::json::array();
-  for (const auto &e : newEvents.events) {
-    newJson["events"].push_back(e);
-  }
-
   // De-duplicate the whole snapshot. Log the event list on a change, tagged
   // with the active state code so a re-log driven by a state change (not the
   // list itself) is self-explanatory.
   const bool changed = eventsGate_.changed(newEvents);
-  if (changed)
-    logger_->debug("'{}' events: {}", cfg_.name, newJson.dump());
 
   // ---- Commit events ----
   {
     std::lock_guard<std::mutex> lock(cbMutex_);
-    jsonEvents_ = std::move(newJson);
+    Payload::inverterEvents(jsonEvents_, newEvents);
     events_ = std::move(newEvents);
   }
 
+  if (changed)
+    logger_->debug("'{}' events: {}", cfg_.name, jsonEvents_);
+
   return changed;
 }
 
@@ -505,35 +519,22 @@ std::expected<bool, ModbusError> InverterMaster::updateDeviceAndJson() {
         cfg_.name, cfg_.slaveId, newDevice.slaveID);
   }
 
-  // ---- Build ordered JSON ----
-  json newJson;
-
-  newJson["manufacturer"] = newDevice.manufacturer;
-  newJson["model"] = newDevice.model;
-  newJson["serial_number"] = newDevice.serialNumber;
-  newJson["firmware_version"] = newDevice.fwVersion;
-  newJson["data_manager"] = newDevice.dataManagerVersion;
-  newJson["register_model"] = newDevice.registerModel;
-  newJson["slave_id"] = newDevice.slaveID;
-  newJson["inverter_id"] = newDevice.id;
-  newJson["hybrid"] = newDevice.isHybrid;
-  newJson["mppt_tracker"] = newDevice.inputs;
-  newJson["phases"] = newDevice.phases;
-  newJson["power_rating"] = newDevice.acPowerApparent;
-
-  logger_->debug("'{}' device: {}", cfg_.name, newJson.dump());
-
   // Record the identity as the baseline so the hasValue() guard short-circuits
   // the Modbus re-read on subsequent polls; this is the first (and only) read,
   // so the callback fires once.
   deviceGate_.changed(newDevice);
+  if (capture_)
+    capture_->shape(captureDevice_,
+                    {newDevice.phases, newDevice.inputs, newDevice.isHybrid});
 
   // ---- Commit values ----
   {
     std::lock_guard<std::mutex> lock(cbMutex_);
-    jsonDevice_ = std::move(newJson);
+    Payload::inverterDevice(jsonDevice_, newDevice);
     device_ = std::move(newDevice);
   }
 
+  logger_->debug("'{}' device: {}", cfg_.name, jsonDevice_);
+
   return true;
 }
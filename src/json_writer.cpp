@@ -0,0 +1,202 @@
+#include "json_writer.h"
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+// nlohmann's dump() switches to exponent notation outside this range of
+// decimal exponents (the position of the decimal point, 1 for "1.5").
+constexpr int minFixedExp = -4;
+constexpr int maxFixedExp = 15;
+
+// Fixed notation is exact only well inside the range where a double still
+// resolves the quantised decimals; beyond it fall back to the digit search.
+constexpr double maxFixedValue = 1e15;
+
+constexpr char hexDigits[] = "0123456789abcdef";
+
+} // namespace
+
+namespace Json {
+
+void Writer::separate() {
+  if (afterKey_)
+    afterKey_ = false;
+  else if (!first_)
+    out_ += ',';
+  first_ = false;
+}
+
+void Writer::key(std::string_view k) {
+  separate();
+  escaped(k);
+  out_ += ':';
+  afterKey_ = true;
+}
+
+void Writer::value(std::uint64_t v) {
+  separate();
+  char buf[24];
+  const auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v);
+  out_.append(buf, end);
+}
+
+void Writer::value(int v) {
+  separate();
+  char buf[16];
+  const auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v);
+  out_.append(buf, end);
+}
+
+void Writer::value(bool v) {
+  separate();
+  out_ += v ? "true" : "false";
+}
+
+void Writer::value(std::string_view v) {
+  separate();
+  escaped(v);
+}
+
+void Writer::value(const std::vector<std::string> &v) {
+  beginArray();
+  for (const auto &s : v)
+    value(std::string_view(s));
+  endArray();
+}
+
+void Writer::number(double v, int decimals) {
+  separate();
+  if (!std::isfinite(v)) {
+    out_ += "null";
+    return;
+  }
+
+  const double mag = std::fabs(v);
+  if (decimals < 0 || mag >= maxFixedValue || (mag != 0.0 && mag < 1e-4)) {
+    shortest(v);
+    return;
+  }
+
+  char buf[32];
+  const auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v,
+                                       std::chars_format::fixed, decimals);
+  if (ec != std::errc{}) {
+    shortest(v);
+    return;
+  }
+  if (decimals == 0) {
+    out_.append(buf, end);
+    out_ += ".0";
+    return;
+  }
+  // Trim trailing zeros, keeping one digit after the point.
+  const char *last = end;
+  while (last[-1] == '0' && last[-2] != '.')
+    --last;
+  out_.append(buf, static_cast<std::size_t>(last - buf));
+}
+
+void Writer::shortest(double v) {
+  // The shortest round-trip digits, laid out as nlohmann's format_buffer()
+  // does: digits d1..dk with the decimal point after position n.
+  char buf[32];
+  const auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v,
+                                       std::chars_format::scientific);
+  std::string_view sci(buf, static_cast<std::size_t>(end - buf));
+
+  if (sci.front() == '-') {
+    out_ += '-';
+    sci.remove_prefix(1);
+  }
+  const std::size_t e = sci.find('e');
+  int exp10 = 0;
+  std::from_chars(sci.data() + e + 1 + (sci[e + 1] == '+'),
+                  sci.data() + sci.size(), exp10);
+
+  char digits[24];
+  int k = 0;
+  for (char c : sci.substr(0, e))
+    if (c != '.')
+      digits[k++] = c;
+  const int n = exp10 + 1;
+  const std::string_view d(digits, static_cast<std::size_t>(k));
+
+  if (k <= n && n <= maxFixedExp) {
+    // 1234e2 -> 123400.0
+    out_ += d;
+    out_.append(static_cast<std::size_t>(n - k), '0');
+    out_ += ".0";
+  } else if (0 < n && n <= maxFixedExp) {
+    // 1234e-2 -> 12.34
+    out_ += d.substr(0, static_cast<std::size_t>(n));
+    out_ += '.';
+    out_ += d.substr(static_cast<std::size_t>(n));
+  } else if (minFixedExp < n && n <= 0) {
+    // 1234e-6 -> 0.001234
+    out_ += "0.";
+    out_.append(static_cast<std::size_t>(-n), '0');
+    out_ += d;
+  } else {
+    // 1e+15, 1.234e-05: at least two exponent digits.
+    out_ += d.front();
+    if (k > 1) {
+      out_ += '.';
+      out_ += d.substr(1);
+    }
+    const int x = n - 1;
+    out_ += x < 0 ? "e-" : "e+";
+    const int ax = x < 0 ? -x : x;
+    if (ax < 10)
+      out_ += '0';
+    char xbuf[8];
+    const auto [xend, xec] = std::to_chars(xbuf, xbuf + sizeof(xbuf), ax);
+    out_.append(xbuf, xend);
+  }
+}
+
+void Writer::escaped(std::string_view s) {
+  out_ += '"';
+  for (char ch : s) {
+    const auto c = static_cast<unsigned char>(ch);
+    switch (c) {
+    case '"':
+      out_ += "\\\"";
+      break;
+    case '\\':
+      out_ += "\\\\";
+      break;
+    case '\b':
+      out_ += "\\b";
+      break;
+    case '\f':
+      out_ += "\\f";
+      break;
+    case '\n':
+      out_ += "\\n";
+      break;
+    case '\r':
+      out_ += "\\r";
+      break;
+    case '\t':
+      out_ += "\\t";
+      break;
+    default:
+      if (c < 0x20) {
+        out_ += "\\u00";
+        out_ += hexDigits[c >> 4];
+        out_ += hexDigits[c & 0x0f];
+      } else {
+        out_ += ch;
+      }
+    }
+  }
+  out_ += '"';
+}
+
+} // namespace Json
@@ -1,23 +1,36 @@
+#include "bus_scheduler.h"
+#include "capture.h"
+#include "cluster.h"
 #include "config.h"
 #include "config_yaml.h"
+#include "dispatcher.h"
 #include "easy_meter.h"
 #include "fronius_meter.h"
 #include "inverter_master.h"
 #include "logger.h"
+#include "memory_budget.h"
 #include "meter_master.h"
 #include "meter_slave.h"
+#include "metrics.h"
+#include "metrics_server.h"
 #include "mqtt_client.h"
 #include "postgres_client.h"
 #include "privileges.h"
 #include "signal_handler.h"
+#include "simulator.h"
+#include "sinks.h"
 #include <CLI/CLI.hpp>
 #include <algorithm>
+#include <cstddef>
 #include <cstdlib>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <set>
+#include <string>
 #include <vector>
 
 using json = nlohmann::json;
@@ -57,6 +70,16 @@ int main(int argc, char *argv[]) {
       "Verify the PostgreSQL schema for each device instead of "
       "creating or upgrading it (no effect without a postgres config)");
 
+  std::string node;
+  app.add_option("-n,--node", node,
+                 "Name of this instance in the cluster (one of cluster.nodes)")
+      ->envname("FRONIUS_NODE");
+
+  std::string capturePath;
+  app.add_option("--capture", capturePath,
+                 "Record every device's inputs to this file, for replay by "
+                 "fronius-bridge-bench");
+
   CLI11_PARSE(app, argc, argv);
 
   // --- Load config ---
@@ -68,8 +91,32 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
+  // The nodes share the file, so each names itself on the command line.
+  if (cfg.cluster) {
+    const auto &nodes = cfg.cluster->nodes;
+    if (std::find(nodes.begin(), nodes.end(), node) == nodes.end()) {
+      std::cerr << "Error loading config: cluster mode requires --node set "
+                   "to one of cluster.nodes\n";
+      return EXIT_FAILURE;
+    }
+    cfg.cluster->node = node;
+  }
+
+  // The low-memory profile's stack size holds for every thread started from
+  // here on, spdlog's async writer included.
+  if (cfg.memory) {
+    try {
+      setThreadStackSize(cfg.memory->threadStackKb * 1024);
+    } catch (const std::exception &ex) {
+      std::cerr << "Error loading config: memory.thread_stack_kb: "
+                << ex.what() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
   // --- Setup logging ---
   setupLogging(cfg.logger);
+  const Metrics::Registration logDropped = logDroppedMetric();
   std::shared_ptr<spdlog::logger> mainLogger = spdlog::get("main");
   if (!mainLogger)
     mainLogger = spdlog::default_logger();
@@ -97,59 +144,254 @@ int main(int argc, char *argv[]) {
   SignalHandler handler;
 
   // All objects are declared here so their lifetimes are identical.
-  // Parallel vectors cfg.meters / meterMasters / meterSlaves are kept
-  // index-aligned: meter i, its master, and its slave (if any) all line up.
-  // meterSlaves[i] is nullptr when meter i has no `slave` block.
+  // inverterMasters, meterMasters and meterSlaves are indexed by DeviceId,
+  // one slot per cfg.deviceRegistry entry, so a reload replaces a device's
+  // master and slave in place. A slot holds nullptr for a device of the
+  // other kind, a vacant slot, and a meter without a `slave` block.
+  //
+  // In cluster mode a master is built only for a device this node may serve,
+  // and its slots hold nullptr otherwise; so are the slaves of meters homed
+  // on another node. mastersMutex guards the master slots against the
+  // coordinator thread switching them while a reload replaces them.
   //
   // Declaration order matters here. Destruction runs in reverse, so:
+  //   0. the metrics endpoint stops first, so no scrape is in flight while
+  //      the objects it reports on are torn down. (Their metric callbacks
+  //      unhook themselves anyway; this just keeps shutdown quiet.) The
+  //      optional cluster coordinator follows: it switches the masters, so it
+  //      goes before them, and closing its session hands its devices to the
+  //      other nodes.
   //   1. inverterMasters and meterMasters destruct first. A Modbus master's
   //      destructor (every inverter, and Fronius meters) calls
   //      bus_->unregisterDevice() to cancel any in-flight retry loop, then
   //      bus_->removeBusCallback() for each bus-level callback it registered;
   //      both must see a live FroniusBus so the bus can synchronously join its
-  //      retry threads and wait out any in-flight callback invocation. An EBZ
+  //      retry threads and wait out any in-flight callback invocation. It
+  //      then leaves its bus's schedule, which must still be live too, since
+  //      remove() waits out a poll in flight. An EBZ
   //      meter master holds no bus — it owns a serial fd and a read thread —
   //      so its destructor just joins that thread and closes the fd; it is
   //      unaffected by `buses` below but, like the others, must destruct
-  //      before `mqtt` (see step 4).
-  //   2. `buses` then drops the last shared_ptr<FroniusBus> for each bus.
+  //      before the dispatcher (see step 3).
+  //   2. `schedulers` then stop their (by now idle) poll threads, and
+  //      `buses` drops the last shared_ptr<FroniusBus> for each bus.
   //      Each FroniusBus destructor joins its bus thread and cancels any
-  //      pending transactions.
-  //   3. meterSlaves destruct independently of the buses — they own their
+  //      pending transactions. The optional capture, which the masters
+  //      write to, is closed after them, and the simulated gateways the
+  //      buses connected to then stop serving.
+  //   3. the dispatcher then lets each sink drain what the masters handed it
+  //      and joins the sinks' threads; the sinks go with it. Both sit after
+  //      the consumers they feed, which must outlive them.
+  //   4. meterSlaves destruct independently of the buses — they own their
   //      own listener thread and modbus context.
-  //   4. mqtt destructs last among the I/O objects so that final
+  //   5. mqtt destructs last among the I/O objects so that final
   //      availability publishes from master destructors land successfully.
   //      The optional PostgresClient sits with mqtt: it is a peer consumer the
-  //      master callbacks feed, so it must outlive every master. It joins its
+  //      dispatcher feeds, so it must outlive the dispatcher. It joins its
   //      own worker thread on destruction.
+  //   6. the optional memory budget goes last: the consumers and the slaves
+  //      hold accounts in it.
+  std::unique_ptr<MemoryBudget> memory;
   std::unique_ptr<MqttClient> mqtt;
   std::unique_ptr<PostgresClient> postgres;
   std::vector<std::unique_ptr<MeterSlave>> meterSlaves;
+  std::unique_ptr<MqttSink> mqttSink;
+  std::unique_ptr<PostgresSink> postgresSink;
+  std::unique_ptr<SlaveSink> slaveSink;
+  std::unique_ptr<SiteSink> siteSink;
+  std::unique_ptr<SnapshotSink> snapshotSink;
+  std::unique_ptr<Dispatcher> dispatcher;
+  std::unique_ptr<CaptureWriter> capture;
+  std::map<int, std::unique_ptr<SimulatedGateway>> simulators;
   std::map<std::string, std::shared_ptr<FroniusBus>> buses;
+  std::map<std::string, std::unique_ptr<BusScheduler>> schedulers;
   std::vector<std::unique_ptr<MeterMaster>> meterMasters;
   std::vector<std::unique_ptr<InverterMaster>> inverterMasters;
+  std::mutex mastersMutex;
+  std::unique_ptr<ClusterCoordinator> cluster;
+  std::unique_ptr<MetricsServer> metrics;
+
+  const std::size_t slots = cfg.deviceRegistry.size();
+  meterSlaves.resize(slots);
+  meterMasters.resize(slots);
+  inverterMasters.resize(slots);
+
+  // Whether this node may ever serve device `id`: always without a cluster.
+  // A reload recomputes the preferences for its roster.
+  auto preferences = cfg.cluster ? clusterPreferences(cfg)
+                                 : std::vector<std::vector<std::string>>{};
+  auto serves = [&](DeviceId id) {
+    return !cfg.cluster ||
+           std::find(preferences[id].begin(), preferences[id].end(), node) !=
+               preferences[id].end();
+  };
+  auto homedHere = [&](DeviceId id) {
+    return !cfg.cluster ||
+           (!preferences[id].empty() && preferences[id].front() == node);
+  };
+
+  // The devices --capture records: those of the startup config. The capture
+  // header names them, so the devices a reload adds or rebuilds are left out.
+  std::vector<bool> captured(slots, false);
+
+  // Logged with each bus below; resolved once logging is set up.
+  auto busLogger = spdlog::get("bus");
+
+  // Decide the libmodbus wire trace here, not in makeBusConfig(): the bus
+  // registry is built during loadConfig(), before setupLogging() has
+  // registered any logger, so the flag cannot be resolved at config-build
+  // time. The hex dump is the most verbose bus diagnostic and sits one level
+  // below the per-transaction 'bus' debug lines: `bus: debug` yields
+  // queue/tx/rx diagnostics, `bus: trace` additionally turns on the raw
+  // libmodbus wire dump. Only a dedicated 'bus' logger at trace level opts
+  // in — a global trace level does not, matching the original behaviour.
+  const bool busTrace =
+      busLogger && busLogger->level() == spdlog::level::trace;
+  if (!busLogger)
+    busLogger = spdlog::default_logger();
+
+  // Buses opened and not yet connected. The masters of a bus register with
+  // it before it connects; one a reload adds to a connected bus is brought
+  // up through connectLate().
+  std::set<std::string> unconnected;
+
+  // The simulated gateways' units, by port, for a reload to compare against.
+  std::map<int, std::vector<SimulatedGateway::Unit>> simulatedUnits;
+
+  // --- The per-device steps, shared by startup and the reloads ---
+
+  // Start meter `id`'s slave, if it has a `slave:` block and is homed here.
+  auto startSlave = [&](const AppConfig &c, DeviceId id) {
+    const auto &m = *meterOf(c, id);
+    if (!m.slave)
+      return;
+    if (!homedHere(id)) {
+      mainLogger->info("Meter slave '{}' left to node '{}'", m.name,
+                       preferences[id].front());
+      return;
+    }
+    meterSlaves[id] =
+        std::make_unique<MeterSlave>(*m.slave, m.name, handler, memory.get());
+    mainLogger->info("Meter slave '{}' enabled", m.name);
+  };
+
+  // Open the bus `key` of `c.buses`, with its poll thread, unless it is open
+  // already.
+  auto openBus = [&](const AppConfig &c, const std::string &key) {
+    if (buses.contains(key))
+      return;
+    const auto &info = c.buses.at(key);
+    ModbusBusConfig busCfg = info.config;
+    busCfg.debug = busTrace;
+    auto bus = std::make_shared<FroniusBus>(busCfg);
+    // Per-bus diagnostic output (queue depth, slave switches, tx/rx
+    // outcomes) goes to the same 'bus' logger at debug level. spdlog
+    // defaults to info-level for unregistered loggers, so these lines are
+    // filtered out by default; users opt in with `bus: debug` (or `trace`)
+    // in the YAML logger.modules section.
+    bus->addBusLogCallback(
+        [busLogger](const std::string &msg) { busLogger->debug("{}", msg); });
+    buses.emplace(key, std::move(bus));
+    // One poll thread per bus for every Modbus master on it.
+    schedulers.emplace(key, std::make_unique<BusScheduler>(key));
+    unconnected.insert(key);
+    busLogger->info("{}", busSummaryLine(key, info));
+  };
+
+  // Build device `id`'s master and wire it to the dispatcher. On a cluster
+  // node `active` is false after a reload: the coordinator then switches it.
+  auto startMeter = [&](const AppConfig &c, DeviceId id, bool active) {
+    const auto &mcfg = *meterOf(c, id);
+    // Construct the kind-appropriate master. Fronius meters attach to a
+    // shared Modbus bus (looked up by the key their bus config produces);
+    // the EBZ Easymeter owns its serial line and takes no bus. Both are
+    // held through the MeterMaster base, so the dispatcher wiring below is
+    // identical regardless of kind.
+    std::unique_ptr<MeterMaster> master;
+    FroniusMeter *late = nullptr;
+    if (auto key = busKeyOf(mcfg)) {
+      openBus(c, *key);
+      auto fronius = std::make_unique<FroniusMeter>(
+          mcfg, handler, buses.at(*key), *schedulers.at(*key));
+      if (!unconnected.contains(*key))
+        late = fronius.get();
+      master = std::move(fronius);
+    } else {
+      master = std::make_unique<EasyMeter>(mcfg, handler);
+    }
+    if (!active)
+      master->setActive(false);
+
+    dispatcher->attach(*master, id, c.mqtt.publish.values.encoding);
+    if (capture && captured[id])
+      master->setCapture(capture.get(), id);
+    if (late)
+      late->connectLate();
+    meterMasters[id] = std::move(master);
+  };
+
+  auto startInverter = [&](const AppConfig &c, DeviceId id, bool active) {
+    const auto &icfg = *inverterOf(c, id);
+    const auto key = busKeyOf(icfg);
+    openBus(c, key);
+    const bool late = !unconnected.contains(key);
+    auto inv = std::make_unique<InverterMaster>(
+        icfg, handler, buses.at(key), *schedulers.at(key), c.site);
+    if (!active)
+      inv->setActive(false);
+
+    dispatcher->attach(*inv, id, c.mqtt.publish.values.encoding);
+    if (capture && captured[id])
+      inv->setCapture(capture.get(), id);
+    if (late)
+      inv->connectLate();
+    inverterMasters[id] = std::move(inv);
+  };
+
+  // One per simulated port, serving every device on it this node may serve.
+  auto simulatedUnitsOf = [&](const AppConfig &c) {
+    std::map<int, std::vector<SimulatedGateway::Unit>> units;
+    for (std::size_t i = 0; i < c.inverters.size(); ++i)
+      if (const auto &inv = c.inverters[i];
+          inv.simulate && serves(inverterDeviceId(c, i)))
+        units[inv.simulate->port].push_back(
+            {SimulatedGateway::Unit::Kind::Inverter, inv.name, inv.slaveId,
+             *inv.simulate});
+    for (std::size_t i = 0; i < c.meters.size(); ++i)
+      if (const auto *f = asFronius(c.meters[i]);
+          f && f->simulate && serves(meterDeviceId(c, i)))
+        units[f->simulate->port].push_back(
+            {SimulatedGateway::Unit::Kind::Meter, c.meters[i].name,
+             f->slaveId, *f->simulate});
+    return units;
+  };
 
   try {
+    // --- Set up the optional memory budget ---
+    // Shared by the slaves' register tables and the consumers' queues.
+    if (cfg.memory) {
+      memory = std::make_unique<MemoryBudget>(cfg.memory->budgetKb * 1024);
+      mainLogger->info("Low-memory profile: {} KiB budget, {} KiB thread "
+                       "stacks",
+                       cfg.memory->budgetKb, cfg.memory->threadStackKb);
+    }
+
     // --- Start meter slaves ---
     // Slaves come first because they bind (potentially privileged) TCP
-    // ports and need to do so before we drop root. The vector is index-
-    // aligned with cfg.meters: meterSlaves[i] corresponds to cfg.meters[i]
-    // and is nullptr when that meter has no `slave` block.
-    meterSlaves.reserve(cfg.meters.size());
-    for (const auto &m : cfg.meters) {
-      if (m.slave) {
-        meterSlaves.push_back(
-            std::make_unique<MeterSlave>(*m.slave, m.name, handler));
-        mainLogger->info("Meter slave '{}' enabled", m.name);
-      } else {
-        meterSlaves.push_back(nullptr);
-      }
-    }
+    // ports and need to do so before we drop root. meterSlaves[id] is
+    // nullptr when device `id` has no `slave` block.
+    for (std::size_t i = 0; i < cfg.meters.size(); ++i)
+      startSlave(cfg, meterDeviceId(cfg, i));
     if (std::all_of(meterSlaves.begin(), meterSlaves.end(),
                     [](const auto &p) { return !p; })) {
       mainLogger->info("No meter slaves configured");
     }
 
+    // --- Start the optional metrics endpoint ---
+    // Bound here, with the slaves, so a privileged port works too.
+    if (cfg.metrics)
+      metrics = std::make_unique<MetricsServer>(*cfg.metrics, handler);
+
     // --- Drop privileges after binding to privileged ports ---
     if (!runUser.empty() && Privileges::isRoot()) {
       Privileges::drop(runUser, runGroup);
@@ -159,7 +401,7 @@ int main(int argc, char *argv[]) {
     }
 
     // --- Start MQTT client ---
-    mqtt = std::make_unique<MqttClient>(cfg.mqtt, handler);
+    mqtt = std::make_unique<MqttClient>(cfg.mqtt, handler, memory.get());
 
     // --- Start optional PostgreSQL consumer ---
     // Constructed only when a postgres section is present; otherwise the
@@ -170,13 +412,57 @@ int main(int argc, char *argv[]) {
       // loadConfig, like cfg.buses); the consumer writes it into
       // public.device_registry at startup.
       postgres = std::make_unique<PostgresClient>(
-          *cfg.postgres, cfg.deviceRegistry, cfg.site, handler);
+          *cfg.postgres, cfg.deviceRegistry, cfg.site, handler, memory.get());
       mainLogger->info("PostgreSQL consumer enabled ({} mode)",
                        cfg.postgres->autoMigrate ? "migrate" : "verify");
     } else {
       mainLogger->info("PostgreSQL consumer disabled");
     }
 
+    // --- Start the dispatcher ---
+    // The masters hand every sample to the dispatcher, which fans it out to
+    // one thread per sink, so no consumer runs on a poll thread. Each sink's
+    // queue drops its oldest samples when full. A pooled sample holds its
+    // payload buffer, so the low-memory profile keeps fewer of them.
+    const std::size_t dispatchQueueSize = cfg.memory ? 32 : 256;
+    dispatcher = std::make_unique<Dispatcher>(cfg.deviceRegistry,
+                                              cfg.aggregate, dispatchQueueSize);
+    mqttSink = std::make_unique<MqttSink>(cfg, *mqtt);
+    dispatcher->subscribe("mqtt", *mqttSink);
+    if (postgres) {
+      postgresSink = std::make_unique<PostgresSink>(cfg, *postgres);
+      dispatcher->subscribe("postgres", *postgresSink);
+    }
+    // Subscribed even without a slave, as a reload may add one.
+    slaveSink = std::make_unique<SlaveSink>(meterSlaves);
+    dispatcher->subscribe("slave", *slaveSink);
+    if (cfg.siteEnergy) {
+      siteSink = std::make_unique<SiteSink>(cfg, *mqtt, postgres.get());
+      dispatcher->subscribe("site", *siteSink);
+    }
+    if (cfg.snapshot) {
+      snapshotSink =
+          std::make_unique<SnapshotSink>(cfg, *mqtt, postgres.get());
+      dispatcher->subscribe("snapshot", *snapshotSink);
+    }
+
+    // --- Start the optional capture ---
+    // Created after the privilege drop, so the file belongs to the user the
+    // bridge runs as.
+    if (!capturePath.empty()) {
+      capture = std::make_unique<CaptureWriter>(capturePath, cfg);
+      for (std::size_t id = 0; id < slots; ++id)
+        captured[id] = !cfg.deviceRegistry[id].vacant();
+    }
+
+    // --- Start the simulated gateways ---
+    // One per simulated port, serving every device that names it, so each
+    // is listening before its bus first connects.
+    simulatedUnits = simulatedUnitsOf(cfg);
+    for (const auto &[port, list] : simulatedUnits)
+      simulators.emplace(
+          port, std::make_unique<SimulatedGateway>(port, list, handler));
+
     // --- Build bus registry + startup summary ---
     // cfg.buses is the derived, deduplicated set of buses (one per unique
     // RS-485 device path or TCP endpoint), synthesised by loadConfig() from
@@ -190,143 +476,52 @@ int main(int argc, char *argv[]) {
     // absent here. No hardware is opened until the connect() calls below.
     //
     // The 'bus' logger is dedicated so per-bus output can be silenced or
-    // surfaced independently of the main and per-device modules; resolve it
-    // once here for both the summary and the diagnostic callback below.
-    auto busLogger = spdlog::get("bus");
-
-    // Decide the libmodbus wire trace here, not in makeBusConfig(): the bus
-    // registry is built during loadConfig(), before setupLogging() has
-    // registered any logger, so the flag cannot be resolved at config-build
-    // time. The hex dump is the most verbose bus diagnostic and sits one level
-    // below the per-transaction 'bus' debug lines: `bus: debug` yields
-    // queue/tx/rx diagnostics, `bus: trace` additionally turns on the raw
-    // libmodbus wire dump. Only a dedicated 'bus' logger at trace level opts
-    // in — a global trace level does not, matching the original behaviour.
-    const bool busTrace =
-        busLogger && busLogger->level() == spdlog::level::trace;
-
-    if (!busLogger)
-      busLogger = spdlog::default_logger();
-    for (const auto &[key, info] : cfg.buses) {
-      ModbusBusConfig busCfg = info.config;
-      busCfg.debug = busTrace;
-      buses.emplace(key, std::make_shared<FroniusBus>(busCfg));
-      busLogger->info("{}", busSummaryLine(key, info));
-    }
-
-    // --- Register bus log callback ---
-    // Per-bus diagnostic output (queue depth, slave switches, tx/rx
-    // outcomes) goes to the same 'bus' logger at debug level. spdlog
-    // defaults to info-level for unregistered loggers, so these lines are
-    // filtered out by default; users opt in with `bus: debug` (or `trace`)
-    // in the YAML logger.modules section.
-    for (auto &[key, bus] : buses)
-      bus->addBusLogCallback(
-          [busLogger](const std::string &msg) { busLogger->debug("{}", msg); });
+    // surfaced independently of the main and per-device modules; it is
+    // resolved once above for both the summary and the diagnostic callback
+    // (see openBus).
+    //
+    // A cluster node opens only the buses of the devices it may serve.
+    std::set<std::string> busKeys;
+    for (std::size_t i = 0; i < cfg.inverters.size(); ++i)
+      if (serves(inverterDeviceId(cfg, i)))
+        busKeys.insert(busKeyOf(cfg.inverters[i]));
+    for (std::size_t i = 0; i < cfg.meters.size(); ++i)
+      if (auto key = busKeyOf(cfg.meters[i]);
+          key && serves(meterDeviceId(cfg, i)))
+        busKeys.insert(*key);
+    for (const auto &[key, info] : cfg.buses)
+      if (busKeys.contains(key))
+        openBus(cfg, key);
 
     // --- Start meter masters ---
-    // Each meter master's value/device callbacks publish to MQTT under
-    // <base>/meter/<name>/<suffix> and, if this meter has a slave block,
-    // feed that slave's register map. The 'meter' class segment lets
-    // downstream consumers subscribe to e.g. fronius-bridge/meter/+/values
-    // to receive every meter without an explicit name allow-list.
-    meterMasters.reserve(cfg.meters.size());
-    for (std::size_t i = 0; i < cfg.meters.size(); ++i) {
-      const auto &mcfg = cfg.meters[i];
-
-      // Construct the kind-appropriate master. Fronius meters attach to a
-      // shared Modbus bus (looked up by the key their bus config produces);
-      // the EBZ Easymeter owns its serial line and takes no bus. Both are
-      // held through the MeterMaster base, so the callback wiring below is
-      // identical regardless of kind.
-      std::unique_ptr<MeterMaster> master;
-      if (auto key = busKeyOf(mcfg)) {
-        master = std::make_unique<FroniusMeter>(mcfg, handler, buses.at(*key));
-      } else {
-        master = std::make_unique<EasyMeter>(mcfg, handler);
-      }
-
-      // Raw pointer to the slave, lifetime-aligned with the master via
-      // the index-aligned vectors above. nullptr when this meter has no
-      // slave block.
-      MeterSlave *slavePtr = meterSlaves[i].get();
-
-      // Capture the topic base by value so the lambdas don't depend on
-      // cfg outliving them (which it does, but explicit is better).
-      const std::string topicBase = cfg.mqtt.topic + "/meter/" + mcfg.name;
-      const std::string name = mcfg.name;
-
-      master->setValueCallback(
-          [&mqtt, &postgres, slavePtr, topicBase,
-           name](std::string jsonDump, MeterTypes::Values values) {
-            mqtt->publish(std::move(jsonDump), topicBase + "/values");
-            // Copy to the postgres consumer (if enabled) before moving into the
-            // slave register map.
-            if (postgres)
-              postgres->onMeter(name, values);
-            if (slavePtr)
-              slavePtr->updateValues(std::move(values));
-          });
-
-      master->setDeviceCallback(
-          [&mqtt, &postgres, slavePtr, topicBase,
-           name](std::string jsonDump, MeterTypes::Device device) {
-            mqtt->publish(std::move(jsonDump), topicBase + "/device");
-            if (postgres)
-              postgres->onMeterDevice(name, device);
-            if (slavePtr)
-              slavePtr->updateDevice(std::move(device));
-          });
-
-      master->setAvailabilityCallback(
-          [&mqtt, topicBase](std::string availability) {
-            mqtt->publish(std::move(availability), topicBase + "/availability");
-          });
-
-      meterMasters.push_back(std::move(master));
-    }
+    for (std::size_t i = 0; i < cfg.meters.size(); ++i)
+      if (serves(meterDeviceId(cfg, i)))
+        startMeter(cfg, meterDeviceId(cfg, i), true);
     if (cfg.meters.empty())
       mainLogger->info("No meters configured");
 
     // --- Start inverter masters ---
-    inverterMasters.reserve(cfg.inverters.size());
-    for (const auto &icfg : cfg.inverters) {
-      auto inv = std::make_unique<InverterMaster>(icfg, handler,
-                                                  buses.at(busKeyOf(icfg)));
-
-      const std::string topicBase = cfg.mqtt.topic + "/inverter/" + icfg.name;
-      const std::string name = icfg.name;
-
-      inv->setValueCallback(
-          [&mqtt, &postgres, topicBase, name](std::string jsonDump,
-                                              InverterTypes::Values values) {
-            mqtt->publish(std::move(jsonDump), topicBase + "/values");
-            if (postgres)
-              postgres->onInverter(name, std::move(values));
-          });
-
-      inv->setEventCallback(
-          [&mqtt, topicBase](std::string jsonDump, InverterTypes::Events) {
-            mqtt->publish(std::move(jsonDump), topicBase + "/events");
-          });
-
-      inv->setDeviceCallback(
-          [&mqtt, &postgres, topicBase, name](std::string jsonDump,
-                                              InverterTypes::Device device) {
-            mqtt->publish(std::move(jsonDump), topicBase + "/device");
-            if (postgres)
-              postgres->onInverterDevice(name, std::move(device));
-          });
+    for (std::size_t i = 0; i < cfg.inverters.size(); ++i)
+      if (serves(inverterDeviceId(cfg, i)))
+        startInverter(cfg, inverterDeviceId(cfg, i), true);
+    if (cfg.inverters.empty())
+      mainLogger->info("No inverters configured");
 
-      inv->setAvailabilityCallback(
-          [&mqtt, topicBase](const std::string &availability) {
-            mqtt->publish(availability, topicBase + "/availability");
+    // --- Join the cluster ---
+    // The coordinator switches the masters to the devices this node serves,
+    // the home ones at once and the rest as the other nodes come and go.
+    if (cfg.cluster) {
+      cluster = std::make_unique<ClusterCoordinator>(
+          cfg, handler, [&](const std::vector<bool> &owned) {
+            std::lock_guard<std::mutex> lock(mastersMutex);
+            for (std::size_t id = 0; id < owned.size(); ++id) {
+              if (inverterMasters[id])
+                inverterMasters[id]->setActive(owned[id]);
+              if (meterMasters[id])
+                meterMasters[id]->setActive(owned[id]);
+            }
           });
-
-      inverterMasters.push_back(std::move(inv));
     }
-    if (cfg.inverters.empty())
-      mainLogger->info("No inverters configured");
 
     // --- Start the buses ---
     // bus->connect() is called only now, after every master sharing each
@@ -334,8 +529,9 @@ int main(int argc, char *argv[]) {
     // would race: the bus thread could fire onBusConnect_ before later
     // masters added their callbacks. The bus's running_.exchange(true)
     // guard makes this a single-shot per bus.
-    for (auto &[key, bus] : buses)
-      bus->connect();
+    for (const auto &key : unconnected)
+      buses.at(key)->connect();
+    unconnected.clear();
 
   } catch (const std::exception &ex) {
     // Funnel startup failures through the same path as runtime fatals: this
@@ -344,10 +540,177 @@ int main(int argc, char *argv[]) {
     handler.shutdown(true, ex.what());
   }
 
-  // --- Wait for shutdown signal ---
-  handler.wait();
+  // --- Serve config reloads until shutdown ---
+  // SIGHUP re-reads the config file. A file that no longer loads, or whose
+  // devices do not fit the running bridge, leaves the running config in
+  // place. Of a valid one the logger levels and the devices are applied (see
+  // reloadConfig()): the masters and slaves of the changed devices are torn
+  // down and rebuilt, the buses with them, while the rest keep polling, and
+  // the consumers, with what they have queued, keep running and take the new
+  // roster through the dispatcher. The other sections are logged as needing
+  // a restart. `cfg` tracks what is in effect, so the next reload reports
+  // against that.
+  auto applyDevices = [&](const AppConfig &next, const ConfigDiff &diff) {
+    std::vector<DeviceId> down = diff.removed;
+    down.insert(down.end(), diff.rebuilt.begin(), diff.rebuilt.end());
+    std::vector<DeviceId> up = diff.added;
+    up.insert(up.end(), diff.rebuilt.begin(), diff.rebuilt.end());
+    std::lock_guard<std::mutex> lock(mastersMutex);
+
+    // Stop the masters, so the dispatcher has the last of their samples,
+    // then the consumers' state of those devices, then their slaves.
+    for (const DeviceId id : down) {
+      inverterMasters[id].reset();
+      meterMasters[id].reset();
+    }
+    dispatcher->retire(down);
+    for (const DeviceId id : down) {
+      meterSlaves[id].reset();
+      captured[id] = false;
+    }
+
+    // Close the buses (and their poll threads) no master is left on, which
+    // includes every bus whose settings changed.
+    std::set<std::string> used;
+    for (std::size_t id = 0; id < slots; ++id) {
+      if (inverterMasters[id])
+        used.insert(busKeyOf(*inverterOf(cfg, static_cast<DeviceId>(id))));
+      if (meterMasters[id])
+        if (auto key = busKeyOf(*meterOf(cfg, static_cast<DeviceId>(id))))
+          used.insert(*key);
+    }
+    for (auto it = buses.begin(); it != buses.end();) {
+      if (used.contains(it->first)) {
+        ++it;
+        continue;
+      }
+      schedulers.erase(it->first);
+      busLogger->info("Bus {} closed", it->first);
+      it = buses.erase(it);
+    }
+
+    if (cfg.cluster)
+      preferences = clusterPreferences(next);
+
+    // Restart the simulated gateways whose units changed.
+    auto units = simulatedUnitsOf(next);
+    for (auto it = simulators.begin(); it != simulators.end();) {
+      const auto u = units.find(it->first);
+      if (u != units.end() && u->second == simulatedUnits[it->first])
+        ++it;
+      else
+        it = simulators.erase(it);
+    }
+    for (const auto &[port, list] : units) {
+      if (simulators.contains(port))
+        continue;
+      try {
+        simulators.emplace(
+            port, std::make_unique<SimulatedGateway>(port, list, handler));
+      } catch (const std::exception &ex) {
+        mainLogger->error("Reload: simulated gateway on port {}: {}", port,
+                          ex.what());
+      }
+    }
+    simulatedUnits = std::move(units);
+
+    for (const DeviceId id : up) {
+      if (!meterOf(next, id))
+        continue;
+      try {
+        startSlave(next, id);
+      } catch (const std::exception &ex) {
+        mainLogger->error("Reload: meter slave '{}': {}",
+                          next.deviceRegistry[id].name, ex.what());
+      }
+    }
+
+    // The consumers take the new roster before the new masters' first
+    // samples.
+    if (postgres)
+      postgres->reload(next.deviceRegistry);
+    if (cluster)
+      cluster->reload(next);
+    dispatcher->admit(next, up);
+
+    if (capture && !up.empty())
+      mainLogger->warn("Reload: the changed devices are not captured");
+    for (const DeviceId id : up) {
+      if (!serves(id))
+        continue;
+      try {
+        if (inverterOf(next, id))
+          startInverter(next, id, !cluster);
+        else
+          startMeter(next, id, !cluster);
+      } catch (const std::exception &ex) {
+        mainLogger->error("Reload: cannot start '{}': {}",
+                          next.deviceRegistry[id].name, ex.what());
+      }
+    }
+    for (const auto &key : unconnected)
+      buses.at(key)->connect();
+    unconnected.clear();
+
+    // The retuned masters keep their connection and take the new interval
+    // at their next poll.
+    for (const DeviceId id : diff.retuned) {
+      if (const auto *inv = inverterOf(next, id)) {
+        if (inverterMasters[id])
+          inverterMasters[id]->setUpdateInterval(inv->updateInterval,
+                                                 inv->adaptive);
+      } else if (const auto *f = asFronius(*meterOf(next, id))) {
+        if (meterMasters[id])
+          meterMasters[id]->setUpdateInterval(f->updateInterval, f->adaptive);
+      }
+    }
+
+    mainLogger->info("Applied the reloaded devices: {} added, {} removed, {} "
+                     "rebuilt, {} retuned",
+                     diff.added.size(), diff.removed.size(),
+                     diff.rebuilt.size(), diff.retuned.size());
+  };
+
+  while (handler.waitForReload()) {
+    mainLogger->info("Reloading config '{}'", config);
+    AppConfig next;
+    ConfigDiff diff;
+    try {
+      next = loadConfig(config);
+      if (next.postgres && cfg.postgres)
+        next.postgres->autoMigrate = cfg.postgres->autoMigrate;
+      if (next.cluster && cfg.cluster)
+        next.cluster->node = cfg.cluster->node;
+      diff = reloadConfig(cfg, next);
+    } catch (const std::exception &ex) {
+      mainLogger->error("Reload failed, keeping the running config: {}",
+                        ex.what());
+      continue;
+    }
+
+    if (diff.empty()) {
+      mainLogger->info("Config unchanged");
+      continue;
+    }
+    if (diff.logLevels) {
+      for (const auto &module : updateLogLevels(next.logger))
+        mainLogger->warn("Logger module '{}' takes effect after a restart",
+                         module);
+      mainLogger->info("Applied the reloaded logger levels");
+    }
+    for (const auto &change : diff.restartRequired)
+      mainLogger->warn("Config change needs a restart to take effect: {}",
+                       change);
+    if (diff.devicesChanged())
+      applyDevices(next, diff);
+    cfg = std::move(next);
+  }
 
   // --- Shutdown ---
+  if (memory)
+    mainLogger->info("Peak resident size {} KiB; memory budget {}",
+                     peakResidentBytes() / 1024, memory->summary());
+
   if (handler.failed()) {
     mainLogger->error("Shutting down: {}", handler.reason());
     return EXIT_FAILURE;
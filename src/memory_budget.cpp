@@ -0,0 +1,127 @@
+#include "memory_budget.h"
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <format>
+#include <pthread.h>
+#include <string>
+#include <sys/resource.h>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace {
+
+void raisePeak(std::atomic<std::size_t> &peak, std::size_t value) noexcept {
+  std::size_t seen = peak.load(std::memory_order_relaxed);
+  while (value > seen &&
+         !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+  }
+}
+
+std::size_t kib(std::size_t bytes) { return (bytes + 1023) / 1024; }
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// MemoryBudget::Account
+// ---------------------------------------------------------------------------
+
+MemoryBudget::Account::Account(MemoryBudget &budget, std::string name)
+    : budget_(budget), name_(std::move(name)) {
+  metric_ = Metrics::callback(
+      Metrics::Type::Gauge, "fronius_bridge_memory_bytes",
+      "Bytes held against the memory budget", {{"account", name_}},
+      [this] { return static_cast<double>(used()); });
+}
+
+bool MemoryBudget::Account::charge(std::size_t bytes) noexcept {
+  std::size_t used = budget_.used_.load(std::memory_order_relaxed);
+  do {
+    if (used + bytes > budget_.limit_)
+      return false;
+  } while (!budget_.used_.compare_exchange_weak(used, used + bytes,
+                                                std::memory_order_relaxed));
+  raisePeak(budget_.peak_, used + bytes);
+  add(bytes);
+  return true;
+}
+
+void MemoryBudget::Account::reserve(std::size_t bytes) noexcept {
+  raisePeak(budget_.peak_,
+            budget_.used_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+  add(bytes);
+}
+
+void MemoryBudget::Account::release(std::size_t bytes) noexcept {
+  used_.fetch_sub(bytes, std::memory_order_relaxed);
+  budget_.used_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void MemoryBudget::Account::add(std::size_t bytes) noexcept {
+  raisePeak(peak_, used_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+// ---------------------------------------------------------------------------
+// MemoryBudget
+// ---------------------------------------------------------------------------
+
+MemoryBudget::MemoryBudget(std::size_t limit) : limit_(limit) {
+  limitMetric_ = Metrics::callback(
+      Metrics::Type::Gauge, "fronius_bridge_memory_budget_bytes",
+      "Bytes the queues and register tables may hold between them", {},
+      [this] { return static_cast<double>(limit_); });
+}
+
+MemoryBudget::Account &MemoryBudget::account(const std::string &name) {
+  for (auto &a : accounts_)
+    if (a.name() == name)
+      return a;
+  return accounts_.emplace_back(*this, name);
+}
+
+std::string MemoryBudget::summary() const {
+  std::vector<const Account *> sorted;
+  for (const auto &a : accounts_)
+    sorted.push_back(&a);
+  std::sort(sorted.begin(), sorted.end(),
+            [](const Account *a, const Account *b) {
+              return a->peak() > b->peak();
+            });
+
+  std::string out = std::format("peak {} of {} KiB",
+                                kib(peak_.load(std::memory_order_relaxed)),
+                                kib(limit_));
+  for (std::size_t i = 0; i < sorted.size(); ++i)
+    out += std::format("{}{} {} KiB", i == 0 ? ": " : ", ", sorted[i]->name(),
+                       kib(sorted[i]->peak()));
+  return out;
+}
+
+// ---------------------------------------------------------------------------
+// Process memory
+// ---------------------------------------------------------------------------
+
+std::size_t peakResidentBytes() {
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024; // KiB on Linux
+}
+
+void setThreadStackSize(std::size_t bytes) {
+  pthread_attr_t attr;
+  int rc = pthread_attr_init(&attr);
+  if (rc == 0) {
+    rc = pthread_attr_setstacksize(&attr, bytes);
+    if (rc == 0)
+      rc = pthread_setattr_default_np(&attr);
+    pthread_attr_destroy(&attr);
+  }
+  if (rc != 0)
+    throw std::system_error(rc, std::generic_category(),
+                            std::format("cannot set the thread stack size "
+                                        "to {} KiB",
+                                        kib(bytes)));
+}
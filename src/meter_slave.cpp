@@ -1,23 +1,34 @@
 #include "meter_slave.h"
+#include "memory_budget.h"
 #include "meter_types.h"
+#include "metrics.h"
+#include "register_store.h"
 #include "signal_handler.h"
+#include <array>
 #include <atomic>
 #include <cerrno>
 #include <chrono>
 #include <cstring>
 #include <expected>
+#include <fcntl.h>
 #include <format>
 #include <fronius/fronius.h>
 #include <fronius/registers.h>
 #include <memory>
 #include <modbus/modbus.h>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 MeterSlave::MeterSlave(const MeterSlaveConfig &cfg, std::string meterName,
-                       SignalHandler &signalHandler)
-    : name_(std::move(meterName)), cfg_(cfg), handler_(signalHandler) {
+                       SignalHandler &signalHandler, MemoryBudget *memory)
+    : name_(std::move(meterName)), cfg_(cfg),
+      replyDuration_(Metrics::histogram(
+          "fronius_bridge_modbus_reply_duration_seconds",
+          "Time to answer one Modbus request from the meter slave",
+          {{"device", name_}})),
+      regs_(MODBUS_REGISTERS, memory ? &memory->account("slaves") : nullptr),
+      handler_(signalHandler) {
 
   // Fixed class-based logger chain: meter.slave -> meter -> default.
   // The meter name is no longer part of the logger name (it already
@@ -49,6 +60,7 @@ MeterSlave::MeterSlave(const MeterSlaveConfig &cfg, std::string meterName,
 }
 
 MeterSlave::~MeterSlave() {
+  stop_ = true;
   if (worker_.joinable())
     worker_.join();
 
@@ -63,35 +75,42 @@ MeterSlave::~MeterSlave() {
 
 std::expected<void, ModbusError> MeterSlave::startListener(void) {
 
-  // --- Create register mapping ---
-  if (!regs_.load()) {
-    regs_.store(std::shared_ptr<modbus_mapping_t>(
-        modbus_mapping_new(0, 0, MODBUS_REGISTERS, 0), ModbusDeleter{}));
-
-    if (!regs_.load()) {
-      return std::unexpected(
-          ModbusError::custom(ENOMEM, "Unable to allocate new Modbus mapping"));
-    }
-  }
+  // --- Served register blocks ---
+  // The C001 common block, the float or int+sf meter model, and the end
+  // marker. Only these spans are carried from one snapshot to the next.
+  const auto block = [](const auto &first, const auto &length, int size) {
+    const int addr = first.ADDR;
+    return RegisterStore::Span{addr, length.ADDR + 1 + size - addr};
+  };
+  const int endAddr = cfg_.useFloatModel
+                          ? M_END::ID.withOffset(M_END::FLOAT_OFFSET).ADDR
+                          : M_END::ID.ADDR;
+  regs_.serve({
+      block(C001::SID, C001::L, C001::SIZE),
+      cfg_.useFloatModel ? block(M21X::ID, M21X::L, M21X::SIZE)
+                         : block(M20X::ID, M20X::L, M20X::SIZE),
+      {endAddr, 2}, // end model ID and L
+  });
 
   // Fill mapping with static SunSpec meter model
-  auto regs = regs_.load();
-  handleResult(
-      ModbusUtils::packToModbus<uint32_t>(regs.get(), C001::SID, 0x53756e53));
-  regs->tab_registers[C001::ID.ADDR] = 1;
-  regs->tab_registers[C001::L.ADDR] = C001::SIZE;
-  regs->tab_registers[C001::DA.ADDR] = cfg_.slaveId;
-
-  if (cfg_.useFloatModel) {
-    regs->tab_registers[M21X::ID.ADDR] = 213;
-    regs->tab_registers[M21X::L.ADDR] = M21X::SIZE;
-    regs->tab_registers[M_END::ID.withOffset(M_END::FLOAT_OFFSET).ADDR] =
-        0xFFFF;
-  } else {
-    regs->tab_registers[M20X::ID.ADDR] = 203;
-    regs->tab_registers[M20X::L.ADDR] = M20X::SIZE;
-    regs->tab_registers[M_END::ID.ADDR] = 0xFFFF;
-  }
+  auto published = regs_.update([&](modbus_mapping_t *regs) {
+    handleResult(
+        ModbusUtils::packToModbus<uint32_t>(regs, C001::SID, 0x53756e53));
+    regs->tab_registers[C001::ID.ADDR] = 1;
+    regs->tab_registers[C001::L.ADDR] = C001::SIZE;
+    regs->tab_registers[C001::DA.ADDR] = cfg_.slaveId;
+
+    if (cfg_.useFloatModel) {
+      regs->tab_registers[M21X::ID.ADDR] = 213;
+      regs->tab_registers[M21X::L.ADDR] = M21X::SIZE;
+    } else {
+      regs->tab_registers[M20X::ID.ADDR] = 203;
+      regs->tab_registers[M20X::L.ADDR] = M20X::SIZE;
+    }
+    regs->tab_registers[endAddr] = 0xFFFF;
+  });
+  if (!published)
+    return std::unexpected(published.error());
 
   // Create new context based on config
   if (cfg_.tcp) {
@@ -165,234 +184,222 @@ MeterSlave::handleResult(std::expected<void, ModbusError> &&result) {
 }
 
 void MeterSlave::updateValues(MeterTypes::Values values) {
-  if (!handler_.isRunning()) {
+  if (!running()) {
     logger_->error("updateValues(): Shutdown in progress");
     return;
   }
 
-  // Snapshot current mapping
-  auto oldRegs = regs_.load();
-  if (!oldRegs) {
-    auto regsAction = handleResult(std::unexpected(ModbusError::custom(
-        ENOMEM, "updateValues(): No existing mapping to base on")));
-    return;
-  }
-
-  auto newRegs = std::shared_ptr<modbus_mapping_t>(
-      modbus_mapping_new(0, 0, MODBUS_REGISTERS, 0), ModbusDeleter{});
-  if (!newRegs) {
-    auto regsAction = handleResult(std::unexpected(ModbusError::custom(
-        ENOMEM, "updateValues(): Unable to allocate new Modbus mapping")));
-    return;
-  }
-
-  // Copy entire register block from old to new (fast)
-  std::memcpy(newRegs->tab_registers, oldRegs->tab_registers,
-              static_cast<size_t>(newRegs->nb_registers) * sizeof(uint16_t));
-
-  logger_->debug(
-      "Meter '{}' values:\n"
-      "  time              : {}\n"
-      "  energy import : P={}Wh Q={}varh S={}VAh\n"
-      "  energy export : P={}Wh Q={}varh S={}VAh\n"
-      "  phVoltage         : {} V\n"
-      "  ppVoltage         : {} V\n"
-      "  current           : {} A\n"
-      "  activePower       : {} W\n"
-      "  reactivePower     : {} var\n"
-      "  apparentPower     : {} VA\n"
-      "  powerFactor       : {}\n"
-      "  frequency         : {} Hz\n"
-      "  phase1 phV={}V ppV={}V I={}A P={}W Q={}var "
-      "S={}VA PF={}\n"
-      "  phase2 phV={}V ppV={}V I={}A P={}W Q={}var "
-      "S={}VA PF={}\n"
-      "  phase3 phV={}V ppV={}V I={}A P={}W Q={}var "
-      "S={}VA PF={}",
-      name_, values.time, values.activeEnergyImport,
-      values.reactiveEnergyImport, values.apparentEnergyImport,
-      values.activeEnergyExport, values.reactiveEnergyExport,
-      values.apparentEnergyExport, values.phVoltage, values.ppVoltage,
-      values.current, values.activePower, values.reactivePower,
-      values.apparentPower, values.powerFactor, values.frequency,
-      values.phase1.phVoltage, values.phase1.ppVoltage, values.phase1.current,
-      values.phase1.activePower, values.phase1.reactivePower,
-      values.phase1.apparentPower, values.phase1.powerFactor,
-      values.phase2.phVoltage, values.phase2.ppVoltage, values.phase2.current,
-      values.phase2.activePower, values.phase2.reactivePower,
-      values.phase2.apparentPower, values.phase2.powerFactor,
-      values.phase3.phVoltage, values.phase3.ppVoltage, values.phase3.current,
-      values.phase3.activePower, values.phase3.reactivePower,
-      values.phase3.apparentPower, values.phase3.powerFactor);
+  // Guarded, so a filtered update does not even gather the 37 arguments.
+  if (logger_->should_log(spdlog::level::debug))
+    logger_->debug(
+        "Meter '{}' values:\n"
+        "  time              : {}\n"
+        "  energy import : P={}Wh Q={}varh S={}VAh\n"
+        "  energy export : P={}Wh Q={}varh S={}VAh\n"
+        "  phVoltage         : {} V\n"
+        "  ppVoltage         : {} V\n"
+        "  current           : {} A\n"
+        "  activePower       : {} W\n"
+        "  reactivePower     : {} var\n"
+        "  apparentPower     : {} VA\n"
+        "  powerFactor       : {}\n"
+        "  frequency         : {} Hz\n"
+        "  phase1 phV={}V ppV={}V I={}A P={}W Q={}var "
+        "S={}VA PF={}\n"
+        "  phase2 phV={}V ppV={}V I={}A P={}W Q={}var "
+        "S={}VA PF={}\n"
+        "  phase3 phV={}V ppV={}V I={}A P={}W Q={}var "
+        "S={}VA PF={}",
+        name_, values.time, values.activeEnergyImport,
+        values.reactiveEnergyImport, values.apparentEnergyImport,
+        values.activeEnergyExport, values.reactiveEnergyExport,
+        values.apparentEnergyExport, values.phVoltage, values.ppVoltage,
+        values.current, values.activePower, values.reactivePower,
+        values.apparentPower, values.powerFactor, values.frequency,
+        values.phase1.phVoltage, values.phase1.ppVoltage, values.phase1.current,
+        values.phase1.activePower, values.phase1.reactivePower,
+        values.phase1.apparentPower, values.phase1.powerFactor,
+        values.phase2.phVoltage, values.phase2.ppVoltage, values.phase2.current,
+        values.phase2.activePower, values.phase2.reactivePower,
+        values.phase2.apparentPower, values.phase2.powerFactor,
+        values.phase3.phVoltage, values.phase3.ppVoltage, values.phase3.current,
+        values.phase3.activePower, values.phase3.reactivePower,
+        values.phase3.apparentPower, values.phase3.powerFactor);
+
+  // Only the value registers change; the store carries the rest over.
+  handleResult(regs_.update([this, &values](modbus_mapping_t *regs) {
+    packValues(regs, values);
+  }));
+}
 
+void MeterSlave::packValues(modbus_mapping_t *regs,
+                            const MeterTypes::Values &values) {
   if (cfg_.useFloatModel) {
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PF,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PF,
                                                   values.powerFactor));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PFPHA,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PFPHA,
                                                   values.phase1.powerFactor));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PFPHB,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PFPHB,
                                                   values.phase2.powerFactor));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PFPHC,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PFPHC,
                                                   values.phase3.powerFactor));
 
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::W,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::W,
                                                   values.activePower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::WPHA,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::WPHA,
                                                   values.phase1.activePower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::WPHB,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::WPHB,
                                                   values.phase2.activePower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::WPHC,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::WPHC,
                                                   values.phase3.activePower));
 
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::VA,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::VA,
                                                   values.apparentPower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::VAPHA,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::VAPHA,
                                                   values.phase1.apparentPower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::VAPHB,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::VAPHB,
                                                   values.phase2.apparentPower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::VAPHC,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::VAPHC,
                                                   values.phase3.apparentPower));
 
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::VAR,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::VAR,
                                                   values.reactivePower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::VARPHA,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::VARPHA,
                                                   values.phase1.reactivePower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::VARPHB,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::VARPHB,
                                                   values.phase2.reactivePower));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::VARPHC,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::VARPHC,
                                                   values.phase3.reactivePower));
 
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PHV,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PHV,
                                                   values.phVoltage));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PHVPHA,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PHVPHA,
                                                   values.phase1.phVoltage));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PHVPHB,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PHVPHB,
                                                   values.phase2.phVoltage));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PHVPHC,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PHVPHC,
                                                   values.phase3.phVoltage));
 
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PPV,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PPV,
                                                   values.ppVoltage));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PPVPHAB,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PPVPHAB,
                                                   values.phase1.ppVoltage));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PPVPHBC,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PPVPHBC,
                                                   values.phase2.ppVoltage));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::PPVPHCA,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::PPVPHCA,
                                                   values.phase3.ppVoltage));
 
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::A,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::A,
                                                   values.current));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::APHA,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::APHA,
                                                   values.phase1.current));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::APHB,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::APHB,
                                                   values.phase2.current));
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::APHC,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::APHC,
                                                   values.phase3.current));
 
     handleResult(ModbusUtils::packToModbus<float>(
-        newRegs.get(), M21X::TOT_WH_IMP, values.activeEnergyImport));
+        regs, M21X::TOT_WH_IMP, values.activeEnergyImport));
     handleResult(ModbusUtils::packToModbus<float>(
-        newRegs.get(), M21X::TOT_WH_EXP, values.activeEnergyExport));
+        regs, M21X::TOT_WH_EXP, values.activeEnergyExport));
     handleResult(ModbusUtils::packToModbus<float>(
-        newRegs.get(), M21X::TOT_VAH_IMP, values.apparentEnergyImport));
+        regs, M21X::TOT_VAH_IMP, values.apparentEnergyImport));
     handleResult(ModbusUtils::packToModbus<float>(
-        newRegs.get(), M21X::TOT_VAH_EXP, values.apparentEnergyExport));
+        regs, M21X::TOT_VAH_EXP, values.apparentEnergyExport));
 
-    handleResult(ModbusUtils::packToModbus<float>(newRegs.get(), M21X::FREQ,
+    handleResult(ModbusUtils::packToModbus<float>(regs, M21X::FREQ,
                                                   values.frequency));
 
   } else {
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::PF, M20X::PF_SF,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::PF, M20X::PF_SF,
                                            values.powerFactor, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PFPHA, M20X::PF_SF, values.phase1.powerFactor, 1));
+        regs, M20X::PFPHA, M20X::PF_SF, values.phase1.powerFactor, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PFPHB, M20X::PF_SF, values.phase2.powerFactor, 1));
+        regs, M20X::PFPHB, M20X::PF_SF, values.phase2.powerFactor, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PFPHC, M20X::PF_SF, values.phase3.powerFactor, 1));
+        regs, M20X::PFPHC, M20X::PF_SF, values.phase3.powerFactor, 1));
 
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::W, M20X::W_SF,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::W, M20X::W_SF,
                                            values.activePower, 0));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::WPHA, M20X::W_SF, values.phase1.activePower, 0));
+        regs, M20X::WPHA, M20X::W_SF, values.phase1.activePower, 0));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::WPHB, M20X::W_SF, values.phase2.activePower, 0));
+        regs, M20X::WPHB, M20X::W_SF, values.phase2.activePower, 0));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::WPHC, M20X::W_SF, values.phase3.activePower, 0));
+        regs, M20X::WPHC, M20X::W_SF, values.phase3.activePower, 0));
 
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::VA, M20X::VA_SF,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::VA, M20X::VA_SF,
                                            values.apparentPower, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::VAPHA,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::VAPHA,
                                            M20X::VA_SF,
                                            values.phase1.apparentPower, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::VAPHB,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::VAPHB,
                                            M20X::VA_SF,
                                            values.phase2.apparentPower, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::VAPHC,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::VAPHC,
                                            M20X::VA_SF,
                                            values.phase3.apparentPower, 0));
 
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::VAR, M20X::VAR_SF, values.reactivePower, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::VARPHA,
+        regs, M20X::VAR, M20X::VAR_SF, values.reactivePower, 0));
+    handleResult(ModbusUtils::packToModbus(regs, M20X::VARPHA,
                                            M20X::VAR_SF,
                                            values.phase1.reactivePower, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::VARPHB,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::VARPHB,
                                            M20X::VAR_SF,
                                            values.phase2.reactivePower, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::VARPHC,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::VARPHC,
                                            M20X::VAR_SF,
                                            values.phase3.reactivePower, 0));
 
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::PHV, M20X::V_SF,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::PHV, M20X::V_SF,
                                            values.phVoltage, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PHVPHA, M20X::V_SF, values.phase1.phVoltage, 1));
+        regs, M20X::PHVPHA, M20X::V_SF, values.phase1.phVoltage, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PHVPHB, M20X::V_SF, values.phase2.phVoltage, 1));
+        regs, M20X::PHVPHB, M20X::V_SF, values.phase2.phVoltage, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PHVPHC, M20X::V_SF, values.phase3.phVoltage, 1));
+        regs, M20X::PHVPHC, M20X::V_SF, values.phase3.phVoltage, 1));
 
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::PPV, M20X::V_SF,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::PPV, M20X::V_SF,
                                            values.ppVoltage, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PPVPHAB, M20X::V_SF, values.phase1.ppVoltage, 1));
+        regs, M20X::PPVPHAB, M20X::V_SF, values.phase1.ppVoltage, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PPVPHBC, M20X::V_SF, values.phase2.ppVoltage, 1));
+        regs, M20X::PPVPHBC, M20X::V_SF, values.phase2.ppVoltage, 1));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::PPVPHCA, M20X::V_SF, values.phase3.ppVoltage, 1));
+        regs, M20X::PPVPHCA, M20X::V_SF, values.phase3.ppVoltage, 1));
 
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::A, M20X::A_SF,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::A, M20X::A_SF,
                                            values.current, 3));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::APHA, M20X::A_SF, values.phase1.current, 3));
+        regs, M20X::APHA, M20X::A_SF, values.phase1.current, 3));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::APHB, M20X::A_SF, values.phase2.current, 3));
+        regs, M20X::APHB, M20X::A_SF, values.phase2.current, 3));
     handleResult(ModbusUtils::packToModbus(
-        newRegs.get(), M20X::APHC, M20X::A_SF, values.phase3.current, 3));
+        regs, M20X::APHC, M20X::A_SF, values.phase3.current, 3));
 
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::TOT_WH_IMP,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::TOT_WH_IMP,
                                            M20X::TOT_WH_SF,
                                            values.activeEnergyImport, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::TOT_WH_EXP,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::TOT_WH_EXP,
                                            M20X::TOT_WH_SF,
                                            values.activeEnergyExport, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::TOT_VAH_IMP,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::TOT_VAH_IMP,
                                            M20X::TOT_VAH_SF,
                                            values.apparentEnergyImport, 0));
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::TOT_VAH_EXP,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::TOT_VAH_EXP,
                                            M20X::TOT_VAH_SF,
                                            values.apparentEnergyExport, 0));
 
-    handleResult(ModbusUtils::packToModbus(newRegs.get(), M20X::FREQ,
+    handleResult(ModbusUtils::packToModbus(regs, M20X::FREQ,
                                            M20X::FREQ_SF, values.frequency, 1));
   }
-
-  regs_.store(newRegs);
 }
 
 void MeterSlave::updateDevice(MeterTypes::Device device) {
-  if (!handler_.isRunning()) {
+  if (!running()) {
     logger_->error("updateDevice(): Shutdown in progress");
     return;
   }
@@ -400,146 +407,221 @@ void MeterSlave::updateDevice(MeterTypes::Device device) {
   if (deviceUpdated_)
     return;
 
-  // Snapshot current mapping
-  auto oldRegs = regs_.load();
-  if (!oldRegs) {
-    auto regsAction = handleResult(std::unexpected(ModbusError::custom(
-        ENOMEM, "updateValues(): No existing mapping to base on")));
+  auto published = regs_.update([this, &device](modbus_mapping_t *regs) {
+    packDevice(regs, device);
+  });
+  if (!published) {
+    handleResult(std::move(published));
     return;
   }
+  deviceUpdated_ = true;
+}
 
-  auto newRegs = std::shared_ptr<modbus_mapping_t>(
-      modbus_mapping_new(0, 0, MODBUS_REGISTERS, 0), ModbusDeleter{});
-  if (!newRegs) {
-    auto regsAction = handleResult(std::unexpected(ModbusError::custom(
-        ENOMEM, "updateValues(): Unable to allocate new Modbus mapping")));
-    return;
-  }
-
-  // Copy entire register block from old to new (fast)
-  std::memcpy(newRegs->tab_registers, oldRegs->tab_registers,
-              static_cast<size_t>(MODBUS_REGISTERS) * sizeof(uint16_t));
-
-  handleResult(ModbusUtils::packToModbus<std::string>(newRegs.get(), C001::MN,
+void MeterSlave::packDevice(modbus_mapping_t *regs,
+                            const MeterTypes::Device &device) {
+  handleResult(ModbusUtils::packToModbus<std::string>(regs, C001::MN,
                                                       device.manufacturer));
-  handleResult(ModbusUtils::packToModbus<std::string>(newRegs.get(), C001::MD,
+  handleResult(ModbusUtils::packToModbus<std::string>(regs, C001::MD,
                                                       device.model));
-  handleResult(ModbusUtils::packToModbus<std::string>(newRegs.get(), C001::OPT,
+  handleResult(ModbusUtils::packToModbus<std::string>(regs, C001::OPT,
                                                       device.options));
-  handleResult(ModbusUtils::packToModbus<std::string>(newRegs.get(), C001::VR,
+  handleResult(ModbusUtils::packToModbus<std::string>(regs, C001::VR,
                                                       device.fwVersion));
-  handleResult(ModbusUtils::packToModbus<std::string>(newRegs.get(), C001::SN,
+  handleResult(ModbusUtils::packToModbus<std::string>(regs, C001::SN,
                                                       device.serialNumber));
-
-  regs_.store(newRegs);
-  deviceUpdated_ = true;
 }
 
-void MeterSlave::tcpClientWorker(int socket) {
-
-  modbus_t *ctx = modbus_new_tcp(nullptr, 0);
-  if (!ctx) {
-    close(socket);
-    auto ctxAction = handleResult(std::unexpected(ModbusError::custom(
-        ENOMEM, "tcpClientWorker(): Unable to create client context")));
-    return;
-  }
-  modbus_set_socket(ctx, socket);
-
-  // Set slave/unit ID
-  if (modbus_set_slave(ctx, cfg_.slaveId) == -1) {
+MeterSlave::TcpClient::~TcpClient() {
+  // modbus_close() closes the socket, which also drops it from the epoll set.
+  if (ctx) {
     modbus_close(ctx);
     modbus_free(ctx);
+  } else if (socket != -1) {
     close(socket);
-    auto slaveAction = handleResult(std::unexpected(ModbusError::fromErrno(
-        "tcpClientWorker(): Setting slave id '{}' failed", cfg_.slaveId)));
-    return;
   }
+}
 
-  // Set request timeout - controls how long modbus_receive() waits per call
-  modbus_set_indication_timeout(ctx, cfg_.requestTimeout, 0);
-
-  // Set libmodbus debug - enable only if logger is at trace level
-  if (logger_->level() == spdlog::level::trace) {
-    if (modbus_set_debug(ctx, true) == -1) {
-      logger_->warn("tcpClientWorker(): Unable to set debug flag");
+void MeterSlave::acceptClients(int epollFd) {
+  for (;;) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int clientSocket = accept4(serverSocket_, (struct sockaddr *)&addr,
+                               &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (clientSocket < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        logger_->warn("acceptClients(): accept failed: {}", strerror(errno));
+      return;
     }
-  }
 
-  // Extract client connection information (IPv4 and IPv6 compatible)
-  auto client = ModbusUtils::getSocketInfo(socket);
-  logger_->info("Meter '{}' client connected from {}:{}", name_, client.ip,
-                client.port);
+    auto client = std::make_unique<TcpClient>();
+    client->socket = clientSocket;
 
-  uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+    // Extract client connection information (IPv4 and IPv6 compatible)
+    auto info = ModbusUtils::getSocketInfo(clientSocket);
+    client->peer = std::format("{}:{}", info.ip, info.port);
 
-  // Track last activity time for idle timeout
-  auto lastActivity = std::chrono::steady_clock::now();
-  auto idleTimeout = std::chrono::seconds(cfg_.idleTimeout);
+    if (clients_.size() >= static_cast<size_t>(cfg_.tcp->maxConnections)) {
+      logger_->warn("Meter '{}' rejected client {}: max_connections ({}) "
+                    "reached",
+                    name_, client->peer, cfg_.tcp->maxConnections);
+      continue;
+    }
 
-  while (handler_.isRunning()) {
-    int rc = modbus_receive(ctx, query);
+    client->ctx = modbus_new_tcp(nullptr, 0);
+    if (!client->ctx) {
+      auto ctxAction = handleResult(std::unexpected(ModbusError::custom(
+          ENOMEM, "acceptClients(): Unable to create client context")));
+      continue;
+    }
+    modbus_set_socket(client->ctx, clientSocket);
 
-    if (rc > 0) {
-      // Valid request received - update activity timestamp
-      lastActivity = std::chrono::steady_clock::now();
+    // Set slave/unit ID
+    if (modbus_set_slave(client->ctx, cfg_.slaveId) == -1) {
+      auto slaveAction = handleResult(std::unexpected(ModbusError::fromErrno(
+          "acceptClients(): Setting slave id '{}' failed", cfg_.slaveId)));
+      continue;
+    }
 
-      auto regs = regs_.load();
-      if (!regs) {
-        auto regsAction = handleResult(std::unexpected(ModbusError::custom(
-            ENOMEM, "tcpClientWorker(): no Modbus mapping available")));
-        break;
+    // Set libmodbus debug - enable only if logger is at trace level
+    if (logger_->level() == spdlog::level::trace) {
+      if (modbus_set_debug(client->ctx, true) == -1) {
+        logger_->warn("acceptClients(): Unable to set debug flag");
       }
+    }
 
-      auto replyStart = std::chrono::steady_clock::now();
-      if (modbus_reply(ctx, query, rc, regs.get()) == -1) {
-        logger_->warn("tcpClientWorker(): Modbus reply failed: {}",
-                      modbus_strerror(errno));
-        break;
-      }
-      if (logger_->level() == spdlog::level::trace) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-            std::chrono::steady_clock::now() - replyStart);
-        logger_->trace("modbus_reply took {} µs", elapsed.count());
-      }
+    struct epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = client.get();
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &ev) == -1) {
+      logger_->warn("acceptClients(): epoll_ctl failed: {}", strerror(errno));
       continue;
     }
 
-    // --- Empty frame (connection closed by client gracefully) ---
-    if (rc == 0) {
-      logger_->info("Meter '{}' client {}:{} closed connection", name_,
-                    client.ip, client.port);
-      break;
+    client->lastActivity = std::chrono::steady_clock::now();
+    logger_->info("Meter '{}' client connected from {}", name_, client->peer);
+    clients_.emplace(clientSocket, std::move(client));
+  }
+}
+
+bool MeterSlave::serviceClient(TcpClient &client, uint32_t events) {
+  if (events & EPOLLERR) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(client.socket, SOL_SOCKET, SO_ERROR, &err, &len);
+    logger_->info("Meter '{}' client {} disconnected: {}", name_, client.peer,
+                  strerror(err));
+    return false;
+  }
+
+  // One read per wakeup: epoll is level-triggered, so a client with more
+  // pending keeps being reported without starving the others.
+  ssize_t rc = recv(client.socket, client.frame.data() + client.frameLen,
+                    client.frame.size() - client.frameLen, 0);
+
+  // --- Empty read (connection closed by client gracefully) ---
+  if (rc == 0) {
+    logger_->info("Meter '{}' client {} closed connection", name_,
+                  client.peer);
+    return false;
+  }
+
+  if (rc < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return true;
+    // Connection issue or abrupt disconnection
+    logger_->info("Meter '{}' client {} disconnected: {}", name_, client.peer,
+                  strerror(errno));
+    return false;
+  }
+
+  if (client.frameLen == 0)
+    client.frameStart = std::chrono::steady_clock::now();
+  client.frameLen += static_cast<size_t>(rc);
+
+  return replyToFrames(client);
+}
+
+bool MeterSlave::replyToFrames(TcpClient &client) {
+  // MBAP header: transaction id (2), protocol id (2), length (2), unit id (1).
+  // `length` counts the unit id and the PDU that follows it.
+  constexpr size_t mbapLength = 7;
+
+  size_t pos = 0;
+  while (client.frameLen - pos >= mbapLength) {
+    const uint8_t *adu = client.frame.data() + pos;
+    const unsigned protocol = (adu[2] << 8) | adu[3];
+    const size_t length = (adu[4] << 8) | adu[5];
+    if (protocol != 0 || length < 2 ||
+        length > MODBUS_TCP_MAX_ADU_LENGTH - (mbapLength - 1)) {
+      logger_->info("Meter '{}' client {} sent a malformed MBAP header, "
+                    "disconnecting",
+                    name_, client.peer);
+      return false;
     }
 
-    // --- Error (rc == -1) ---
+    const size_t aduLength = mbapLength - 1 + length;
+    if (client.frameLen - pos < aduLength)
+      break; // wait for the rest of the frame
 
-    // Timeout errors - check if idle timeout exceeded
-    if (errno == ETIMEDOUT || errno == EAGAIN || errno == EWOULDBLOCK) {
-      auto now = std::chrono::steady_clock::now();
-      if (now - lastActivity > idleTimeout) {
-        logger_->info("Meter '{}' client {}:{} idle timeout ({}s), "
-                      "disconnecting",
-                      name_, client.ip, client.port, cfg_.idleTimeout);
-        break;
-      }
-      continue;
+    auto regs = regs_.current();
+    if (!regs) {
+      auto regsAction = handleResult(std::unexpected(ModbusError::custom(
+          ENOMEM, "replyToFrames(): no Modbus mapping available")));
+      return false;
     }
 
-    // Interrupted by signal - check shutdown flag
-    if (errno == EINTR) {
-      continue; // isRunning() checked at loop start
+    auto replyStart = std::chrono::steady_clock::now();
+    if (modbus_reply(client.ctx, adu, static_cast<int>(aduLength),
+                     regs.get()) == -1) {
+      logger_->warn("replyToFrames(): Modbus reply failed: {}",
+                    modbus_strerror(errno));
+      return false;
+    }
+    const auto replyTime = std::chrono::steady_clock::now() - replyStart;
+    replyDuration_.observe(replyTime);
+    if (logger_->should_log(spdlog::level::trace)) {
+      auto elapsed =
+          std::chrono::duration_cast<std::chrono::microseconds>(replyTime);
+      logger_->trace("modbus_reply took {} µs", elapsed.count());
     }
 
-    // Connection issue, protocol error or abrupt disconnection
-    logger_->info("Meter '{}' client {}:{} disconnected: {}", name_, client.ip,
-                  client.port, modbus_strerror(errno));
-    break;
+    // Valid request answered - update activity timestamp
+    client.lastActivity = replyStart;
+    pos += aduLength;
   }
 
-  modbus_close(ctx);
-  modbus_free(ctx);
-  close(socket);
+  // Keep a trailing partial frame at the front of the buffer.
+  if (pos > 0) {
+    std::memmove(client.frame.data(), client.frame.data() + pos,
+                 client.frameLen - pos);
+    client.frameLen -= pos;
+    client.frameStart = std::chrono::steady_clock::now();
+  }
+  return true;
+}
+
+void MeterSlave::expireClients(void) {
+  const auto now = std::chrono::steady_clock::now();
+  const auto idleTimeout = std::chrono::seconds(cfg_.idleTimeout);
+  const auto requestTimeout = std::chrono::seconds(cfg_.requestTimeout);
+
+  std::erase_if(clients_, [&](const auto &entry) {
+    const TcpClient &client = *entry.second;
+    if (now - client.lastActivity > idleTimeout) {
+      logger_->info("Meter '{}' client {} idle timeout ({}s), disconnecting",
+                    name_, client.peer, cfg_.idleTimeout);
+      return true;
+    }
+    if (client.frameLen > 0 && now - client.frameStart > requestTimeout) {
+      logger_->info("Meter '{}' client {} request timeout ({}s), "
+                    "disconnecting",
+                    name_, client.peer, cfg_.requestTimeout);
+      return true;
+    }
+    return false;
+  });
 }
 
 void MeterSlave::rtuClientHandler() {
@@ -570,7 +652,7 @@ void MeterSlave::rtuClientHandler() {
   auto idleTimeout = std::chrono::seconds(cfg_.idleTimeout);
   bool isActive = false;
 
-  while (handler_.isRunning()) {
+  while (running()) {
     int rc = modbus_receive(listenCtx_, query);
 
     // --- Valid request received ---
@@ -584,16 +666,19 @@ void MeterSlave::rtuClientHandler() {
       }
       lastActivity = std::chrono::steady_clock::now();
 
-      auto regs = regs_.load();
+      auto regs = regs_.current();
       if (!regs) {
         auto regsAction = handleResult(std::unexpected(ModbusError::custom(
             ENOMEM, "rtuClientWorker(): no Modbus mapping available")));
         break;
       }
 
+      const auto replyStart = std::chrono::steady_clock::now();
       if (modbus_reply(listenCtx_, query, rc, regs.get()) == -1) {
         logger_->warn("rtuClientHandler(): reply failed: {}",
                       modbus_strerror(errno));
+      } else {
+        replyDuration_.observeSince(replyStart);
       }
       continue;
     }
@@ -619,7 +704,7 @@ void MeterSlave::rtuClientHandler() {
 
     // Interrupted by signal - check shutdown flag
     if (errno == EINTR) {
-      continue; // isRunning() checked at loop start
+      continue; // running() checked at loop start
     }
 
     // Fatal serial errors - cannot recover
@@ -645,14 +730,41 @@ void MeterSlave::tcpClientHandler(void) {
     return;
   }
 
-  struct pollfd pfd;
-  pfd.fd = serverSocket_;
-  pfd.events = POLLIN;
+  // The listener and every client socket are non-blocking and live in one
+  // epoll set; this thread is the only one that touches them.
+  int flags = fcntl(serverSocket_, F_GETFL, 0);
+  if (flags == -1 || fcntl(serverSocket_, F_SETFL, flags | O_NONBLOCK) == -1) {
+    auto fcntlAction = handleResult(std::unexpected(ModbusError::fromErrno(
+        "tcpClientHandler(): unable to make server socket non-blocking")));
+    return;
+  }
 
-  while (handler_.isRunning()) {
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd == -1) {
+    auto epollAction = handleResult(std::unexpected(
+        ModbusError::fromErrno("tcpClientHandler(): epoll_create1 failed")));
+    return;
+  }
 
-    // Use timeout to allow periodic checking of isRunning()
-    int ret = poll(&pfd, 1, 500);
+  // The listener is registered with a null data.ptr; clients carry theirs.
+  struct epoll_event listenEv{};
+  listenEv.events = EPOLLIN;
+  listenEv.data.ptr = nullptr;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket_, &listenEv) == -1) {
+    close(epollFd);
+    auto epollAction = handleResult(std::unexpected(
+        ModbusError::fromErrno("tcpClientHandler(): epoll_ctl failed")));
+    return;
+  }
+
+  std::array<struct epoll_event, 32> events;
+
+  while (running()) {
+
+    // Use timeout to allow periodic checking of running() and the client
+    // idle/request timeouts
+    int ret = epoll_wait(epollFd, events.data(),
+                         static_cast<int>(events.size()), 500);
 
     if (ret < 0) {
       if (errno == EINTR) {
@@ -660,61 +772,44 @@ void MeterSlave::tcpClientHandler(void) {
         continue;
       }
       auto pollAction = handleResult(std::unexpected(
-          ModbusError::fromErrno("tcpClientHandler(): poll failed")));
+          ModbusError::fromErrno("tcpClientHandler(): epoll_wait failed")));
       break;
-    } else if (ret == 0) {
-      // Timeout - loop back and check isRunning()
-      continue;
     }
 
-    // Check for incoming connection
-    if (pfd.revents & POLLIN) {
-      struct sockaddr_storage addr;
-      socklen_t addrlen = sizeof(addr);
-      int clientSocket =
-          accept(serverSocket_, (struct sockaddr *)&addr, &addrlen);
-
-      if (clientSocket < 0) {
-        if (errno == EINTR) {
-          // Interrupted - check if we should continue
-          if (!handler_.isRunning())
-            break;
+    bool listenerFailed = false;
+    for (int i = 0; i < ret; ++i) {
+      const struct epoll_event &ev = events[i];
+
+      if (!ev.data.ptr) {
+        // Check for socket errors
+        if (ev.events & (EPOLLERR | EPOLLHUP)) {
+          listenerFailed = true;
           continue;
         }
-        logger_->warn("tcpClientHandler(): accept failed: {}", strerror(errno));
+        acceptClients(epollFd);
         continue;
       }
 
-      // spawn a thread to handle the client
-      {
-        std::lock_guard<std::mutex> lock(clientMutex_);
-        clientThreads_.emplace_back(
-            [clientSocket, this]() { tcpClientWorker(clientSocket); });
-      }
+      auto *client = static_cast<TcpClient *>(ev.data.ptr);
+      if (!serviceClient(*client, ev.events))
+        clients_.erase(client->socket);
     }
 
-    // Check for socket errors
-    if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    if (listenerFailed) {
       auto pfdAction = handleResult(std::unexpected(
           ModbusError::custom(EIO, "tcpClientHandler(): server socket error")));
       break;
     }
+
+    expireClients();
   }
 
-  // Shutdown: close server socket to unblock any pending accepts
+  // Shutdown: drop every client, then stop the listener
+  clients_.clear();
+  close(epollFd);
   if (serverSocket_ != -1) {
     shutdown(serverSocket_, SHUT_RDWR);
   }
 
-  // Join all client threads
-  {
-    std::lock_guard<std::mutex> lock(clientMutex_);
-    for (auto &t : clientThreads_) {
-      if (t.joinable())
-        t.join();
-    }
-    clientThreads_.clear();
-  }
-
   logger_->debug("Modbus TCP slave run loop stopped");
 }
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using Metrics::Counter;
+using Metrics::Histogram;
+using Metrics::Labels;
+using Metrics::Type;
+
+// One labelled series of a family. Exactly one of counter, histogram or read
+// is set; a callback series also carries the id its Registration removes it
+// by.
+struct Series {
+  Labels labels;
+  std::unique_ptr<Counter> counter;
+  std::unique_ptr<Histogram> histogram;
+  std::function<double()> read;
+  std::uint64_t callbackId{0};
+};
+
+struct Family {
+  Type type;
+  std::string help;
+  std::vector<Series> series;
+};
+
+// Families by name, so a scrape lists them in a stable order.
+struct Registry {
+  std::mutex mutex;
+  std::map<std::string, Family> families;
+  std::uint64_t nextCallbackId{1};
+};
+
+Registry &registry() {
+  static Registry instance;
+  return instance;
+}
+
+// The family `name`, created with `type` on first use. Called under the
+// registry mutex.
+Family &family(Registry &reg, const std::string &name, const std::string &help,
+               Type type) {
+  auto [it, inserted] = reg.families.try_emplace(name, Family{type, help, {}});
+  if (!inserted && it->second.type != type)
+    throw std::logic_error("metric '" + name +
+                           "' is already registered with another type");
+  return it->second;
+}
+
+const char *typeName(Type type) {
+  switch (type) {
+  case Type::Counter:
+    return "counter";
+  case Type::Gauge:
+    return "gauge";
+  case Type::Histogram:
+    return "histogram";
+  }
+  return "untyped";
+}
+
+// Append `value` with '\' and newline escaped, plus '"' inside label values.
+void appendEscaped(std::string &out, std::string_view value, bool quote) {
+  for (char c : value) {
+    if (c == '\\')
+      out += "\\\\";
+    else if (c == '\n')
+      out += "\\n";
+    else if (quote && c == '"')
+      out += "\\\"";
+    else
+      out += c;
+  }
+}
+
+// Append `{a="x",b="y"}`, with an extra le label for histogram buckets.
+// Nothing at all for an empty set.
+void appendLabels(std::string &out, const Labels &labels,
+                  std::string_view le = {}) {
+  if (labels.empty() && le.empty())
+    return;
+  out += '{';
+  bool first = true;
+  for (const auto &[key, value] : labels) {
+    if (!first)
+      out += ',';
+    first = false;
+    out += key;
+    out += "=\"";
+    appendEscaped(out, value, true);
+    out += '"';
+  }
+  if (!le.empty()) {
+    if (!first)
+      out += ',';
+    out += "le=\"";
+    out += le;
+    out += '"';
+  }
+  out += '}';
+}
+
+void appendSample(std::string &out, std::string_view name,
+                  std::string_view suffix, const Labels &labels, double value,
+                  std::string_view le = {}) {
+  out += name;
+  out += suffix;
+  appendLabels(out, labels, le);
+  out += ' ';
+  out += std::format("{}", value);
+  out += '\n';
+}
+
+void appendHistogram(std::string &out, std::string_view name,
+                     const Labels &labels, const Histogram &h) {
+  const auto snap = h.snapshot();
+  std::uint64_t cumulative = 0;
+  for (std::size_t i = 0; i < Histogram::boundsNs.size(); ++i) {
+    cumulative += snap.buckets[i];
+    const double bound = static_cast<double>(Histogram::boundsNs[i]) / 1e9;
+    appendSample(out, name, "_bucket", labels,
+                 static_cast<double>(cumulative), std::format("{}", bound));
+  }
+  appendSample(out, name, "_bucket", labels, static_cast<double>(snap.count),
+               "+Inf");
+  appendSample(out, name, "_sum", labels, snap.sumSeconds);
+  appendSample(out, name, "_count", labels, static_cast<double>(snap.count));
+}
+
+} // namespace
+
+namespace Metrics {
+
+std::size_t shardIndex() noexcept {
+  static std::atomic<std::size_t> next{0};
+  thread_local const std::size_t index =
+      next.fetch_add(1, std::memory_order_relaxed) % shardCount;
+  return index;
+}
+
+std::uint64_t Counter::value() const noexcept {
+  std::uint64_t sum = 0;
+  for (const auto &s : shards_)
+    sum += s.value.load(std::memory_order_relaxed);
+  return sum;
+}
+
+void Histogram::observe(std::chrono::nanoseconds d) noexcept {
+  const std::int64_t ns = std::max<std::int64_t>(d.count(), 0);
+  const auto bucket = static_cast<std::size_t>(
+      std::lower_bound(boundsNs.begin(), boundsNs.end(), ns) -
+      boundsNs.begin());
+  Shard &s = shards_[shardIndex()];
+  s.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  s.sumNs.fetch_add(static_cast<std::uint64_t>(ns), std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const noexcept {
+  Snapshot snap;
+  std::uint64_t sumNs = 0;
+  for (const auto &s : shards_) {
+    for (std::size_t i = 0; i < bucketCount; ++i)
+      snap.buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+    sumNs += s.sumNs.load(std::memory_order_relaxed);
+  }
+  for (auto b : snap.buckets)
+    snap.count += b;
+  snap.sumSeconds = static_cast<double>(sumNs) / 1e9;
+  return snap;
+}
+
+void Registration::reset() noexcept {
+  if (id_ == 0)
+    return;
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  for (auto &[name, fam] : reg.families)
+    std::erase_if(fam.series,
+                  [this](const Series &s) { return s.callbackId == id_; });
+  id_ = 0;
+}
+
+Counter &counter(const std::string &name, const std::string &help,
+                 const Labels &labels) {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  Family &fam = family(reg, name, help, Type::Counter);
+  for (auto &s : fam.series)
+    if (s.counter && s.labels == labels)
+      return *s.counter;
+  Series &s = fam.series.emplace_back();
+  s.labels = labels;
+  s.counter = std::make_unique<Counter>();
+  return *s.counter;
+}
+
+Histogram &histogram(const std::string &name, const std::string &help,
+                     const Labels &labels) {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  Family &fam = family(reg, name, help, Type::Histogram);
+  for (auto &s : fam.series)
+    if (s.histogram && s.labels == labels)
+      return *s.histogram;
+  Series &s = fam.series.emplace_back();
+  s.labels = labels;
+  s.histogram = std::make_unique<Histogram>();
+  return *s.histogram;
+}
+
+Registration callback(Type type, const std::string &name,
+                      const std::string &help, const Labels &labels,
+                      std::function<double()> read) {
+  if (type == Type::Histogram)
+    throw std::logic_error("metric '" + name +
+                           "': histograms cannot be exported by callback");
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  Family &fam = family(reg, name, help, type);
+  Series &s = fam.series.emplace_back();
+  s.labels = labels;
+  s.read = std::move(read);
+  s.callbackId = reg.nextCallbackId++;
+  return Registration{s.callbackId};
+}
+
+std::string render() {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+
+  std::string out;
+  for (const auto &[name, fam] : reg.families) {
+    if (fam.series.empty())
+      continue;
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    appendEscaped(out, fam.help, false);
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += typeName(fam.type);
+    out += '\n';
+
+    for (const auto &s : fam.series) {
+      if (s.histogram)
+        appendHistogram(out, name, s.labels, *s.histogram);
+      else if (s.counter)
+        appendSample(out, name, "", s.labels,
+                     static_cast<double>(s.counter->value()));
+      else if (s.read)
+        appendSample(out, name, "", s.labels, s.read());
+    }
+  }
+  return out;
+}
+
+} // namespace Metrics
@@ -0,0 +1,161 @@
+#include "metrics_server.h"
+#include "metrics.h"
+#include "signal_handler.h"
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <netdb.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+// How long a client may take to send its request header.
+constexpr int requestTimeoutSec = 5;
+
+// Largest request header read; a scrape request is a few hundred bytes.
+constexpr std::size_t maxRequestSize = 8192;
+
+// Write all of `data`, giving up on the first error.
+void sendAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return;
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+}
+
+void respond(int fd, std::string_view status, std::string_view contentType,
+             std::string_view body) {
+  sendAll(fd, std::format("HTTP/1.1 {}\r\n"
+                          "Content-Type: {}\r\n"
+                          "Content-Length: {}\r\n"
+                          "Connection: close\r\n"
+                          "\r\n",
+                          status, contentType, body.size()));
+  sendAll(fd, body);
+}
+
+} // namespace
+
+MetricsServer::MetricsServer(const MetricsConfig &cfg,
+                             SignalHandler &signalHandler)
+    : cfg_(cfg), handler_(signalHandler) {
+  logger_ = spdlog::get("main");
+  if (!logger_)
+    logger_ = spdlog::default_logger();
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+  addrinfo *res = nullptr;
+  const std::string port = std::to_string(cfg_.port);
+  if (int rc = getaddrinfo(cfg_.listen.c_str(), port.c_str(), &hints, &res);
+      rc != 0)
+    throw std::runtime_error(std::format("metrics: cannot resolve '{}': {}",
+                                         cfg_.listen, gai_strerror(rc)));
+
+  int err = 0;
+  for (addrinfo *ai = res; ai && listenSocket_ == -1; ai = ai->ai_next) {
+    int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                      ai->ai_protocol);
+    if (fd == -1) {
+      err = errno;
+      continue;
+    }
+    const int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == -1 ||
+        ::listen(fd, 8) == -1) {
+      err = errno;
+      close(fd);
+      continue;
+    }
+    listenSocket_ = fd;
+  }
+  freeaddrinfo(res);
+
+  if (listenSocket_ == -1)
+    throw std::runtime_error(std::format("metrics: cannot listen on {}:{}: {}",
+                                         cfg_.listen, cfg_.port,
+                                         std::strerror(err)));
+
+  logger_->info("Metrics endpoint listening on {}:{}/metrics", cfg_.listen,
+                cfg_.port);
+  worker_ = std::thread(&MetricsServer::run, this);
+}
+
+MetricsServer::~MetricsServer() {
+  if (worker_.joinable())
+    worker_.join();
+  if (listenSocket_ != -1)
+    close(listenSocket_);
+}
+
+void MetricsServer::run() {
+  while (handler_.isRunning()) {
+    pollfd pfd{.fd = listenSocket_, .events = POLLIN, .revents = 0};
+    const int rc = ::poll(&pfd, 1, 500);
+    if (rc == 0 || (rc < 0 && errno == EINTR))
+      continue;
+    if (rc < 0) {
+      logger_->warn("Metrics endpoint poll failed: {}", std::strerror(errno));
+      continue;
+    }
+
+    const int client = ::accept4(listenSocket_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client == -1) {
+      if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED)
+        logger_->warn("Metrics endpoint accept failed: {}",
+                      std::strerror(errno));
+      continue;
+    }
+    serve(client);
+    close(client);
+  }
+}
+
+void MetricsServer::serve(int client) {
+  timeval tv{.tv_sec = requestTimeoutSec, .tv_usec = 0};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  // Only the request line matters, but read up to the end of the header so
+  // the client is not reset while it is still sending it.
+  std::string request;
+  char buf[1024];
+  while (request.size() < maxRequestSize &&
+         request.find("\r\n\r\n") == std::string::npos) {
+    const ssize_t n = ::recv(client, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    request.append(buf, static_cast<std::size_t>(n));
+  }
+
+  const std::string_view line =
+      std::string_view(request).substr(0, request.find("\r\n"));
+  const bool scrape = line.starts_with("GET /metrics ") ||
+                      line.starts_with("GET /metrics?") ||
+                      line == "GET /metrics";
+  if (!scrape) {
+    logger_->debug("Metrics endpoint: rejected request '{}'", line);
+    respond(client, "404 Not Found", "text/plain; charset=utf-8",
+            "Not Found\n");
+    return;
+  }
+
+  respond(client, "200 OK", "text/plain; version=0.0.4; charset=utf-8",
+          Metrics::render());
+}
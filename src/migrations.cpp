@@ -48,6 +48,10 @@ constexpr char inverter004[] = {
 #embed "db/inverter/004_retention.sql"
     , 0};
 
+constexpr char inverter005[] = {
+#embed "db/inverter/005_edge_agg.sql"
+    , 0};
+
 constexpr char meter003[] = {
 #embed "db/meter/003_power_agg.sql"
     , 0};
@@ -56,6 +60,10 @@ constexpr char meter004[] = {
 #embed "db/meter/004_retention.sql"
     , 0};
 
+constexpr char meter005[] = {
+#embed "db/meter/005_edge_agg.sql"
+    , 0};
+
 constexpr char public001[] = {
 #embed "db/public/001_registry.sql"
     , 0};
@@ -72,6 +80,14 @@ constexpr char public004[] = {
 #embed "db/public/004_site_location.sql"
     , 0};
 
+constexpr char public005[] = {
+#embed "db/public/005_site_energy_live.sql"
+    , 0};
+
+constexpr char public006[] = {
+#embed "db/public/006_site_snapshot.sql"
+    , 0};
+
 constexpr std::array inverterArray = {
     Migration{1, "initial",
               std::string_view{inverter001, sizeof(inverter001) - 1}},
@@ -81,6 +97,8 @@ constexpr std::array inverterArray = {
               std::string_view{inverter003, sizeof(inverter003) - 1}},
     Migration{4, "retention",
               std::string_view{inverter004, sizeof(inverter004) - 1}},
+    Migration{5, "edge_agg",
+              std::string_view{inverter005, sizeof(inverter005) - 1}},
 };
 
 constexpr std::array meterArray = {
@@ -88,6 +106,7 @@ constexpr std::array meterArray = {
     Migration{2, "rollup", std::string_view{meter002, sizeof(meter002) - 1}},
     Migration{3, "power_agg", std::string_view{meter003, sizeof(meter003) - 1}},
     Migration{4, "retention", std::string_view{meter004, sizeof(meter004) - 1}},
+    Migration{5, "edge_agg", std::string_view{meter005, sizeof(meter005) - 1}},
 };
 
 constexpr std::array publicArray = {
@@ -99,6 +118,10 @@ constexpr std::array publicArray = {
               std::string_view{public003, sizeof(public003) - 1}},
     Migration{4, "site_location",
               std::string_view{public004, sizeof(public004) - 1}},
+    Migration{5, "site_energy_live",
+              std::string_view{public005, sizeof(public005) - 1}},
+    Migration{6, "site_snapshot",
+              std::string_view{public006, sizeof(public006) - 1}},
 };
 
 } // namespace
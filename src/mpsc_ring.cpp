@@ -0,0 +1,54 @@
+#include "mpsc_ring.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+
+Wakeup::Wakeup() : fd_(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+  if (fd_ < 0)
+    throw std::system_error(errno, std::generic_category(), "eventfd");
+}
+
+Wakeup::~Wakeup() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+void Wakeup::notify() noexcept {
+  // Pairs with the fence in waitUntil(): the caller's change is ordered
+  // before the look at sleeping_.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!sleeping_.load(std::memory_order_relaxed))
+    return;
+  const std::uint64_t one = 1;
+  // EAGAIN means the counter is already non-zero: a wake is pending anyway.
+  [[maybe_unused]] const auto n = ::write(fd_, &one, sizeof one);
+}
+
+bool Wakeup::block(std::optional<Clock::time_point> deadline) {
+  int timeoutMs = -1;
+  if (deadline) {
+    const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+        *deadline - Clock::now());
+    if (left.count() <= 0)
+      return false;
+    timeoutMs = static_cast<int>(
+        std::min<std::chrono::milliseconds::rep>(left.count(), INT32_MAX));
+  }
+
+  pollfd pfd{.fd = fd_, .events = POLLIN, .revents = 0};
+  const int rc = ::poll(&pfd, 1, timeoutMs);
+  if (rc <= 0)
+    return rc < 0 && errno == EINTR; // EINTR: re-check like a wake
+
+  // Reset the counter so the next sleep blocks again.
+  std::uint64_t count = 0;
+  [[maybe_unused]] const auto n = ::read(fd_, &count, sizeof count);
+  return true;
+}
@@ -1,14 +1,19 @@
 #include "mqtt_client.h"
 #include "config_yaml.h"
+#include "metrics.h"
 #include "signal_handler.h"
 #include <algorithm>
 #include <cerrno>
 #include <chrono>
 #include <cstring>
 #include <functional>
+#include <memory>
 #include <mosquitto.h>
+#include <mqtt_protocol.h>
 #include <openssl/ssl.h>
 #include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string_view>
 #include <unistd.h>
 
 namespace {
@@ -28,8 +33,20 @@ constexpr int loopTimeoutMs = 100;
 
 // MQTT 3.1.1 CONNACK "server unavailable" - the one refusal the broker can
 // recover from on its own. mosquitto.h has no named constants for these codes.
+// A v5 CONNACK carries a reason code instead, where "server unavailable" and
+// "server busy" are the recoverable ones.
 constexpr int connackServerUnavailable = 3;
 
+bool isRecoverableConnack(int rc, bool v5) {
+  if (v5)
+    return rc == MQTT_RC_SERVER_UNAVAILABLE || rc == MQTT_RC_SERVER_BUSY;
+  return rc == connackServerUnavailable;
+}
+
+bool isBinary(const MqttPublishPolicy &policy) {
+  return policy.encoding != MqttEncoding::Json;
+}
+
 // Mirror mosquitto_loop_forever()'s own fatal/retryable split: it gives up (its
 // thread returns) on these codes, and on MOSQ_ERR_ERRNO when errno is EPROTO -
 // a protocol/TLS rejection that fails identically every retry, i.e. a
@@ -60,8 +77,42 @@ bool isFatalLoopError(int rc, int err) {
 }
 } // namespace
 
-MqttClient::MqttClient(const MqttConfig &cfg, SignalHandler &signalHandler)
-    : cfg_(cfg), handler_(signalHandler) {
+MqttClient::MqttClient(const MqttConfig &cfg, SignalHandler &signalHandler,
+                       MemoryBudget *memory)
+    : cfg_(cfg),
+      v5_(isBinary(cfg.publish.values) || isBinary(cfg.publish.delta)),
+      handler_(signalHandler), payloads_(cfg.queueSize),
+      memory_(memory ? &memory->account("mqtt") : nullptr),
+      publishLatency_(Metrics::histogram(
+          "fronius_bridge_mqtt_publish_latency_seconds",
+          "Time from enqueue until the message is handed to the broker "
+          "connection")),
+      queueDepthMetric_(Metrics::callback(
+          Metrics::Type::Gauge, "fronius_bridge_mqtt_queue_depth",
+          "Messages waiting in the MQTT topic queues", {},
+          [this] {
+            const std::size_t count =
+                topicCount_.load(std::memory_order_acquire);
+            std::size_t depth = 0;
+            for (std::size_t i = 0; i < count; ++i)
+              depth += queue(i).ring.size();
+            return static_cast<double>(depth);
+          })),
+      droppedMetric_(Metrics::callback(
+          Metrics::Type::Counter, "fronius_bridge_mqtt_dropped_total",
+          "Messages dropped from full MQTT topic queues", {},
+          [this] { return static_cast<double>(droppedMessages()); })),
+      inflightMetric_(Metrics::callback(
+          Metrics::Type::Gauge, "fronius_bridge_mqtt_inflight",
+          "Messages handed to the broker connection and not yet completed",
+          {}, [this] {
+            return static_cast<double>(
+                inflight_.load(std::memory_order_relaxed));
+          })),
+      poolMissesMetric_(Metrics::callback(
+          Metrics::Type::Counter, "fronius_bridge_pool_misses_total",
+          "Buffers allocated because their pool was empty", {{"pool", "mqtt"}},
+          [this] { return static_cast<double>(payloads_.misses()); })) {
 
   // Setup mqtt logger
   logger_ = spdlog::get("mqtt");
@@ -85,6 +136,10 @@ MqttClient::MqttClient(const MqttConfig &cfg, SignalHandler &signalHandler)
     throw std::runtime_error("Failed to create mosquitto client");
   }
 
+  // The content-type property needs MQTT v5, which the broker must support.
+  if (v5_)
+    mosquitto_int_option(mosq_, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+
   // Set username/password if provided
   if (cfg_.user.has_value()) {
     mosquitto_username_pw_set(mosq_, opt_c_str(cfg_.user),
@@ -140,6 +195,7 @@ MqttClient::MqttClient(const MqttConfig &cfg, SignalHandler &signalHandler)
   // Set Mosquitto callbacks
   mosquitto_connect_callback_set(mosq_, MqttClient::onConnect);
   mosquitto_disconnect_callback_set(mosq_, MqttClient::onDisconnect);
+  mosquitto_publish_callback_set(mosq_, MqttClient::onPublish);
   mosquitto_log_callback_set(mosq_, MqttClient::onLog);
 
   // We drive mosquitto_loop() ourselves and publish from the worker thread.
@@ -149,6 +205,11 @@ MqttClient::MqttClient(const MqttConfig &cfg, SignalHandler &signalHandler)
   // as loop_start did.
   mosquitto_threaded_set(mosq_, true);
 
+  // Match libmosquitto's own QoS 1/2 window to ours, so whatever drain()
+  // hands over goes onto the wire instead of into its internal queue.
+  mosquitto_int_option(mosq_, MOSQ_OPT_SEND_MAXIMUM,
+                       static_cast<int>(cfg_.maxInflight));
+
   // Only initiate here; networkLoop() drives the handshake and all reconnects
   // (mosquitto_loop_start would quit on a TLS/protocol rejection).
   // connect_async just validates and queues, so a failure now is a real setup
@@ -171,6 +232,7 @@ MqttClient::MqttClient(const MqttConfig &cfg, SignalHandler &signalHandler)
 
 MqttClient::~MqttClient() {
   cv_.notify_all();
+  wake_.notify();
   if (networkThread_.joinable())
     networkThread_.join();
   if (worker_.joinable())
@@ -185,47 +247,147 @@ MqttClient::~MqttClient() {
   mosquitto_lib_cleanup();
 }
 
+MqttClient::TopicId MqttClient::addTopic(std::string topic,
+                                         const MqttPublishPolicy &policy) {
+  // Producers read topics_ without the lock, so a slot is filled before the
+  // count that publishes it.
+  std::lock_guard<std::mutex> lock(topicMutex_);
+  const std::size_t count = topicCount_.load(std::memory_order_relaxed);
+  // A device a reload took out and puts back gets its topics again.
+  std::optional<std::size_t> idle;
+  for (std::size_t id = 0; id < count; ++id) {
+    TopicQueue &q = queue(id);
+    if (q.topic == topic) {
+      q.state.store(TopicState::Live, std::memory_order_release);
+      return static_cast<TopicId>(id);
+    }
+    if (!idle && q.state.load(std::memory_order_acquire) == TopicState::Idle)
+      idle = id;
+  }
+
+  // The publish thread no longer touches an idle queue, and nothing is
+  // pushed to it before this returns its id.
+  if (idle) {
+    TopicQueue &q = queue(*idle);
+    q.topic = std::move(topic);
+    q.policy = policy;
+    mosquitto_property_free_all(&q.properties);
+    setProperties(q);
+    q.lastHash.store(0, std::memory_order_relaxed);
+    q.state.store(TopicState::Live, std::memory_order_release);
+    return static_cast<TopicId>(*idle);
+  }
+
+  if (count == maxTopics)
+    throw std::length_error(
+        std::format("MQTT: more than {} topics configured", maxTopics));
+  auto added =
+      std::make_unique<TopicQueue>(std::move(topic), policy, cfg_.queueSize);
+  setProperties(*added);
+  auto &chunk = topics_[count / topicChunk];
+  if (!chunk)
+    chunk = std::make_unique<TopicChunk>();
+  topicStorage_.push_back(std::move(added));
+  (*chunk)[count % topicChunk] = topicStorage_.back().get();
+  topicCount_.store(count + 1, std::memory_order_release);
+  return static_cast<TopicId>(count);
+}
+
+void MqttClient::releaseTopic(TopicId topic) {
+  std::lock_guard<std::mutex> lock(topicMutex_);
+  queue(topic).state.store(TopicState::Released, std::memory_order_release);
+}
+
+void MqttClient::setProperties(TopicQueue &queue) {
+  if (!v5_)
+    return;
+  const int rc =
+      mosquitto_property_add_string(&queue.properties, MQTT_PROP_CONTENT_TYPE,
+                                    contentType(queue.policy.encoding));
+  if (rc != MOSQ_ERR_SUCCESS)
+    throw std::runtime_error(
+        std::format("MQTT: cannot set the content type of '{}': {}",
+                    queue.topic, mosquitto_strerror(rc)));
+}
+
 bool MqttClient::hasQueuedMessages() const {
-  return std::any_of(topicQueues_.begin(), topicQueues_.end(),
-                     [](const auto &p) { return !p.second.empty(); });
+  const std::size_t count = topicCount_.load(std::memory_order_acquire);
+  for (std::size_t i = 0; i < count; ++i) {
+    const TopicQueue &q = queue(i);
+    if (q.held.has_value() || !q.ring.empty())
+      return true;
+  }
+  return false;
+}
+
+std::uint64_t MqttClient::droppedMessages() const noexcept {
+  const std::size_t count = topicCount_.load(std::memory_order_acquire);
+  std::uint64_t dropped = 0;
+  for (std::size_t i = 0; i < count; ++i)
+    dropped += queue(i).ring.dropped();
+  return dropped + overBudget_.load(std::memory_order_relaxed);
+}
+
+bool MqttClient::windowOpen() const noexcept {
+  return inflight_.load(std::memory_order_acquire) < cfg_.maxInflight;
 }
 
-void MqttClient::publish(std::string payload, const std::string &topic) {
-  std::unique_lock<std::mutex> lock(mutex_);
+std::uint64_t MqttClient::connections() const noexcept {
+  return connections_.load(std::memory_order_relaxed);
+}
+
+void MqttClient::publish(std::string_view payload, TopicId topic) {
+  TopicQueue *q = &queue(topic);
 
   // Duplicate suppression per topic
-  std::size_t payloadHash = std::hash<std::string>{}(payload);
-  auto itHash = lastPayloadHashes_.find(topic);
-  if (itHash != lastPayloadHashes_.end() && itHash->second == payloadHash)
+  const std::size_t payloadHash = std::hash<std::string_view>{}(payload);
+  if (q->lastHash.exchange(payloadHash, std::memory_order_relaxed) ==
+      payloadHash)
     return;
-  lastPayloadHashes_[topic] = payloadHash;
-
-  auto &q = topicQueues_[topic];
 
-  // If topic queue is full, drop oldest for that topic
-  if (q.size() >= cfg_.queueSize) {
-    q.pop();
-    droppedCount_[topic]++;
+  // A pooled buffer keeps its capacity from its previous message, so the
+  // copy allocates nothing. If the topic queue is full, the ring drops the
+  // oldest message for that topic (returning its buffer to the pool).
+  auto buffer = payloads_.acquire();
+  if (buffer->capacity() < payload.size())
+    buffer->reserve(payload.size() + payload.size() / 4); // headroom
+  buffer->assign(payload);
+  Message message{std::move(buffer), std::chrono::steady_clock::now()};
+
+  bool dropped = false;
+  if (memory_) {
+    message.charged = sizeof(Message) + message.payload->capacity();
+    while (!memory_->charge(message.charged)) {
+      overBudget_.fetch_add(1, std::memory_order_relaxed);
+      dropped = true;
+      auto oldest = q->ring.tryPop();
+      if (!oldest) {
+        message.charged = 0;
+        break;
+      }
+      memory_->release(oldest->charged);
+    }
+  }
+  if (!memory_ || message.charged > 0) {
+    dropped |= q->ring.push(std::move(message), [this](Message &&oldest) {
+      if (memory_)
+        memory_->release(oldest.charged);
+    });
+    wake_.notify();
   }
-
-  q.push({payload});
 
   // Logging only if disconnected
   if (!connected_.load()) {
-    if (droppedCount_[topic] > 0) {
+    if (dropped) {
       logger_->warn("MQTT queue full for topic '{}', dropped oldest "
                     "message (total dropped: {})",
-                    topic, droppedCount_[topic]);
+                    q->topic, q->ring.dropped());
     } else {
-      if (q.size() > 0) {
-        logger_->debug(
-            "Waiting for MQTT connection... ({} messages cached for '{}')",
-            q.size(), topic);
-      }
+      logger_->debug(
+          "Waiting for MQTT connection... ({} messages cached for '{}')",
+          q->ring.size(), q->topic);
     }
   }
-
-  cv_.notify_one();
 }
 
 void MqttClient::networkLoop() {
@@ -275,14 +437,15 @@ void MqttClient::networkLoop() {
 
 void MqttClient::run() {
   while (handler_.isRunning()) {
-    std::unique_lock<std::mutex> lock(mutex_);
-
-    cv_.wait(lock, [&] {
-      return (connected_.load() && hasQueuedMessages()) ||
+    wake_.wait([&] {
+      return (connected_.load() && hasQueuedMessages() && windowOpen()) ||
              !handler_.isRunning();
     });
 
-    if (!handler_.isRunning()) {
+    // The last pass after shutdown hands over everything still queued;
+    // waiting for acknowledgements would only delay the exit.
+    const bool flushing = !handler_.isRunning();
+    if (flushing) {
       if (!connected_.load()) {
         break;
       }
@@ -291,49 +454,89 @@ void MqttClient::run() {
       }
     }
 
-    for (auto &[topic, q] : topicQueues_) {
-      while (!q.empty() && connected_.load()) {
-        auto payload = q.front().payload;
-        lock.unlock();
+    drain(flushing);
+  }
+
+  logger_->debug("MQTT run loop stopped.");
+}
 
-        int rc = mosquitto_publish(mosq_, nullptr, opt_c_str(topic),
-                                   payload.size(), payload.c_str(), 1, true);
+void MqttClient::drain(bool ignoreWindow) {
+  const std::size_t count = topicCount_.load(std::memory_order_acquire);
+
+  // A released topic with nothing left to send is handed to addTopic().
+  for (std::size_t i = 0; i < count; ++i) {
+    TopicQueue &q = queue(i);
+    auto released = TopicState::Released;
+    if (q.state.load(std::memory_order_acquire) == released && !q.held &&
+        q.ring.empty())
+      q.state.compare_exchange_strong(released, TopicState::Idle,
+                                      std::memory_order_acq_rel);
+  }
 
-        lock.lock();
-        if (rc == MOSQ_ERR_SUCCESS) {
-          q.pop();
-          logger_->debug("Published MQTT message to topic '{}': {}", topic,
+  bool progress = true;
+  while (progress && connected_.load()) {
+    progress = false;
+    for (std::size_t i = 0; i < count; ++i) {
+      if (!ignoreWindow && !windowOpen())
+        return;
+      TopicQueue &q = queue(i);
+      if (!q.held)
+        q.held = q.ring.tryPop();
+      if (!q.held)
+        continue;
+      const std::string &payload = *q.held->payload;
+
+      // Counted before the call: onPublish() may run on the network thread
+      // before mosquitto_publish() returns.
+      inflight_.fetch_add(1, std::memory_order_acq_rel);
+      int rc = mosquitto_publish_v5(mosq_, nullptr, opt_c_str(q.topic),
+                                    payload.size(), payload.c_str(),
+                                    q.policy.qos, q.policy.retain,
+                                    q.properties);
+
+      if (rc == MOSQ_ERR_SUCCESS) {
+        publishLatency_.observeSince(q.held->enqueued);
+        if (memory_)
+          memory_->release(q.held->charged);
+        if (isBinary(q.policy))
+          logger_->debug("Published MQTT message to topic '{}': {} bytes of {}",
+                         q.topic, payload.size(),
+                         contentType(q.policy.encoding));
+        else
+          logger_->debug("Published MQTT message to topic '{}': {}", q.topic,
                          payload);
-          droppedCount_[topic] = 0;
-        } else {
-          logger_->error("MQTT publish failed for '{}': {}", topic,
-                         mosquitto_strerror(rc));
-          break;
-        }
+        q.held.reset();
+        progress = true;
+      } else {
+        inflight_.fetch_sub(1, std::memory_order_acq_rel);
+        logger_->error("MQTT publish failed for '{}': {}", q.topic,
+                       mosquitto_strerror(rc));
       }
     }
   }
-
-  logger_->debug("MQTT run loop stopped.");
 }
 
 void MqttClient::onConnect(struct mosquitto *mosq, void *obj, int rc) {
   MqttClient *self = static_cast<MqttClient *>(obj);
 
+  if (rc == 0) {
+    self->inflight_.store(0, std::memory_order_release);
+    self->connections_.fetch_add(1, std::memory_order_relaxed);
+  }
   self->connected_ = (rc == 0);
-  self->cv_.notify_one();
+  self->wake_.notify();
 
   if (rc != 0) {
     // A negative CONNACK must be classified here: the drop that follows reaches
     // networkLoop only as a generic MOSQ_ERR_CONN_REFUSED. "Server unavailable"
     // can clear on its own (retry); any other refusal is a misconfiguration.
-    if (rc == connackServerUnavailable) {
-      self->logger_->warn("MQTT connection failed: {} ({})",
-                          mosquitto_connack_string(rc), rc);
+    const char *reason =
+        self->v5_ ? mosquitto_reason_string(rc) : mosquitto_connack_string(rc);
+    if (isRecoverableConnack(rc, self->v5_)) {
+      self->logger_->warn("MQTT connection failed: {} ({})", reason, rc);
     } else {
-      self->handler_.shutdown(true,
-                              std::format("MQTT connection failed: {} ({})",
-                                          mosquitto_connack_string(rc), rc));
+      self->handler_.shutdown(
+          true, std::format("MQTT connection failed: {} ({})", reason, rc));
     }
     return;
   }
@@ -363,6 +566,18 @@ void MqttClient::onDisconnect(struct mosquitto *mosq, void *obj, int rc) {
     self->logger_->info("MQTT disconnected");
 }
 
+void MqttClient::onPublish(struct mosquitto *mosq, void *obj, int mid) {
+  MqttClient *self = static_cast<MqttClient *>(obj);
+
+  // Saturating: a resend completing after the reset in onConnect() must not
+  // wrap the count.
+  std::size_t n = self->inflight_.load(std::memory_order_acquire);
+  while (n > 0 && !self->inflight_.compare_exchange_weak(
+                      n, n - 1, std::memory_order_acq_rel))
+    ;
+  self->wake_.notify();
+}
+
 void MqttClient::onLog(struct mosquitto *mosq, void *obj, int level,
                        const char *str) {
   MqttClient *self = static_cast<MqttClient *>(obj);
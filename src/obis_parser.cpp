@@ -0,0 +1,96 @@
+#include "obis_parser.h"
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <system_error>
+
+namespace {
+
+constexpr bool isDigit(char c) noexcept { return c >= '0' && c <= '9'; }
+
+constexpr bool isAlnum(char c) noexcept {
+  return isDigit(c) || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+// Consume one or more digits from `s` at `pos`.
+bool digits(std::string_view s, std::size_t &pos) noexcept {
+  const std::size_t start = pos;
+  while (pos < s.size() && isDigit(s[pos]))
+    ++pos;
+  return pos > start;
+}
+
+// Consume the literal `lit` from `s` at `pos`.
+bool literal(std::string_view s, std::size_t &pos,
+             std::string_view lit) noexcept {
+  if (s.substr(pos, lit.size()) != lit)
+    return false;
+  pos += lit.size();
+  return true;
+}
+
+} // namespace
+
+namespace Obis {
+
+std::optional<DataSet> parseDataSet(std::string_view line) noexcept {
+  // x-0:a.b.c*255
+  std::size_t pos = 0;
+  if (line.empty() || !isDigit(line[0]))
+    return std::nullopt;
+  pos = 1;
+  if (!literal(line, pos, "-0:") || !digits(line, pos) ||
+      !literal(line, pos, ".") || !digits(line, pos) ||
+      !literal(line, pos, ".") || !digits(line, pos) ||
+      !literal(line, pos, "*255"))
+    return std::nullopt;
+  const std::string_view code = line.substr(0, pos);
+
+  // (value[*unit])
+  if (!literal(line, pos, "("))
+    return std::nullopt;
+  const std::size_t close = line.find(')', pos);
+  if (close == std::string_view::npos || close == pos)
+    return std::nullopt;
+  const std::string_view body = line.substr(pos, close - pos);
+
+  const std::size_t star = body.find('*');
+  if (star == std::string_view::npos)
+    return DataSet{code, body, {}};
+  return DataSet{code, body.substr(0, star), body.substr(star + 1)};
+}
+
+std::optional<double> parseNumber(std::string_view text) noexcept {
+  // from_chars rejects a leading '+', which std::stod accepted.
+  if (!text.empty() && text.front() == '+')
+    text.remove_prefix(1);
+  if (text.empty())
+    return std::nullopt;
+
+  double value = 0.0;
+  const char *end = text.data() + text.size();
+  const auto [ptr, ec] = std::from_chars(text.data(), end, value);
+  if (ec != std::errc{} || ptr != end)
+    return std::nullopt;
+  return value;
+}
+
+std::optional<std::string_view>
+firmwareVersion(std::string_view identification) noexcept {
+  if (identification.empty() || identification.front() != '/')
+    return std::nullopt;
+  identification.remove_prefix(1);
+
+  const std::size_t sep = identification.find('_');
+  if (sep == 0 || sep == std::string_view::npos ||
+      sep + 1 == identification.size())
+    return std::nullopt;
+  for (std::size_t i = 0; i < identification.size(); ++i) {
+    if (i != sep && !isAlnum(identification[i]))
+      return std::nullopt;
+  }
+  return identification.substr(sep + 1);
+}
+
+} // namespace Obis
@@ -0,0 +1,480 @@
+#include "payloads.h"
+#include "binary_writer.h"
+#include "config_yaml.h"
+#include "edge_aggregator.h"
+#include "inverter_types.h"
+#include "json_writer.h"
+#include "meter_types.h"
+#include "site_energy.h"
+#include "site_snapshot.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <variant>
+
+namespace {
+
+using Json::field;
+using Json::kilo;
+using Json::number;
+using Q = Json::Quantity;
+using IV = InverterTypes::Values;
+using IP = InverterTypes::Phase;
+using II = InverterTypes::Input;
+using IE = InverterTypes::Events;
+using ID = InverterTypes::Device;
+using MV = MeterTypes::Values;
+using MP = MeterTypes::Phase;
+using MD = MeterTypes::Device;
+using SE = SiteEnergyTotals;
+
+// --- Inverter values: the time, then the phases and inputs arrays between
+//     the runs of scalar fields. Precisions follow
+//     InverterTypes::Values::round().
+constexpr auto inverterTime = std::tuple{
+    field("time", &IV::time),
+};
+// Only in adaptive mode, where it is non-zero.
+constexpr auto inverterInterval = std::tuple{
+    field("interval", &IV::interval),
+};
+constexpr auto inverterHead = std::tuple{
+    kilo("ac_energy", &IV::acEnergy),
+    number("ac_power_active", &IV::acPowerActive, 2, Q::Power),
+    number("ac_power_apparent", &IV::acPowerApparent, 2, Q::Power),
+    number("ac_power_reactive", &IV::acPowerReactive, 2, Q::Power),
+    number("ac_power_factor", &IV::acPowerFactor, 2),
+};
+constexpr auto inverterPhase = std::tuple{
+    number("ac_voltage", &IP::acVoltage, 1, Q::Voltage),
+    number("ac_current", &IP::acCurrent, 3, Q::Current),
+};
+constexpr auto inverterMid = std::tuple{
+    number("ac_frequency", &IV::acFrequency, 2),
+    number("dc_power", &IV::dcPower, 2, Q::Power),
+    number("efficiency", &IV::efficiency, 2),
+};
+constexpr auto inverterInput = std::tuple{
+    number("dc_voltage", &II::dcVoltage, 1, Q::Voltage),
+    number("dc_current", &II::dcCurrent, 3, Q::Current),
+    number("dc_power", &II::dcPower, 2, Q::Power),
+};
+constexpr auto inverterInputEnergy = std::tuple{
+    kilo("dc_energy", &II::dcEnergy),
+};
+// Both runs, for the delta: dc_energy never moves on a hybrid inverter.
+constexpr auto inverterInputAll =
+    std::tuple_cat(inverterInput, inverterInputEnergy);
+
+constexpr auto inverterEventFields = std::tuple{
+    field("active_code", &IE::activeCode),
+    field("state", &IE::state),
+    field("events", &IE::events),
+};
+
+// power_rating is read from the nameplate registers unquantised.
+constexpr auto inverterDeviceFields = std::tuple{
+    field("data_manager", &ID::dataManagerVersion),
+    field("firmware_version", &ID::fwVersion),
+    field("hybrid", &ID::isHybrid),
+    field("inverter_id", &ID::id),
+    field("manufacturer", &ID::manufacturer),
+    field("model", &ID::model),
+    field("mppt_tracker", &ID::inputs),
+    field("phases", &ID::phases),
+    field("power_rating", &ID::acPowerApparent),
+    field("register_model", &ID::registerModel),
+    field("serial_number", &ID::serialNumber),
+    field("slave_id", &ID::slaveID),
+};
+
+// --- Meter values. Both kinds share the fields; the EBZ reports no total
+//     current. Precisions follow MeterTypes::Values::round().
+constexpr auto meterTime = std::tuple{
+    field("time", &MV::time),
+};
+constexpr auto meterInterval = std::tuple{
+    field("interval", &MV::interval),
+};
+constexpr auto meterTotals = std::tuple{
+    kilo("energy_active_import", &MV::activeEnergyImport),
+    kilo("energy_active_export", &MV::activeEnergyExport),
+    kilo("energy_apparent_import", &MV::apparentEnergyImport),
+    kilo("energy_apparent_export", &MV::apparentEnergyExport),
+    kilo("energy_reactive_import", &MV::reactiveEnergyImport),
+    kilo("energy_reactive_export", &MV::reactiveEnergyExport),
+    number("power_active", &MV::activePower, 2, Q::Power),
+    number("power_apparent", &MV::apparentPower, 2, Q::Power),
+    number("power_reactive", &MV::reactivePower, 2, Q::Power),
+    number("power_factor", &MV::powerFactor, 2),
+    number("frequency", &MV::frequency, 2),
+    number("voltage_ph", &MV::phVoltage, 1, Q::Voltage),
+    number("voltage_pp", &MV::ppVoltage, 1, Q::Voltage),
+};
+constexpr auto meterCurrent = std::tuple{
+    number("current", &MV::current, 3, Q::Current),
+};
+constexpr auto meterPhase = std::tuple{
+    number("power_active", &MP::activePower, 2, Q::Power),
+    number("power_apparent", &MP::apparentPower, 2, Q::Power),
+    number("power_reactive", &MP::reactivePower, 2, Q::Power),
+    number("power_factor", &MP::powerFactor, 2),
+    number("voltage_ph", &MP::phVoltage, 1, Q::Voltage),
+    number("voltage_pp", &MP::ppVoltage, 1, Q::Voltage),
+    number("current", &MP::current, 3, Q::Current),
+};
+
+constexpr auto froniusMeterDeviceFields = std::tuple{
+    field("firmware_version", &MD::fwVersion),
+    field("manufacturer", &MD::manufacturer),
+    field("meter_id", &MD::id),
+    field("model", &MD::model),
+    field("phases", &MD::phases),
+    field("register_model", &MD::registerModel),
+    field("serial_number", &MD::serialNumber),
+    field("slave_id", &MD::slaveID),
+};
+
+constexpr auto easyMeterDeviceFields = std::tuple{
+    field("firmware_version", &MD::fwVersion),
+    field("manufacturer", &MD::manufacturer),
+    field("model", &MD::model),
+    field("options", &MD::options),
+    field("phases", &MD::phases),
+    field("serial_number", &MD::serialNumber),
+};
+
+// --- Site energy: the day's running totals, energies in kWh.
+constexpr auto siteEnergyFields = std::tuple{
+    field("time", &SE::time),
+    field("day", &SE::day),
+    kilo("production", &SE::production),
+    kilo("consumption", &SE::consumption),
+    kilo("self_consumption", &SE::selfConsumption),
+    kilo("from_grid", &SE::fromGrid),
+    kilo("to_grid", &SE::toGrid),
+};
+
+// `key`: [ {"id":1, <fields of items[0]>}, ... ] for the first `count` items.
+template <typename W, typename Item, std::size_t N, typename Fields>
+void writeList(W &w, const char *key,
+               const std::array<const Item *, N> &items, int count,
+               const Fields &fields) {
+  w.key(key);
+  w.beginArray();
+  for (int i = 0; i < count; ++i) {
+    w.beginObject();
+    w.key("id");
+    w.value(i + 1);
+    Json::writeFields(w, *items[static_cast<std::size_t>(i)], fields);
+    w.endObject();
+  }
+  w.endArray();
+}
+
+template <typename W>
+void writeInverterValues(W &w, const IV &v, int phases, int inputs,
+                         bool hybrid) {
+  w.beginObject();
+  Json::writeFields(w, v, inverterTime);
+  if (v.interval != 0)
+    Json::writeFields(w, v, inverterInterval);
+  Json::writeFields(w, v, inverterHead);
+  writeList(w, "phases", std::array{&v.phase1, &v.phase2, &v.phase3},
+            std::clamp(phases, 1, 3), inverterPhase);
+  Json::writeFields(w, v, inverterMid);
+  // A hybrid inverter reports no per-input energy.
+  const std::array inputList{&v.input1, &v.input2};
+  if (hybrid)
+    writeList(w, "inputs", inputList, std::clamp(inputs, 1, 2),
+              inverterInput);
+  else
+    writeList(w, "inputs", inputList, std::clamp(inputs, 1, 2),
+              inverterInputAll);
+  w.endObject();
+}
+
+template <typename W>
+void writeMeterValues(W &w, const MV &v, int phases, bool withCurrent) {
+  w.beginObject();
+  Json::writeFields(w, v, meterTime);
+  if (v.interval != 0)
+    Json::writeFields(w, v, meterInterval);
+  Json::writeFields(w, v, meterTotals);
+  if (withCurrent)
+    Json::writeFields(w, v, meterCurrent);
+  writeList(w, "phases", std::array{&v.phase1, &v.phase2, &v.phase3},
+            std::clamp(phases, 1, 3), meterPhase);
+  w.endObject();
+}
+
+// An edge aggregate: the bucket, then its four statistics, each a full
+// values document written by `doc(values)`.
+template <typename W, typename Values, typename Doc>
+void writeBucket(W &w, const Bucket<Values> &b, Doc &&doc) {
+  w.beginObject();
+  w.key("time");
+  w.value(b.start);
+  w.key("bucket");
+  w.value(b.width);
+  w.key("samples");
+  w.value(b.samples);
+  for (const auto &[key, values] :
+       {std::pair{"avg", &b.avg}, std::pair{"min", &b.min},
+        std::pair{"max", &b.max}, std::pair{"last", &b.last}}) {
+    w.key(key);
+    doc(*values);
+  }
+  w.endObject();
+}
+
+// Run `write(w)` with the writer for `encoding` over `out`.
+template <typename Write>
+void encode(std::string &out, MqttEncoding encoding, Write &&write) {
+  switch (encoding) {
+  case MqttEncoding::Cbor: {
+    Binary::Writer w(out, Binary::Format::Cbor);
+    write(w);
+    return;
+  }
+  case MqttEncoding::MsgPack: {
+    Binary::Writer w(out, Binary::Format::MsgPack);
+    write(w);
+    return;
+  }
+  case MqttEncoding::Json:
+    break;
+  }
+  Json::Writer w(out);
+  write(w);
+}
+
+template <typename T, typename Fields>
+void writeObject(std::string &out, const T &obj, const Fields &fields) {
+  Json::Writer w(out);
+  w.beginObject();
+  Json::writeFields(w, obj, fields);
+  w.endObject();
+}
+
+// The deadband of a quantity.
+struct Band {
+  const MqttDeadbandConfig &cfg;
+  double operator()(Json::Quantity q) const {
+    switch (q) {
+    case Q::Power:
+      return cfg.power;
+    case Q::Voltage:
+      return cfg.voltage;
+    case Q::Current:
+      return cfg.current;
+    case Q::Energy:
+      return cfg.energy;
+    case Q::None:
+      break;
+    }
+    return 0.0;
+  }
+};
+
+// The delta counterpart of writeList(): only the items with a moved field,
+// each with its id and the fields that moved; nothing at all if none did.
+template <typename W, typename Item, std::size_t N, typename Fields>
+void writeMovedList(W &w, const char *key,
+                    const std::array<const Item *, N> &items,
+                    const std::array<Item *, N> &last, const Fields &fields,
+                    const Band &band) {
+  bool open = false;
+  for (std::size_t i = 0; i < N; ++i) {
+    if (!Json::anyMoved(*items[i], *last[i], fields, band))
+      continue;
+    if (!open) {
+      w.key(key);
+      w.beginArray();
+      open = true;
+    }
+    w.beginObject();
+    w.key("id");
+    w.value(static_cast<int>(i) + 1);
+    Json::writeMovedFields(w, *items[i], *last[i], fields, band);
+    w.endObject();
+  }
+  if (open)
+    w.endArray();
+}
+
+} // namespace
+
+namespace Payload {
+
+void inverterValues(std::string &out, const InverterTypes::Values &v,
+                    int phases, int inputs, bool hybrid,
+                    MqttEncoding encoding) {
+  encode(out, encoding, [&](auto &w) {
+    writeInverterValues(w, v, phases, inputs, hybrid);
+  });
+}
+
+void inverterEvents(std::string &out, const InverterTypes::Events &e) {
+  writeObject(out, e, inverterEventFields);
+}
+
+void inverterDevice(std::string &out, const InverterTypes::Device &d) {
+  writeObject(out, d, inverterDeviceFields);
+}
+
+void froniusMeterValues(std::string &out, const MeterTypes::Values &v,
+                        int phases, MqttEncoding encoding) {
+  encode(out, encoding,
+         [&](auto &w) { writeMeterValues(w, v, phases, true); });
+}
+
+void froniusMeterDevice(std::string &out, const MeterTypes::Device &d) {
+  writeObject(out, d, froniusMeterDeviceFields);
+}
+
+void easyMeterValues(std::string &out, const MeterTypes::Values &v,
+                     MqttEncoding encoding) {
+  encode(out, encoding, [&](auto &w) { writeMeterValues(w, v, 3, false); });
+}
+
+void easyMeterDevice(std::string &out, const MeterTypes::Device &d) {
+  writeObject(out, d, easyMeterDeviceFields);
+}
+
+void inverterAggregate(std::string &out,
+                       const Bucket<InverterTypes::Values> &b, int phases,
+                       int inputs, bool hybrid, MqttEncoding encoding) {
+  encode(out, encoding, [&](auto &w) {
+    writeBucket(w, b, [&](const IV &v) {
+      writeInverterValues(w, v, phases, inputs, hybrid);
+    });
+  });
+}
+
+void froniusMeterAggregate(std::string &out,
+                           const Bucket<MeterTypes::Values> &b, int phases,
+                           MqttEncoding encoding) {
+  encode(out, encoding, [&](auto &w) {
+    writeBucket(w, b,
+                [&](const MV &v) { writeMeterValues(w, v, phases, true); });
+  });
+}
+
+void easyMeterAggregate(std::string &out, const Bucket<MeterTypes::Values> &b,
+                        MqttEncoding encoding) {
+  encode(out, encoding, [&](auto &w) {
+    writeBucket(w, b,
+                [&](const MV &v) { writeMeterValues(w, v, 3, false); });
+  });
+}
+
+void siteEnergy(std::string &out, const SiteEnergyTotals &t,
+                MqttEncoding encoding) {
+  encode(out, encoding, [&](auto &w) {
+    w.beginObject();
+    Json::writeFields(w, t, siteEnergyFields);
+    w.endObject();
+  });
+}
+
+void siteSnapshot(std::string &out, const Snapshot &s,
+                  MqttEncoding encoding) {
+  encode(out, encoding, [&](auto &w) {
+    w.beginObject();
+    w.key("time");
+    w.value(s.time);
+    w.key("complete");
+    w.value(s.complete);
+    w.key("production_power");
+    w.number(s.productionPower, 2);
+    if (s.primaryPower) {
+      w.key("primary_power");
+      w.number(*s.primaryPower, 2);
+    }
+    w.key("devices");
+    w.beginObject();
+    for (const auto &r : s.readings) {
+      w.key(r.name);
+      if (const auto *v = std::get_if<IV>(&r.values))
+        writeInverterValues(w, *v, r.phases, r.inputs, r.hybrid);
+      else if (r.easyMeter)
+        writeMeterValues(w, std::get<MV>(r.values), 3, false);
+      else
+        writeMeterValues(w, std::get<MV>(r.values), r.phases, true);
+    }
+    w.endObject();
+    w.endObject();
+  });
+}
+
+// Phases and inputs the device does not have stay zero, so they never move;
+// neither does the dc_energy of a hybrid inverter or the EBZ's total current.
+bool valuesDelta(std::string &out, const InverterTypes::Values &v,
+                 InverterTypes::Values &last,
+                 const MqttDeadbandConfig &deadband, MqttEncoding encoding) {
+  const Band band{deadband};
+  const std::array phases{&v.phase1, &v.phase2, &v.phase3};
+  const std::array lastPhases{&last.phase1, &last.phase2, &last.phase3};
+  const std::array inputs{&v.input1, &v.input2};
+  const std::array lastInputs{&last.input1, &last.input2};
+
+  bool any = Json::anyMoved(v, last, inverterHead, band) ||
+             Json::anyMoved(v, last, inverterMid, band);
+  for (std::size_t i = 0; i < phases.size(); ++i)
+    any = any ||
+          Json::anyMoved(*phases[i], *lastPhases[i], inverterPhase, band);
+  for (std::size_t i = 0; i < inputs.size(); ++i)
+    any = any ||
+          Json::anyMoved(*inputs[i], *lastInputs[i], inverterInputAll, band);
+  if (!any)
+    return false;
+
+  encode(out, encoding, [&](auto &w) {
+    w.beginObject();
+    Json::writeFields(w, v, inverterTime);
+    if (v.interval != 0)
+      Json::writeFields(w, v, inverterInterval);
+    Json::writeMovedFields(w, v, last, inverterHead, band);
+    writeMovedList(w, "phases", phases, lastPhases, inverterPhase, band);
+    Json::writeMovedFields(w, v, last, inverterMid, band);
+    writeMovedList(w, "inputs", inputs, lastInputs, inverterInputAll, band);
+    w.endObject();
+  });
+  last.time = v.time;
+  last.interval = v.interval;
+  return true;
+}
+
+bool valuesDelta(std::string &out, const MeterTypes::Values &v,
+                 MeterTypes::Values &last,
+                 const MqttDeadbandConfig &deadband, MqttEncoding encoding) {
+  const Band band{deadband};
+  const std::array phases{&v.phase1, &v.phase2, &v.phase3};
+  const std::array lastPhases{&last.phase1, &last.phase2, &last.phase3};
+
+  bool any = Json::anyMoved(v, last, meterTotals, band) ||
+             Json::anyMoved(v, last, meterCurrent, band);
+  for (std::size_t i = 0; i < phases.size(); ++i)
+    any = any || Json::anyMoved(*phases[i], *lastPhases[i], meterPhase, band);
+  if (!any)
+    return false;
+
+  encode(out, encoding, [&](auto &w) {
+    w.beginObject();
+    Json::writeFields(w, v, meterTime);
+    if (v.interval != 0)
+      Json::writeFields(w, v, meterInterval);
+    Json::writeMovedFields(w, v, last, meterTotals, band);
+    Json::writeMovedFields(w, v, last, meterCurrent, band);
+    writeMovedList(w, "phases", phases, lastPhases, meterPhase, band);
+    w.endObject();
+  });
+  last.time = v.time;
+  last.interval = v.interval;
+  return true;
+}
+
+} // namespace Payload
@@ -1,10 +1,12 @@
 #include "pg.h"
 #include "db_error.h"
+#include <bit>
 #include <charconv>
-#include <cmath>
+#include <chrono>
+#include <cstdint>
 #include <expected>
-#include <format>
 #include <libpq-fe.h>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -44,6 +46,14 @@ DbError fromFailedResult(PGconn *conn, PGresult *res, DbError::Kind errKind) {
   return DbError::make(errKind, "{}", DbError::firstLine(view));
 }
 
+// A pipeline operation libpq refused or a result missing from the stream. The
+// pipeline's position is unknowable afterwards, so this is always PROTOCOL.
+DbError pipelineBroken(PGconn *conn, std::string_view what) {
+  const char *message = PQerrorMessage(conn);
+  return DbError::make(DbError::Kind::PROTOCOL, "pipeline {}: {}", what,
+                       DbError::firstLine(message ? message : ""));
+}
+
 } // namespace
 
 // ---------------------------------------------------------------------------
@@ -64,19 +74,34 @@ int Result::asInt(int row, int col) const noexcept {
 // Params
 // ---------------------------------------------------------------------------
 
-template <typename T> Params &Params::addFloat(T value) {
-  if (std::isnan(value)) {
-    cells_.emplace_back("NaN");
-  } else if (std::isinf(value)) {
-    cells_.emplace_back(value < 0 ? "-Infinity" : "Infinity");
-  } else {
-    cells_.emplace_back(std::format("{}", value));
-  }
-  return *this;
+// float4/float8 travel as their IEEE 754 bit patterns, which is exactly the
+// server's binary send format.
+Params &Params::add(float value) {
+  return addBinary(std::bit_cast<std::uint32_t>(value), sizeof(float),
+                   FLOAT4OID);
 }
 
-template Params &Params::addFloat<float>(float);
-template Params &Params::addFloat<double>(double);
+Params &Params::add(double value) {
+  return addBinary(std::bit_cast<std::uint64_t>(value), sizeof(double),
+                   FLOAT8OID);
+}
+
+Params &Params::addTimestamp(std::chrono::microseconds sinceUnixEpoch) {
+  // The server counts timestamptz from 2000-01-01 00:00:00 UTC, 946684800 s
+  // after the Unix epoch.
+  constexpr std::chrono::microseconds postgresEpoch{
+      std::chrono::seconds{946684800}};
+  const auto micros = (sinceUnixEpoch - postgresEpoch).count();
+  return addBinary(static_cast<std::uint64_t>(micros), sizeof(std::int64_t),
+                   TIMESTAMPTZOID);
+}
+
+Params &Params::addBinary(std::uint64_t bits, std::size_t size, Oid type) {
+  std::string cell(size, '\0');
+  for (std::size_t i = 0; i < size; ++i)
+    cell[size - 1 - i] = static_cast<char>((bits >> (8 * i)) & 0xff);
+  return addCell(std::move(cell), type, static_cast<int>(size));
+}
 
 const char *const *Params::values() const {
   ptrs_.clear();
@@ -121,12 +146,33 @@ std::expected<Result, DbError> Conn::execParams(std::string_view sql,
                                                 const Params &params,
                                                 DbError::Kind errKind) {
   const std::string query{sql};
-  // nullptr paramTypes -> server infers each parameter's type from its use site
-  // (all our parameters land in typed INSERT columns or known function args);
-  // nullptr paramLengths/paramFormats -> text format throughout; final 0 ->
-  // text-format results.
-  Result res{PQexecParams(conn_, query.c_str(), params.count(), nullptr,
-                          params.values(), nullptr, nullptr, 0)};
+  // Binary cells carry their type OID; text cells pass 0 and the server infers
+  // the type from the use site (all our parameters land in typed INSERT
+  // columns or known function args). Final 0 -> text-format results.
+  Result res{PQexecParams(conn_, query.c_str(), params.count(), params.types(),
+                          params.values(), params.lengths(), params.formats(),
+                          0)};
+  if (!resultOk(res.get()))
+    return std::unexpected(fromFailedResult(conn_, res.get(), errKind));
+  return res;
+}
+
+std::expected<Result, DbError> Conn::execPrepared(const std::string &name,
+                                                  std::string_view sql,
+                                                  const Params &params,
+                                                  DbError::Kind errKind) {
+  if (!prepared_.contains(name)) {
+    const std::string query{sql};
+    Result prep{PQprepare(conn_, name.c_str(), query.c_str(), params.count(),
+                          params.types())};
+    if (!resultOk(prep.get()))
+      return std::unexpected(fromFailedResult(conn_, prep.get(), errKind));
+    prepared_.insert(name);
+  }
+
+  Result res{PQexecPrepared(conn_, name.c_str(), params.count(),
+                            params.values(), params.lengths(),
+                            params.formats(), 0)};
   if (!resultOk(res.get()))
     return std::unexpected(fromFailedResult(conn_, res.get(), errKind));
   return res;
@@ -165,4 +211,125 @@ std::expected<void, DbError> Transaction::commit(DbError::Kind errKind) {
   return {};
 }
 
+// ---------------------------------------------------------------------------
+// Pipeline
+// ---------------------------------------------------------------------------
+
+std::expected<Pipeline, DbError> Pipeline::enter(Conn &conn) {
+  if (PQenterPipelineMode(conn.get()) != 1)
+    return std::unexpected(pipelineBroken(conn.get(), "enter failed"));
+  return Pipeline{conn};
+}
+
+Pipeline::~Pipeline() {
+  if (!conn_)
+    return;
+
+  if (unsynced_ > 0) {
+    conn_->close();
+    return;
+  }
+
+  // Drain what is still in flight; a unit that fails here is already lost to
+  // the caller, which left early. Stop as soon as a collect makes no progress
+  // (the link dropped) - there is nothing left to exit from then.
+  while (units_ > 0) {
+    const std::size_t before = units_;
+    (void)collect();
+    if (units_ == before)
+      return;
+  }
+  PQexitPipelineMode(conn_->get());
+}
+
+std::expected<void, DbError> Pipeline::send(const std::string &name,
+                                            std::string_view sql,
+                                            const Params &params) {
+  PGconn *conn = conn_->get();
+  const bool prepared = !name.empty() && conn_->prepared_.contains(name);
+  const bool prepare =
+      !name.empty() && !prepared && !preparing_.contains(name);
+  const std::string query{prepared ? std::string_view{} : sql};
+
+  if (prepare) {
+    if (PQsendPrepare(conn, name.c_str(), query.c_str(), params.count(),
+                      params.types()) != 1)
+      return std::unexpected(pipelineBroken(conn, "prepare failed"));
+    preparing_.insert(name);
+    steps_.push_back(Step{Step::Kind::PREPARE, name});
+  }
+
+  const int sent =
+      prepared || prepare
+          ? PQsendQueryPrepared(conn, name.c_str(), params.count(),
+                                params.values(), params.lengths(),
+                                params.formats(), 0)
+          : PQsendQueryParams(conn, query.c_str(), params.count(),
+                              params.types(), params.values(),
+                              params.lengths(), params.formats(), 0);
+  if (sent != 1)
+    return std::unexpected(pipelineBroken(conn, "send failed"));
+  steps_.push_back(Step{Step::Kind::QUERY, {}});
+  ++unsynced_;
+  return {};
+}
+
+std::expected<void, DbError> Pipeline::sync() {
+  if (PQpipelineSync(conn_->get()) != 1)
+    return std::unexpected(pipelineBroken(conn_->get(), "sync failed"));
+  steps_.push_back(Step{Step::Kind::SYNC, {}});
+  ++units_;
+  unsynced_ = 0;
+  return {};
+}
+
+std::expected<void, DbError> Pipeline::collect(DbError::Kind errKind) {
+  if (units_ == 0)
+    return std::unexpected(DbError::make(
+        DbError::Kind::INTERNAL, "pipeline collect with no synced unit"));
+
+  PGconn *conn = conn_->get();
+  std::optional<DbError> failure;
+
+  while (!steps_.empty()) {
+    const Step step = std::move(steps_.front());
+    steps_.pop_front();
+
+    Result res{PQgetResult(conn)};
+    if (!res.get())
+      return std::unexpected(pipelineBroken(conn, "result missing"));
+
+    const ExecStatusType status = PQresultStatus(res.get());
+    if (step.kind == Step::Kind::SYNC) {
+      if (status != PGRES_PIPELINE_SYNC)
+        return std::unexpected(pipelineBroken(conn, "out of step"));
+      --units_;
+      if (failure)
+        return std::unexpected(std::move(*failure));
+      return {};
+    }
+
+    // Each statement's results end with a null result; the sync point does
+    // not have one.
+    Result end{PQgetResult(conn)};
+
+    if (step.kind == Step::Kind::PREPARE) {
+      preparing_.erase(step.name);
+      if (resultOk(res.get()))
+        conn_->prepared_.insert(step.name);
+    }
+
+    // The first failure names the unit's error; the statements the server
+    // skipped after it report PGRES_PIPELINE_ABORTED and add nothing.
+    if (!resultOk(res.get()) && status != PGRES_PIPELINE_ABORTED &&
+        !failure) {
+      failure = fromFailedResult(conn, res.get(), errKind);
+      if (failure->kind == DbError::Kind::PROTOCOL)
+        return std::unexpected(std::move(*failure));
+    }
+  }
+
+  return std::unexpected(pipelineBroken(conn, "sync point missing"));
+}
+
 } // namespace pg
@@ -1,12 +1,15 @@
 #include "postgres_client.h"
 #include "db_error.h"
+#include "metrics.h"
 #include "migrations.h"
 #include "pg.h"
 #include "schema_migrator.h"
 #include "signal_handler.h"
+#include "spool.h"
 #include "utils.h"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cerrno>
 #include <chrono>
 #include <cstdio>
@@ -17,13 +20,16 @@
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <span>
 #include <spdlog/spdlog.h>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unistd.h>
 #include <utility>
 #include <variant>
+#include <vector>
 
 // ---------------------------------------------------------------------------
 // Helpers
@@ -35,14 +41,28 @@ namespace {
 // sustained DB outage, but a once-per-N notice is informative.
 constexpr std::size_t dropLogThreshold = 100;
 
-// Convert Values::time (epoch milliseconds, UTC) to an ISO-8601 timestamp
-// string ("YYYY-MM-DD HH:MM:SS+00") for binding as TIMESTAMPTZ. The epoch is
+// The v3 wire protocol carries the parameter count of a Bind message in 16
+// bits, so no single statement may bind more than this many values.
+constexpr int maxStatementParams = 65535;
+
+// Events sent per pipeline round before their results are collected. Results
+// are read in blocking mode, so this bounds the unread backlog (a few dozen
+// bytes per statement) well within the socket buffers whatever batch_size is.
+constexpr std::size_t pipelineDepth = 64;
+
+// How long a spooled record waits for its device's upsert before it is
+// dropped. After a restart the device caches start empty and fill only as the
+// masters report in, and a device that stays offline (an inverter at night)
+// must not hold up the replay of everyone else's data indefinitely.
+constexpr std::chrono::seconds spoolDeviceWait{60};
+
+// Convert Values::time (epoch milliseconds, UTC) to a time point for binding
+// as TIMESTAMPTZ (pg::Params sends it in binary as microseconds). The epoch is
 // already UTC, so the instant is exact; PostgreSQL converts to the session
 // time zone on display. Millisecond precision matches the source.
-std::string timeFromMillis(uint64_t ms) {
-  const auto tp = std::chrono::sys_time<std::chrono::milliseconds>{
+std::chrono::sys_time<std::chrono::milliseconds> timeFromMillis(uint64_t ms) {
+  return std::chrono::sys_time<std::chrono::milliseconds>{
       std::chrono::milliseconds{ms}};
-  return std::format("{:%Y-%m-%d %H:%M:%S}+00", tp);
 }
 
 // libpq notice receiver: route server NOTICE/WARNING messages through the
@@ -70,6 +90,115 @@ void routeNotice(void *arg, const PGresult *res) {
     logger->debug("{}", message);
 }
 
+// The errors that end the worker's drain loop: FATAL shuts the bridge down and
+// PROTOCOL (a dropped link) forces a reconnect. Anything else costs only the
+// event(s) whose statement failed.
+bool endsDrain(const DbError &err) {
+  return err.severity == DbError::Severity::FATAL ||
+         err.kind == DbError::Kind::PROTOCOL;
+}
+
+// Accumulates the rows of one multi-row INSERT ... VALUES statement. `into` is
+// a cached "INSERT INTO <schema>.<table> (<cols>) VALUES " prefix; addRow()
+// appends one "($n,...)" tuple per call and binds its values, the tuple width
+// being the number of values passed. Should the next row overflow the
+// per-statement parameter limit, the rows so far are sent first, so any batch
+// size is safe. Runs on the caller's transaction; flush() sends the remainder.
+//
+// A single row -- the steady state, one sample per device per drain -- runs
+// as the prepared statement `stmt`, so its SQL is parsed once per connection.
+// A larger batch varies in width and goes through execParams; either way the
+// values are bound in binary. Given a pipeline, statements are queued on it
+// rather than run.
+class RowBatch {
+public:
+  RowBatch(const std::string &into, const std::string &stmt,
+           pg::Pipeline *pipeline)
+      : into_(into), stmt_(stmt), pipeline_(pipeline) {}
+
+  template <typename... Ts>
+  std::expected<void, DbError> addRow(pg::Conn &conn, Ts &&...values) {
+    constexpr int width = static_cast<int>(sizeof...(Ts));
+    if (params_.count() + width > maxStatementParams)
+      if (auto r = flush(conn); !r)
+        return r;
+
+    if (rows_ > 0)
+      sql_ += ',';
+    sql_ += '(';
+    for (int i = 1; i <= width; ++i) {
+      if (i > 1)
+        sql_ += ',';
+      sql_ += '$';
+      sql_ += std::to_string(params_.count() + i);
+    }
+    sql_ += ')';
+    (params_.add(std::forward<Ts>(values)), ...);
+    ++rows_;
+    return {};
+  }
+
+  std::expected<void, DbError> flush(pg::Conn &conn) {
+    if (rows_ == 0)
+      return {};
+    std::expected<void, DbError> sent;
+    if (pipeline_) {
+      static const std::string unnamed;
+      sent = pipeline_->send(rows_ == 1 ? stmt_ : unnamed, into_ + sql_,
+                             params_);
+    } else if (auto r = rows_ == 1
+                            ? conn.execPrepared(stmt_, into_ + sql_, params_)
+                            : conn.execParams(into_ + sql_, params_);
+               !r) {
+      sent = std::unexpected(r.error());
+    }
+    sql_.clear();
+    params_ = pg::Params{};
+    rows_ = 0;
+    return sent;
+  }
+
+private:
+  const std::string &into_;
+  const std::string &stmt_;
+  pg::Pipeline *pipeline_;
+  std::string sql_;
+  pg::Params params_;
+  int rows_{0};
+};
+
+// The power_edge INSERT prefix of schema `s` (quoted). Both kinds share the
+// table layout (migration 005).
+std::string edgeSqlOf(const std::string &s) {
+  return "INSERT INTO " + s +
+         ".power_edge (bucket, width, samples, avg_power, min_power, "
+         "max_power, last_power) VALUES ";
+}
+
+// True for the value payloads, which insertValues() batches; device payloads
+// are written one at a time. Generic so it can take the private Event type.
+bool isValues(const auto &ev) {
+  return std::holds_alternative<InverterTypes::Values>(ev.payload) ||
+         std::holds_alternative<MeterTypes::Values>(ev.payload) ||
+         std::holds_alternative<PowerBucket>(ev.payload);
+}
+
+// Append a value event of device `name` to the spool. False for a device
+// event, or if the spool could not store it.
+bool spill(Spool &spool, std::string_view name, const auto &ev) {
+  return std::visit(
+      [&](const auto &payload) {
+        using T = std::decay_t<decltype(payload)>;
+        if constexpr (std::is_same_v<T, InverterTypes::Values> ||
+                      std::is_same_v<T, MeterTypes::Values> ||
+                      std::is_same_v<T, PowerBucket>)
+          return spool.append(name, payload);
+        else
+          return false;
+      },
+      ev.payload);
+}
+
 } // namespace
 
 // ---------------------------------------------------------------------------
@@ -79,11 +208,59 @@ void routeNotice(void *arg, const PGresult *res) {
 PostgresClient::PostgresClient(const PostgresConfig &cfg,
                                std::vector<DeviceRegistryEntry> registry,
                                std::optional<SiteConfig> site,
-                               SignalHandler &signalHandler)
+                               SignalHandler &signalHandler,
+                               MemoryBudget *memory)
     : cfg_(cfg), registry_(std::move(registry)), site_(std::move(site)),
-      handler_(signalHandler) {
-  // Synchronous validation only. The connection is established lazily by the
-  // worker so a transient DB outage at startup does not block the bridge;
+      handler_(signalHandler),
+      // No more writers than devices; the memory queue is split between them,
+      // and under a memory budget its slots take at most half of it.
+      writers_([&] {
+        const auto devices = static_cast<std::size_t>(std::ranges::count_if(
+            registry_, [](const auto &e) { return !e.vacant(); }));
+        const std::size_t n = std::clamp<std::size_t>(
+            static_cast<std::size_t>(cfg_.writers), 1,
+            std::max<std::size_t>(devices, 1));
+        std::size_t queueSize = cfg_.queueSize;
+        if (memory)
+          queueSize = std::min(queueSize, memory->limit() / 2 /
+                                              MpscRing<Event>::slotBytes());
+        std::vector<std::unique_ptr<Writer>> writers;
+        for (std::size_t i = 0; i < n; ++i)
+          writers.push_back(std::make_unique<Writer>(
+              i, std::max<std::size_t>(queueSize / n, 1)));
+        return writers;
+      }()),
+      commitLatency_(Metrics::histogram(
+          "fronius_bridge_postgres_commit_latency_seconds",
+          "Time from enqueue until the event's batch is written")),
+      queueDepthMetric_(Metrics::callback(
+          Metrics::Type::Gauge, "fronius_bridge_postgres_queue_depth",
+          "Events waiting in the PostgreSQL memory queue", {},
+          [this] {
+            std::size_t depth = 0;
+            for (const auto &w : writers_)
+              depth += w->queue.size();
+            return static_cast<double>(depth);
+          })),
+      droppedMetric_(Metrics::callback(
+          Metrics::Type::Counter, "fronius_bridge_postgres_dropped_total",
+          "Events dropped from the full PostgreSQL memory queue", {},
+          [this] { return static_cast<double>(droppedEvents()); })),
+      schemasReadyMetric_(Metrics::callback(
+          Metrics::Type::Gauge, "fronius_bridge_postgres_schemas_ready_seconds",
+          "Seconds from startup until the device schemas were migrated, 0 "
+          "until then",
+          {}, [this] { return schemasReadySeconds_.load(); })),
+      firstInsertMetric_(Metrics::callback(
+          Metrics::Type::Gauge, "fronius_bridge_postgres_first_insert_seconds",
+          "Seconds from startup until the first sample was written, 0 until "
+          "then",
+          {}, [this] { return firstInsertSeconds_.load(); })),
+      cachedInverters_(registry_.size()), cachedMeters_(registry_.size()),
+      readyInverters_(registry_.size()), readyMeters_(registry_.size()),
+      deviceCached_(std::make_unique<std::atomic<bool>[]>(registry_.size())) {
+  // Synchronous validation only. The connections are established lazily by
+  // the writers so a transient DB outage at startup does not block the bridge;
   // reconnect-delay bounds were already checked by parseReconnectDelay().
   if (cfg_.dsn.empty())
     throw std::invalid_argument("postgres.dsn is empty");
@@ -92,16 +269,46 @@ PostgresClient::PostgresClient(const PostgresConfig &cfg,
   if (!postgresLogger_)
     postgresLogger_ = spdlog::default_logger();
 
-  // Start the worker last - all members are valid and `this` is safe to
+  // Opening the spool recovers what a previous run left behind; failing to
+  // create its directory is a configuration error like a missing DSN.
+  if (cfg_.spool) {
+    spool_ = std::make_unique<Spool>(*cfg_.spool, postgresLogger_);
+    spoolWatermark_ =
+        std::max<std::size_t>(cfg_.spool->highWatermark / writers_.size(), 1);
+    spoolWatermark_ =
+        std::min(spoolWatermark_, writers_.front()->queue.capacity());
+  }
+
+  // The rings' slots are allocated up front, so they are a fixed cost.
+  if (memory) {
+    std::size_t slots = 0;
+    for (const auto &w : writers_)
+      slots += w->queue.capacity();
+    memory->account("postgres").reserve(slots *
+                                        MpscRing<Event>::slotBytes());
+    if (slots < cfg_.queueSize)
+      postgresLogger_->info("Postgres memory queue limited to {} events by "
+                            "the memory budget",
+                            slots);
+  }
+
+  // Start the writers last - all members are valid and `this` is safe to
   // observe from another thread.
-  worker_ = std::jthread{&PostgresClient::run, this};
+  for (auto &w : writers_)
+    w->thread = std::jthread{&PostgresClient::run, this, std::ref(*w)};
 }
 
 PostgresClient::~PostgresClient() {
   // main() will already have called handler_.shutdown() in the normal case;
-  // wake the queue cv as a belt-and-braces measure. std::jthread joins on
-  // destruction. conn_ is complete here, so its unique_ptr destroys cleanly.
-  queueCv_.notify_all();
+  // wake the writers as a belt-and-braces measure. All of them are joined
+  // before any member goes, as a writer replaying the spool touches the
+  // others' replay queues. pg::Conn is complete here, so the writers'
+  // unique_ptrs destroy cleanly.
+  for (auto &w : writers_)
+    w->wake.notify();
+  for (auto &w : writers_)
+    if (w->thread.joinable())
+      w->thread.join();
   postgresLogger_->debug("PostgresClient shut down");
 }
 
@@ -109,65 +316,107 @@ PostgresClient::~PostgresClient() {
 // Producer side: callbacks -> queue
 // ---------------------------------------------------------------------------
 
-void PostgresClient::onInverterDevice(std::string deviceName,
+void PostgresClient::onInverterDevice(DeviceId device,
                                       InverterTypes::Device dev) {
-  enqueue(
-      Event{.deviceName = std::move(deviceName), .payload = std::move(dev)});
+  enqueue(Event{.device = device, .payload = std::move(dev)});
 }
 
-void PostgresClient::onMeterDevice(std::string deviceName,
-                                   MeterTypes::Device dev) {
-  enqueue(
-      Event{.deviceName = std::move(deviceName), .payload = std::move(dev)});
+void PostgresClient::onMeterDevice(DeviceId device, MeterTypes::Device dev) {
+  enqueue(Event{.device = device, .payload = std::move(dev)});
 }
 
-void PostgresClient::onInverter(std::string deviceName,
-                                InverterTypes::Values values) {
-  enqueue(
-      Event{.deviceName = std::move(deviceName), .payload = std::move(values)});
+void PostgresClient::onInverter(DeviceId device, InverterTypes::Values values) {
+  enqueue(Event{.device = device, .payload = std::move(values)});
 }
 
-void PostgresClient::onMeter(std::string deviceName,
-                             MeterTypes::Values values) {
-  enqueue(
-      Event{.deviceName = std::move(deviceName), .payload = std::move(values)});
+void PostgresClient::onMeter(DeviceId device, MeterTypes::Values values) {
+  enqueue(Event{.device = device, .payload = std::move(values)});
 }
 
-void PostgresClient::enqueue(Event ev) {
-  std::size_t droppedToReport = 0;
+void PostgresClient::onPowerBucket(DeviceId device, PowerBucket bucket) {
+  enqueue(Event{.device = device, .payload = bucket});
+}
+
+// Not a device's event: device 0 routes it to writer 0.
+void PostgresClient::onSiteEnergy(SiteEnergyDelta delta) {
+  enqueue(Event{.device = 0, .payload = std::move(delta)});
+}
 
+void PostgresClient::onSiteSnapshot(SnapshotRow row) {
+  enqueue(Event{.device = 0, .payload = std::move(row)});
+}
+
+void PostgresClient::reload(std::vector<DeviceRegistryEntry> registry) {
   {
-    std::lock_guard<std::mutex> lock(queueMutex_);
+    std::lock_guard<std::mutex> lock(rosterMutex_);
+    registry_ = std::move(registry);
+    roster_.fetch_add(1, std::memory_order_acq_rel);
+  }
+  // Writer 0 syncs public.device_registry as it takes the new roster, which
+  // this event makes sure it does at once.
+  enqueue(Event{.device = 0, .payload = RosterChange{}});
+}
 
-    // Bounded FIFO: when full, drop the oldest event to make room. Newer
-    // telemetry is more valuable and TimescaleDB compresses runs of similar
-    // values cheaply, so the gap is comparatively cheap.
-    if (queue_.size() >= cfg_.queueSize) {
-      queue_.pop();
-      ++droppedSinceLastLog_;
+PostgresClient::Writer::Writer(std::size_t index, std::size_t queueSize)
+    : index(index), queue(queueSize) {}
 
-      if (droppedSinceLastLog_ >= dropLogThreshold)
-        droppedToReport = std::exchange(droppedSinceLastLog_, 0);
-    }
+PostgresClient::Writer &PostgresClient::writerOf(DeviceId device) const {
+  return *writers_[device % writers_.size()];
+}
 
-    queue_.push(std::move(ev));
+void PostgresClient::enqueue(Event ev) {
+  ev.enqueued = std::chrono::steady_clock::now();
+  ev.roster = roster_.load(std::memory_order_acquire);
+  Writer &w = writerOf(ev.device);
+
+  // Past the high watermark a value event goes to disk instead, and so does
+  // every one after it until the spool has drained, so the replay keeps
+  // arrival order. Only this outage path takes a lock; should the append fail
+  // the event falls back to the memory queue.
+  if (spool_ && isValues(ev) &&
+      (spooling_.load(std::memory_order_acquire) ||
+       w.queue.size() >= spoolWatermark_)) {
+    std::lock_guard<std::mutex> lock(spoolMutex_);
+    if (spill(*spool_, nameOf(ev.device), ev)) {
+      spooling_.store(true, std::memory_order_release);
+      w.wake.notify();
+      return;
+    }
   }
 
-  queueCv_.notify_one();
+  // Bounded FIFO: when full, the ring drops the oldest event to make room.
+  // Newer telemetry is more valuable and TimescaleDB compresses runs of
+  // similar values cheaply, so the gap is comparatively cheap.
+  const bool dropped = w.queue.push(std::move(ev));
+  w.wake.notify();
 
-  if (droppedToReport > 0) {
-    postgresLogger_->warn(
-        "Postgres queue full: dropped {} oldest events since last log",
-        droppedToReport);
+  if (dropped &&
+      droppedSinceLastLog_.fetch_add(1, std::memory_order_relaxed) + 1 >=
+          dropLogThreshold) {
+    if (const auto n = droppedSinceLastLog_.exchange(0); n > 0)
+      postgresLogger_->warn(
+          "Postgres queue full: dropped {} oldest events since last log", n);
   }
 }
 
+std::uint64_t PostgresClient::droppedEvents() const noexcept {
+  std::uint64_t dropped = 0;
+  for (const auto &w : writers_)
+    dropped += w->queue.dropped();
+  return dropped;
+}
+
 // ---------------------------------------------------------------------------
 // Worker side: queue -> database
 // ---------------------------------------------------------------------------
 
-void PostgresClient::run() {
-  postgresLogger_->debug("Postgres worker thread started");
+void PostgresClient::run(Writer &w) {
+  postgresLogger_->debug("Postgres writer {} thread started", w.index);
+  {
+    std::lock_guard<std::mutex> lock(rosterMutex_);
+    w.registry = registry_;
+    w.roster = roster_.load(std::memory_order_relaxed);
+  }
 
   const std::chrono::seconds minDelay{cfg_.reconnectDelay.min};
   const std::chrono::seconds maxDelay{cfg_.reconnectDelay.max};
@@ -178,7 +427,7 @@ void PostgresClient::run() {
   while (handler_.isRunning()) {
 
     // --- Connect, check extensions, replay cached device upserts. ---
-    auto setup = connectAndPrepare();
+    auto setup = connectAndPrepare(w);
     if (!setup) {
       const auto &err = setup.error();
       if (err.severity == DbError::Severity::FATAL) {
@@ -191,28 +440,43 @@ void PostgresClient::run() {
       }
       postgresLogger_->warn("Postgres setup failed: {} - retrying in {}s",
                             err.describe(), backoff.count());
-      sleepBackoff(backoff);
+      sleepBackoff(w, backoff);
       backoff = exponential ? std::min(backoff * 2, maxDelay) : minDelay;
       continue;
     }
 
     backoff = minDelay;
-    postgresLogger_->info("Postgres connected");
-
-    // --- Drain queue until shutdown or a connection-level failure. ---
+    if (writers_.size() == 1)
+      postgresLogger_->info("Postgres connected");
+    else
+      postgresLogger_->info("Postgres writer {} of {} connected", w.index + 1,
+                            writers_.size());
+
+    // --- Drain queue in batches until shutdown or a connection-level
+    //     failure. ---
     while (handler_.isRunning()) {
-      Event ev;
-      {
-        std::unique_lock<std::mutex> lock(queueMutex_);
-        queueCv_.wait(lock,
-                      [&] { return !queue_.empty() || !handler_.isRunning(); });
-        if (!handler_.isRunning() && queue_.empty())
-          break;
-        ev = std::move(queue_.front());
-        queue_.pop();
+      if (!fillBatch(w))
+        break;
+
+      const auto spooledIn = [&] {
+        return static_cast<std::size_t>(std::ranges::count_if(
+            w.batch, [](const Event &ev) { return ev.spooled; }));
+      };
+      const std::size_t handedOut = spool_ ? spooledIn() : 0;
+
+      auto result = writeBatch(w);
+
+      // Commit the spool once everything taken from it, by every writer, is
+      // written. On an error the unwritten events stay in w.batch, and in
+      // flight.
+      if (spool_) {
+        const std::size_t settled = handedOut - spooledIn();
+        std::lock_guard<std::mutex> lock(spoolMutex_);
+        spoolInFlight_ -= settled;
+        if (spoolInFlight_ == 0)
+          spool_->commit();
       }
 
-      auto result = processEvent(ev);
       if (!result) {
         const auto &err = result.error();
 
@@ -222,34 +486,367 @@ void PostgresClient::run() {
           break;
         }
 
-        if (err.kind == DbError::Kind::PROTOCOL) {
-          // Connection broken: drop out of the inner loop and reconnect. The
-          // caches persist, so the reconnect replays the device upserts.
-          conn_.reset();
-          break;
-        }
+        // Connection broken (writeBatch() returns nothing else): drop out of
+        // the inner loop and reconnect. The caches persist, so the reconnect
+        // replays the device upserts, and w.batch still holds the events
+        // whose transaction was rolled back, so they are retried rather than
+        // lost.
+        w.conn.reset();
+        break;
+      }
+    }
+  }
+
+  postgresLogger_->debug("Postgres writer {} thread stopping", w.index);
+
+  if (spool_)
+    spillOnShutdown(w);
+
+  if (w.conn)
+    w.conn->close();
+}
+
+bool PostgresClient::fillBatch(Writer &w) {
+  // The spool is shared with producers spilling into it and with the other
+  // writers; the memory queue needs no lock.
+  const auto spoolReady = [&] {
+    if (!spool_)
+      return false;
+    std::lock_guard<std::mutex> lock(spoolMutex_);
+    replaySpool(w);
+    return !w.replay.empty();
+  };
+  const auto queued = [&] {
+    if (!spool_)
+      return w.queue.size();
+    std::lock_guard<std::mutex> lock(spoolMutex_);
+    return w.queue.size() + w.replay.size() + spool_->pending();
+  };
+  const auto spoolDeadline = [&] {
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    if (spool_) {
+      std::lock_guard<std::mutex> lock(spoolMutex_);
+      deadline = spoolWaitUntil_;
+    }
+    return deadline;
+  };
+
+  // Events left over from a connection that dropped mid-batch are written
+  // first; only an empty batch blocks for new work. A spooled record waiting
+  // for its device's upsert is not work yet, but its wait expiring is.
+  if (w.batch.empty()) {
+    const auto ready = [&] {
+      return !w.queue.empty() || spoolReady() || !handler_.isRunning();
+    };
+    // waitUntil() gives up early only when a spooled record's wait runs out;
+    // the predicate's next look at the spool then drops what timed out.
+    while (!w.wake.waitUntil(spoolDeadline(), ready))
+      ;
+    if (!handler_.isRunning())
+      return false;
+  }
+
+  // Linger for a partial batch to fill. With the default of 0 this is skipped
+  // and the batch is simply whatever is already queued, so a steady poll rate
+  // pays no extra latency while a backlog still drains batchSize at a time.
+  if (cfg_.lingerMs > 0 && w.batch.size() + queued() < cfg_.batchSize) {
+    w.wake.waitFor(std::chrono::milliseconds{cfg_.lingerMs}, [&] {
+      return w.batch.size() + queued() >= cfg_.batchSize ||
+             !handler_.isRunning();
+    });
+    if (!handler_.isRunning())
+      return false;
+  }
+
+  // Memory first: while the spool is non-empty, values go to it, so anything
+  // still queued in memory is older than the spooled records.
+  while (w.batch.size() < cfg_.batchSize) {
+    auto ev = w.queue.tryPop();
+    if (!ev)
+      break;
+    w.batch.push_back(std::move(*ev));
+  }
+  if (spool_) {
+    std::lock_guard<std::mutex> lock(spoolMutex_);
+    replaySpool(w);
+    while (w.batch.size() < cfg_.batchSize && !w.replay.empty()) {
+      w.batch.push_back(std::move(w.replay.front()));
+      w.replay.pop_front();
+    }
+    // Drained, and nothing handed out is left waiting in a replay queue: new
+    // value events go back to the memory queues.
+    if (spool_->pending() == 0 &&
+        std::ranges::all_of(writers_,
+                            [](const auto &o) { return o->replay.empty(); }))
+      spooling_.store(false, std::memory_order_release);
+  }
+  return true;
+}
+
+void PostgresClient::replaySpool(Writer &self) {
+  std::size_t dropped = 0;
+  std::size_t unknown = 0;
+
+  while (auto entry = spool_->front()) {
+    // A device removed from the configuration since the record was spooled
+    // has no schema to go to.
+    const auto id = deviceIdOf(entry->deviceName);
+    if (!id) {
+      spool_->pop();
+      ++unknown;
+      continue;
+    }
+
+    if (deviceCached_[*id].load(std::memory_order_acquire)) {
+      spoolWaitUntil_.reset();
+      // A writer that is behind holds the replay up here until it has room.
+      Writer &owner = writerOf(*id);
+      const std::size_t room =
+          &owner == &self ? cfg_.batchSize - self.batch.size() : cfg_.batchSize;
+      if (owner.replay.size() >= room)
+        break;
+      owner.replay.push_back(std::visit(
+          [&](const auto &values) {
+            return Event{.device = *id,
+                         .payload = values,
+                         .spooled = true,
+                         .roster = roster_.load(std::memory_order_acquire)};
+          },
+          entry->values));
+      spool_->pop();
+      ++spoolInFlight_;
+      if (&owner != &self)
+        owner.wake.notify();
+      continue;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!spoolWaitUntil_)
+      spoolWaitUntil_ = now + spoolDeviceWait;
+    if (now < *spoolWaitUntil_)
+      break;
 
-        // TRANSIENT QUERY: warn and continue; the event is lost. Includes a
-        // duplicate-timestamp unique violation (a benign re-poll) and a
-        // constraint violation (a data/schema mismatch worth noticing but not
-        // worth taking the whole bridge down for).
-        postgresLogger_->warn("Postgres event failed: {}", err.describe());
+    // Waited long enough: drop the device's records as they come up. The
+    // deadline stays expired until a record can be replayed again.
+    spool_->pop();
+    ++dropped;
+  }
+  if (spool_->pending() == 0)
+    spoolWaitUntil_.reset();
+
+  if (dropped > 0)
+    postgresLogger_->warn("Postgres spool: dropped {} events of devices not "
+                          "upserted within {}s",
+                          dropped, spoolDeviceWait.count());
+  if (unknown > 0)
+    postgresLogger_->warn("Postgres spool: dropped {} events of devices no "
+                          "longer configured",
+                          unknown);
+}
+
+std::optional<DeviceId>
+PostgresClient::deviceIdOf(std::string_view name) const {
+  std::lock_guard<std::mutex> lock(rosterMutex_);
+  for (std::size_t id = 0; id < registry_.size(); ++id)
+    if (registry_[id].name == name)
+      return static_cast<DeviceId>(id);
+  return std::nullopt;
+}
+
+std::string PostgresClient::nameOf(DeviceId device) const {
+  std::lock_guard<std::mutex> lock(rosterMutex_);
+  return registry_[device].name;
+}
+
+std::string PostgresClient::nameOf(const Writer &w, const Event &ev) const {
+  return ev.roster <= w.roster ? w.registry[ev.device].name
+                               : nameOf(ev.device);
+}
+
+std::expected<void, DbError> PostgresClient::adoptRoster(Writer &w) {
+  std::vector<DeviceRegistryEntry> latest;
+  {
+    std::lock_guard<std::mutex> lock(rosterMutex_);
+    latest = registry_;
+    w.roster = roster_.load(std::memory_order_relaxed);
+  }
+  // A slot that changed hands starts over: the next device event migrates
+  // or verifies the new device's schema.
+  for (std::size_t id = w.index; id < latest.size(); id += writers_.size()) {
+    if (latest[id] == w.registry[id])
+      continue;
+    cachedInverters_[id].reset();
+    cachedMeters_[id].reset();
+    readyInverters_[id].reset();
+    readyMeters_[id].reset();
+    deviceCached_[id].store(false, std::memory_order_release);
+  }
+  w.registry = std::move(latest);
+  if (w.index != 0 || !cfg_.syncRegistry)
+    return {};
+  w.registrySynced = false;
+  if (!w.conn)
+    return {};
+  if (auto r = syncRegistry(*w.conn, w.registry, site_); !r)
+    return r;
+  w.registrySynced = true;
+  postgresLogger_->info("Device registry updated");
+  return {};
+}
+
+void PostgresClient::spillOnShutdown(Writer &w) {
+  std::lock_guard<std::mutex> lock(spoolMutex_);
+
+  // Spooled events in w.batch and w.replay were never committed, so the
+  // spool replays them anyway. Device events are not spilled: the masters
+  // report their devices again on the next start.
+  std::size_t spilled = 0;
+  for (const auto &ev : w.batch)
+    if (!ev.spooled && spill(*spool_, nameOf(w, ev), ev))
+      ++spilled;
+  while (auto ev = w.queue.tryPop())
+    if (spill(*spool_, nameOf(w, *ev), *ev))
+      ++spilled;
+  w.batch.clear();
+
+  if (spilled > 0)
+    postgresLogger_->info("Spooled {} unwritten events for the next start",
+                          spilled);
+}
+
+std::expected<void, DbError> PostgresClient::writeBatch(Writer &w) {
+  // [0, done) has been committed or dropped. On a drain-ending error the rest
+  // stays in w.batch for the next connection.
+  std::size_t done = 0;
+  auto fail = [&](DbError err) -> std::expected<void, DbError> {
+    observeWritten(w, done);
+    w.batch.erase(w.batch.begin(),
+                  w.batch.begin() + static_cast<std::ptrdiff_t>(done));
+    return std::unexpected(std::move(err));
+  };
+
+  while (done < w.batch.size()) {
+    // The first event enqueued after a reload moves the writer to the new
+    // roster; the events before it were written under the old one.
+    if (w.batch[done].roster > w.roster) {
+      if (auto r = adoptRoster(w); !r) {
+        if (endsDrain(r.error()))
+          return fail(r.error());
+        postgresLogger_->warn("Syncing the device registry failed: {}",
+                              r.error().describe());
+      }
+    }
+
+    // A device event runs on its own: the upsert is a single autocommitted
+    // statement, and on first sight it migrates the schema the values after it
+    // insert into.
+    if (!isValues(w.batch[done])) {
+      if (auto r = processEvent(w, w.batch[done]); !r) {
+        if (endsDrain(r.error()))
+          return fail(r.error());
+        postgresLogger_->warn("Postgres event failed: {}",
+                              r.error().describe());
       }
+      ++done;
+      continue;
     }
+
+    std::size_t end = done;
+    while (end < w.batch.size() && isValues(w.batch[end]) &&
+           w.batch[end].roster <= w.roster)
+      ++end;
+
+    if (cfg_.pipeline) {
+      // One unit per event: a failure costs only the event that caused it.
+      if (auto r = writePipelined(w, done, end); !r)
+        return fail(r.error());
+      continue;
+    }
+
+    const std::span<const Event> run{w.batch.data() + done, end - done};
+    auto r = insertValues(w, run);
+    if (!r && endsDrain(r.error()))
+      return fail(r.error());
+    if (r)
+      noteFirstInsert();
+
+    if (!r && run.size() > 1) {
+      // One bad row rolls back the whole run. Retry one event per transaction
+      // so only the offending event is lost, as in the unbatched path.
+      postgresLogger_->debug("Postgres batch of {} events failed: {} - "
+                             "retrying per event",
+                             run.size(), r.error().describe());
+      for (; done < end; ++done) {
+        auto single =
+            insertValues(w, std::span<const Event>{&w.batch[done], 1});
+        if (!single && endsDrain(single.error()))
+          return fail(single.error());
+        if (!single)
+          postgresLogger_->warn("Postgres event failed: {}",
+                                single.error().describe());
+        else
+          noteFirstInsert();
+      }
+      continue;
+    }
+
+    // TRANSIENT QUERY: warn and continue; the event is lost. Includes a
+    // duplicate-timestamp unique violation (a benign re-poll) and a
+    // constraint violation (a data/schema mismatch worth noticing but not
+    // worth taking the whole bridge down for).
+    if (!r)
+      postgresLogger_->warn("Postgres event failed: {}", r.error().describe());
+    done = end;
   }
 
-  postgresLogger_->debug("Postgres worker thread stopping");
+  observeWritten(w, w.batch.size());
+  w.batch.clear();
+  return {};
+}
 
-  if (conn_)
-    conn_->close();
+void PostgresClient::observeWritten(const Writer &w, std::size_t end) {
+  const auto now = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < end; ++i)
+    if (!w.batch[i].spooled)
+      commitLatency_.observe(now - w.batch[i].enqueued);
 }
 
-void PostgresClient::sleepBackoff(std::chrono::seconds duration) {
-  std::unique_lock<std::mutex> lock(queueMutex_);
-  queueCv_.wait_for(lock, duration, [&] { return !handler_.isRunning(); });
+std::expected<void, DbError>
+PostgresClient::writePipelined(Writer &w, std::size_t &done,
+                               std::size_t end) {
+  while (done < end) {
+    const std::size_t roundEnd = std::min(end, done + pipelineDepth);
+
+    auto pipeline = pg::Pipeline::enter(*w.conn);
+    if (!pipeline)
+      return std::unexpected(pipeline.error());
+
+    for (std::size_t i = done; i < roundEnd; ++i)
+      if (auto r = processEvent(w, w.batch[i], &*pipeline); !r)
+        return r;
+
+    // Units complete in send order, so each result belongs to w.batch[done].
+    // A drain-ending error leaves `done` on the event that hit it; the guard
+    // then drains or abandons the rest of the round.
+    for (; done < roundEnd; ++done) {
+      auto r = pipeline->collect();
+      if (!r && endsDrain(r.error()))
+        return r;
+      if (!r)
+        postgresLogger_->warn("Postgres event failed: {}",
+                              r.error().describe());
+      else
+        noteFirstInsert();
+    }
+  }
+  return {};
 }
 
-void PostgresClient::attachSqlTrace() {
+void PostgresClient::sleepBackoff(Writer &w, std::chrono::seconds duration) {
+  w.wake.waitFor(duration, [&] { return !handler_.isRunning(); });
+}
+
+void PostgresClient::attachSqlTrace(Writer &w) {
   if (!sqlTraceFile_) {
     std::error_code ec;
     std::filesystem::path temp_dir = std::filesystem::temp_directory_path(ec);
@@ -280,19 +877,19 @@ void PostgresClient::attachSqlTrace() {
     postgresLogger_->trace("libpq SQL trace -> {}", path.string());
   }
 
-  if (conn_)
-    conn_->trace(sqlTraceFile_.get());
+  if (w.conn)
+    w.conn->trace(sqlTraceFile_.get());
 }
 
-std::expected<void, DbError> PostgresClient::connectAndPrepare() {
+std::expected<void, DbError> PostgresClient::connectAndPrepare(Writer &w) {
   // --- Open or reopen the connection. PQconnectdb does not throw; a failed
   //     connection is reported via isOpen()/connectError() rather than an
   //     exception, so there is no catch ladder here. On failure the dead handle
   //     is released before returning so it is not held during the backoff. ---
-  conn_ = std::make_unique<pg::Conn>(cfg_.dsn);
-  if (!conn_->isOpen()) {
-    DbError err = conn_->connectError();
-    conn_.reset();
+  w.conn = std::make_unique<pg::Conn>(cfg_.dsn);
+  if (!w.conn->isOpen()) {
+    DbError err = w.conn->connectError();
+    w.conn.reset();
     return std::unexpected(err);
   }
 
@@ -300,17 +897,23 @@ std::expected<void, DbError> PostgresClient::connectAndPrepare() {
   //     libpq's default stderr sink. Installed here so it covers the migrations
   //     that follow; re-installed on every reconnect, as each new PGconn starts
   //     with the default receiver. ---
-  conn_->setNoticeReceiver(&routeNotice, postgresLogger_.get());
+  w.conn->setNoticeReceiver(&routeNotice, postgresLogger_.get());
+
+  // The trace file and the one-time block below are shared by the writers.
+  // The first to get here runs the one-time block; the others wait for it,
+  // so none writes a device before the public schema and the roster are set
+  // up.
+  std::unique_lock<std::mutex> setup(setupMutex_);
 
   // --- Hook libpq's wire-level SQL trace if requested by log level. ---
   if (postgresLogger_->should_log(spdlog::level::trace))
-    attachSqlTrace();
+    attachSqlTrace(w);
 
   // --- Verify the required extensions exist (once per process). The check is
   //     database-global, so it need not repeat on every reconnect; a missing
   //     extension is FATAL and bubbles up to shut the bridge down. ---
   if (!extensionsChecked_) {
-    SchemaMigrator m{*conn_};
+    SchemaMigrator m{*w.conn};
     if (auto r = m.checkExtensions(); !r)
       return r;
     // Bring the shared public schema (device registry, and later the
@@ -323,53 +926,81 @@ std::expected<void, DbError> PostgresClient::connectAndPrepare() {
     // Reflect the configured device roster into public.device_registry. Done
     // after the public schema exists and before the flag is set, so a transient
     // failure here retries the whole one-time block on the next reconnect.
-    if (auto r = syncRegistry(); !r)
-      return r;
+    // A cluster node leaves it to the leader.
+    if (cfg_.syncRegistry)
+      if (auto r = syncRegistry(*w.conn, w.registry, site_); !r)
+        return r;
+    migrateRoster(*w.conn, w.registry);
     extensionsChecked_ = true;
+    w.registrySynced = true;
   }
+  setup.unlock();
 
-  // --- Replay device upserts from the cache. On a reconnect the schemas
-  //     already exist (migrate ran on first sight and is not repeated here),
-  //     so this just refreshes each device row and last_seen. The cached SQL
-  //     is connection-independent, so nothing needs re-preparing. On first
-  //     connect the caches are empty and the device callbacks populate them
-  //     via the normal lazy-migrate path.
-  //
-  //     Copy `device` out before the call so the upsert does not read from the
-  //     same cache entry it rewrites. ---
-  for (const auto &[name, cached] : cachedInverters_) {
-    auto device = cached.device;
-    if (auto r = upsertInverterDevice(name, device); !r)
+  // A reload's roster the link dropped before writer 0 could sync. Only
+  // writer 0 syncs after a reload, and a cluster node leaves it to the leader.
+  if (w.index == 0 && cfg_.syncRegistry && !w.registrySynced) {
+    if (auto r = syncRegistry(*w.conn, w.registry, site_); !r)
       return r;
+    w.registrySynced = true;
   }
-  for (const auto &[name, cached] : cachedMeters_) {
-    auto device = cached.device;
-    if (auto r = upsertMeterDevice(name, device); !r)
-      return r;
+
+  // --- Replay the writer's device upserts from the cache. On a reconnect the
+  //     schemas already exist (migrate ran on first sight and is not repeated
+  //     here), so this just refreshes each device row and last_seen. The new
+  //     connection has no prepared statements; each is re-prepared from the
+  //     cached name and SQL on first use, starting with these upserts. On first
+  //     connect the caches are empty and the device callbacks populate them,
+  //     from the schemas migrateRoster() readied or via the lazy path.
+  //
+  //     Copy `dev` out before the call so the upsert does not read from the
+  //     same cache entry it rewrites. ---
+  for (std::size_t id = w.index; id < w.registry.size();
+       id += writers_.size()) {
+    const auto device = static_cast<DeviceId>(id);
+    if (cachedInverters_[id]) {
+      auto dev = cachedInverters_[id]->device;
+      if (auto r = upsertInverterDevice(w, device, dev); !r)
+        return r;
+    }
+    if (cachedMeters_[id]) {
+      auto dev = cachedMeters_[id]->device;
+      if (auto r = upsertMeterDevice(w, device, dev); !r)
+        return r;
+    }
   }
 
   return {};
 }
 
-std::expected<void, DbError> PostgresClient::processEvent(const Event &ev) {
+std::expected<void, DbError>
+PostgresClient::processEvent(Writer &w, const Event &ev,
+                             pg::Pipeline *pipeline) {
   return std::visit(
-      [this, &ev](const auto &payload) -> std::expected<void, DbError> {
+      [this, &w, &ev,
+       pipeline](const auto &payload) -> std::expected<void, DbError> {
         using T = std::decay_t<decltype(payload)>;
         if constexpr (std::is_same_v<T, InverterTypes::Device>) {
-          return upsertInverterDevice(ev.deviceName, payload);
+          return upsertInverterDevice(w, ev.device, payload);
         } else if constexpr (std::is_same_v<T, MeterTypes::Device>) {
-          return upsertMeterDevice(ev.deviceName, payload);
-        } else if constexpr (std::is_same_v<T, InverterTypes::Values>) {
-          return insertInverterValues(ev.deviceName, payload);
-        } else if constexpr (std::is_same_v<T, MeterTypes::Values>) {
-          return insertMeterValues(ev.deviceName, payload);
+          return upsertMeterDevice(w, ev.device, payload);
+        } else if constexpr (std::is_same_v<T, SiteEnergyDelta>) {
+          return addSiteEnergy(w, payload);
+        } else if constexpr (std::is_same_v<T, SnapshotRow>) {
+          return upsertSiteSnapshot(w, payload);
+        } else if constexpr (std::is_same_v<T, RosterChange>) {
+          return {}; // taken by writeBatch() before it gets here
+        } else {
+          return insertValues(w, std::span<const Event>{&ev, 1}, pipeline);
         }
       },
       ev.payload);
 }
 
-std::expected<void, DbError> PostgresClient::syncRegistry() {
-  auto tx = pg::Transaction::begin(*conn_, DbError::Kind::MIGRATION);
+std::expected<void, DbError>
+PostgresClient::syncRegistry(pg::Conn &conn,
+                             const std::vector<DeviceRegistryEntry> &registry,
+                             const std::optional<SiteConfig> &site) {
+  auto tx = pg::Transaction::begin(conn, DbError::Kind::MIGRATION);
   if (!tx)
     return std::unexpected(tx.error());
 
@@ -379,8 +1010,10 @@ std::expected<void, DbError> PostgresClient::syncRegistry() {
   // devices no longer in the configuration -- whose updated_at is strictly
   // older. This avoids binding the name list as an array just to delete the
   // complement.
-  for (const auto &e : registry_) {
-    if (auto r = conn_->execParams(
+  for (const auto &e : registry) {
+    if (e.vacant())
+      continue;
+    if (auto r = conn.execParams(
             "INSERT INTO public.device_registry "
             "(device_name, kind, location, is_primary, updated_at) "
             "VALUES ($1, $2, $3, $4, now()) "
@@ -393,7 +1026,7 @@ std::expected<void, DbError> PostgresClient::syncRegistry() {
       return std::unexpected(r.error());
   }
 
-  if (auto r = conn_->exec(
+  if (auto r = conn.exec(
           "DELETE FROM public.device_registry WHERE updated_at < now()",
           DbError::Kind::MIGRATION);
       !r)
@@ -405,12 +1038,12 @@ std::expected<void, DbError> PostgresClient::syncRegistry() {
   // columns are NULL together when there is no section; a present one always
   // sets latitude and longitude (the config requires them).
   const std::optional<double> lat =
-      site_ ? std::optional<double>{site_->latitude} : std::nullopt;
+      site ? std::optional<double>{site->latitude} : std::nullopt;
   const std::optional<double> lon =
-      site_ ? std::optional<double>{site_->longitude} : std::nullopt;
+      site ? std::optional<double>{site->longitude} : std::nullopt;
   const std::optional<double> hor =
-      site_ ? std::optional<double>{site_->horizon} : std::nullopt;
-  if (auto r = conn_->execParams(
+      site ? std::optional<double>{site->horizon} : std::nullopt;
+  if (auto r = conn.execParams(
           "INSERT INTO public.site (id, latitude, longitude, horizon_deg) "
           "VALUES (TRUE, $1, $2, $3) "
           "ON CONFLICT (id) DO UPDATE SET "
@@ -425,63 +1058,195 @@ std::expected<void, DbError> PostgresClient::syncRegistry() {
   return {};
 }
 
+void PostgresClient::migrateRoster(
+    const pg::Conn &conn, const std::vector<DeviceRegistryEntry> &registry) {
+  const auto devices = static_cast<std::size_t>(std::ranges::count_if(
+      registry, [](const auto &e) { return !e.vacant(); }));
+  if (devices == 0)
+    return;
+  const auto begin = std::chrono::steady_clock::now();
+
+  // Each worker takes the next unclaimed schema until none are left, so a
+  // slow schema (a hypertable conversion on an upgrade) holds up only its own
+  // worker. SchemaMigrator locks per schema, so the workers never wait on
+  // each other, and a second bridge instance starting at the same time
+  // serialises with them schema by schema.
+  const std::size_t workers = std::min<std::size_t>(
+      static_cast<std::size_t>(cfg_.migrateConnections), devices);
+  std::atomic<std::size_t> next{0};
+  std::vector<char> migrated(registry.size(), 0);
+  {
+    std::vector<std::jthread> pool;
+    pool.reserve(workers);
+    for (std::size_t w = 0; w < workers; ++w)
+      pool.emplace_back([&] {
+        pg::Conn conn{cfg_.dsn};
+        if (!conn.isOpen()) {
+          postgresLogger_->warn("Schema migration connection failed: {}",
+                                conn.connectError().describe());
+          return;
+        }
+        conn.setNoticeReceiver(&routeNotice, postgresLogger_.get());
+        SchemaMigrator m{conn};
+        for (std::size_t id = next++; id < registry.size() &&
+                                      handler_.isRunning();
+             id = next++) {
+          const auto &e = registry[id];
+          if (e.vacant())
+            continue;
+          const auto &set =
+              e.kind == "inverter" ? inverterMigrations : meterMigrations;
+          auto r = cfg_.autoMigrate ? m.migrate(set, e.name)
+                                    : m.verify(set, e.name);
+          if (r)
+            migrated[id] = 1;
+          else
+            postgresLogger_->warn("Migrating schema '{}' failed: {} - "
+                                  "retrying on first sight",
+                                  e.name, r.error().describe());
+        }
+      });
+  }
+
+  std::size_t ready = 0;
+  for (std::size_t id = 0; id < registry.size(); ++id) {
+    if (!migrated[id])
+      continue;
+    const auto &e = registry[id];
+    if (e.kind == "inverter")
+      readyInverters_[id] = inverterCache(conn, e.name);
+    else
+      readyMeters_[id] = meterCache(conn, e.name);
+    ++ready;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> took = now - begin;
+  postgresLogger_->info("Migrated {} of {} device schemas over {} "
+                        "connections in {:.3f}s",
+                        ready, devices, workers, took.count());
+  if (ready == devices)
+    schemasReadySeconds_ = std::max(
+        std::chrono::duration<double>(now - started_).count(), 1e-6);
+}
+
+void PostgresClient::noteFirstInsert() {
+  if (firstInsertSeen_.exchange(true))
+    return;
+  const std::chrono::duration<double> since =
+      std::chrono::steady_clock::now() - started_;
+  firstInsertSeconds_ = std::max(since.count(), 1e-6);
+  postgresLogger_->info("First sample written {:.3f}s after startup",
+                        since.count());
+}
+
+PostgresClient::CachedInverter
+PostgresClient::inverterCache(const pg::Conn &conn, const std::string &name) {
+  const std::string s = conn.quoteName(name);
+  CachedInverter ci;
+  ci.upsertStmt = name + ".device";
+  ci.valuesStmt = name + ".samples";
+  ci.phaseStmt = name + ".phase_samples";
+  ci.inputStmt = name + ".input_samples";
+  ci.edgeStmt = name + ".power_edge";
+  ci.upsertSql =
+      "INSERT INTO " + s +
+      ".device (serial_number, manufacturer, model, firmware_version, "
+      "data_manager, register_model, inverter_id, slave_id, hybrid, "
+      "mppt_tracker, phases, power_rating, last_seen) "
+      "VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9,$10,$11,$12, now()) "
+      "ON CONFLICT (serial_number) DO UPDATE SET "
+      "manufacturer=EXCLUDED.manufacturer, model=EXCLUDED.model, "
+      "firmware_version=EXCLUDED.firmware_version, "
+      "data_manager=EXCLUDED.data_manager, "
+      "register_model=EXCLUDED.register_model, "
+      "inverter_id=EXCLUDED.inverter_id, slave_id=EXCLUDED.slave_id, "
+      "hybrid=EXCLUDED.hybrid, mppt_tracker=EXCLUDED.mppt_tracker, "
+      "phases=EXCLUDED.phases, power_rating=EXCLUDED.power_rating, "
+      "last_seen=now()";
+  ci.valuesSql =
+      "INSERT INTO " + s +
+      ".samples (time, ac_energy, ac_power_active, ac_power_apparent, "
+      "ac_power_reactive, ac_power_factor, ac_frequency, dc_power, "
+      "efficiency) VALUES ";
+  ci.phaseSql = "INSERT INTO " + s +
+                ".phase_samples (time, phase_id, ac_voltage, ac_current) "
+                "VALUES ";
+  ci.inputSql = "INSERT INTO " + s +
+                ".input_samples (time, input_id, dc_voltage, dc_current, "
+                "dc_power, dc_energy) VALUES ";
+  ci.edgeSql = edgeSqlOf(s);
+  return ci;
+}
+
+PostgresClient::CachedMeter
+PostgresClient::meterCache(const pg::Conn &conn, const std::string &name) {
+  const std::string s = conn.quoteName(name);
+  CachedMeter cm;
+  cm.upsertStmt = name + ".device";
+  cm.valuesStmt = name + ".samples";
+  cm.phaseStmt = name + ".phase_samples";
+  cm.edgeStmt = name + ".power_edge";
+  cm.upsertSql =
+      "INSERT INTO " + s +
+      ".device (serial_number, manufacturer, model, firmware_version, "
+      "register_model, meter_id, slave_id, phases, last_seen) "
+      "VALUES ($1,$2,$3,$4,$5,$6,$7,$8, now()) "
+      "ON CONFLICT (serial_number) DO UPDATE SET "
+      "manufacturer=EXCLUDED.manufacturer, model=EXCLUDED.model, "
+      "firmware_version=EXCLUDED.firmware_version, "
+      "register_model=EXCLUDED.register_model, meter_id=EXCLUDED.meter_id, "
+      "slave_id=EXCLUDED.slave_id, phases=EXCLUDED.phases, last_seen=now()";
+  cm.valuesSql =
+      "INSERT INTO " + s +
+      ".samples (time, energy_active_import, energy_active_export, "
+      "energy_apparent_import, energy_apparent_export, "
+      "energy_reactive_import, energy_reactive_export, power_active, "
+      "power_apparent, power_reactive, power_factor, frequency, voltage_ph, "
+      "voltage_pp, current) VALUES ";
+  cm.phaseSql =
+      "INSERT INTO " + s +
+      ".phase_samples (time, phase_id, power_active, power_apparent, "
+      "power_reactive, power_factor, voltage_ph, voltage_pp, current) "
+      "VALUES ";
+  cm.edgeSql = edgeSqlOf(s);
+  return cm;
+}
+
 // ---------------------------------------------------------------------------
 // SQL paths
 // ---------------------------------------------------------------------------
 
 std::expected<void, DbError>
-PostgresClient::upsertInverterDevice(const std::string &name,
+PostgresClient::upsertInverterDevice(Writer &w, DeviceId device,
                                      const InverterTypes::Device &dev) {
-  if (!conn_)
+  if (!w.conn)
     return std::unexpected(DbError::make(
         DbError::Kind::INTERNAL, "upsertInverterDevice without a connection"));
 
-  auto it = cachedInverters_.find(name);
-  if (it == cachedInverters_.end()) {
+  const std::string &name = w.registry[device].name;
+  auto &slot = cachedInverters_[device];
+  if (!slot && readyInverters_[device]) {
+    // Migrated at startup by migrateRoster().
+    slot = std::move(readyInverters_[device]);
+    readyInverters_[device].reset();
+  } else if (!slot) {
     // First sight of this device: create/verify its schema, then build the
     // schema-qualified SQL it will reuse. Not repeated on reconnect (the entry
     // stays cached).
-    SchemaMigrator m{*conn_};
+    SchemaMigrator m{*w.conn};
     auto migrated = cfg_.autoMigrate ? m.migrate(inverterMigrations, name)
                                      : m.verify(inverterMigrations, name);
     if (!migrated)
       return std::unexpected(migrated.error());
-
-    const std::string s = conn_->quoteName(name);
-    CachedInverter ci;
-    ci.upsertSql =
-        "INSERT INTO " + s +
-        ".device (serial_number, manufacturer, model, firmware_version, "
-        "data_manager, register_model, inverter_id, slave_id, hybrid, "
-        "mppt_tracker, phases, power_rating, last_seen) "
-        "VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9,$10,$11,$12, now()) "
-        "ON CONFLICT (serial_number) DO UPDATE SET "
-        "manufacturer=EXCLUDED.manufacturer, model=EXCLUDED.model, "
-        "firmware_version=EXCLUDED.firmware_version, "
-        "data_manager=EXCLUDED.data_manager, "
-        "register_model=EXCLUDED.register_model, "
-        "inverter_id=EXCLUDED.inverter_id, slave_id=EXCLUDED.slave_id, "
-        "hybrid=EXCLUDED.hybrid, mppt_tracker=EXCLUDED.mppt_tracker, "
-        "phases=EXCLUDED.phases, power_rating=EXCLUDED.power_rating, "
-        "last_seen=now()";
-    ci.valuesSql =
-        "INSERT INTO " + s +
-        ".samples (time, ac_energy, ac_power_active, ac_power_apparent, "
-        "ac_power_reactive, ac_power_factor, ac_frequency, dc_power, "
-        "efficiency) VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9)";
-    ci.phaseSql = "INSERT INTO " + s +
-                  ".phase_samples (time, phase_id, ac_voltage, ac_current) "
-                  "VALUES ($1,$2,$3,$4)";
-    ci.inputSql = "INSERT INTO " + s +
-                  ".input_samples (time, input_id, dc_voltage, dc_current, "
-                  "dc_power, dc_energy) VALUES ($1,$2,$3,$4,$5,$6)";
-    it = cachedInverters_.emplace(name, std::move(ci)).first;
+    slot = inverterCache(*w.conn, name);
   }
+  deviceCached_[device].store(true, std::memory_order_release);
 
   // A single ON CONFLICT upsert is atomic on its own, so it runs in autocommit
   // with no surrounding transaction.
-  if (auto r = conn_->execParams(
-          it->second.upsertSql,
+  if (auto r = w.conn->execPrepared(
+          slot->upsertStmt, slot->upsertSql,
           pg::Params{dev.serialNumber, dev.manufacturer, dev.model,
                      dev.fwVersion, dev.dataManagerVersion, dev.registerModel,
                      dev.id, dev.slaveID, dev.isHybrid, dev.inputs, dev.phases,
@@ -489,7 +1254,7 @@ PostgresClient::upsertInverterDevice(const std::string &name,
       !r)
     return std::unexpected(r.error());
 
-  auto &ci = it->second;
+  auto &ci = *slot;
   ci.device = dev;
   ci.isHybrid = dev.isHybrid;
   ci.phases = dev.phases;
@@ -501,47 +1266,26 @@ PostgresClient::upsertInverterDevice(const std::string &name,
 }
 
 std::expected<void, DbError>
-PostgresClient::upsertMeterDevice(const std::string &name,
+PostgresClient::upsertMeterDevice(Writer &w, DeviceId device,
                                   const MeterTypes::Device &dev) {
-  if (!conn_)
+  if (!w.conn)
     return std::unexpected(DbError::make(
         DbError::Kind::INTERNAL, "upsertMeterDevice without a connection"));
 
-  auto it = cachedMeters_.find(name);
-  if (it == cachedMeters_.end()) {
-    SchemaMigrator m{*conn_};
+  const std::string &name = w.registry[device].name;
+  auto &slot = cachedMeters_[device];
+  if (!slot && readyMeters_[device]) {
+    slot = std::move(readyMeters_[device]);
+    readyMeters_[device].reset();
+  } else if (!slot) {
+    SchemaMigrator m{*w.conn};
     auto migrated = cfg_.autoMigrate ? m.migrate(meterMigrations, name)
                                      : m.verify(meterMigrations, name);
     if (!migrated)
       return std::unexpected(migrated.error());
-
-    const std::string s = conn_->quoteName(name);
-    CachedMeter cm;
-    cm.upsertSql =
-        "INSERT INTO " + s +
-        ".device (serial_number, manufacturer, model, firmware_version, "
-        "register_model, meter_id, slave_id, phases, last_seen) "
-        "VALUES ($1,$2,$3,$4,$5,$6,$7,$8, now()) "
-        "ON CONFLICT (serial_number) DO UPDATE SET "
-        "manufacturer=EXCLUDED.manufacturer, model=EXCLUDED.model, "
-        "firmware_version=EXCLUDED.firmware_version, "
-        "register_model=EXCLUDED.register_model, meter_id=EXCLUDED.meter_id, "
-        "slave_id=EXCLUDED.slave_id, phases=EXCLUDED.phases, last_seen=now()";
-    cm.valuesSql =
-        "INSERT INTO " + s +
-        ".samples (time, energy_active_import, energy_active_export, "
-        "energy_apparent_import, energy_apparent_export, "
-        "energy_reactive_import, energy_reactive_export, power_active, "
-        "power_apparent, power_reactive, power_factor, frequency, voltage_ph, "
-        "voltage_pp, current) "
-        "VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9,$10,$11,$12,$13,$14,$15)";
-    cm.phaseSql =
-        "INSERT INTO " + s +
-        ".phase_samples (time, phase_id, power_active, power_apparent, "
-        "power_reactive, power_factor, voltage_ph, voltage_pp, current) "
-        "VALUES ($1,$2,$3,$4,$5,$6,$7,$8,$9)";
-    it = cachedMeters_.emplace(name, std::move(cm)).first;
+    slot = meterCache(*w.conn, name);
   }
+  deviceCached_[device].store(true, std::memory_order_release);
 
   // A non-SunSpec meter (e.g. EBZ Easymeter over SML) leaves the SunSpec /
   // Modbus identity fields unset; store NULL rather than empty/zero so the
@@ -556,15 +1300,15 @@ PostgresClient::upsertMeterDevice(const std::string &name,
 
   // A single ON CONFLICT upsert is atomic on its own, so it runs in autocommit
   // with no surrounding transaction.
-  if (auto r =
-          conn_->execParams(it->second.upsertSql,
-                            pg::Params{dev.serialNumber, dev.manufacturer,
-                                       dev.model, dev.fwVersion, registerModel,
-                                       meterId, slaveId, dev.phases});
+  if (auto r = w.conn->execPrepared(
+          slot->upsertStmt, slot->upsertSql,
+          pg::Params{dev.serialNumber, dev.manufacturer, dev.model,
+                     dev.fwVersion, registerModel, meterId, slaveId,
+                     dev.phases});
       !r)
     return std::unexpected(r.error());
 
-  auto &cm = it->second;
+  auto &cm = *slot;
   cm.device = dev;
   cm.phases = dev.phases;
 
@@ -574,143 +1318,269 @@ PostgresClient::upsertMeterDevice(const std::string &name,
 }
 
 std::expected<void, DbError>
-PostgresClient::insertInverterValues(const std::string &name,
-                                     const InverterTypes::Values &v) {
-  if (!conn_)
-    return std::unexpected(DbError::make(
-        DbError::Kind::INTERNAL, "insertInverterValues without a connection"));
-
-  const auto it = cachedInverters_.find(name);
-  if (it == cachedInverters_.end()) {
-    // Values can briefly precede the device upsert at startup (e.g. on a shared
-    // bus where each device is polled in turn). Without the cache we have
-    // neither the schema SQL nor the cardinality flags, so drop the event.
-    return std::unexpected(DbError::make(
-        DbError::Kind::QUERY,
-        "inverter '{}' values arrived before its device upsert, dropping",
-        name));
-  }
-
-  const auto &cache = it->second;
-  const auto ts = timeFromMillis(v.time);
-  const bool isHybrid = cache.isHybrid;
-  const int phases = std::clamp(cache.phases, 1, 3);
-  const int inputs = std::clamp(cache.inputs, 1, 2);
-
-  auto tx = pg::Transaction::begin(*conn_);
-  if (!tx)
-    return std::unexpected(tx.error());
-
-  if (auto r = conn_->execParams(
-          cache.valuesSql, pg::Params{ts, Utils::scaleToKilo(v.acEnergy),
-                                      static_cast<float>(v.acPowerActive),
-                                      static_cast<float>(v.acPowerApparent),
-                                      static_cast<float>(v.acPowerReactive),
-                                      static_cast<float>(v.acPowerFactor),
-                                      static_cast<float>(v.acFrequency),
-                                      static_cast<float>(v.dcPower),
-                                      static_cast<float>(v.efficiency)});
+PostgresClient::addSiteEnergy(Writer &w, const SiteEnergyDelta &delta) {
+  // One function call, atomic on its own: it locks the day's row, adds the
+  // increments and re-derives the dependent columns.
+  constexpr double kWh = 1000.0;
+  if (auto r = w.conn->execPrepared(
+          "public.add_site_energy",
+          "SELECT public.add_site_energy($1::date, $2, $3, $4, $5, $6, $7)",
+          pg::Params{delta.day, delta.measured, delta.production / kWh,
+                     delta.consumption / kWh, delta.fromGrid / kWh,
+                     delta.toGrid / kWh, delta.overlap / kWh});
       !r)
     return std::unexpected(r.error());
 
-  const std::array<const InverterTypes::Phase *, 3> phaseList = {
-      &v.phase1, &v.phase2, &v.phase3};
-  for (int i = 0; i < phases; ++i) {
-    if (auto r = conn_->execParams(
-            cache.phaseSql,
-            pg::Params{ts, static_cast<int16_t>(i + 1),
-                       static_cast<float>(phaseList[i]->acVoltage),
-                       static_cast<float>(phaseList[i]->acCurrent)});
-        !r)
-      return std::unexpected(r.error());
-  }
+  postgresLogger_->trace("Added site energy of {}", delta.day);
+  return {};
+}
 
-  const std::array<const InverterTypes::Input *, 2> inputList = {&v.input1,
-                                                                 &v.input2};
-  for (int i = 0; i < inputs; ++i) {
-    // dc_energy is NULL for hybrid inverters (the struct holds 0.0 as a
-    // sentinel that would corrupt monotonic-counter analysis); otherwise
-    // scale raw Wh to kWh on the way to the column.
-    std::optional<double> dcEnergy =
-        isHybrid
-            ? std::nullopt
-            : std::optional<double>{Utils::scaleToKilo(inputList[i]->dcEnergy)};
-
-    if (auto r = conn_->execParams(
-            cache.inputSql,
-            pg::Params{ts, static_cast<int16_t>(i + 1),
-                       static_cast<float>(inputList[i]->dcVoltage),
-                       static_cast<float>(inputList[i]->dcCurrent),
-                       static_cast<float>(inputList[i]->dcPower), dcEnergy});
-        !r)
-      return std::unexpected(r.error());
-  }
+std::expected<void, DbError>
+PostgresClient::upsertSiteSnapshot(Writer &w, const SnapshotRow &row) {
+  if (auto r = w.conn->execPrepared(
+          "public.site_snapshot",
+          "INSERT INTO public.site_snapshot (time, complete, "
+          "production_power, primary_power, document) "
+          "VALUES ($1, $2, $3, $4, $5::jsonb) "
+          "ON CONFLICT (time) DO UPDATE SET complete = EXCLUDED.complete, "
+          "production_power = EXCLUDED.production_power, "
+          "primary_power = EXCLUDED.primary_power, "
+          "document = EXCLUDED.document",
+          pg::Params{timeFromMillis(row.time), row.complete,
+                     row.productionPower, row.primaryPower, row.document});
+      !r)
+    return std::unexpected(r.error());
 
-  if (auto committed = tx->commit(); !committed)
-    return std::unexpected(committed.error());
+  postgresLogger_->trace("Wrote site snapshot at {}", row.time);
   return {};
 }
 
 std::expected<void, DbError>
-PostgresClient::insertMeterValues(const std::string &name,
-                                  const MeterTypes::Values &v) {
-  if (!conn_)
-    return std::unexpected(DbError::make(
-        DbError::Kind::INTERNAL, "insertMeterValues without a connection"));
+PostgresClient::insertValues(Writer &w, std::span<const Event> events,
+                             pg::Pipeline *pipeline) {
+  if (!w.conn)
+    return std::unexpected(DbError::make(DbError::Kind::INTERNAL,
+                                         "insertValues without a connection"));
+  pg::Conn &conn = *w.conn;
+
+  // One RowBatch per device and table, indexed by DeviceId like the caches.
+  // The cache entries are stable: nothing below touches cachedInverters_ /
+  // cachedMeters_.
+  struct InverterRows {
+    InverterRows(const CachedInverter &c, pg::Pipeline *p)
+        : cache(c), samples(c.valuesSql, c.valuesStmt, p),
+          phases(c.phaseSql, c.phaseStmt, p),
+          inputs(c.inputSql, c.inputStmt, p), edge(c.edgeSql, c.edgeStmt, p) {}
+    const CachedInverter &cache;
+    RowBatch samples;
+    RowBatch phases;
+    RowBatch inputs;
+    RowBatch edge;
+  };
+  struct MeterRows {
+    MeterRows(const CachedMeter &c, pg::Pipeline *p)
+        : cache(c), samples(c.valuesSql, c.valuesStmt, p),
+          phases(c.phaseSql, c.phaseStmt, p), edge(c.edgeSql, c.edgeStmt, p) {}
+    const CachedMeter &cache;
+    RowBatch samples;
+    RowBatch phases;
+    RowBatch edge;
+  };
+  std::vector<std::optional<InverterRows>> inverterRows(w.registry.size());
+  std::vector<std::optional<MeterRows>> meterRows(w.registry.size());
+
+  auto addInverter =
+      [&conn](InverterRows &rows,
+              const InverterTypes::Values &v) -> std::expected<void, DbError> {
+    const auto ts = timeFromMillis(v.time);
+    const bool isHybrid = rows.cache.isHybrid;
+    const int phases = std::clamp(rows.cache.phases, 1, 3);
+    const int inputs = std::clamp(rows.cache.inputs, 1, 2);
+
+    if (auto r = rows.samples.addRow(conn, ts, Utils::scaleToKilo(v.acEnergy),
+                                     static_cast<float>(v.acPowerActive),
+                                     static_cast<float>(v.acPowerApparent),
+                                     static_cast<float>(v.acPowerReactive),
+                                     static_cast<float>(v.acPowerFactor),
+                                     static_cast<float>(v.acFrequency),
+                                     static_cast<float>(v.dcPower),
+                                     static_cast<float>(v.efficiency));
+        !r)
+      return r;
 
-  const auto it = cachedMeters_.find(name);
-  if (it == cachedMeters_.end()) {
-    return std::unexpected(DbError::make(
-        DbError::Kind::QUERY,
-        "meter '{}' values arrived before its device upsert, dropping", name));
-  }
+    const std::array<const InverterTypes::Phase *, 3> phaseList = {
+        &v.phase1, &v.phase2, &v.phase3};
+    for (int i = 0; i < phases; ++i) {
+      if (auto r = rows.phases.addRow(
+              conn, ts, static_cast<int16_t>(i + 1),
+              static_cast<float>(phaseList[i]->acVoltage),
+              static_cast<float>(phaseList[i]->acCurrent));
+          !r)
+        return r;
+    }
 
-  const auto &cache = it->second;
-  const auto ts = timeFromMillis(v.time);
-  const int phases = std::clamp(cache.phases, 1, 3);
+    const std::array<const InverterTypes::Input *, 2> inputList = {&v.input1,
+                                                                   &v.input2};
+    for (int i = 0; i < inputs; ++i) {
+      // dc_energy is NULL for hybrid inverters (the struct holds 0.0 as a
+      // sentinel that would corrupt monotonic-counter analysis); otherwise
+      // scale raw Wh to kWh on the way to the column.
+      std::optional<double> dcEnergy =
+          isHybrid ? std::nullopt
+                   : std::optional<double>{
+                         Utils::scaleToKilo(inputList[i]->dcEnergy)};
+
+      if (auto r = rows.inputs.addRow(
+              conn, ts, static_cast<int16_t>(i + 1),
+              static_cast<float>(inputList[i]->dcVoltage),
+              static_cast<float>(inputList[i]->dcCurrent),
+              static_cast<float>(inputList[i]->dcPower), dcEnergy);
+          !r)
+        return r;
+    }
+    return {};
+  };
+
+  auto addMeter =
+      [&conn](MeterRows &rows,
+              const MeterTypes::Values &v) -> std::expected<void, DbError> {
+    const auto ts = timeFromMillis(v.time);
+    const int phases = std::clamp(rows.cache.phases, 1, 3);
+
+    // Energies are scaled Wh -> kWh at bind time, the same boundary scaling
+    // libfronius applies for the MQTT JSON.
+    if (auto r = rows.samples.addRow(
+            conn, ts, Utils::scaleToKilo(v.activeEnergyImport),
+            Utils::scaleToKilo(v.activeEnergyExport),
+            Utils::scaleToKilo(v.apparentEnergyImport),
+            Utils::scaleToKilo(v.apparentEnergyExport),
+            Utils::scaleToKilo(v.reactiveEnergyImport),
+            Utils::scaleToKilo(v.reactiveEnergyExport),
+            static_cast<float>(v.activePower),
+            static_cast<float>(v.apparentPower),
+            static_cast<float>(v.reactivePower),
+            static_cast<float>(v.powerFactor), static_cast<float>(v.frequency),
+            static_cast<float>(v.phVoltage), static_cast<float>(v.ppVoltage),
+            static_cast<float>(v.current));
+        !r)
+      return r;
 
-  auto tx = pg::Transaction::begin(*conn_);
-  if (!tx)
-    return std::unexpected(tx.error());
+    const std::array<const MeterTypes::Phase *, 3> phaseList = {
+        &v.phase1, &v.phase2, &v.phase3};
+    for (int i = 0; i < phases; ++i) {
+      if (auto r = rows.phases.addRow(
+              conn, ts, static_cast<int16_t>(i + 1),
+              static_cast<float>(phaseList[i]->activePower),
+              static_cast<float>(phaseList[i]->apparentPower),
+              static_cast<float>(phaseList[i]->reactivePower),
+              static_cast<float>(phaseList[i]->powerFactor),
+              static_cast<float>(phaseList[i]->phVoltage),
+              static_cast<float>(phaseList[i]->ppVoltage),
+              static_cast<float>(phaseList[i]->current));
+          !r)
+        return r;
+    }
+    return {};
+  };
+
+  auto addBucket = [&conn](RowBatch &edge, const PowerBucket &b) {
+    return edge.addRow(conn, timeFromMillis(b.start), b.width, b.samples,
+                       static_cast<float>(b.avg), static_cast<float>(b.min),
+                       static_cast<float>(b.max), static_cast<float>(b.last));
+  };
+
+  // Pipelined, the unit closed by the sync below is the transaction.
+  std::optional<pg::Transaction> tx;
+  if (!pipeline) {
+    auto begun = pg::Transaction::begin(conn);
+    if (!begun)
+      return std::unexpected(begun.error());
+    tx.emplace(std::move(*begun));
+  }
 
-  // Energies are scaled Wh -> kWh at bind time, the same boundary scaling
-  // libfronius applies for the MQTT JSON.
-  if (auto r = conn_->execParams(
-          cache.valuesSql,
-          pg::Params{
-              ts, Utils::scaleToKilo(v.activeEnergyImport),
-              Utils::scaleToKilo(v.activeEnergyExport),
-              Utils::scaleToKilo(v.apparentEnergyImport),
-              Utils::scaleToKilo(v.apparentEnergyExport),
-              Utils::scaleToKilo(v.reactiveEnergyImport),
-              Utils::scaleToKilo(v.reactiveEnergyExport),
-              static_cast<float>(v.activePower),
-              static_cast<float>(v.apparentPower),
-              static_cast<float>(v.reactivePower),
-              static_cast<float>(v.powerFactor),
-              static_cast<float>(v.frequency), static_cast<float>(v.phVoltage),
-              static_cast<float>(v.ppVoltage), static_cast<float>(v.current)});
-      !r)
-    return std::unexpected(r.error());
+  for (const auto &ev : events) {
+    if (const auto *v = std::get_if<InverterTypes::Values>(&ev.payload)) {
+      auto &rows = inverterRows[ev.device];
+      if (!rows) {
+        const auto &cached = cachedInverters_[ev.device];
+        if (!cached) {
+          // Values can briefly precede the device upsert at startup (e.g. on
+          // a shared bus where each device is polled in turn). Without the
+          // cache we have neither the schema SQL nor the cardinality flags,
+          // so drop the event; the rest of the batch is unaffected.
+          postgresLogger_->warn("inverter '{}' values arrived before its "
+                                "device upsert, dropping",
+                                w.registry[ev.device].name);
+          continue;
+        }
+        rows.emplace(*cached, pipeline);
+      }
+      if (auto r = addInverter(*rows, *v); !r)
+        return r;
+    } else if (const auto *v = std::get_if<MeterTypes::Values>(&ev.payload)) {
+      auto &rows = meterRows[ev.device];
+      if (!rows) {
+        const auto &cached = cachedMeters_[ev.device];
+        if (!cached) {
+          postgresLogger_->warn(
+              "meter '{}' values arrived before its device upsert, dropping",
+              w.registry[ev.device].name);
+          continue;
+        }
+        rows.emplace(*cached, pipeline);
+      }
+      if (auto r = addMeter(*rows, *v); !r)
+        return r;
+    } else if (const auto *b = std::get_if<PowerBucket>(&ev.payload)) {
+      // Either kind of device; its cache says which.
+      RowBatch *edge = nullptr;
+      if (const auto &cached = cachedInverters_[ev.device]) {
+        auto &rows = inverterRows[ev.device];
+        if (!rows)
+          rows.emplace(*cached, pipeline);
+        edge = &rows->edge;
+      } else if (const auto &cached = cachedMeters_[ev.device]) {
+        auto &rows = meterRows[ev.device];
+        if (!rows)
+          rows.emplace(*cached, pipeline);
+        edge = &rows->edge;
+      } else {
+        postgresLogger_->warn("'{}' power bucket arrived before its device "
+                              "upsert, dropping",
+                              w.registry[ev.device].name);
+        continue;
+      }
+      if (auto r = addBucket(*edge, *b); !r)
+        return r;
+    }
+  }
 
-  const std::array<const MeterTypes::Phase *, 3> phaseList = {
-      &v.phase1, &v.phase2, &v.phase3};
-  for (int i = 0; i < phases; ++i) {
-    if (auto r = conn_->execParams(
-            cache.phaseSql,
-            pg::Params{ts, static_cast<int16_t>(i + 1),
-                       static_cast<float>(phaseList[i]->activePower),
-                       static_cast<float>(phaseList[i]->apparentPower),
-                       static_cast<float>(phaseList[i]->reactivePower),
-                       static_cast<float>(phaseList[i]->powerFactor),
-                       static_cast<float>(phaseList[i]->phVoltage),
-                       static_cast<float>(phaseList[i]->ppVoltage),
-                       static_cast<float>(phaseList[i]->current)});
-        !r)
-      return std::unexpected(r.error());
+  // Send what is left in every statement. Parent and child rows go in
+  // separate statements; they share a transaction, so a sample is still all
+  // or nothing.
+  for (auto &rows : inverterRows) {
+    if (!rows)
+      continue;
+    for (RowBatch *batch :
+         {&rows->samples, &rows->phases, &rows->inputs, &rows->edge})
+      if (auto r = batch->flush(conn); !r)
+        return r;
+  }
+  for (auto &rows : meterRows) {
+    if (!rows)
+      continue;
+    for (RowBatch *batch : {&rows->samples, &rows->phases, &rows->edge})
+      if (auto r = batch->flush(conn); !r)
+        return r;
   }
 
+  if (pipeline)
+    return pipeline->sync();
+
   if (auto committed = tx->commit(); !committed)
     return std::unexpected(committed.error());
+
+  postgresLogger_->trace("Wrote {} value events in one transaction",
+                         events.size());
   return {};
 }
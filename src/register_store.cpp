@@ -0,0 +1,104 @@
+#include "register_store.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <fronius/fronius.h>
+#include <memory>
+#include <modbus/modbus.h>
+#include <vector>
+
+void RegisterStore::serve(std::vector<Span> spans) {
+  std::erase_if(spans, [this](const Span &s) {
+    return s.count <= 0 || s.addr < 0 || s.addr + s.count > registers_;
+  });
+  std::sort(spans.begin(), spans.end(),
+            [](const Span &a, const Span &b) { return a.addr < b.addr; });
+
+  spans_.clear();
+  for (const Span &s : spans) {
+    if (!spans_.empty() &&
+        s.addr <= spans_.back().addr + spans_.back().count) {
+      Span &last = spans_.back();
+      last.count = std::max(last.addr + last.count, s.addr + s.count) -
+                   last.addr;
+    } else {
+      spans_.push_back(s);
+    }
+  }
+  if (!spans_.empty())
+    window_ = {spans_.front().addr,
+               spans_.back().addr + spans_.back().count - spans_.front().addr};
+}
+
+std::expected<std::shared_ptr<modbus_mapping_t>, ModbusError>
+RegisterStore::acquire() {
+  const auto published = current_.load(std::memory_order_acquire);
+
+  std::shared_ptr<modbus_mapping_t> next;
+  for (const auto &m : pool_) {
+    // Only the published snapshot can gain readers, so a spare whose sole
+    // owner is the pool stays free until we publish it.
+    if (m != published && m.use_count() == 1) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      next = m;
+      break;
+    }
+  }
+
+  if (!next) {
+    next = std::shared_ptr<modbus_mapping_t>(
+        account_ ? modbus_mapping_new_start_address(
+                       0, 0, 0, 0, static_cast<unsigned>(window_.addr),
+                       static_cast<unsigned>(window_.count), 0, 0)
+                 : modbus_mapping_new(0, 0, registers_, 0),
+        Deleter{});
+    if (!next) {
+      return std::unexpected(ModbusError::custom(
+          ENOMEM, "RegisterStore: unable to allocate Modbus mapping"));
+    }
+    if (account_)
+      account_->reserve(sizeof(modbus_mapping_t) +
+                        static_cast<std::size_t>(window_.count) *
+                            sizeof(std::uint16_t));
+    pool_.push_back(next);
+  }
+
+  if (published)
+    copySpans(*published, *next);
+  return next;
+}
+
+std::expected<modbus_mapping_t *, ModbusError>
+RegisterStore::stageIn(const modbus_mapping_t &snapshot) {
+  if (!staging_ || staging_->nb_registers < registers_) {
+    if (staging_)
+      account_->release(static_cast<std::size_t>(staging_->nb_registers) *
+                        sizeof(std::uint16_t));
+    staging_.reset(modbus_mapping_new(0, 0, registers_, 0));
+    if (!staging_) {
+      return std::unexpected(ModbusError::custom(
+          ENOMEM, "RegisterStore: unable to allocate the staging mapping"));
+    }
+    account_->reserve(static_cast<std::size_t>(registers_) *
+                      sizeof(std::uint16_t));
+  }
+  copySpans(snapshot, *staging_);
+  return staging_.get();
+}
+
+void RegisterStore::stageOut(const modbus_mapping_t &staging,
+                             modbus_mapping_t &snapshot) const {
+  copySpans(staging, snapshot);
+}
+
+void RegisterStore::copySpans(const modbus_mapping_t &from,
+                              modbus_mapping_t &to) const {
+  for (const Span &s : spans_) {
+    std::memcpy(to.tab_registers + (s.addr - to.start_registers),
+                from.tab_registers + (s.addr - from.start_registers),
+                static_cast<std::size_t>(s.count) * sizeof(std::uint16_t));
+  }
+}
@@ -97,10 +97,13 @@ SchemaMigrator::validateMigrationList(std::span<const Migration> migrations) {
   return {};
 }
 
-std::expected<void, DbError> SchemaMigrator::acquireAdvisoryLock() {
-  if (auto res = conn_.exec("SELECT pg_advisory_xact_lock(" +
-                                std::to_string(advisoryLockKey) + ")",
-                            DbError::Kind::MIGRATION);
+std::expected<void, DbError>
+SchemaMigrator::acquireAdvisoryLock(std::string_view schemaName) {
+  if (auto res = conn_.execParams(
+          "SELECT pg_advisory_xact_lock($1, hashtext($2))",
+          pg::Params{static_cast<int>(advisoryLockClass),
+                     std::string{schemaName}},
+          DbError::Kind::MIGRATION);
       !res)
     return std::unexpected(res.error());
   return {};
@@ -199,7 +202,7 @@ SchemaMigrator::migrate(std::span<const Migration> migrations,
   if (!tx)
     return std::unexpected(tx.error());
 
-  if (auto r = acquireAdvisoryLock(); !r)
+  if (auto r = acquireAdvisoryLock(schemaName); !r)
     return r;
   if (auto r = createSchema(schemaName); !r)
     return r;
@@ -265,7 +268,7 @@ SchemaMigrator::verify(std::span<const Migration> migrations,
   if (!tx)
     return std::unexpected(tx.error());
 
-  if (auto r = acquireAdvisoryLock(); !r)
+  if (auto r = acquireAdvisoryLock(schemaName); !r)
     return r;
   // verify() writes nothing: no CREATE SCHEMA, no schema_version table. Just
   // point search_path at the (possibly absent) schema and read the version.
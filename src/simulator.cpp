@@ -0,0 +1,638 @@
+#include "simulator.h"
+#include "config_yaml.h"
+#include "signal_handler.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fronius/fronius.h>
+#include <fronius/registers.h>
+#include <memory>
+#include <modbus/modbus.h>
+#include <numbers>
+#include <poll.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Register helpers
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Every unit's mapping covers [baseAddr, baseAddr + registerCount), enough
+// for the longest model chain (a hybrid inverter ends at 40330).
+constexpr int baseAddr = 40000;
+constexpr int registerCount = 512;
+
+// SunSpec's "not implemented" values.
+constexpr std::uint16_t noUint16 = 0xFFFF;
+constexpr std::uint16_t noInt16 = 0x8000;
+
+// Inverter model chain (register addresses, zero-based).
+constexpr int invModel = 40069;  // 101/102/103, L=50
+constexpr int nameplate = 40121; // 120, L=26
+constexpr int settings = 40149;  // 121, L=30
+constexpr int status = 40181;    // 122, L=44
+constexpr int controls = 40227;  // 123, L=24
+constexpr int mppt = 40253;      // 160, L=8+20*N (then 124 if hybrid)
+
+constexpr double powerCycle = 600.0; // s, inverter AC power sine
+constexpr double meterCycle = 300.0; // s, meter import/export swing
+constexpr double powerFactor = 0.95;
+
+void put(modbus_mapping_t *regs, int addr, std::uint16_t value) {
+  const int i = addr - baseAddr;
+  if (i >= 0 && i < regs->nb_registers)
+    regs->tab_registers[i] = value;
+}
+
+// An int16 or uint16 field as value * 10^-sf, clamped into range.
+void putScaled(modbus_mapping_t *regs, int addr, double value, int sf,
+               bool isSigned = true) {
+  const double raw = std::round(value * std::pow(10.0, -sf));
+  if (isSigned)
+    put(regs, addr,
+        static_cast<std::uint16_t>(static_cast<std::int16_t>(
+            std::clamp(raw, -32767.0, 32767.0))));
+  else
+    put(regs, addr, static_cast<std::uint16_t>(std::clamp(raw, 0.0, 65534.0)));
+}
+
+void putSf(modbus_mapping_t *regs, int addr, int sf) {
+  put(regs, addr, static_cast<std::uint16_t>(static_cast<std::int16_t>(sf)));
+}
+
+// An acc32 or uint32, high word first.
+void putUint32(modbus_mapping_t *regs, int addr, std::uint32_t value) {
+  put(regs, addr, static_cast<std::uint16_t>(value >> 16));
+  put(regs, addr + 1, static_cast<std::uint16_t>(value & 0xFFFF));
+}
+
+// A string of `count` registers, two characters each, NUL padded.
+void putString(modbus_mapping_t *regs, int addr, int count,
+               std::string_view text) {
+  for (int i = 0; i < count; ++i) {
+    const std::size_t c = 2 * static_cast<std::size_t>(i);
+    const auto hi = c < text.size() ? static_cast<std::uint8_t>(text[c]) : 0;
+    const auto lo =
+        c + 1 < text.size() ? static_cast<std::uint8_t>(text[c + 1]) : 0;
+    put(regs, addr + i, static_cast<std::uint16_t>((hi << 8) | lo));
+  }
+}
+
+// The finest scale factor, no finer than `finest`, at which `max` still fits
+// an int16: a 200 kW inverter needs W_SF = 1 where a 5 kW one has 0.
+int scaleFor(double max, int finest) {
+  int sf = finest;
+  while (max * std::pow(10.0, -sf) > 32767.0)
+    ++sf;
+  return sf;
+}
+
+double noise(std::mt19937 &rng, double amplitude) {
+  return std::uniform_real_distribution<double>(-amplitude, amplitude)(rng);
+}
+
+std::uint32_t wattHours(double energy) {
+  return static_cast<std::uint32_t>(std::fmod(energy, 4294967296.0));
+}
+
+std::shared_ptr<spdlog::logger> busLogger() {
+  auto logger = spdlog::get("bus");
+  return logger ? logger : spdlog::default_logger();
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// SimulatedGateway
+// ---------------------------------------------------------------------------
+
+SimulatedGateway::State::~State() {
+  if (regs)
+    modbus_mapping_free(regs);
+}
+
+SimulatedGateway::Client::~Client() {
+  // modbus_close() closes the socket too.
+  if (ctx) {
+    modbus_close(ctx);
+    modbus_free(ctx);
+  } else if (socket != -1) {
+    close(socket);
+  }
+}
+
+SimulatedGateway::SimulatedGateway(int port, const std::vector<Unit> &units,
+                                   SignalHandler &signalHandler)
+    : port_(port), handler_(signalHandler), logger_(busLogger()),
+      start_(std::chrono::steady_clock::now()), lastTick_(start_) {
+
+  for (const auto &unit : units) {
+    auto state = std::make_unique<State>();
+    state->unit = unit;
+    state->regs = modbus_mapping_new_start_address(0, 0, 0, 0, baseAddr,
+                                                   registerCount, 0, 0);
+    if (!state->regs)
+      throw std::runtime_error(
+          ModbusError::custom(ENOMEM,
+                              "Simulator: unable to allocate the mapping "
+                              "for '{}'",
+                              unit.name)
+              .describe());
+    state->rng.seed(static_cast<std::uint32_t>(port) * 256u +
+                    static_cast<std::uint32_t>(unit.slaveId));
+    const double cycle =
+        unit.kind == Unit::Kind::Inverter ? powerCycle : meterCycle;
+    state->phaseOffset =
+        std::uniform_real_distribution<double>(0.0, cycle)(state->rng);
+    fillStatic(*state);
+    generate(*state, 0.0, 0.0);
+    units_.emplace(unit.slaveId, std::move(state));
+  }
+
+  listenCtx_ = modbus_new_tcp("127.0.0.1", port_);
+  if (!listenCtx_)
+    throw std::runtime_error(
+        ModbusError::custom(ENOMEM,
+                            "Simulator: unable to create the libmodbus TCP "
+                            "context")
+            .describe());
+  serverSocket_ = modbus_tcp_listen(listenCtx_, 16);
+  if (serverSocket_ == -1) {
+    auto err = ModbusError::fromErrno(
+        "Simulator: failed to listen on '127.0.0.1:{}'", port_);
+    modbus_free(listenCtx_);
+    throw std::runtime_error(err.describe());
+  }
+  const int flags = fcntl(serverSocket_, F_GETFL, 0);
+  if (flags == -1 || fcntl(serverSocket_, F_SETFL, flags | O_NONBLOCK) == -1) {
+    auto err = ModbusError::fromErrno(
+        "Simulator: unable to make the listener on port {} non-blocking",
+        port_);
+    close(serverSocket_);
+    modbus_free(listenCtx_);
+    throw std::runtime_error(err.describe());
+  }
+
+  logger_->info("Simulated gateway on '127.0.0.1:{}' serving {} device(s)",
+                port_, units_.size());
+  worker_ = std::thread(&SimulatedGateway::run, this);
+}
+
+SimulatedGateway::~SimulatedGateway() {
+  stop_ = true;
+  if (worker_.joinable())
+    worker_.join();
+  clients_.clear();
+  if (serverSocket_ != -1)
+    close(serverSocket_);
+  if (listenCtx_)
+    modbus_free(listenCtx_);
+}
+
+void SimulatedGateway::run() {
+  std::vector<struct pollfd> fds;
+  auto nextTick = lastTick_ + std::chrono::seconds(1);
+
+  while (running()) {
+    fds.clear();
+    fds.push_back({serverSocket_, POLLIN, 0});
+    for (const auto &[socket, client] : clients_)
+      fds.push_back({socket, POLLIN, 0});
+
+    // Wake for the next tick, and at least twice a second for running().
+    const auto untilTick =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            nextTick - std::chrono::steady_clock::now());
+    const int timeout =
+        static_cast<int>(std::clamp<std::int64_t>(untilTick.count(), 0, 500));
+
+    if (poll(fds.data(), fds.size(), timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+      logger_->error("Simulator on port {}: poll failed: {}", port_,
+                     std::strerror(errno));
+      break;
+    }
+
+    if (fds[0].revents & POLLIN)
+      acceptClient();
+    for (std::size_t i = 1; i < fds.size(); ++i) {
+      if (!fds[i].revents)
+        continue;
+      auto it = clients_.find(fds[i].fd);
+      if (it != clients_.end() && !serviceClient(*it->second))
+        clients_.erase(it);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= nextTick) {
+      tick(now);
+      nextTick = std::max(nextTick + std::chrono::seconds(1),
+                          now + std::chrono::milliseconds(500));
+    }
+  }
+
+  clients_.clear();
+  logger_->debug("Simulator on port {} stopped", port_);
+}
+
+void SimulatedGateway::tick(std::chrono::steady_clock::time_point now) {
+  using seconds = std::chrono::duration<double>;
+  const double t = seconds(now - start_).count();
+  const double dt = seconds(now - lastTick_).count();
+  lastTick_ = now;
+  for (auto &[id, state] : units_)
+    generate(*state, t, dt);
+}
+
+void SimulatedGateway::acceptClient() {
+  for (;;) {
+    int socket = accept4(serverSocket_, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (socket < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        logger_->warn("Simulator on port {}: accept failed: {}", port_,
+                      std::strerror(errno));
+      return;
+    }
+
+    auto client = std::make_unique<Client>();
+    client->socket = socket;
+    client->ctx = modbus_new_tcp(nullptr, 0);
+    if (!client->ctx) {
+      logger_->warn("Simulator on port {}: unable to create a client context",
+                    port_);
+      continue;
+    }
+    modbus_set_socket(client->ctx, socket);
+    logger_->debug("Simulator on port {}: client connected", port_);
+    clients_.emplace(socket, std::move(client));
+  }
+}
+
+bool SimulatedGateway::serviceClient(Client &client) {
+  const ssize_t rc = recv(client.socket, client.frame.data() + client.frameLen,
+                          client.frame.size() - client.frameLen, 0);
+  if (rc == 0)
+    return false;
+  if (rc < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  client.frameLen += static_cast<std::size_t>(rc);
+
+  // MBAP header: transaction id (2), protocol id (2), length (2), unit id (1),
+  // as in MeterSlave::replyToFrames().
+  constexpr std::size_t mbapLength = 7;
+  std::size_t pos = 0;
+  while (client.frameLen - pos >= mbapLength) {
+    const std::uint8_t *adu = client.frame.data() + pos;
+    const std::size_t length = (adu[4] << 8) | adu[5];
+    if (length < 2 || length > MODBUS_TCP_MAX_ADU_LENGTH - (mbapLength - 1))
+      return false;
+    const std::size_t aduLength = mbapLength - 1 + length;
+    if (client.frameLen - pos < aduLength)
+      break;
+    reply(client, adu, static_cast<int>(aduLength));
+    pos += aduLength;
+  }
+
+  if (pos > 0) {
+    std::memmove(client.frame.data(), client.frame.data() + pos,
+                 client.frameLen - pos);
+    client.frameLen -= pos;
+  }
+  return true;
+}
+
+void SimulatedGateway::reply(Client &client, const std::uint8_t *adu,
+                             int length) {
+  auto it = units_.find(adu[6]);
+  if (it == units_.end()) {
+    modbus_reply_exception(client.ctx, adu, MODBUS_EXCEPTION_GATEWAY_TARGET);
+    return;
+  }
+  State &state = *it->second;
+
+  // The gateway's one thread sleeps through the delay, which is what holds
+  // back the requests queued behind this one.
+  const auto &sim = state.unit.simulate;
+  const int jitter =
+      sim.jitter > 0
+          ? std::uniform_int_distribution<int>(0, sim.jitter)(state.rng)
+          : 0;
+  if (running())
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(sim.latency + jitter));
+
+  modbus_set_slave(client.ctx, state.unit.slaveId);
+  if (modbus_reply(client.ctx, adu, length, state.regs) == -1)
+    logger_->debug("Simulator on port {}: reply to '{}' failed: {}", port_,
+                   state.unit.name, modbus_strerror(errno));
+}
+
+// ---------------------------------------------------------------------------
+// Register sets
+// ---------------------------------------------------------------------------
+
+void SimulatedGateway::fillStatic(State &state) {
+  const auto &unit = state.unit;
+  const auto &sim = unit.simulate;
+  auto *regs = state.regs;
+  const bool inverter = unit.kind == Unit::Kind::Inverter;
+
+  // C001 common model
+  putUint32(regs, C001::SID.ADDR, 0x53756e53); // "SunS"
+  put(regs, C001::ID.ADDR, 1);
+  put(regs, C001::L.ADDR, C001::SIZE);
+  putString(regs, C001::MN.ADDR, 16, "Fronius");
+  putString(regs, C001::MD.ADDR, 16,
+            inverter ? (sim.hybrid ? "Simulated hybrid inverter"
+                                   : "Simulated inverter")
+                     : "Simulated meter");
+  putString(regs, C001::OPT.ADDR, 8, "simulate");
+  putString(regs, C001::VR.ADDR, 8, "1.0.0");
+  putString(regs, C001::SN.ADDR, 16,
+            std::format("SIM{:05}{:03}", port_, unit.slaveId));
+  put(regs, C001::DA.ADDR, static_cast<std::uint16_t>(unit.slaveId));
+
+  if (!inverter) {
+    put(regs, M20X::ID.ADDR, static_cast<std::uint16_t>(200 + sim.phases));
+    put(regs, M20X::L.ADDR, M20X::SIZE);
+    put(regs, M_END::ID.ADDR, 0xFFFF);
+    put(regs, M_END::L.ADDR, 0);
+    return;
+  }
+
+  const int wSf = scaleFor(1.2 * sim.power, 0);
+  const int aSf = scaleFor(1.2 * sim.power / 230.0, -2);
+
+  put(regs, invModel, static_cast<std::uint16_t>(100 + sim.phases));
+  put(regs, invModel + 1, 50);
+
+  // 120 nameplate
+  const int np = nameplate + 2;
+  put(regs, nameplate, 120);
+  put(regs, nameplate + 1, 26);
+  for (int i = 0; i < 26; ++i)
+    put(regs, np + i, noUint16);
+  put(regs, np + 0, sim.hybrid ? 82 : 4); // DERTyp: PV, or PV + storage
+  putScaled(regs, np + 1, sim.power, wSf, false); // WRtg
+  putSf(regs, np + 2, wSf);
+  putScaled(regs, np + 3, sim.power, wSf, false); // VARtg
+  putSf(regs, np + 4, wSf);
+  for (int q = 0; q < 4; ++q) // VArRtgQ1..Q4
+    putScaled(regs, np + 5 + q, (q < 2 ? 0.6 : -0.6) * sim.power, wSf);
+  putSf(regs, np + 9, wSf);
+  putScaled(regs, np + 10, sim.power / 230.0 / sim.phases, aSf, false);
+  putSf(regs, np + 11, aSf); // ARtg_SF
+  put(regs, np + 25, 0);     // Pad
+
+  // 121 basic settings
+  const int bs = settings + 2;
+  put(regs, settings, 121);
+  put(regs, settings + 1, 30);
+  putScaled(regs, bs + 0, sim.power, wSf, false); // WMax
+  putScaled(regs, bs + 1, 230.0, -1, false);      // VRef
+  putScaled(regs, bs + 3, 253.0, -1, false);      // VMax
+  putScaled(regs, bs + 4, 195.5, -1, false);      // VMin
+  putScaled(regs, bs + 5, sim.power, wSf, false); // VAMax
+  putScaled(regs, bs + 18, 50.0, -2, false);      // ECPNomHz
+  putSf(regs, bs + 20, wSf);                      // WMax_SF
+  putSf(regs, bs + 21, -1);                       // VRef_SF
+  putSf(regs, bs + 23, -1);                       // VMinMax_SF
+  putSf(regs, bs + 24, wSf);                      // VAMax_SF
+  putSf(regs, bs + 29, -2);                       // ECPNomHz_SF
+
+  // 122 measurements and status: connected, available and operating
+  put(regs, status, 122);
+  put(regs, status + 1, 44);
+  put(regs, status + 2, 0x7); // PVConn
+  put(regs, status + 4, 0x1); // ECPConn
+
+  // 123 immediate controls, all released
+  put(regs, controls, 123);
+  put(regs, controls + 1, 24);
+
+  // 160 multiple MPPT, one module per input
+  const int mb = mppt + 2;
+  put(regs, mppt, 160);
+  put(regs, mppt + 1, static_cast<std::uint16_t>(8 + 20 * sim.inputs));
+  putSf(regs, mb + 0, -2);  // DCA_SF
+  putSf(regs, mb + 1, -1);  // DCV_SF
+  putSf(regs, mb + 2, wSf); // DCW_SF
+  putSf(regs, mb + 3, 0);   // DCWH_SF
+  put(regs, mb + 6, static_cast<std::uint16_t>(sim.inputs)); // N
+  put(regs, mb + 7, noUint16);                              // TmsPer
+  for (int k = 0; k < sim.inputs; ++k) {
+    const int m = mb + 8 + 20 * k;
+    put(regs, m, static_cast<std::uint16_t>(k + 1));
+    putString(regs, m + 1, 8, std::format("String {}", k + 1));
+    put(regs, m + 16, noInt16); // Tmp
+  }
+
+  int end = mb + 8 + 20 * sim.inputs;
+  if (sim.hybrid) {
+    // 124 storage: a half-charged battery, idle
+    put(regs, end, 124);
+    put(regs, end + 1, 24);
+    putScaled(regs, end + 2, sim.power, wSf, false); // WChaMax
+    putScaled(regs, end + 8, 50.0, -2, false);       // ChaState
+    put(regs, end + 11, 3);                          // ChaSt: holding
+    putSf(regs, end + 18, wSf);                      // WChaMax_SF
+    putSf(regs, end + 22, -2);                       // ChaState_SF
+    end += 2 + 24;
+  }
+  put(regs, end, 0xFFFF);
+  put(regs, end + 1, 0);
+}
+
+void SimulatedGateway::generate(State &state, double now, double dt) {
+  if (state.unit.kind == Unit::Kind::Inverter)
+    generateInverter(state, now, dt);
+  else
+    generateMeter(state, now, dt);
+}
+
+void SimulatedGateway::generateInverter(State &state, double now, double dt) {
+  const auto &sim = state.unit.simulate;
+  auto *regs = state.regs;
+  auto &rng = state.rng;
+  const int wSf = scaleFor(1.2 * sim.power, 0);
+  const int aSf = scaleFor(1.2 * sim.power / 230.0, -2);
+
+  const double angle =
+      2.0 * std::numbers::pi * (now + state.phaseOffset) / powerCycle;
+  const double ac = std::max(
+      0.0, sim.power * (0.5 - 0.5 * std::cos(angle)) + noise(rng, 0.01) *
+                                                         sim.power);
+  const bool producing = ac > 0.005 * sim.power;
+  const double dc = producing ? ac / 0.97 : 0.0;
+  state.acEnergy += ac * dt / 3600.0;
+
+  // 10X inverter model
+  const int b = invModel + 2;
+  const double frequency = 50.0 + noise(rng, 0.02);
+  const double apparent = ac / powerFactor;
+  const double reactive = apparent * std::sin(std::acos(powerFactor));
+  double current = 0.0;
+  for (int p = 0; p < 3; ++p) {
+    if (p >= sim.phases) {
+      put(regs, b + 1 + p, noUint16); // AphX
+      put(regs, b + 8 + p, noUint16); // PhVphX
+      put(regs, b + 5 + p, noUint16); // PPVphXY
+      continue;
+    }
+    const double v = 230.0 + noise(rng, 2.0);
+    const double a = apparent / sim.phases / v;
+    current += a;
+    putScaled(regs, b + 1 + p, a, aSf, false);
+    putScaled(regs, b + 8 + p, v, -1, false);
+    if (sim.phases == 3)
+      putScaled(regs, b + 5 + p, v * std::numbers::sqrt3, -1, false);
+    else
+      put(regs, b + 5 + p, noUint16);
+  }
+  putScaled(regs, b + 0, current, aSf, false);
+  putSf(regs, b + 4, aSf);
+  putSf(regs, b + 11, -1);
+  putScaled(regs, b + 12, ac, wSf);
+  putSf(regs, b + 13, wSf);
+  putScaled(regs, b + 14, frequency, -2, false);
+  putSf(regs, b + 15, -2);
+  putScaled(regs, b + 16, apparent, wSf);
+  putSf(regs, b + 17, wSf);
+  putScaled(regs, b + 18, reactive, wSf);
+  putSf(regs, b + 19, wSf);
+  putScaled(regs, b + 20, producing ? 100.0 * powerFactor : 100.0, -1);
+  putSf(regs, b + 21, -1);
+  putUint32(regs, b + 22, wattHours(state.acEnergy));
+  putSf(regs, b + 24, 0);
+
+  // DC side: the inputs split the power 55/45, like a larger and a smaller
+  // string.
+  const double share[2] = {sim.inputs == 1 ? 1.0 : 0.55, 0.45};
+  const double voltage[2] = {producing ? 620.0 + noise(rng, 5.0) : 0.0,
+                             producing ? 540.0 + noise(rng, 5.0) : 0.0};
+  double dcCurrent = 0.0;
+  const auto timestamp = static_cast<std::uint32_t>(
+      std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count() -
+      946684800); // SunSpec epoch, 2000-01-01
+  for (int k = 0; k < sim.inputs; ++k) {
+    const int m = mppt + 2 + 8 + 20 * k;
+    const double w = dc * share[k];
+    const double a = voltage[k] > 0.0 ? w / voltage[k] : 0.0;
+    dcCurrent += a;
+    state.dcEnergy[k] += w * dt / 3600.0;
+    putScaled(regs, m + 9, a, -2, false);
+    putScaled(regs, m + 10, voltage[k], -1, false);
+    putScaled(regs, m + 11, w, wSf, false);
+    putUint32(regs, m + 12, wattHours(state.dcEnergy[k]));
+    putUint32(regs, m + 14, timestamp);
+    put(regs, m + 17, producing ? 4 : 2); // DCSt: MPPT or sleeping
+  }
+  putScaled(regs, b + 25, dcCurrent, -2, false);
+  putSf(regs, b + 26, -2);
+  putScaled(regs, b + 27, voltage[0], -1, false);
+  putSf(regs, b + 28, -1);
+  putScaled(regs, b + 29, dc, wSf);
+  putSf(regs, b + 30, wSf);
+  putScaled(regs, b + 31, 35.0 + noise(rng, 1.0), -1); // TmpCab
+  put(regs, b + 32, noInt16);
+  put(regs, b + 33, noInt16);
+  put(regs, b + 34, noInt16);
+  putSf(regs, b + 35, -1);
+  put(regs, b + 36, producing ? 4 : 2); // St: MPPT or sleeping
+  put(regs, b + 37, producing ? 4 : 2); // StVnd
+}
+
+void SimulatedGateway::generateMeter(State &state, double now, double dt) {
+  const auto &sim = state.unit.simulate;
+  auto *regs = state.regs;
+  auto &rng = state.rng;
+  const int wSf = scaleFor(1.2 * sim.power, 0);
+  const int aSf = scaleFor(1.2 * sim.power / 230.0, -2);
+
+  const double angle =
+      2.0 * std::numbers::pi * (now + state.phaseOffset) / meterCycle;
+  const double w =
+      sim.power * std::sin(angle) + noise(rng, 0.02) * sim.power;
+  const double va = std::abs(w) / powerFactor;
+  const double var = (w < 0.0 ? -va : va) * std::sin(std::acos(powerFactor));
+  if (w > 0.0)
+    state.importEnergy += w * dt / 3600.0;
+  else
+    state.exportEnergy -= w * dt / 3600.0;
+
+  const Register a[3] = {M20X::APHA, M20X::APHB, M20X::APHC};
+  const Register phv[3] = {M20X::PHVPHA, M20X::PHVPHB, M20X::PHVPHC};
+  const Register ppv[3] = {M20X::PPVPHAB, M20X::PPVPHBC, M20X::PPVPHCA};
+  const Register pw[3] = {M20X::WPHA, M20X::WPHB, M20X::WPHC};
+  const Register pva[3] = {M20X::VAPHA, M20X::VAPHB, M20X::VAPHC};
+  const Register pvar[3] = {M20X::VARPHA, M20X::VARPHB, M20X::VARPHC};
+  const Register ppf[3] = {M20X::PFPHA, M20X::PFPHB, M20X::PFPHC};
+
+  double current = 0.0;
+  double sumVoltage = 0.0;
+  for (int p = 0; p < 3; ++p) {
+    if (p >= sim.phases) {
+      for (const auto *r : {&a[p], &pw[p], &pva[p], &pvar[p], &ppf[p]})
+        put(regs, r->ADDR, noInt16);
+      put(regs, phv[p].ADDR, noInt16);
+      put(regs, ppv[p].ADDR, noInt16);
+      continue;
+    }
+    const double v = 230.0 + noise(rng, 2.0);
+    const double amps = va / sim.phases / v;
+    current += amps;
+    sumVoltage += v;
+    putScaled(regs, a[p].ADDR, amps, aSf);
+    putScaled(regs, phv[p].ADDR, v, -1);
+    putScaled(regs, ppv[p].ADDR, v * std::numbers::sqrt3, -1);
+    putScaled(regs, pw[p].ADDR, w / sim.phases, wSf);
+    putScaled(regs, pva[p].ADDR, va / sim.phases, wSf);
+    putScaled(regs, pvar[p].ADDR, var / sim.phases, wSf);
+    putScaled(regs, ppf[p].ADDR, 100.0 * powerFactor, -1);
+  }
+  const double phVoltage = sumVoltage / sim.phases;
+
+  putScaled(regs, M20X::A.ADDR, current, aSf);
+  putSf(regs, M20X::A_SF.ADDR, aSf);
+  putScaled(regs, M20X::PHV.ADDR, phVoltage, -1);
+  putScaled(regs, M20X::PPV.ADDR, phVoltage * std::numbers::sqrt3, -1);
+  putSf(regs, M20X::V_SF.ADDR, -1);
+  putScaled(regs, M20X::FREQ.ADDR, 50.0 + noise(rng, 0.02), -2);
+  putSf(regs, M20X::FREQ_SF.ADDR, -2);
+  putScaled(regs, M20X::W.ADDR, w, wSf);
+  putSf(regs, M20X::W_SF.ADDR, wSf);
+  putScaled(regs, M20X::VA.ADDR, va, wSf);
+  putSf(regs, M20X::VA_SF.ADDR, wSf);
+  putScaled(regs, M20X::VAR.ADDR, var, wSf);
+  putSf(regs, M20X::VAR_SF.ADDR, wSf);
+  putScaled(regs, M20X::PF.ADDR, 100.0 * powerFactor, -1);
+  putSf(regs, M20X::PF_SF.ADDR, -1);
+
+  putUint32(regs, M20X::TOT_WH_IMP.ADDR, wattHours(state.importEnergy));
+  putUint32(regs, M20X::TOT_WH_EXP.ADDR, wattHours(state.exportEnergy));
+  putSf(regs, M20X::TOT_WH_SF.ADDR, 0);
+  putUint32(regs, M20X::TOT_VAH_IMP.ADDR,
+            wattHours(state.importEnergy / powerFactor));
+  putUint32(regs, M20X::TOT_VAH_EXP.ADDR,
+            wattHours(state.exportEnergy / powerFactor));
+  putSf(regs, M20X::TOT_VAH_SF.ADDR, 0);
+}
@@ -0,0 +1,288 @@
+#include "sinks.h"
+#include "config_yaml.h"
+#include "dispatcher.h"
+#include "edge_aggregator.h"
+#include "meter_slave.h"
+#include "payloads.h"
+#include "postgres_client.h"
+#include "site_energy.h"
+#include "site_snapshot.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// MqttSink
+// ---------------------------------------------------------------------------
+
+MqttSink::MqttSink(const AppConfig &cfg, MqttClient &mqtt)
+    : mqtt_(mqtt),
+      forwardRaw_(!cfg.aggregate || cfg.aggregate->forwardRaw),
+      encoding_(cfg.mqtt.publish.values.encoding),
+      devices_(cfg.deviceRegistry.size()) {
+  for (std::size_t id = 0; id < cfg.deviceRegistry.size(); ++id)
+    if (!cfg.deviceRegistry[id].vacant())
+      admit(cfg, static_cast<DeviceId>(id));
+}
+
+void MqttSink::admit(const AppConfig &cfg, DeviceId device) {
+  // Intern the device's topics once here, so a sample costs an id lookup
+  // instead of building and hashing strings. The 'inverter' / 'meter' class
+  // segment lets downstream consumers subscribe to e.g.
+  // fronius-bridge/meter/+/values to receive every meter without an explicit
+  // name allow-list.
+  const auto &entry = cfg.deviceRegistry[device];
+  const std::string base = cfg.mqtt.topic + "/" + entry.kind + "/" + entry.name;
+  // Built aside, so a throw leaves the slot out of the roster.
+  Device d;
+  auto topic = [&](const std::string &suffix,
+                   const MqttPublishPolicy &policy) {
+    d.topics.push_back(mqtt_.addTopic(base + suffix, policy));
+    return d.topics.back();
+  };
+  std::unique_ptr<ValuesPublisher<InverterTypes::Values>> inverterValues;
+  std::unique_ptr<ValuesPublisher<MeterTypes::Values>> meterValues;
+  try {
+    if (inverterOf(cfg, device)) {
+      d.eventsTopic = topic("/events", cfg.mqtt.publish.events);
+      inverterValues = std::make_unique<ValuesPublisher<InverterTypes::Values>>(
+          cfg.mqtt, mqtt_, base);
+    } else {
+      d.easyMeter = !busKeyOf(*meterOf(cfg, device));
+      meterValues = std::make_unique<ValuesPublisher<MeterTypes::Values>>(
+          cfg.mqtt, mqtt_, base);
+    }
+    d.deviceTopic = topic("/device", cfg.mqtt.publish.device);
+    d.availabilityTopic = topic("/availability", cfg.mqtt.publish.availability);
+    if (cfg.aggregate)
+      d.aggregateTopic = topic("/values/aggregate", cfg.mqtt.publish.values);
+  } catch (...) {
+    if (inverterValues)
+      inverterValues->release();
+    if (meterValues)
+      meterValues->release();
+    release(d);
+    throw;
+  }
+  d.inverterValues = std::move(inverterValues);
+  d.meterValues = std::move(meterValues);
+  devices_[device] = std::move(d);
+}
+
+void MqttSink::retire(DeviceId device) { release(devices_[device]); }
+
+void MqttSink::release(Device &d) {
+  if (d.inverterValues)
+    d.inverterValues->release();
+  if (d.meterValues)
+    d.meterValues->release();
+  for (const MqttClient::TopicId id : d.topics)
+    mqtt_.releaseTopic(id);
+  d = Device{};
+}
+
+void MqttSink::consume(const Sample &sample) {
+  Device &d = devices_[sample.device];
+  if (!d.admitted())
+    return;
+  std::visit(
+      [&](const auto &data) {
+        using T = std::decay_t<decltype(data)>;
+        if constexpr (std::is_same_v<T, InverterTypes::Values>) {
+          if (forwardRaw_)
+            d.inverterValues->publish(sample.payload, data);
+        } else if constexpr (std::is_same_v<T, MeterTypes::Values>) {
+          if (forwardRaw_)
+            d.meterValues->publish(sample.payload, data);
+        } else if constexpr (std::is_same_v<T, InverterTypes::Events>) {
+          mqtt_.publish(sample.payload, d.eventsTopic);
+        } else if constexpr (std::is_same_v<T, InverterTypes::Device>) {
+          d.phases = data.phases;
+          d.inputs = data.inputs;
+          d.hybrid = data.isHybrid;
+          mqtt_.publish(sample.payload, d.deviceTopic);
+        } else if constexpr (std::is_same_v<T, MeterTypes::Device>) {
+          d.phases = data.phases;
+          mqtt_.publish(sample.payload, d.deviceTopic);
+        } else if constexpr (std::is_same_v<T, Bucket<InverterTypes::Values>>) {
+          Payload::inverterAggregate(buf_, data, d.phases, d.inputs, d.hybrid,
+                                     encoding_);
+          mqtt_.publish(buf_, d.aggregateTopic);
+        } else if constexpr (std::is_same_v<T, Bucket<MeterTypes::Values>>) {
+          if (d.easyMeter)
+            Payload::easyMeterAggregate(buf_, data, encoding_);
+          else
+            Payload::froniusMeterAggregate(buf_, data, d.phases, encoding_);
+          mqtt_.publish(buf_, d.aggregateTopic);
+        } else {
+          mqtt_.publish(sample.payload, d.availabilityTopic);
+        }
+      },
+      sample.data);
+}
+
+// ---------------------------------------------------------------------------
+// PostgresSink
+// ---------------------------------------------------------------------------
+
+PostgresSink::PostgresSink(const AppConfig &cfg, PostgresClient &postgres)
+    : postgres_(postgres),
+      forwardRaw_(!cfg.aggregate || cfg.aggregate->forwardRaw) {}
+
+void PostgresSink::consume(const Sample &sample) {
+  const DeviceId id = sample.device;
+  std::visit(
+      [&](const auto &data) {
+        using T = std::decay_t<decltype(data)>;
+        if constexpr (std::is_same_v<T, InverterTypes::Values>) {
+          if (forwardRaw_)
+            postgres_.onInverter(id, data);
+        } else if constexpr (std::is_same_v<T, MeterTypes::Values>) {
+          if (forwardRaw_)
+            postgres_.onMeter(id, data);
+        } else if constexpr (std::is_same_v<T, InverterTypes::Device>) {
+          postgres_.onInverterDevice(id, data);
+        } else if constexpr (std::is_same_v<T, MeterTypes::Device>) {
+          postgres_.onMeterDevice(id, data);
+        } else if constexpr (std::is_same_v<T, Bucket<InverterTypes::Values>>) {
+          if (!forwardRaw_)
+            postgres_.onInverter(id, Edge::sample(data));
+          postgres_.onPowerBucket(id, Edge::power(data));
+        } else if constexpr (std::is_same_v<T, Bucket<MeterTypes::Values>>) {
+          if (!forwardRaw_)
+            postgres_.onMeter(id, Edge::sample(data));
+          postgres_.onPowerBucket(id, Edge::power(data));
+        }
+        // Events and availability are not stored.
+      },
+      sample.data);
+}
+
+// ---------------------------------------------------------------------------
+// SlaveSink
+// ---------------------------------------------------------------------------
+
+SlaveSink::SlaveSink(const std::vector<std::unique_ptr<MeterSlave>> &slaves)
+    : table_(slaves), slaves_(slaves.size(), nullptr) {
+  for (std::size_t id = 0; id < slaves.size(); ++id)
+    slaves_[id] = slaves[id].get();
+}
+
+void SlaveSink::admit(const AppConfig & /*cfg*/, DeviceId device) {
+  slaves_[device] = table_[device].get();
+}
+
+void SlaveSink::retire(DeviceId device) { slaves_[device] = nullptr; }
+
+void SlaveSink::consume(const Sample &sample) {
+  MeterSlave *slave = slaves_[sample.device];
+  if (!slave)
+    return;
+  if (const auto *v = std::get_if<MeterTypes::Values>(&sample.data))
+    slave->updateValues(*v);
+  else if (const auto *d = std::get_if<MeterTypes::Device>(&sample.data))
+    slave->updateDevice(*d);
+}
+
+// ---------------------------------------------------------------------------
+// SiteSink
+// ---------------------------------------------------------------------------
+
+SiteSink::SiteSink(const AppConfig &cfg, MqttClient &mqtt,
+                   PostgresClient *postgres)
+    : energy_(cfg.deviceRegistry), mqtt_(mqtt), postgres_(postgres),
+      encoding_(cfg.mqtt.publish.values.encoding),
+      topic_(mqtt.addTopic(cfg.mqtt.topic + "/site/energy",
+                           cfg.mqtt.publish.values)),
+      intervalMs_(static_cast<std::uint64_t>(cfg.siteEnergy->interval) *
+                  1000) {}
+
+void SiteSink::retire(DeviceId device) { energy_.retire(device); }
+
+void SiteSink::admit(const AppConfig &cfg, DeviceId device) {
+  energy_.admit(device, cfg.deviceRegistry[device]);
+}
+
+void SiteSink::consume(const Sample &sample) {
+  if (const auto *v = std::get_if<InverterTypes::Values>(&sample.data))
+    energy_.add(sample.device, *v);
+  else if (const auto *v = std::get_if<MeterTypes::Values>(&sample.data))
+    energy_.add(sample.device, *v);
+  else
+    return;
+
+  const std::uint64_t now = energy_.totals().time;
+  if (flushed_ == 0)
+    flushed_ = now;
+  if (energy_.dayClosed() || now - flushed_ >= intervalMs_)
+    flush();
+}
+
+void SiteSink::flush() {
+  flushed_ = energy_.totals().time;
+  Payload::siteEnergy(buf_, energy_.totals(), encoding_);
+  mqtt_.publish(buf_, topic_);
+
+  auto deltas = energy_.take();
+  if (postgres_)
+    for (auto &d : deltas)
+      postgres_->onSiteEnergy(std::move(d));
+}
+
+// ---------------------------------------------------------------------------
+// SnapshotSink
+// ---------------------------------------------------------------------------
+
+SnapshotSink::SnapshotSink(const AppConfig &cfg, MqttClient &mqtt,
+                           PostgresClient *postgres)
+    : snapshot_(cfg), mqtt_(mqtt), postgres_(postgres),
+      encoding_(cfg.mqtt.publish.values.encoding),
+      topic_(mqtt.addTopic(cfg.mqtt.topic + "/site/snapshot",
+                           cfg.mqtt.publish.values)) {}
+
+void SnapshotSink::retire(DeviceId device) {
+  snapshot_.retire(device);
+  if (snapshot_.ready())
+    flush();
+}
+
+void SnapshotSink::admit(const AppConfig &cfg, DeviceId device) {
+  snapshot_.admit(cfg, device);
+}
+
+void SnapshotSink::consume(const Sample &sample) {
+  std::visit(
+      [&](const auto &data) {
+        using T = std::decay_t<decltype(data)>;
+        if constexpr (std::is_same_v<T, InverterTypes::Values> ||
+                      std::is_same_v<T, MeterTypes::Values>)
+          snapshot_.add(sample.device, data);
+        else if constexpr (std::is_same_v<T, InverterTypes::Device> ||
+                           std::is_same_v<T, MeterTypes::Device>)
+          snapshot_.shape(sample.device, data);
+      },
+      sample.data);
+
+  if (snapshot_.ready())
+    flush();
+}
+
+void SnapshotSink::flush() {
+  for (const auto &snap : snapshot_.take()) {
+    Payload::siteSnapshot(buf_, snap, encoding_);
+    mqtt_.publish(buf_, topic_);
+
+    if (!postgres_)
+      continue;
+    if (encoding_ != MqttEncoding::Json)
+      Payload::siteSnapshot(json_, snap);
+    postgres_->onSiteSnapshot(
+        {snap.time, snap.complete, snap.productionPower, snap.primaryPower,
+         encoding_ == MqttEncoding::Json ? buf_ : json_});
+  }
+}
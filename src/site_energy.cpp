@@ -0,0 +1,209 @@
+#include "site_energy.h"
+#include "config_yaml.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <format>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// The local calendar day holding `ms`: its name and the local midnight that
+// ends it. mktime() normalises the day past the month's end and resolves the
+// DST offset of that midnight.
+struct LocalDay {
+  std::string name;
+  std::uint64_t end{0}; // ms since the epoch
+};
+
+LocalDay localDay(std::uint64_t ms) {
+  const auto t = static_cast<std::time_t>(ms / 1000);
+  std::tm tm{};
+  localtime_r(&t, &tm);
+
+  LocalDay day;
+  day.name = std::format("{:04}-{:02}-{:02}", tm.tm_year + 1900, tm.tm_mon + 1,
+                         tm.tm_mday);
+  tm.tm_mday += 1;
+  tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+  tm.tm_isdst = -1;
+  day.end = static_cast<std::uint64_t>(std::mktime(&tm)) * 1000;
+  return day;
+}
+
+bool moved(const SiteEnergyDelta &d) {
+  return d.production != 0.0 || d.consumption != 0.0 || d.fromGrid != 0.0 ||
+         d.toGrid != 0.0 || d.overlap != 0.0;
+}
+
+} // namespace
+
+SiteEnergy::SiteEnergy(const std::vector<DeviceRegistryEntry> &registry)
+    : inverter_(registry.size(), false), sources_(registry.size()) {
+  for (std::size_t i = 0; i < registry.size(); ++i) {
+    const auto &e = registry[i];
+    if (e.kind == "inverter") {
+      inverter_[i] = true;
+    } else if (e.primary) {
+      primary_ = static_cast<DeviceId>(i);
+      measured_ = e.location == "feed-in";
+    }
+  }
+  sums_.measured = pending_.measured = measured_;
+}
+
+void SiteEnergy::retire(DeviceId device) {
+  if (inverter_[device]) {
+    inverter_[device] = false;
+    sources_[device] = Source{};
+  } else if (device == primary_) {
+    primary_.reset();
+    meter_ = Source{};
+    meterExport_.reset();
+  }
+}
+
+void SiteEnergy::admit(DeviceId device, const DeviceRegistryEntry &entry) {
+  if (entry.kind == "inverter") {
+    inverter_[device] = true;
+    sources_[device] = Source{};
+    return;
+  }
+  if (!entry.primary)
+    return;
+  primary_ = device;
+  meter_ = Source{};
+  meterExport_.reset();
+  const bool measured = entry.location == "feed-in";
+  if (measured == measured_)
+    return;
+
+  // The regime changed: the increments so far go out under the old one,
+  // and the day's sums other than production restart under the new one.
+  if (moved(pending_))
+    closed_.push_back(pending_);
+  measured_ = measured;
+  const double production = sums_.production;
+  sums_ = SiteEnergyDelta{totals_.day, measured_};
+  sums_.production = production;
+  pending_ = SiteEnergyDelta{totals_.day, measured_};
+  derive();
+}
+
+void SiteEnergy::add(DeviceId device, const InverterTypes::Values &v) {
+  if (device >= inverter_.size() || !inverter_[device])
+    return;
+  roll(v.time);
+
+  Source &s = sources_[device];
+  credit(&SiteEnergyDelta::production, increase(s.energy, v.acEnergy));
+  if (!measured_) {
+    integrate(v.time);
+    s.power = std::max(v.acPowerActive, 0.0);
+    s.seen = v.time;
+  }
+  totals_.time = std::max(totals_.time, v.time);
+  derive();
+}
+
+void SiteEnergy::add(DeviceId device, const MeterTypes::Values &v) {
+  if (device != primary_)
+    return;
+  roll(v.time);
+
+  const double imported = increase(meter_.energy, v.activeEnergyImport);
+  if (measured_) {
+    credit(&SiteEnergyDelta::fromGrid, imported);
+    credit(&SiteEnergyDelta::toGrid,
+           increase(meterExport_, v.activeEnergyExport));
+  } else {
+    credit(&SiteEnergyDelta::consumption, imported);
+    integrate(v.time);
+    meter_.power = std::max(v.activePower, 0.0);
+    meter_.seen = v.time;
+  }
+  totals_.time = std::max(totals_.time, v.time);
+  derive();
+}
+
+std::vector<SiteEnergyDelta> SiteEnergy::take() {
+  std::vector<SiteEnergyDelta> out = std::move(closed_);
+  closed_.clear();
+  if (moved(pending_))
+    out.push_back(pending_);
+  pending_ = SiteEnergyDelta{totals_.day, measured_};
+  return out;
+}
+
+void SiteEnergy::roll(std::uint64_t time) {
+  if (dayEnd_ != 0 && time < dayEnd_)
+    return;
+
+  // The overlap up to midnight still belongs to the closing day.
+  if (dayEnd_ != 0 && !measured_)
+    integrate(dayEnd_);
+  if (moved(pending_))
+    closed_.push_back(pending_);
+
+  LocalDay day = localDay(time);
+  dayEnd_ = day.end;
+  sums_ = SiteEnergyDelta{day.name, measured_};
+  pending_ = sums_;
+  totals_ = SiteEnergyTotals{};
+  totals_.day = std::move(day.name);
+}
+
+void SiteEnergy::integrate(std::uint64_t time) {
+  if (time <= integrated_)
+    return;
+  if (integrated_ != 0) {
+    const std::uint64_t from = integrated_;
+    const auto held = [from](const Source &s) {
+      return from - s.seen < staleMs ? s.power : 0.0;
+    };
+    double production = 0.0;
+    for (const Source &s : sources_)
+      production += held(s);
+    const double dt = static_cast<double>(std::min(time - from, staleMs));
+    // W * ms to Wh.
+    credit(&SiteEnergyDelta::overlap,
+           std::min(production, held(meter_)) * dt / 3.6e6);
+  }
+  integrated_ = time;
+}
+
+void SiteEnergy::derive() {
+  totals_.production = sums_.production;
+  if (measured_) {
+    totals_.fromGrid = sums_.fromGrid;
+    totals_.toGrid = sums_.toGrid;
+    totals_.selfConsumption = std::max(sums_.production - sums_.toGrid, 0.0);
+    totals_.consumption = totals_.selfConsumption + sums_.fromGrid;
+  } else {
+    totals_.consumption = sums_.consumption;
+    totals_.selfConsumption =
+        std::min({sums_.overlap, sums_.production, sums_.consumption});
+    totals_.toGrid = sums_.production - totals_.selfConsumption;
+    totals_.fromGrid = sums_.consumption - totals_.selfConsumption;
+  }
+}
+
+void SiteEnergy::credit(double SiteEnergyDelta::*field, double wh) {
+  sums_.*field += wh;
+  pending_.*field += wh;
+}
+
+double SiteEnergy::increase(std::optional<double> &last, double reading) {
+  if (!std::isfinite(reading) || reading <= 0.0)
+    return 0.0;
+  const double delta = last && reading >= *last ? reading - *last : 0.0;
+  last = reading;
+  return delta;
+}
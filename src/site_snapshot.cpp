@@ -0,0 +1,123 @@
+#include "site_snapshot.h"
+#include "config_yaml.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <variant>
+#include <vector>
+
+SiteSnapshot::SiteSnapshot(const AppConfig &cfg)
+    : intervalMs_(static_cast<std::uint64_t>(cfg.snapshot->interval) * 1000),
+      slots_(cfg.deviceRegistry.size()) {
+  for (std::size_t id = 0; id < cfg.deviceRegistry.size(); ++id)
+    if (!cfg.deviceRegistry[id].vacant())
+      admit(cfg, static_cast<DeviceId>(id));
+}
+
+void SiteSnapshot::admit(const AppConfig &cfg, DeviceId device) {
+  auto &s = slots_[device];
+  s = Slot{};
+  s.occupied = true;
+  if (const auto *inv = inverterOf(cfg, device)) {
+    s.name = inv->name;
+    s.values = InverterTypes::Values{};
+  } else {
+    const auto &m = *meterOf(cfg, device);
+    s.name = m.name;
+    s.easyMeter = !busKeyOf(m);
+    s.primary = m.primary;
+    s.values = MeterTypes::Values{};
+  }
+  ++occupied_;
+}
+
+void SiteSnapshot::retire(DeviceId device) {
+  auto &s = slots_[device];
+  if (!s.occupied)
+    return;
+  if (s.reported)
+    --reported_;
+  s = Slot{};
+  --occupied_;
+  // The open tick may have waited on this device alone.
+  if (open_ && reported_ > 0 && reported_ == occupied_)
+    close(true);
+}
+
+void SiteSnapshot::shape(DeviceId device, const InverterTypes::Device &d) {
+  auto &s = slots_[device];
+  s.phases = d.phases;
+  s.inputs = d.inputs;
+  s.hybrid = d.isHybrid;
+}
+
+void SiteSnapshot::shape(DeviceId device, const MeterTypes::Device &d) {
+  slots_[device].phases = d.phases;
+}
+
+void SiteSnapshot::add(DeviceId device, const InverterTypes::Values &v) {
+  fold(device, v);
+}
+
+void SiteSnapshot::add(DeviceId device, const MeterTypes::Values &v) {
+  fold(device, v);
+}
+
+std::vector<Snapshot> SiteSnapshot::take() {
+  return std::exchange(closed_, {});
+}
+
+template <typename Values>
+void SiteSnapshot::fold(DeviceId device, const Values &v) {
+  const std::uint64_t tick = v.time - v.time % intervalMs_;
+  if (tick < tick_) {
+    // One tick behind, the tick is out already; further back, the clock
+    // went back.
+    if (tick_ - tick <= intervalMs_)
+      return;
+    start(tick);
+  } else if (tick > tick_) {
+    if (open_ && reported_ > 0)
+      close(false);
+    start(tick);
+  } else if (!open_) {
+    return; // closed complete; a later telegram of the EBZ
+  }
+
+  Slot &s = slots_[device];
+  if (!s.occupied || s.reported)
+    return;
+  s.reported = true;
+  s.values = v;
+  if (++reported_ == occupied_)
+    close(true);
+}
+
+void SiteSnapshot::start(std::uint64_t tick) {
+  tick_ = tick;
+  open_ = true;
+  reported_ = 0;
+  for (auto &s : slots_)
+    s.reported = false;
+}
+
+void SiteSnapshot::close(bool complete) {
+  Snapshot snap;
+  snap.time = tick_;
+  snap.complete = complete;
+  snap.readings.reserve(reported_);
+  for (const auto &s : slots_) {
+    if (!s.reported)
+      continue;
+    if (const auto *iv = std::get_if<InverterTypes::Values>(&s.values))
+      snap.productionPower += iv->acPowerActive;
+    else if (s.primary)
+      snap.primaryPower = std::get<MeterTypes::Values>(s.values).activePower;
+    snap.readings.push_back(
+        {s.name, s.easyMeter, s.phases, s.inputs, s.hybrid, s.values});
+  }
+  closed_.push_back(std::move(snap));
+  open_ = false;
+}
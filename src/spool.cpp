@@ -0,0 +1,450 @@
+#include "spool.h"
+#include "config_yaml.h"
+#include "edge_aggregator.h"
+#include "inverter_types.h"
+#include "meter_types.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Segment layout
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// The Values structs and PowerBucket are stored as raw bytes, which is only
+// sound while they stay plain data. A change that alters the largest one's
+// size also changes recordSize below, so segments written by an older build
+// are discarded rather than misread; bump segmentVersion for any other layout
+// change.
+static_assert(std::is_trivially_copyable_v<InverterTypes::Values>);
+static_assert(std::is_trivially_copyable_v<MeterTypes::Values>);
+static_assert(std::is_trivially_copyable_v<PowerBucket>);
+
+constexpr char segmentMagic[8] = {'F', 'B', 'S', 'P', 'O', 'O', 'L', '1'};
+constexpr std::uint32_t segmentVersion = 1;
+
+// Records per segment. With the larger (meter) Values this is about 1.3 MiB
+// per file: large enough that a long outage needs few files, small enough
+// that the size cap and the deletion of replayed data stay fine-grained.
+constexpr std::uint32_t segmentRecords = 4096;
+
+enum RecordKind : std::uint32_t {
+  inverterRecord = 1,
+  meterRecord = 2,
+  powerBucketRecord = 3,
+};
+
+constexpr std::size_t payloadSize =
+    std::max({sizeof(InverterTypes::Values), sizeof(MeterTypes::Values),
+              sizeof(PowerBucket)});
+
+// Device names are at most 32 characters (validated at config load), so the
+// field always keeps a terminating NUL.
+struct Record {
+  std::uint32_t kind;
+  char device[36];
+  alignas(8) std::byte payload[payloadSize];
+};
+
+struct SegmentHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t recordSize;
+  std::uint32_t capacity;
+  std::uint32_t written;  // records stored
+  std::uint32_t consumed; // records replayed and committed
+};
+
+// Records start on a cache line of their own after the header.
+constexpr std::size_t recordsOffset = 64;
+static_assert(sizeof(SegmentHeader) <= recordsOffset);
+
+constexpr std::size_t segmentBytes =
+    recordsOffset + std::size_t{segmentRecords} * sizeof(Record);
+
+SegmentHeader *header(std::byte *map) {
+  return reinterpret_cast<SegmentHeader *>(map);
+}
+
+std::byte *recordAt(std::byte *map, std::uint32_t index) {
+  return map + recordsOffset + std::size_t{index} * sizeof(Record);
+}
+
+// "spool-<seq>.seg" -> seq, or std::nullopt for any other file name.
+std::optional<std::uint64_t> segmentSeq(const std::string &fileName) {
+  constexpr std::string_view prefix = "spool-";
+  constexpr std::string_view suffix = ".seg";
+  const std::string_view name{fileName};
+  if (name.size() <= prefix.size() + suffix.size() ||
+      !name.starts_with(prefix) || !name.ends_with(suffix))
+    return std::nullopt;
+
+  const auto digits = name.substr(
+      prefix.size(), name.size() - prefix.size() - suffix.size());
+  std::uint64_t seq = 0;
+  const auto [end, ec] =
+      std::from_chars(digits.data(), digits.data() + digits.size(), seq);
+  if (ec != std::errc{} || end != digits.data() + digits.size())
+    return std::nullopt;
+  return seq;
+}
+
+// Make a segment's creation or removal durable, so a recovered spool never
+// finds a file it had already deleted or misses one it had written to.
+void syncDirectory(const std::filesystem::path &dir) {
+  const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  ::fsync(fd);
+  ::close(fd);
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Factory
+// ---------------------------------------------------------------------------
+
+Spool::Spool(const PostgresSpoolConfig &cfg,
+             std::shared_ptr<spdlog::logger> logger)
+    : cfg_(cfg), logger_(std::move(logger)), dir_(cfg.dir) {
+  // At least two segments, so the open segment filling up never forces out
+  // the one being replayed.
+  maxSegments_ =
+      std::max<std::size_t>(cfg_.maxSizeMb * 1024 * 1024 / segmentBytes, 2);
+
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  if (ec)
+    throw std::runtime_error(std::format(
+        "postgres.spool.dir '{}': {}", dir_.string(), ec.message()));
+
+  recover();
+}
+
+Spool::~Spool() {
+  if (cfg_.fsync != SpoolFsync::Never && !segments_.empty())
+    sync(segments_.back());
+  for (auto &seg : segments_)
+    closeSegment(seg, false);
+}
+
+// ---------------------------------------------------------------------------
+// Append
+// ---------------------------------------------------------------------------
+
+bool Spool::append(std::string_view deviceName,
+                   const InverterTypes::Values &values) {
+  return appendRecord(inverterRecord, deviceName, &values, sizeof values);
+}
+
+bool Spool::append(std::string_view deviceName,
+                   const MeterTypes::Values &values) {
+  return appendRecord(meterRecord, deviceName, &values, sizeof values);
+}
+
+bool Spool::append(std::string_view deviceName, const PowerBucket &bucket) {
+  return appendRecord(powerBucketRecord, deviceName, &bucket, sizeof bucket);
+}
+
+bool Spool::appendRecord(std::uint32_t kind, std::string_view deviceName,
+                         const void *values, std::size_t size) {
+  if (segments_.empty() ||
+      header(segments_.back().map)->written == segmentRecords) {
+    if (!segments_.empty() && cfg_.fsync == SpoolFsync::Segment)
+      sync(segments_.back());
+
+    auto seg = createSegment();
+    if (!seg)
+      return false;
+    segments_.push_back(std::move(*seg));
+
+    // Size cap: make room by dropping the oldest segment, records still to
+    // be replayed included. Records already taken are in the caller's hands.
+    while (segments_.size() > maxSegments_)
+      dropOldest();
+  }
+
+  auto &seg = segments_.back();
+  auto *hdr = header(seg.map);
+
+  Record rec{};
+  rec.kind = kind;
+  deviceName.copy(rec.device, sizeof rec.device - 1);
+  std::memcpy(rec.payload, values, size);
+  std::memcpy(recordAt(seg.map, hdr->written), &rec, sizeof rec);
+
+  // Count the record only once its bytes are in place.
+  ++hdr->written;
+  ++pending_;
+
+  if (cfg_.fsync == SpoolFsync::Always)
+    sync(seg);
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Replay
+// ---------------------------------------------------------------------------
+
+std::optional<Spool::Entry> Spool::front() {
+  for (auto &seg : segments_) {
+    const auto *hdr = header(seg.map);
+    while (seg.taken < hdr->written) {
+      Record rec;
+      std::memcpy(&rec, recordAt(seg.map, seg.taken), sizeof rec);
+
+      Entry entry;
+      entry.deviceName.assign(rec.device,
+                              ::strnlen(rec.device, sizeof rec.device));
+      if (rec.kind == inverterRecord) {
+        InverterTypes::Values v;
+        std::memcpy(&v, rec.payload, sizeof v);
+        entry.values = v;
+        return entry;
+      }
+      if (rec.kind == meterRecord) {
+        MeterTypes::Values v;
+        std::memcpy(&v, rec.payload, sizeof v);
+        entry.values = v;
+        return entry;
+      }
+      if (rec.kind == powerBucketRecord) {
+        PowerBucket b;
+        std::memcpy(&b, rec.payload, sizeof b);
+        entry.values = b;
+        return entry;
+      }
+
+      logger_->warn("Skipping corrupt record {} in spool segment '{}'",
+                    seg.taken, seg.path.string());
+      ++seg.taken;
+      --pending_;
+    }
+  }
+  return std::nullopt;
+}
+
+void Spool::pop() {
+  for (auto &seg : segments_) {
+    if (seg.taken < header(seg.map)->written) {
+      ++seg.taken;
+      --pending_;
+      return;
+    }
+  }
+}
+
+void Spool::commit() {
+  for (auto &seg : segments_) {
+    auto *hdr = header(seg.map);
+    if (hdr->consumed == seg.taken)
+      continue;
+    hdr->consumed = seg.taken;
+    if (cfg_.fsync == SpoolFsync::Always)
+      sync(seg);
+  }
+
+  // Replay is FIFO, so the segments with nothing left are at the front. The
+  // open segment goes too once drained; the next spill starts a fresh one.
+  bool removed = false;
+  while (!segments_.empty()) {
+    auto &oldest = segments_.front();
+    const auto *hdr = header(oldest.map);
+    if (hdr->consumed < hdr->written)
+      break;
+    closeSegment(oldest, true);
+    segments_.pop_front();
+    removed = true;
+  }
+  if (removed && cfg_.fsync != SpoolFsync::Never)
+    syncDirectory(dir_);
+}
+
+// ---------------------------------------------------------------------------
+// Segment files
+// ---------------------------------------------------------------------------
+
+std::optional<Spool::Segment> Spool::createSegment() {
+  Segment seg;
+  seg.seq = nextSeq_++;
+  seg.path = dir_ / std::format("spool-{:08}.seg", seg.seq);
+
+  const int fd =
+      ::open(seg.path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    const int err = errno;
+    logger_->warn("Could not create spool segment '{}': {}", seg.path.string(),
+                  std::strerror(err));
+    return std::nullopt;
+  }
+
+  void *map = MAP_FAILED;
+  if (::ftruncate(fd, static_cast<off_t>(segmentBytes)) == 0)
+    map = ::mmap(nullptr, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                 0);
+  const int err = errno;
+  ::close(fd);
+
+  if (map == MAP_FAILED) {
+    logger_->warn("Could not map spool segment '{}': {}", seg.path.string(),
+                  std::strerror(err));
+    std::error_code ec;
+    std::filesystem::remove(seg.path, ec);
+    return std::nullopt;
+  }
+
+  seg.map = static_cast<std::byte *>(map);
+  auto *hdr = header(seg.map);
+  std::memcpy(hdr->magic, segmentMagic, sizeof segmentMagic);
+  hdr->version = segmentVersion;
+  hdr->recordSize = sizeof(Record);
+  hdr->capacity = segmentRecords;
+  hdr->written = 0;
+  hdr->consumed = 0;
+
+  if (cfg_.fsync != SpoolFsync::Never) {
+    sync(seg);
+    syncDirectory(dir_);
+  }
+
+  logger_->debug("Opened spool segment '{}'", seg.path.string());
+  return seg;
+}
+
+std::optional<Spool::Segment>
+Spool::openSegment(std::uint64_t seq, const std::filesystem::path &path) {
+  auto discard = [&](std::string_view why) -> std::optional<Segment> {
+    logger_->warn("Discarding spool segment '{}': {}", path.string(), why);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return std::nullopt;
+  };
+
+  const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0)
+    return discard(std::strerror(errno));
+
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) != segmentBytes) {
+    ::close(fd);
+    return discard("unexpected size");
+  }
+
+  void *map =
+      ::mmap(nullptr, segmentBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int err = errno;
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return discard(std::strerror(err));
+
+  Segment seg;
+  seg.seq = seq;
+  seg.path = path;
+  seg.map = static_cast<std::byte *>(map);
+
+  const auto *hdr = header(seg.map);
+  if (std::memcmp(hdr->magic, segmentMagic, sizeof segmentMagic) != 0 ||
+      hdr->version != segmentVersion || hdr->recordSize != sizeof(Record) ||
+      hdr->capacity != segmentRecords || hdr->written > segmentRecords ||
+      hdr->consumed > hdr->written) {
+    ::munmap(map, segmentBytes);
+    return discard("incompatible layout");
+  }
+
+  seg.taken = hdr->consumed;
+  return seg;
+}
+
+void Spool::recover() {
+  std::vector<std::pair<std::uint64_t, std::filesystem::path>> found;
+
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(dir_, ec)) {
+    if (!entry.is_regular_file())
+      continue;
+    if (auto seq = segmentSeq(entry.path().filename().string()))
+      found.emplace_back(*seq, entry.path());
+  }
+  if (ec)
+    throw std::runtime_error(std::format(
+        "postgres.spool.dir '{}': {}", dir_.string(), ec.message()));
+
+  std::ranges::sort(found);
+
+  for (const auto &[seq, path] : found) {
+    nextSeq_ = std::max(nextSeq_, seq + 1);
+
+    auto seg = openSegment(seq, path);
+    if (!seg)
+      continue;
+
+    const auto *hdr = header(seg->map);
+    if (hdr->consumed == hdr->written) {
+      closeSegment(*seg, true);
+      continue;
+    }
+    pending_ += hdr->written - hdr->consumed;
+    segments_.push_back(std::move(*seg));
+  }
+
+  // The cap may have been lowered since the segments were written.
+  while (segments_.size() > maxSegments_)
+    dropOldest();
+
+  if (pending_ > 0)
+    logger_->info("Recovered {} spooled events in {} segments from '{}'",
+                  pending_, segments_.size(), dir_.string());
+}
+
+void Spool::dropOldest() {
+  auto &oldest = segments_.front();
+  const std::uint32_t lost = header(oldest.map)->written - oldest.taken;
+  pending_ -= lost;
+  logger_->warn("Postgres spool over its {} MiB cap: dropped {} oldest "
+                "spooled events",
+                cfg_.maxSizeMb, lost);
+  closeSegment(oldest, true);
+  segments_.pop_front();
+}
+
+void Spool::sync(const Segment &seg) {
+  if (::msync(seg.map, segmentBytes, MS_SYNC) != 0) {
+    const int err = errno;
+    logger_->warn("Could not flush spool segment '{}': {}", seg.path.string(),
+                  std::strerror(err));
+  }
+}
+
+void Spool::closeSegment(Segment &seg, bool remove) {
+  if (seg.map) {
+    ::munmap(seg.map, segmentBytes);
+    seg.map = nullptr;
+  }
+  if (remove) {
+    std::error_code ec;
+    std::filesystem::remove(seg.path, ec);
+  }
+}
@@ -0,0 +1,46 @@
+#include "sun.h"
+#include <chrono>
+#include <cmath>
+#include <numbers>
+
+namespace {
+
+constexpr double degToRad = std::numbers::pi / 180.0;
+
+// J2000.0 (2000-01-01 12:00 TT, taken as UTC) as a Unix time.
+constexpr double j2000Unix = 946728000.0;
+
+} // namespace
+
+namespace Sun {
+
+double altitude(double latitude, double longitude,
+                std::chrono::system_clock::time_point t) {
+  const double unix =
+      std::chrono::duration<double>(t.time_since_epoch()).count();
+  const double d = (unix - j2000Unix) / 86400.0; // days since J2000.0
+
+  // Mean anomaly, mean longitude and ecliptic longitude of the sun.
+  const double g = (357.529 + 0.98560028 * d) * degToRad;
+  const double q = 280.459 + 0.98564736 * d;
+  const double l =
+      (q + 1.915 * std::sin(g) + 0.020 * std::sin(2.0 * g)) * degToRad;
+  const double e = (23.439 - 0.00000036 * d) * degToRad; // obliquity
+
+  const double rightAscension =
+      std::atan2(std::cos(e) * std::sin(l), std::cos(l));
+  const double declination = std::asin(std::sin(e) * std::sin(l));
+
+  // Greenwich mean sidereal time in degrees, then the local hour angle.
+  const double gmst = std::fmod(280.46061837 + 360.98564736629 * d, 360.0);
+  const double hourAngle = gmst * degToRad + longitude * degToRad -
+                           rightAscension;
+
+  const double lat = latitude * degToRad;
+  return std::asin(std::sin(lat) * std::sin(declination) +
+                   std::cos(lat) * std::cos(declination) *
+                       std::cos(hourAngle)) /
+         degToRad;
+}
+
+} // namespace Sun